@@ -23,6 +23,17 @@
 //
 typedef int PageNum;
 
+//
+// LSN: log sequence number of a write-ahead log record.  LSNs grow
+// monotonically and 0 means "not logged".  The PF layer itself does not
+// log, but enforces write-ahead logging for its clients: a page marked
+// dirty with an LSN is only written after the client's log flush
+// function (see PF_FileHandle::SetLogFlusher) has made the log durable
+// up to that LSN.
+//
+typedef long long LSN;
+typedef RC (*PF_LogFlushFn)(void *ctx, LSN lsn);
+
 // Page Size
 //
 // Each page stores some header information.  The PF_PageHdr is defined
@@ -32,6 +43,36 @@ typedef int PageNum;
 //
 const int PF_PAGE_SIZE = 4096 - sizeof(int);
 
+//
+// PF_FrameInfo: snapshot of one occupied frame of the buffer pool, as
+// returned by PF_Manager::GetBufferInfo.  lastAccess is the value of the
+// buffer manager's access clock (incremented on every page request) when
+// the page was last requested, so larger means more recent.
+//
+const int PF_FILENAME_LEN = 256;
+
+struct PF_FrameInfo {
+   int     slot;                                  // buffer slot
+   int     fd;                                    // OS file descriptor
+   char    fileName[PF_FILENAME_LEN];             // "" for memory blocks
+   PageNum pageNum;                               // page number
+   int     pinCount;                              // pin count
+   int     bDirty;                                // TRUE if page is dirty
+   int     accessCount;                           // requests since loaded
+   long    lastAccess;                            // access clock at last use
+};
+
+//
+// PF_DirtyPage: a dirty page of a file, as returned by
+// PF_FileHandle::GetDirtyPages.  recLSN is the LSN of the first logged
+// change since the page was last written, 0 if no logged change made it
+// dirty.
+//
+struct PF_DirtyPage {
+   PageNum pageNum;                               // page number
+   LSN     recLSN;                                // oldest unwritten change
+};
+
 //
 // PF_PageHandle: PF page interface
 //
@@ -91,8 +132,11 @@ public:
    RC GetPrevPage (PageNum current, PF_PageHandle &pageHandle) const;
 
    RC AllocatePage(PF_PageHandle &pageHandle);    // Allocate a new page
+   // Allocate a given page, see pf_filehandle.cc; for log replay
+   RC AllocateThisPage(PageNum pageNum, PF_PageHandle &pageHandle);
    RC DisposePage (PageNum pageNum);              // Dispose of a page
    RC MarkDirty   (PageNum pageNum) const;        // Mark page as dirty
+   RC MarkDirty   (PageNum pageNum, LSN lsn) const; // ... by log record lsn
    RC UnpinPage   (PageNum pageNum) const;        // Unpin the page
 
    // Flush pages from buffer pool.  Will write dirty pages to disk.
@@ -101,12 +145,37 @@ public:
    // Force a page or pages to disk (but do not remove from the buffer pool)
    RC ForcePages  (PageNum pageNum=ALL_PAGES) const;
 
+   // Make everything written to the file so far durable (fsync)
+   RC Sync        () const;
+
+   // Read or write the contents (PF_PAGE_SIZE bytes) of a used page
+   // directly, bypassing the buffer pool.  Meant for recovery: the page
+   // must not be in the buffer, and different pages may be accessed by
+   // different threads at the same time.
+   RC ReadPageImage (PageNum pageNum, char *pData) const;
+   RC WritePageImage(PageNum pageNum, const char *pData) const;
+
+   // Support for fuzzy checkpoints.  GetDirtyPages returns the dirty
+   // pages of the file in the buffer pool (new[]-allocated, the caller
+   // deletes it).  TricklePages queues pages to be written back one at a
+   // time while other pages are requested, instead of all at once.
+   RC GetDirtyPages(PF_DirtyPage *&pages, int &numPages) const;
+   RC TricklePages (const PageNum *pages, int numPages) const;
+
+   // Install the function that flushes the file's write-ahead log, NULL
+   // to remove it.  It is called before writing a page marked dirty with
+   // an LSN.
+   RC SetLogFlusher(PF_LogFlushFn flushLog, void *ctx) const;
+
 private:
 
    // IsValidPageNum will return TRUE if page number is valid and FALSE
    // otherwise
    int IsValidPageNum (PageNum pageNum) const;
 
+   // Chain the pages not in use into a new free list
+   RC RebuildFreeList ();
+
    PF_BufferMgr *pBufferMgr;                      // pointer to buffer manager
    PF_FileHdr hdr;                                // file header
    int bFileOpen;                                 // file open flag
@@ -135,6 +204,23 @@ public:
    RC PrintBuffer   ();
    RC ResizeBuffer  (int iNewSize);
 
+   // Buffer introspection.  GetBufferInfo returns one PF_FrameInfo per
+   // occupied frame, from most to least recently used; the caller must
+   // delete [] the array.  PrintHeatMap displays the resident pages of
+   // each open file together with how often they were requested.
+   RC GetBufferInfo (PF_FrameInfo *&frames, int &numFrames) const;
+   RC PrintHeatMap  ();
+
+   // Save the (file, page) pairs resident in the buffer to hotSetFile,
+   // or load such a list back.  Loaded pages are prefetched, in sorted
+   // batches, once their file is open; warming never evicts a resident
+   // page.  SetHotSetFile keeps the hot set saved in hotSetFile: when a
+   // file is closed and when the PF_Manager is destroyed.  To save it
+   // more often, call SaveHotSet; page requests never do.
+   RC SaveHotSet    (const char *hotSetFile) const;
+   RC LoadHotSet    (const char *hotSetFile);
+   RC SetHotSetFile (const char *hotSetFile);
+
    // Three Methods for manipulating raw memory buffers.  These memory
    // locations are handled by the buffer manager, but are not
    // associated with a particular file.  These should be used if you
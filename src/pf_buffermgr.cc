@@ -17,7 +17,10 @@
 
 #include <cstdio>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/uio.h>
 #include <iostream>
+#include <algorithm>
 #include "pf_buffermgr.h"
 
 using namespace std;
@@ -131,6 +134,7 @@ PF_BufferMgr::PF_BufferMgr(int _numPages) : hashTable(PF_HASH_TBL_SIZE)
    bufTable[0].prev = bufTable[numPages - 1].next = INVALID_SLOT;
    free = 0;
    first = last = INVALID_SLOT;
+   accessClock = 0;
 
 #ifdef PF_LOG
    WriteLog("Succesfully created the buffer manager.\n");
@@ -192,6 +196,17 @@ RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,
    pStatisticsMgr->Register(PF_GETPAGE, STAT_ADDONE);
 #endif
 
+   // Read ahead some of the hot set while warming up.  A failed prefetch
+   // only means the page will be read on demand, so ignore errors.
+   if (!prefetchQueue.empty())
+      PrefetchStep();
+
+   // Clean one page for a pending checkpoint.  As with prefetching, a
+   // failure here is not the caller's: the page stays dirty and will be
+   // written when it is replaced or flushed.
+   if (!trickleQueue.empty())
+      TrickleStep();
+
    // Search for page in buffer
    if ((rc = hashTable.Find(fd, pageNum, slot)) &&
          (rc != PF_HASHNOTFOUND))
@@ -248,6 +263,8 @@ RC PF_BufferMgr::GetPage(int fd, PageNum pageNum, char **ppBuffer,
          return (rc);
    }
 
+   RecordAccess(slot);
+
    // Point ppBuffer to page
    *ppBuffer = bufTable[slot].pData;
 
@@ -300,6 +317,8 @@ RC PF_BufferMgr::AllocatePage(int fd, PageNum pageNum, char **ppBuffer)
    WriteLog("Succesfully allocated page.\n");
 #endif
 
+   RecordAccess(slot);
+
    // Point ppBuffer to page
    *ppBuffer = bufTable[slot].pData;
 
@@ -314,9 +333,12 @@ RC PF_BufferMgr::AllocatePage(int fd, PageNum pageNum, char **ppBuffer)
 //       it will be written back to the file.
 // In:   fd - OS file descriptor of the file associated with the page
 //       pageNum - number of the page to mark dirty
+//       lsn - LSN of the log record describing the change, 0 if the
+//             change was not logged.  The log is forced up to the
+//             page's largest LSN before the page is written.
 // Ret:  PF return code
 //
-RC PF_BufferMgr::MarkDirty(int fd, PageNum pageNum)
+RC PF_BufferMgr::MarkDirty(int fd, PageNum pageNum, LSN lsn)
 {
    RC  rc;       // return code
    int slot;     // buffer slot where page is located
@@ -340,6 +362,10 @@ RC PF_BufferMgr::MarkDirty(int fd, PageNum pageNum)
 
    // Mark this page dirty
    bufTable[slot].bDirty = TRUE;
+   if (lsn > bufTable[slot].pageLSN)
+      bufTable[slot].pageLSN = lsn;
+   if (lsn > 0 && bufTable[slot].recLSN == 0)
+      bufTable[slot].recLSN = lsn;
 
    // Make this page the most recently used page
    if ((rc = Unlink(slot)) ||
@@ -440,9 +466,12 @@ RC PF_BufferMgr::FlushPages(int fd)
  sprintf (psMessage, "Page (%d) is dirty\n",bufTable[slot].pageNum);
  WriteLog(psMessage);
 #endif
-               if ((rc = WritePage(fd, bufTable[slot].pageNum, bufTable[slot].pData)))
+               if ((rc = ForceLog(slot)) ||
+                     (rc = WritePage(fd, bufTable[slot].pageNum, bufTable[slot].pData)))
                   return (rc);
                bufTable[slot].bDirty = FALSE;
+               bufTable[slot].pageLSN = 0;
+               bufTable[slot].recLSN = 0;
             }
 
             // Remove page from the hash table and add the slot to the free list
@@ -504,9 +533,12 @@ RC PF_BufferMgr::ForcePages(int fd, PageNum pageNum)
 sprintf (psMessage, "Page (%d) is dirty\n",bufTable[slot].pageNum);
 WriteLog(psMessage);
 #endif
-            if ((rc = WritePage(fd, bufTable[slot].pageNum, bufTable[slot].pData)))
+            if ((rc = ForceLog(slot)) ||
+                  (rc = WritePage(fd, bufTable[slot].pageNum, bufTable[slot].pData)))
                return (rc);
             bufTable[slot].bDirty = FALSE;
+            bufTable[slot].pageLSN = 0;
+            bufTable[slot].recLSN = 0;
          }
       }
       slot = next;
@@ -795,11 +827,14 @@ RC PF_BufferMgr::InternalAlloc(int &slot)
 
       // Write out the page if it is dirty
       if (bufTable[slot].bDirty) {
-         if ((rc = WritePage(bufTable[slot].fd, bufTable[slot].pageNum,
+         if ((rc = ForceLog(slot)) ||
+               (rc = WritePage(bufTable[slot].fd, bufTable[slot].pageNum,
                bufTable[slot].pData)))
             return (rc);
 
          bufTable[slot].bDirty = FALSE;
+         bufTable[slot].pageLSN = 0;
+         bufTable[slot].recLSN = 0;
       }
 
       // Remove page from the hash table and slot from the used buffer list
@@ -909,11 +944,73 @@ RC PF_BufferMgr::InitPageDesc(int fd, PageNum pageNum, int slot)
    bufTable[slot].pageNum  = pageNum;
    bufTable[slot].bDirty   = FALSE;
    bufTable[slot].pinCount = 1;
+   bufTable[slot].accessCount = 0;
+   bufTable[slot].lastAccess  = 0;
+   bufTable[slot].pageLSN  = 0;
+   bufTable[slot].recLSN   = 0;
 
    // Return ok
    return (0);
 }
 
+//
+// ForceLog
+//
+// Desc: Internal.  Write-ahead logging: before the page in slot is
+//       written, have the file's log flushed up to the LSN of the last
+//       logged change to the page.  Pages that were never changed under
+//       a log, and files without a log, need nothing.
+// In:   slot - slot of the page about to be written
+// Ret:  PF return code, or the error of the log flush function
+//
+RC PF_BufferMgr::ForceLog(int slot)
+{
+   if (bufTable[slot].pageLSN == 0)
+      return (0);
+
+   std::map<int, PF_LogHook>::iterator it = logHooks.find(bufTable[slot].fd);
+   if (it == logHooks.end())
+      return (0);
+
+   return (it->second.flushLog(it->second.ctx, bufTable[slot].pageLSN));
+}
+
+//
+// SetLogFlusher
+//
+// Desc: Install the function that makes the log of the file open on fd
+//       durable up to a given LSN.  See ForceLog.
+// In:   fd - OS file descriptor
+//       flushLog - flush function, NULL to remove it
+//       ctx - passed back to flushLog
+// Ret:  PF return code
+//
+RC PF_BufferMgr::SetLogFlusher(int fd, PF_LogFlushFn flushLog, void *ctx)
+{
+   if (flushLog == NULL) {
+      logHooks.erase(fd);
+   } else {
+      PF_LogHook hook;
+      hook.flushLog = flushLog;
+      hook.ctx = ctx;
+      logHooks[fd] = hook;
+   }
+   return (0);
+}
+
+//
+// RecordAccess
+//
+// Desc: Internal.  Count a request for the page in slot and stamp it with
+//       the access clock.  Used by the buffer introspection methods.
+// In:   slot - slot of the requested page
+//
+void PF_BufferMgr::RecordAccess(int slot)
+{
+   bufTable[slot].accessCount++;
+   bufTable[slot].lastAccess = ++accessClock;
+}
+
 //------------------------------------------------------------------------------
 // Methods for manipulating raw memory buffers
 //------------------------------------------------------------------------------
@@ -978,3 +1075,543 @@ RC PF_BufferMgr::DisposeBlock(char* buffer)
 {
    return UnpinPage(MEMORY_FD, PageNum(buffer));
 }
+
+//------------------------------------------------------------------------------
+// Methods for buffer introspection
+//------------------------------------------------------------------------------
+
+//
+// Number of characters of the widest bar in the heat map
+//
+#define HEAT_BAR_WIDTH 20
+
+//
+// FrameLess
+//
+// Orders frame snapshots by file and then by page number
+//
+static bool FrameLess(const PF_FrameInfo &a, const PF_FrameInfo &b)
+{
+   if (a.fd != b.fd)
+      return a.fd < b.fd;
+   return a.pageNum < b.pageNum;
+}
+
+static bool HotPageLess(const PF_HotPage &a, const PF_HotPage &b)
+{
+   return a.pageNum < b.pageNum;
+}
+
+//
+// RegisterFile
+//
+// Desc: Remember the name of the file open on fd so that frames can be
+//       reported by file name.  Pages of the file waiting in a loaded hot
+//       set are read into the buffer now.
+// In:   fd - OS file descriptor
+//       fileName - name the file was opened with
+// Ret:  PF return code
+//
+RC PF_BufferMgr::RegisterFile(int fd, const char *fileName)
+{
+   fileNames[fd] = fileName;
+   closedHot.erase(fileName);
+   return WarmFile(fd);
+}
+
+//
+// SnapshotFile
+//
+// Desc: Remember the pages of the file open on fd that are resident in
+//       the buffer, so that the hot set still contains them after the
+//       file is closed (closing flushes them from the buffer).
+// In:   fd - OS file descriptor
+// Ret:  PF return code
+//
+RC PF_BufferMgr::SnapshotFile(int fd)
+{
+   std::map<int, std::string>::iterator name = fileNames.find(fd);
+   if (name == fileNames.end())
+      return (0);
+
+   std::vector<PF_HotPage> &pages = closedHot[name->second];
+   pages.clear();
+   for (int slot = first; slot != INVALID_SLOT; slot = bufTable[slot].next)
+      if (bufTable[slot].fd == fd) {
+         PF_HotPage hot;
+         hot.pageNum = bufTable[slot].pageNum;
+         hot.accessCount = bufTable[slot].accessCount;
+         pages.push_back(hot);
+      }
+   std::sort(pages.begin(), pages.end(), HotPageLess);
+
+   return (0);
+}
+
+//
+// UnregisterFile
+//
+// Desc: Forget the file open on fd, including any of its hot pages that
+//       are still waiting to be prefetched.  Called when the file is
+//       closed.
+// In:   fd - OS file descriptor
+// Ret:  PF return code
+//
+RC PF_BufferMgr::UnregisterFile(int fd)
+{
+   fileNames.erase(fd);
+   logHooks.erase(fd);
+
+   std::deque<PF_Prefetch>::iterator it = prefetchQueue.begin();
+   while (it != prefetchQueue.end())
+      if (it->fd == fd)
+         it = prefetchQueue.erase(it);
+      else
+         ++it;
+
+   std::deque<std::pair<int, PageNum> >::iterator tt = trickleQueue.begin();
+   while (tt != trickleQueue.end())
+      if (tt->first == fd)
+         tt = trickleQueue.erase(tt);
+      else
+         ++tt;
+
+   return (0);
+}
+
+//
+// GetFrameInfo
+//
+// Desc: Take a snapshot of every occupied buffer frame.
+// Out:  frames - new[]-allocated array, most recently used frame first.
+//                The caller is responsible for deleting it.
+//       numFrames - number of entries in frames
+// Ret:  PF_NOMEM or 0
+//
+RC PF_BufferMgr::GetFrameInfo(PF_FrameInfo *&frames, int &numFrames) const
+{
+   int slot;
+
+   numFrames = 0;
+   for (slot = first; slot != INVALID_SLOT; slot = bufTable[slot].next)
+      numFrames++;
+
+   if ((frames = new PF_FrameInfo[numFrames > 0 ? numFrames : 1]) == NULL)
+      return (PF_NOMEM);
+
+   int i = 0;
+   for (slot = first; slot != INVALID_SLOT; slot = bufTable[slot].next, i++) {
+      PF_FrameInfo &info = frames[i];
+      std::map<int, std::string>::const_iterator it =
+         fileNames.find(bufTable[slot].fd);
+
+      info.slot        = slot;
+      info.fd          = bufTable[slot].fd;
+      info.fileName[0] = '\0';
+      if (it != fileNames.end()) {
+         strncpy(info.fileName, it->second.c_str(), PF_FILENAME_LEN - 1);
+         info.fileName[PF_FILENAME_LEN - 1] = '\0';
+      }
+      info.pageNum     = bufTable[slot].pageNum;
+      info.pinCount    = bufTable[slot].pinCount;
+      info.bDirty      = bufTable[slot].bDirty;
+      info.accessCount = bufTable[slot].accessCount;
+      info.lastAccess  = bufTable[slot].lastAccess;
+   }
+
+   return (0);
+}
+
+//
+// PrintHeatMap
+//
+// Desc: Display the resident pages of every file, in page order, with a
+//       bar proportional to the number of requests each page received.
+//       Memory blocks (see AllocateBlock) are not shown.
+// Ret:  PF return code
+//
+RC PF_BufferMgr::PrintHeatMap()
+{
+   RC rc;
+   PF_FrameInfo *frames;
+   int numFrames, i, j;
+
+   if ((rc = GetFrameInfo(frames, numFrames)))
+      return (rc);
+
+   std::sort(frames, frames + numFrames, FrameLess);
+
+   int maxAccess = 1;
+   for (i = 0; i < numFrames; i++)
+      if (frames[i].accessCount > maxAccess)
+         maxAccess = frames[i].accessCount;
+
+   cout << "Buffer heat map: " << numFrames << " of " << numPages
+      << " frames in use, access clock " << accessClock << ".\n";
+
+   for (i = 0; i < numFrames; i = j) {
+      // Find the frames of this file and sum them up
+      int pinned = 0, dirty = 0, requests = 0;
+      for (j = i; j < numFrames && frames[j].fd == frames[i].fd; j++) {
+         pinned += (frames[j].pinCount > 0);
+         dirty += (frames[j].bDirty != FALSE);
+         requests += frames[j].accessCount;
+      }
+      if (frames[i].fd == MEMORY_FD)
+         continue;
+
+      cout << (frames[i].fileName[0] ? frames[i].fileName : "?")
+         << " (fd " << frames[i].fd << "): " << j - i << " pages, "
+         << pinned << " pinned, " << dirty << " dirty, "
+         << requests << " requests\n";
+
+      for (int k = i; k < j; k++) {
+         char bar[HEAT_BAR_WIDTH + 1];
+         int width = (frames[k].accessCount * HEAT_BAR_WIDTH + maxAccess - 1)
+            / maxAccess;
+         memset(bar, ' ', HEAT_BAR_WIDTH);
+         memset(bar, '#', width);
+         bar[HEAT_BAR_WIDTH] = '\0';
+
+         char line[100];
+         sprintf(line, "  page %6d |%s| %8d  last %ld %s%s\n",
+               frames[k].pageNum, bar, frames[k].accessCount,
+               frames[k].lastAccess,
+               frames[k].pinCount ? "P" : "",
+               frames[k].bDirty ? "D" : "");
+         cout << line;
+      }
+   }
+
+   delete [] frames;
+   return (0);
+}
+
+//
+// SaveHotSet
+//
+// Desc: Write the (file, page) pairs resident in the buffer to a text
+//       file, one "pageNum accessCount fileName" line per page, so that a
+//       later LoadHotSet can warm the buffer with them.  The pages that
+//       files closed in the meantime had resident are included as well.
+//       The list goes to hotSetFile.tmp first and is renamed over
+//       hotSetFile, so that a crash while saving leaves the last list.
+// In:   hotSetFile - name of the file to write
+// Ret:  PF_UNIX or other PF return code
+//
+RC PF_BufferMgr::SaveHotSet(const char *hotSetFile) const
+{
+   RC rc;
+   PF_FrameInfo *frames;
+   int numFrames;
+
+   if ((rc = GetFrameInfo(frames, numFrames)))
+      return (rc);
+
+   std::sort(frames, frames + numFrames, FrameLess);
+
+   std::string tmp = std::string(hotSetFile) + ".tmp";
+   FILE *fp = fopen(tmp.c_str(), "w");
+   if (fp == NULL) {
+      delete [] frames;
+      return (PF_UNIX);
+   }
+
+   for (int i = 0; i < numFrames; i++)
+      if (frames[i].fd != MEMORY_FD && frames[i].fileName[0])
+         fprintf(fp, "%d %d %s\n", frames[i].pageNum,
+               frames[i].accessCount, frames[i].fileName);
+
+   // Pages of files that were closed since they were last resident
+   std::map<std::string, std::vector<PF_HotPage> >::const_iterator it;
+   for (it = closedHot.begin(); it != closedHot.end(); ++it)
+      for (size_t i = 0; i < it->second.size(); i++)
+         fprintf(fp, "%d %d %s\n", it->second[i].pageNum,
+               it->second[i].accessCount, it->first.c_str());
+
+   delete [] frames;
+   if (fclose(fp) || rename(tmp.c_str(), hotSetFile) < 0) {
+      unlink(tmp.c_str());
+      return (PF_UNIX);
+   }
+   return (0);
+}
+
+//
+// LoadHotSet
+//
+// Desc: Read a file written by SaveHotSet.  Pages of files that are
+//       open are queued for prefetching right away, pages of other files
+//       are remembered until their file is opened (see WarmFile).
+// In:   hotSetFile - name of the file to read
+// Ret:  PF_UNIX or other PF return code
+//
+RC PF_BufferMgr::LoadHotSet(const char *hotSetFile)
+{
+   RC rc;
+   FILE *fp = fopen(hotSetFile, "r");
+   if (fp == NULL)
+      return (PF_UNIX);
+
+   char line[PF_FILENAME_LEN + 32];
+   char fileName[PF_FILENAME_LEN];
+   PF_HotPage hot;
+   while (fgets(line, sizeof(line), fp) != NULL) {
+      if (sscanf(line, "%d %d %255[^\n]", &hot.pageNum, &hot.accessCount,
+               fileName) != 3 || hot.pageNum < 0)
+         continue;
+      hotPages[fileName].push_back(hot);
+   }
+   fclose(fp);
+
+   for (std::map<int, std::string>::iterator it = fileNames.begin();
+         it != fileNames.end(); ++it)
+      if ((rc = WarmFile(it->first)))
+         return (rc);
+
+   return (0);
+}
+
+//
+// SetHotSetFile
+//
+// Desc: Keep the hot set persisted in hotSetFile: it is written when a
+//       file is closed and when the PF_Manager is destroyed, never while
+//       a page is requested.
+// In:   hotSetFile - name of the file, NULL or "" to stop persisting
+// Ret:  PF return code
+//
+RC PF_BufferMgr::SetHotSetFile(const char *_hotSetFile)
+{
+   hotSetFile = _hotSetFile ? _hotSetFile : "";
+   return (0);
+}
+
+//
+// SaveHotSet
+//
+// Desc: Write the hot set to the file configured with SetHotSetFile
+// Ret:  PF return code, 0 if no file is configured
+//
+RC PF_BufferMgr::SaveHotSet() const
+{
+   if (hotSetFile.empty())
+      return (0);
+   return SaveHotSet(hotSetFile.c_str());
+}
+
+//
+// WarmFile
+//
+// Desc: Internal.  Queue the hot pages pending for the file open on fd
+//       for prefetching.  The pages are sorted and, where they form
+//       contiguous runs, the OS is asked to start reading the runs in
+//       the background.  The queue is drained a batch at a time by
+//       PrefetchStep, piggybacked on GetPage, so opening the file does
+//       not wait for the reads.  The window is bounded by the number of
+//       free slots: warming never evicts a resident page.
+// In:   fd - OS file descriptor of a registered file
+// Ret:  PF return code
+//
+RC PF_BufferMgr::WarmFile(int fd)
+{
+   std::map<int, std::string>::iterator name = fileNames.find(fd);
+   if (name == fileNames.end())
+      return (0);
+   std::map<std::string, std::vector<PF_HotPage> >::iterator pending =
+      hotPages.find(name->second);
+   if (pending == hotPages.end())
+      return (0);
+
+   std::vector<PF_HotPage> &pages = pending->second;
+   std::sort(pages.begin(), pages.end(), HotPageLess);
+
+   // Slots that are free now, less those promised to other files
+   int window = -(int)prefetchQueue.size();
+   for (int slot = free; slot != INVALID_SLOT; slot = bufTable[slot].next)
+      window++;
+
+   std::deque<PF_Prefetch> queue;
+   for (size_t i = 0; i < pages.size() && (int)queue.size() < window; i++) {
+      int slot;
+      if ((i > 0 && pages[i].pageNum == pages[i - 1].pageNum) ||
+            !hashTable.Find(fd, pages[i].pageNum, slot))
+         continue;
+
+      PF_Prefetch p;
+      p.fd = fd;
+      p.pageNum = pages[i].pageNum;
+      p.accessCount = pages[i].accessCount;
+      queue.push_back(p);
+   }
+   hotPages.erase(pending);
+
+#ifdef POSIX_FADV_WILLNEED
+   // Start the disk reads now, one request per contiguous run
+   for (size_t i = 0, j; i < queue.size(); i = j) {
+      for (j = i + 1; j < queue.size() &&
+            queue[j].pageNum == queue[j - 1].pageNum + 1; j++)
+         ;
+      posix_fadvise(fd, queue[i].pageNum * (long)pageSize + PF_FILE_HDR_SIZE,
+            (j - i) * (long)pageSize, POSIX_FADV_WILLNEED);
+   }
+#endif
+
+   prefetchQueue.insert(prefetchQueue.end(), queue.begin(), queue.end());
+   return (0);
+}
+
+//
+// PrefetchStep
+//
+// Desc: Internal.  Read the next run of contiguous queued hot pages (at
+//       most PF_PREFETCH_BATCH of them) into free slots with a single
+//       read request.  Queued pages that have been requested in the
+//       meantime are skipped.  Once no slot is free the queue is dropped.
+// Ret:  PF return code
+//
+RC PF_BufferMgr::PrefetchStep()
+{
+   RC rc;
+   int slots[PF_PREFETCH_BATCH];
+   struct iovec iov[PF_PREFETCH_BATCH];
+   PF_Prefetch run[PF_PREFETCH_BATCH];
+   int n = 0, slot;
+
+   while (!prefetchQueue.empty() && n < PF_PREFETCH_BATCH) {
+      PF_Prefetch p = prefetchQueue.front();
+      if (n > 0 && (p.fd != run[0].fd || p.pageNum != run[n - 1].pageNum + 1))
+         break;
+      prefetchQueue.pop_front();
+      if (!hashTable.Find(p.fd, p.pageNum, slot)) {
+         // Requested in the meantime, this ends the run
+         if (n > 0)
+            break;
+         continue;
+      }
+      if (free == INVALID_SLOT) {
+         prefetchQueue.clear();
+         break;
+      }
+      slots[n] = free;
+      free = bufTable[free].next;
+      iov[n].iov_base = bufTable[slots[n]].pData;
+      iov[n].iov_len = pageSize;
+      run[n++] = p;
+   }
+   if (n == 0)
+      return (0);
+
+   // Read the whole run at once.  Only pages read completely are kept, a
+   // short read means the file has shrunk since the hot set was saved.
+   long offset = run[0].pageNum * (long)pageSize + PF_FILE_HDR_SIZE;
+   long numBytes = -1;
+   if (lseek(run[0].fd, offset, L_SET) >= 0)
+      numBytes = readv(run[0].fd, iov, n);
+   int numRead = numBytes < 0 ? 0 : numBytes / pageSize;
+
+   for (int i = 0; i < n; i++) {
+      if (i >= numRead) {
+         InsertFree(slots[i]);
+         continue;
+      }
+
+#ifdef PF_STATS
+      pStatisticsMgr->Register(PF_READPAGE, STAT_ADDONE);
+#endif
+
+      if ((rc = LinkHead(slots[i])) ||
+            (rc = hashTable.Insert(run[i].fd, run[i].pageNum, slots[i])) ||
+            (rc = InitPageDesc(run[i].fd, run[i].pageNum, slots[i])))
+         return (rc);
+      bufTable[slots[i]].pinCount = 0;
+      bufTable[slots[i]].accessCount = run[i].accessCount;
+      bufTable[slots[i]].lastAccess = accessClock;
+   }
+
+   return (numBytes < 0 ? PF_UNIX : 0);
+}
+
+//
+// GetDirtyPages
+//
+// Desc: Collect the dirty pages of the file open on fd.
+// In:   fd - OS file descriptor
+// Out:  pages - new[]-allocated array, the caller deletes it
+//       numPages - number of entries in pages
+// Ret:  PF_NOMEM or 0
+//
+RC PF_BufferMgr::GetDirtyPages(int fd, PF_DirtyPage *&pages,
+                               int &numPages) const
+{
+   int slot;
+
+   numPages = 0;
+   for (slot = first; slot != INVALID_SLOT; slot = bufTable[slot].next)
+      if (bufTable[slot].fd == fd && bufTable[slot].bDirty)
+         numPages++;
+
+   if ((pages = new PF_DirtyPage[numPages > 0 ? numPages : 1]) == NULL)
+      return (PF_NOMEM);
+
+   int i = 0;
+   for (slot = first; slot != INVALID_SLOT; slot = bufTable[slot].next)
+      if (bufTable[slot].fd == fd && bufTable[slot].bDirty) {
+         pages[i].pageNum = bufTable[slot].pageNum;
+         pages[i].recLSN  = bufTable[slot].recLSN;
+         i++;
+      }
+
+   return (0);
+}
+
+//
+// TricklePages
+//
+// Desc: Queue pages of the file open on fd for TrickleStep.
+// In:   fd - OS file descriptor
+//       pages - the pages, written in this order
+//       numPages - number of entries in pages
+// Ret:  0
+//
+RC PF_BufferMgr::TricklePages(int fd, const PageNum *pages, int numPages)
+{
+   for (int i = 0; i < numPages; i++)
+      trickleQueue.push_back(std::make_pair(fd, pages[i]));
+   return (0);
+}
+
+//
+// TrickleStep
+//
+// Desc: Internal.  Write back the first queued page that is still in the
+//       buffer, dirty and unpinned, dropping the entries skipped on the
+//       way.  Pinned pages are left alone since their client may be in
+//       the middle of changing them.  At most one page is written, so
+//       that the writes of a checkpoint are spread over many requests.
+// Ret:  PF return code
+//
+RC PF_BufferMgr::TrickleStep()
+{
+   RC  rc;
+   int slot;
+
+   while (!trickleQueue.empty()) {
+      std::pair<int, PageNum> p = trickleQueue.front();
+      trickleQueue.pop_front();
+
+      if (hashTable.Find(p.first, p.second, slot) ||
+            !bufTable[slot].bDirty || bufTable[slot].pinCount > 0)
+         continue;
+
+      if ((rc = ForceLog(slot)) ||
+            (rc = WritePage(p.first, p.second, bufTable[slot].pData)))
+         return (rc);
+      bufTable[slot].bDirty = FALSE;
+      bufTable[slot].pageLSN = 0;
+      bufTable[slot].recLSN = 0;
+      break;
+   }
+
+   return (0);
+}
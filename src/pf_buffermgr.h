@@ -15,6 +15,10 @@
 #ifndef PF_BUFFERMGR_H
 #define PF_BUFFERMGR_H
 
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
 #include "pf_internal.h"
 #include "pf_hashtable.h"
 
@@ -39,8 +43,40 @@ struct PF_BufPageDesc {
     short int  pinCount;    // pin count
     PageNum    pageNum;     // page number for this page
     int        fd;          // OS file descriptor of this page
+    int        accessCount; // number of requests since the page was loaded
+    long       lastAccess;  // access clock at the last request
+    LSN        pageLSN;     // largest LSN the page was dirtied with, or 0
+    LSN        recLSN;      // first LSN the page was dirtied with, or 0
 };
 
+//
+// PF_LogHook - how to force the write-ahead log of a file
+//
+struct PF_LogHook {
+    PF_LogFlushFn flushLog;  // flush the log up to an LSN
+    void       *ctx;        // first argument of flushLog
+};
+
+//
+// PF_HotPage - one entry of a saved hot set
+//
+struct PF_HotPage {
+    PageNum    pageNum;     // page number
+    int        accessCount; // access count when the hot set was saved
+};
+
+//
+// PF_Prefetch - a hot page waiting to be read into the buffer
+//
+struct PF_Prefetch {
+    int        fd;          // OS file descriptor
+    PageNum    pageNum;     // page number
+    int        accessCount; // access count when the hot set was saved
+};
+
+// Maximum number of contiguous pages read by one prefetch request
+const int PF_PREFETCH_BATCH = 16;
+
 //
 // PF_BufferMgr - manage the page buffer
 //
@@ -57,7 +93,8 @@ public:
     // Allocate a new page in the buffer, point *ppBuffer to its location
     RC  AllocatePage (int fd, PageNum pageNum, char **ppBuffer);
 
-    RC  MarkDirty    (int fd, PageNum pageNum);  // Mark page dirty
+    RC  MarkDirty    (int fd, PageNum pageNum,  // Mark page dirty
+                      LSN lsn = 0);
     RC  UnpinPage    (int fd, PageNum pageNum);  // Unpin page from the buffer
     RC  FlushPages   (int fd);                   // Flush pages for file
 
@@ -73,6 +110,28 @@ public:
     // Attempts to resize the buffer to the new size
     RC ResizeBuffer  (int iNewSize);
 
+    // Remember the name of the file open on fd, and forget it again.
+    // SnapshotFile records the file's resident pages for the hot set
+    // before they are flushed on close.
+    RC RegisterFile  (int fd, const char *fileName);
+    RC SnapshotFile  (int fd);
+    RC UnregisterFile(int fd);
+
+    // Install the write-ahead log flush function of the file open on fd
+    RC SetLogFlusher (int fd, PF_LogFlushFn flushLog, void *ctx);
+
+    // Fuzzy checkpoint support, see PF_FileHandle
+    RC GetDirtyPages (int fd, PF_DirtyPage *&pages, int &numPages) const;
+    RC TricklePages  (int fd, const PageNum *pages, int numPages);
+
+    // Buffer introspection, see PF_Manager
+    RC GetFrameInfo  (PF_FrameInfo *&frames, int &numFrames) const;
+    RC PrintHeatMap  ();
+    RC SaveHotSet    (const char *hotSetFile) const;
+    RC LoadHotSet    (const char *hotSetFile);
+    RC SetHotSetFile (const char *hotSetFile);
+    RC SaveHotSet    () const;                   // to the configured file
+
     // Three Methods for manipulating raw memory buffers.  These memory
     // locations are handled by the buffer manager, but are not
     // associated with a particular file.  These should be used if you
@@ -101,6 +160,21 @@ private:
     // Init the page desc entry
     RC  InitPageDesc (int fd, PageNum pageNum, int slot);
 
+    // Flush the log up to the LSN of the page in slot before writing it
+    RC  ForceLog     (int slot);
+
+    // Bump the access statistics of a slot
+    void RecordAccess(int slot);
+
+    // Queue the pending hot pages of the file open on fd for prefetch
+    RC  WarmFile     (int fd);
+
+    // Read the next batch of queued hot pages into free slots
+    RC  PrefetchStep ();
+
+    // Write back the next queued trickle page that still needs it
+    RC  TrickleStep  ();
+
     PF_BufPageDesc *bufTable;                     // info on buffer pages
     PF_HashTable   hashTable;                     // Hash table object
     int            numPages;                      // # of pages in the buffer
@@ -108,6 +182,17 @@ private:
     int            first;                         // MRU page slot
     int            last;                          // LRU page slot
     int            free;                          // head of free list
+    long           accessClock;                   // # of page requests
+    std::map<int, std::string> fileNames;         // open files by fd
+    std::map<int, PF_LogHook> logHooks;           // WAL flush by fd
+    std::map<std::string, std::vector<PF_HotPage> > hotPages;
+                                                  // pages still to warm
+    std::map<std::string, std::vector<PF_HotPage> > closedHot;
+                                                  // hot pages of closed files
+    std::deque<PF_Prefetch> prefetchQueue;        // sorted by fd and page
+    std::deque<std::pair<int, PageNum> > trickleQueue;
+                                                  // (fd, page) to write back
+    std::string    hotSetFile;                    // "" if none configured
 };
 
 #endif
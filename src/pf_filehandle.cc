@@ -242,6 +242,9 @@ RC PF_FileHandle::GetThisPage(PageNum pageNum, PF_PageHandle &pageHandle) const
 // Desc: Allocate a new page in the file (may get a page which was
 //       previously disposed)
 //       The file handle must refer to an open file
+//       A free list whose head is a used page (left by a crash after
+//       the page was written back but before the header was) is built
+//       again from the pages not in use, see RebuildFreeList.
 // Out:  pageHandle - becomes a handle to the newly-allocated page
 //                    this function modifies local var's in pageHandle
 // Ret:  PF return code
@@ -266,6 +269,14 @@ RC PF_FileHandle::AllocatePage(PF_PageHandle &pageHandle)
             &pPageBuf)))
          return (rc);
 
+      // A used page at the head, see above
+      if (((PF_PageHdr*)pPageBuf)->nextFree == PF_PAGE_USED) {
+         if ((rc = UnpinPage(pageNum)) ||
+               (rc = RebuildFreeList()))
+            return (rc);
+         return (AllocatePage(pageHandle));
+      }
+
       // Set the first free page to the next page on the free list
       hdr.firstFree = ((PF_PageHdr*)pPageBuf)->nextFree;
    }
@@ -305,6 +316,106 @@ RC PF_FileHandle::AllocatePage(PF_PageHandle &pageHandle)
    return (0);
 }
 
+//
+// AllocateThisPage
+//
+// Desc: Allocate a given page: the one just past the end of the file, a
+//       page not in use, wherever it is on the free list, or one the file
+//       header counts but that was never written.  Meant for log replay,
+//       which has to allocate pages again where they were before a
+//       crash, when the file header and the pages may have reached the
+//       disk in any order.
+//       The file handle must refer to an open file
+// In:   pageNum - the number of the page to allocate
+// Out:  pageHandle - becomes a handle to the newly-allocated page
+// Ret:  PF_INVALIDPAGE if the page is used or further past the end of the
+//       file, other PF errors
+//
+RC PF_FileHandle::AllocateThisPage(PageNum pageNum, PF_PageHandle &pageHandle)
+{
+   int     rc;               // return code
+   char    *pPageBuf;        // address of page in buffer pool
+   char    *pPrevBuf;        // address of a page before it on the list
+   PageNum prev;             // page before it on the free list
+   PageNum next;             // page after it on the free list
+
+   // File must be open
+   if (!bFileOpen)
+      return (PF_CLOSEDFILE);
+
+   if (pageNum == hdr.numPages) {
+
+      // Allocate a new page in the file
+      if ((rc = pBufferMgr->AllocatePage(unixfd,
+            pageNum,
+            &pPageBuf)))
+         return (rc);
+      hdr.numPages++;
+   }
+   else {
+
+      // Validate page number
+      if (!IsValidPageNum(pageNum))
+         return (PF_INVALIDPAGE);
+
+      // Page must not be in use.  A page never written is on no list.
+      rc = pBufferMgr->GetPage(unixfd, pageNum, &pPageBuf);
+      if (rc == PF_INCOMPLETEREAD) {
+         if ((rc = pBufferMgr->AllocatePage(unixfd, pageNum, &pPageBuf)))
+            return (rc);
+         next = PF_PAGE_LIST_END;
+      }
+      else if (rc)
+         return (rc);
+      else
+         next = ((PF_PageHdr*)pPageBuf)->nextFree;
+      if (next == PF_PAGE_USED) {
+         if ((rc = UnpinPage(pageNum)))
+            return (rc);
+         return (PF_INVALIDPAGE);
+      }
+
+      // Take it off the free list.  A page not found before the list
+      // ends (or reaches a used page) was taken off already.
+      if (hdr.firstFree == pageNum)
+         hdr.firstFree = next;
+      else {
+         prev = hdr.firstFree;
+         for (int i = 0; prev != PF_PAGE_LIST_END && i < hdr.numPages; i++) {
+            if ((rc = pBufferMgr->GetPage(unixfd, prev, &pPrevBuf)))
+               return (rc);
+            PageNum after = ((PF_PageHdr*)pPrevBuf)->nextFree;
+            if (after == pageNum) {
+               ((PF_PageHdr*)pPrevBuf)->nextFree = next;
+               if ((rc = MarkDirty(prev)))
+                  return (rc);
+            }
+            if ((rc = UnpinPage(prev)))
+               return (rc);
+            if (after == pageNum || after == PF_PAGE_USED)
+               break;
+            prev = after;
+         }
+      }
+   }
+
+   // Mark the header as changed
+   bHdrChanged = TRUE;
+
+   // Mark this page as used, zero it out and mark it dirty
+   ((PF_PageHdr *)pPageBuf)->nextFree = PF_PAGE_USED;
+   memset(pPageBuf + sizeof(PF_PageHdr), 0, PF_PAGE_SIZE);
+   if ((rc = MarkDirty(pageNum)))
+      return (rc);
+
+   // Set the pageHandle local variables
+   pageHandle.pageNum = pageNum;
+   pageHandle.pPageData = pPageBuf + sizeof(PF_PageHdr);
+
+   // Return ok
+   return (0);
+}
+
 //
 // DisposePage
 //
@@ -387,6 +498,31 @@ RC PF_FileHandle::MarkDirty(PageNum pageNum) const
    return (pBufferMgr->MarkDirty(unixfd, pageNum));
 }
 
+//
+// MarkDirty
+//
+// Desc: Mark a page as being dirty by a logged change.  Before the page
+//       is written back to disk the log flush function installed with
+//       SetLogFlusher is called with the largest such LSN.
+//       The file handle must refer to an open file
+// In:   pageNum - number of page to mark dirty
+//       lsn - LSN of the log record describing the change
+// Ret:  PF return code
+//
+RC PF_FileHandle::MarkDirty(PageNum pageNum, LSN lsn) const
+{
+   // File must be open
+   if (!bFileOpen)
+      return (PF_CLOSEDFILE);
+
+   // Validate page number
+   if (!IsValidPageNum(pageNum))
+      return (PF_INVALIDPAGE);
+
+   // Tell the buffer manager to mark the page dirty
+   return (pBufferMgr->MarkDirty(unixfd, pageNum, lsn));
+}
+
 //
 // UnpinPage
 //
@@ -495,6 +631,191 @@ RC PF_FileHandle::ForcePages(PageNum pageNum) const
 }
 
 
+//
+// Sync
+//
+// Desc: Make everything written to the file durable.  ForcePages only
+//       hands the pages to the OS; call this afterwards when the data
+//       has to survive a system crash.
+// Ret:  PF_UNIX or PF_CLOSEDFILE
+//
+RC PF_FileHandle::Sync() const
+{
+   // File must be open
+   if (!bFileOpen)
+      return (PF_CLOSEDFILE);
+
+   if (fsync(unixfd) < 0)
+      return (PF_UNIX);
+
+   return (0);
+}
+
+//
+// ReadPageImage
+//
+// Desc: Read the contents of a page straight from the file, without
+//       going through the buffer pool.  Uses pread, so several threads
+//       can read (different) pages concurrently.  The page must not be
+//       in the buffer pool, or the image read may be stale.
+// In:   pageNum - the number of the page to read
+// Out:  pData - receives the PF_PAGE_SIZE bytes of page contents
+// Ret:  PF_INVALIDPAGE if the page is not a used page, other PF errors
+//
+RC PF_FileHandle::ReadPageImage(PageNum pageNum, char *pData) const
+{
+   PF_PageHdr pageHdr;
+
+   // File must be open
+   if (!bFileOpen)
+      return (PF_CLOSEDFILE);
+
+   // Validate page number
+   if (!IsValidPageNum(pageNum))
+      return (PF_INVALIDPAGE);
+
+   long offset = pageNum * (long)(PF_PAGE_SIZE + sizeof(PF_PageHdr))
+      + PF_FILE_HDR_SIZE;
+   int numBytes = pread(unixfd, &pageHdr, sizeof(PF_PageHdr), offset);
+   if (numBytes < 0)
+      return (PF_UNIX);
+   if (numBytes != sizeof(PF_PageHdr))
+      return (PF_INCOMPLETEREAD);
+   if (pageHdr.nextFree != PF_PAGE_USED)
+      return (PF_INVALIDPAGE);
+
+   numBytes = pread(unixfd, pData, PF_PAGE_SIZE, offset + sizeof(PF_PageHdr));
+   if (numBytes < 0)
+      return (PF_UNIX);
+   if (numBytes != PF_PAGE_SIZE)
+      return (PF_INCOMPLETEREAD);
+   return (0);
+}
+
+//
+// WritePageImage
+//
+// Desc: Write the contents of a used page straight to the file, without
+//       going through the buffer pool.  Counterpart of ReadPageImage.
+// In:   pageNum - the number of the page to write
+//       pData - PF_PAGE_SIZE bytes of page contents
+// Ret:  PF return code
+//
+RC PF_FileHandle::WritePageImage(PageNum pageNum, const char *pData) const
+{
+   // File must be open
+   if (!bFileOpen)
+      return (PF_CLOSEDFILE);
+
+   // Validate page number
+   if (!IsValidPageNum(pageNum))
+      return (PF_INVALIDPAGE);
+
+   long offset = pageNum * (long)(PF_PAGE_SIZE + sizeof(PF_PageHdr))
+      + PF_FILE_HDR_SIZE + sizeof(PF_PageHdr);
+   int numBytes = pwrite(unixfd, pData, PF_PAGE_SIZE, offset);
+   if (numBytes < 0)
+      return (PF_UNIX);
+   if (numBytes != PF_PAGE_SIZE)
+      return (PF_INCOMPLETEWRITE);
+   return (0);
+}
+
+//
+// GetDirtyPages
+//
+// Desc: Take the dirty page table of the file: every page of the file
+//       that is dirty in the buffer pool, with the LSN of its oldest
+//       change not yet written
+// Out:  pages - new[]-allocated array, the caller deletes it
+//       numPages - number of entries in pages
+// Ret:  PF return code
+//
+RC PF_FileHandle::GetDirtyPages(PF_DirtyPage *&pages, int &numPages) const
+{
+   // File must be open
+   if (!bFileOpen)
+      return (PF_CLOSEDFILE);
+
+   return (pBufferMgr->GetDirtyPages(unixfd, pages, numPages));
+}
+
+//
+// TricklePages
+//
+// Desc: Have pages of the file written back gradually: one page of the
+//       queue is written on each page request to the buffer manager, if
+//       it is still dirty and not pinned then.  The pages stay in the
+//       buffer pool.
+// In:   pages - the pages to write, in order
+//       numPages - number of entries in pages
+// Ret:  PF return code
+//
+RC PF_FileHandle::TricklePages(const PageNum *pages, int numPages) const
+{
+   // File must be open
+   if (!bFileOpen)
+      return (PF_CLOSEDFILE);
+
+   return (pBufferMgr->TricklePages(unixfd, pages, numPages));
+}
+
+//
+// SetLogFlusher
+//
+// Desc: Install the function that makes the file's write-ahead log
+//       durable up to an LSN.  The buffer manager calls it before
+//       writing back a page marked dirty with an LSN.
+// In:   flushLog - the flush function, NULL to remove it
+//       ctx - first argument passed to flushLog
+// Ret:  PF return code
+//
+RC PF_FileHandle::SetLogFlusher(PF_LogFlushFn flushLog, void *ctx) const
+{
+   // File must be open
+   if (!bFileOpen)
+      return (PF_CLOSEDFILE);
+
+   return (pBufferMgr->SetLogFlusher(unixfd, flushLog, ctx));
+}
+
+//
+// RebuildFreeList
+//
+// Desc: Internal.  Chain every page not in use into a new free list,
+//       lowest page first.  The list is only broken by a crash (see
+//       AllocatePage), so reading every page is rare.  A page the
+//       header counts but that was never written is not in use either.
+// Ret:  PF return code
+//
+RC PF_FileHandle::RebuildFreeList()
+{
+   int     rc;               // return code
+   char    *pPageBuf;        // address of page in buffer pool
+
+   hdr.firstFree = PF_PAGE_LIST_END;
+   bHdrChanged = TRUE;
+   for (PageNum pageNum = hdr.numPages - 1; pageNum >= 0; pageNum--) {
+      rc = pBufferMgr->GetPage(unixfd, pageNum, &pPageBuf);
+      if (rc == PF_INCOMPLETEREAD) {
+         if ((rc = pBufferMgr->AllocatePage(unixfd, pageNum, &pPageBuf)))
+            return (rc);
+         ((PF_PageHdr*)pPageBuf)->nextFree = PF_PAGE_LIST_END;
+      }
+      else if (rc)
+         return (rc);
+      if (((PF_PageHdr*)pPageBuf)->nextFree != PF_PAGE_USED) {
+         ((PF_PageHdr*)pPageBuf)->nextFree = hdr.firstFree;
+         hdr.firstFree = pageNum;
+         if ((rc = MarkDirty(pageNum)))
+            return (rc);
+      }
+      if ((rc = UnpinPage(pageNum)))
+         return (rc);
+   }
+   return (0);
+}
+
 //
 // IsValidPageNum
 //
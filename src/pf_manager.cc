@@ -36,6 +36,9 @@ PF_Manager::PF_Manager()
 //
 PF_Manager::~PF_Manager()
 {
+   // Persist the hot set if SetHotSetFile asked for it
+   pBufferMgr->SaveHotSet();
+
    // Destroy the buffer manager objects
    delete pBufferMgr;
 }
@@ -158,6 +161,13 @@ RC PF_Manager::OpenFile (const char *fileName, PF_FileHandle &fileHandle)
    // Set file header to be not changed
    fileHandle.bHdrChanged = FALSE;
 
+   // Let the buffer manager know the file by name (this also warms the
+   // buffer with the file's pages from a loaded hot set)
+   if ((rc = pBufferMgr->RegisterFile(fileHandle.unixfd, fileName))) {
+      pBufferMgr->UnregisterFile(fileHandle.unixfd);
+      goto err;
+   }
+
    // Set local variables in file handle object to refer to open file
    fileHandle.pBufferMgr = pBufferMgr;
    fileHandle.bFileOpen = TRUE;
@@ -194,11 +204,15 @@ RC PF_Manager::CloseFile(PF_FileHandle &fileHandle)
    if (!fileHandle.bFileOpen)
       return (PF_CLOSEDFILE);
 
+   // Remember the file's resident pages for the hot set
+   pBufferMgr->SnapshotFile(fileHandle.unixfd);
+
    // Flush all buffers for this file and write out the header
    if ((rc = fileHandle.FlushPages()))
       return (rc);
 
    // Close the file
+   pBufferMgr->UnregisterFile(fileHandle.unixfd);
    if (close(fileHandle.unixfd) < 0)
       return (PF_UNIX);
    fileHandle.bFileOpen = FALSE;
@@ -206,6 +220,11 @@ RC PF_Manager::CloseFile(PF_FileHandle &fileHandle)
    // Reset the buffer manager pointer in the file handle
    fileHandle.pBufferMgr = NULL;
 
+   // Persist the hot set if SetHotSetFile asked for it.  It is only a
+   // hint for the next start, so failing to save it does not fail the
+   // close.
+   pBufferMgr->SaveHotSet();
+
    // Return ok
    return 0;
 }
@@ -258,6 +277,73 @@ RC PF_Manager::ResizeBuffer(int iNewSize)
    return pBufferMgr->ResizeBuffer(iNewSize);
 }
 
+//
+// GetBufferInfo
+//
+// Desc: Take a snapshot of the occupied frames of the buffer pool
+// Out:  frames - array of numFrames entries, most recently used first.
+//                The caller must delete [] it.
+//       numFrames - number of entries in frames
+// Ret:  Returns the result of PF_BufferMgr::GetFrameInfo
+//
+RC PF_Manager::GetBufferInfo(PF_FrameInfo *&frames, int &numFrames) const
+{
+   return pBufferMgr->GetFrameInfo(frames, numFrames);
+}
+
+//
+// PrintHeatMap
+//
+// Desc: Display the resident pages of each file and how often they were
+//       requested.  Like PrintBuffer, meant for the system command.
+// Ret:  Returns the result of PF_BufferMgr::PrintHeatMap
+//
+RC PF_Manager::PrintHeatMap()
+{
+   return pBufferMgr->PrintHeatMap();
+}
+
+//
+// SaveHotSet
+//
+// Desc: Write the (file, page) pairs resident in the buffer to a file
+// In:   hotSetFile - name of the file to write
+// Ret:  Returns the result of PF_BufferMgr::SaveHotSet
+//
+RC PF_Manager::SaveHotSet(const char *hotSetFile) const
+{
+   return pBufferMgr->SaveHotSet(hotSetFile);
+}
+
+//
+// LoadHotSet
+//
+// Desc: Warm the buffer with the pages listed in a file written by
+//       SaveHotSet.  Typically called right after start-up, before the
+//       files are opened; each file's pages are then prefetched in page
+//       order as soon as it is opened.
+// In:   hotSetFile - name of the file to read
+// Ret:  Returns the result of PF_BufferMgr::LoadHotSet
+//
+RC PF_Manager::LoadHotSet(const char *hotSetFile)
+{
+   return pBufferMgr->LoadHotSet(hotSetFile);
+}
+
+//
+// SetHotSetFile
+//
+// Desc: Keep the hot set saved in a file, so that it survives a shutdown
+//       and can be handed to LoadHotSet on the next start.  It is saved
+//       when a file is closed and when the PF_Manager is destroyed.
+// In:   hotSetFile - file to save to, NULL to stop saving
+// Ret:  Returns the result of PF_BufferMgr::SetHotSetFile
+//
+RC PF_Manager::SetHotSetFile(const char *hotSetFile)
+{
+   return pBufferMgr->SetHotSetFile(hotSetFile);
+}
+
 //------------------------------------------------------------------------------
 // Three Methods for manipulating raw memory buffers.  These memory
 // locations are handled by the buffer manager, but are not
@@ -38,6 +38,9 @@ extern void PF_Statistics();
 // Defines
 //
 #define FILE1	"file1"
+#define FILE2	"file2"
+#define HOTSET	"file2.hot"
+#define HOT_PAGES 10
 
 RC TestPF()
 {
@@ -272,6 +275,138 @@ RC TestPF()
    return (0);
 }
 
+//
+// TestHotSet
+//
+// Checks the buffer introspection methods, then saves the hot set,
+// "restarts" with a new PF_Manager and verifies that reloading the hot
+// set brings the pages back without any misses.
+//
+RC TestHotSet()
+{
+   PF_FileHandle fh;
+   PF_PageHandle ph;
+   PF_FrameInfo *frames;
+   RC rc;
+   PageNum pageNum;
+   int numFrames, i, j;
+
+   {
+      PF_Manager pfm;
+
+      cout << "Creating file: " << FILE2 << "\n";
+      if ((rc = pfm.CreateFile(FILE2)) ||
+            (rc = pfm.OpenFile(FILE2, fh)))
+         return (rc);
+
+      // Allocate the pages and then request page i another i times
+      for (i = 0; i < HOT_PAGES; i++) {
+         if ((rc = fh.AllocatePage(ph)) ||
+               (rc = ph.GetPageNum(pageNum)) ||
+               (rc = fh.UnpinPage(pageNum)))
+            return (rc);
+         for (j = 0; j < i; j++)
+            if ((rc = fh.GetThisPage(pageNum, ph)) ||
+                  (rc = fh.UnpinPage(pageNum)))
+               return (rc);
+      }
+
+      cout << "Verifying the buffer frame information: ";
+      if ((rc = pfm.GetBufferInfo(frames, numFrames)))
+         return (rc);
+      if (numFrames != HOT_PAGES) {
+         cout << "Number of frames is incorrect! (" << numFrames << ")\n";
+         exit(1);
+      }
+      for (i = 0; i < numFrames; i++)
+         if (strcmp(frames[i].fileName, FILE2) ||
+               frames[i].pinCount != 0 ||
+               frames[i].accessCount != frames[i].pageNum + 1) {
+            cout << "Frame of page " << frames[i].pageNum
+               << " is incorrect!\n";
+            exit(1);
+         }
+      // Page HOT_PAGES - 1 was requested last
+      if (frames[0].pageNum != HOT_PAGES - 1) {
+         cout << "MRU frame is incorrect! (" << frames[0].pageNum << ")\n";
+         exit(1);
+      }
+      delete [] frames;
+      cout << " Correct!\n";
+
+      if ((rc = pfm.PrintHeatMap()) ||
+            (rc = pfm.SaveHotSet(HOTSET)))
+         return (rc);
+
+      // The hot set must also be saved by itself when the file is
+      // closed and again on shutdown, from the pages the file had
+      // resident when it was closed
+      unlink(HOTSET);
+      if ((rc = pfm.SetHotSetFile(HOTSET)) ||
+            (rc = pfm.CloseFile(fh)))
+         return (rc);
+      if (access(HOTSET, R_OK)) {
+         cout << "Hot set was not saved on close!\n";
+         exit(1);
+      }
+      unlink(HOTSET);
+   }
+
+   // It is written to HOTSET ".tmp" first and renamed
+   if (access(HOTSET, R_OK) || !access(HOTSET ".tmp", F_OK)) {
+      cout << "Hot set was not saved on shutdown!\n";
+      exit(1);
+   }
+
+   {
+      PF_Manager pfm;
+
+      cout << "Restarting and reloading the hot set.\n";
+      if ((rc = pfm.LoadHotSet(HOTSET)) ||
+            (rc = pfm.OpenFile(FILE2, fh)))
+         return (rc);
+
+      // The pages are prefetched in one batch with the first request
+      for (i = 0; i < HOT_PAGES; i++)
+         if ((rc = fh.GetThisPage(i, ph)) ||
+               (rc = fh.UnpinPage(i)))
+            return (rc);
+
+      if ((rc = pfm.GetBufferInfo(frames, numFrames)))
+         return (rc);
+      delete [] frames;
+      if (numFrames != HOT_PAGES) {
+         cout << "Number of warmed frames is incorrect! (" << numFrames
+            << ")\n";
+         exit(1);
+      }
+
+#ifdef PF_STATS
+      cout << "Verifying that warmed pages were found in buffer pool: ";
+      int *piPNF = pStatisticsMgr->Get(PF_PAGENOTFOUND);
+      int *piRP = pStatisticsMgr->Get(PF_READPAGE);
+      if (piPNF != NULL) {
+         cout << "Number of pages not found in the buffer is incorrect! ("
+            << *piPNF << ")\n";
+         exit(1);
+      }
+      if (piRP == NULL || *piRP != HOT_PAGES) {
+         cout << "Number of pages read in is incorrect!\n";
+         exit(1);
+      }
+      cout << " Correct!\n";
+      delete piRP;
+#endif
+
+      if ((rc = pfm.CloseFile(fh)) ||
+            (rc = pfm.DestroyFile(FILE2)))
+         return (rc);
+   }
+
+   unlink(HOTSET);
+   return (0);
+}
+
 int main()
 {
    RC rc;
@@ -293,8 +428,10 @@ int main()
 
    // Delete files from last time
    unlink(FILE1);
+   unlink(FILE2);
 
-   if ((rc = TestPF())) {
+   if ((rc = TestPF()) ||
+         (rc = TestHotSet())) {
       PF_PrintError(rc);
       return (1);
    }
@@ -21,8 +21,11 @@
 #include "redbase.h"
 #include "rm_rid.h"
 #include "pf.h"
+#include <stdint.h>
+#include <pthread.h>
 #include <string>
 #include <list>
+#include <set>
 #include <vector>
 #include <map>
 using namespace std;
@@ -33,6 +36,8 @@ using namespace std;
 class RM_Record {
   friend class RM_FileScan;
   friend class RM_FileHandle;
+  friend class RM_RecCursor;
+  friend class RM_RecView;
 public:
     RM_Record ();
     ~RM_Record();
@@ -43,52 +48,417 @@ public:
 
     // Return the RID associated with the record
     RC GetRid (RID &rid) const;
+
+    // Return the length of the record, which only varies in files of
+    // variable-length records
+    RC GetLength(int &length) const;
+
+    // Return the number of bytes GetData gives: the whole record, or only
+    // the inline prefix of a record kept in overflow pages.  The rest of
+    // such a record is read with an RM_RecCursor.
+    RC GetDataLength(int &length) const;
+
+    // Replace the contents of the record, for UpdateRec, with the whole
+    // record: a record that only held its prefix drops the rest, and
+    // UpdateRec then stores just the bytes given.  To change the prefix
+    // and keep the rest, change it in place through GetData instead.
+    // Only records of variable-length files may change their length.
+    RC SetData(const char *pData, int length);
 private:
-  int recordSize;
+  int recordSize;    // bytes in data
   char *data;
   RID rid_;
+  int length_;       // of the whole record
+  PageNum overflow_; // first overflow page if data is only the prefix
+  bool projected_;   // data only holds the attributes of a projection
+  void set(const char *pData, int length, bool isLong = false);
+};
+
+//
+// RM_RecView: a record read in place, without copying.  GetData points
+// into the page holding the record, which stays pinned until the view is
+// released, given another record, or destroyed.  A view given a record
+// on the page it already pins keeps its pin, so reusing one view for a
+// scan pins each page once and allocates nothing.  Views must be
+// released before their file is closed.
+//
+class RM_RecView {
+  friend class RM_FileScan;
+  friend class RM_FileHandle;
+  friend class RM_RecCursor;
+public:
+    RM_RecView ();
+    ~RM_RecView();
+
+    RC GetData      (const char *&pData) const;  // valid until released
+    RC GetRid       (RID &rid) const;
+    RC GetLength    (int &length) const;         // of the whole record
+    RC GetDataLength(int &length) const;         // bytes GetData gives
+
+    RC CopyTo       (RM_Record &rec) const;      // copy the record out
+    RC Release      ();                          // unpin the page
+private:
+  const PF_FileHandle *pfh_;
+  PageNum pageNum_;    // the pinned page, -1 if none
+  char *pageData_;
+  const char *data;
+  int inlineLength;    // bytes on the page, the RM_VarLong included
+  bool isLong;
+  int length_;         // of the whole record
+  PageNum overflow_;
+  RID rid_;
+  vector<char> own_;   // a record put together from a PAX page
+  bool holds(const PF_FileHandle *pfh, PageNum pageNum) const
+    { return pfh_ == pfh && pageNum_ == pageNum; }
+  void hold(const PF_FileHandle *pfh, PageNum pageNum, char *pageData);
+  void set(const char *pData, int length, bool isLong, const RID &rid);
+};
+
+class RM_LogManager;
+class RM_Predicate;
+struct RM_VarLong;
+struct RM_FileRecPage;
+
+//
+// RM_ZoneMap: the smallest and largest value of an attribute on each
+// virtual page of a file, see RM_FileHandle::AddZoneMap
+//
+struct RM_ZoneMap {
+  AttrType attrType;
+  int attrLength;
+  int attrOffset;
+  vector<char> any;   // a record of the page has a value that compares
+  vector<char> low;   // attrLength bytes for each page
+  vector<char> high;
+};
+
+//
+// RM_AttrInfo: an attribute of the schema of a file, see
+// RM_Manager::CreateFile
+//
+struct RM_AttrInfo {
+  char attrName[MAXNAME + 1];
+  AttrType attrType;
+  int attrLength;
+  int attrOffset;
+  bool nullable;      // kept for the layers above, RM stores no nulls
 };
 
+//
+// Called by RM_FileHandle::Compact for each record it moved, once the
+// moves are committed, so that indexes can follow it.  An error stops
+// the calls, and the empty pages are then not given back.
+//
+typedef RC (*RM_RemapFn)(void *ctx, const RID &oldRid, const RID &newRid);
+
 //
 // RM_FileHandle: RM File interface
 //
 class RM_FileHandle {
   friend class RM_Manager;
   friend class RM_FileScan;
+  friend class RM_ParallelScan;
+  friend class RM_RecCursor;
+  friend class RM_Loader;
 public:
     RM_FileHandle ();
     ~RM_FileHandle();
 
     // Given a RID, return the record
     RC GetRec     (const RID &rid, RM_Record &rec) const;
+    // ... or a view of it on its page
+    RC GetRec     (const RID &rid, RM_RecView &view) const;
 
     RC InsertRec  (const char *pData, RID &rid);       // Insert a new record
+    // Insert a record of length bytes, up to the record size given to
+    // CreateFile in a variable-length file
+    RC InsertRec  (const char *pData, int length, RID &rid);
+    // Insert numRecs records laid out as GetNextBatch returns them, a
+    // record size apart, and set rids, unless NULL, to their RIDs.  The
+    // records going to one page are written and logged together, and
+    // new pages are filled whole.  lengths, unless NULL, gives the length
+    // of each record of a variable-length file.
+    RC InsertRecs (const char *pData, int numRecs, RID *rids,
+                   const int *lengths = NULL);
 
     RC DeleteRec  (const RID &rid);                    // Delete a record
     RC UpdateRec  (const RM_Record &rec);              // Update a record
+    // Delete the records of numRecs RIDs, or update numRecs records to
+    // the RIDs they were got from, a page at a time: each page is pinned
+    // once for all its records.  A RID without a record stops the batch
+    // with RM_REC_NO_EXIST; the pages before it are changed already.
+    RC DeleteRecs (const RID *rids, int numRecs);
+    RC UpdateRecs (const RM_Record *recs, int numRecs);
 
     // Forces a page (along with any contents stored in this class)
     // from the buffer pool to disk.  Default value forces all pages.
     RC ForcePages (PageNum pageNum = ALL_PAGES);
     inline int GetRecordPerPage() const { return recordPerPage; }
+
+    // Make every change since the last commit durable through the
+    // write-ahead log.  With SetAsyncCommit(n) the log is only flushed
+    // on every n-th commit, so that n commits share one fsync: the
+    // others return before they are durable, and a crash can lose up
+    // to n-1 commits already acknowledged.  Nothing flushes them after
+    // a delay; only the n-th commit, a page written back or closing the
+    // file does.
+    RC Commit     ();
+    RC SetAsyncCommit(int commits);
+
+    // Take a fuzzy checkpoint: log the dirty page table, so that crash
+    // recovery only redoes from its oldest change, and let the buffer
+    // manager write those pages back gradually.  No page is written
+    // here.  Once the changes at the start of the log are all on
+    // written pages and committed, the log is cut to the rest, so an
+    // open file's log stays bounded.  A checkpoint is also taken every
+    // SetCheckpointInterval bytes of log (0 turns that off).
+    RC Checkpoint ();
+    RC SetCheckpointInterval(int logBytes);
+
+    // Let inserts fill pages up to percent (1 to 100) of their slots,
+    // keeping the rest for later growth.  Kept in the file header.
+    RC SetFillFactor(int percent);
+
+    // Keep the first bytes (up to 1/4 of a page) of records too long for
+    // a record page there, and the rest in overflow pages.  Scans whose
+    // condition is in those bytes never read the overflow pages.  Kept in
+    // the file header; records already stored keep their prefix.
+    RC SetInlinePrefix(int bytes);
+
+    // Keep the smallest and largest value of an attribute on every page
+    // of a file of fixed-length records, so that scans skip the pages
+    // where a condition on it cannot hold.  Kept in a file next to this
+    // one and rebuilt after a crash.  DropZoneMap drops those of the
+    // attributes at attrOffset.
+    RC AddZoneMap (AttrType attrType, int attrLength, int attrOffset);
+    RC AddZoneMap (const char *attrName);    // an attribute of the schema
+    RC DropZoneMap(int attrOffset);
+
+    // The schema of the file, empty if it was created without one, and
+    // the attribute of it named attrName (RM_NO_SUCH_ATTR if none is)
+    RC GetSchema  (vector<RM_AttrInfo> &attrs) const;
+    RC GetAttr    (const char *attrName, RM_AttrInfo &attr) const;
+
+    // Move the records of the last pages of a file of fixed-length
+    // records into the first pages with room (up to the fill factor),
+    // commit, and call remap, unless NULL, with the old and new RID of
+    // each.  The pages left empty at the end go back to the PF file
+    // for later inserts, so scans only read pages with records.  Records
+    // on cold pages (see Compress) stay where they are.  Scans open
+    // meanwhile may miss moved records or return them twice.
+    RC Compact    (RM_RemapFn remap = NULL, void *ctx = NULL);
+
+    // Encode the records of a file of fixed-length records, a page at a
+    // time, into cold pages that each hold the records of several pages,
+    // and commit.  Each 4-byte word of a record is stored for the
+    // records of a page as a constant, as differences from their
+    // smallest value, or as indexes into a few distinct values, so that
+    // integers close to each other and strings of few values take a
+    // fraction of their size.  Pages that do not encode to half a page
+    // are kept as they are.  RIDs do not change, and the records are
+    // read as before, decoded a page at a time; a change to a record on
+    // a cold page first gives its page a record page of its own again.
+    // Compress again once many have been changed.  No scan may be open
+    // on the file meanwhile.
+    RC Compress   ();
 private:
   bool fileOpen_;
   PF_FileHandle pfh_;
+  RM_LogManager *log_;
+  LSN checkpointLSN;      // LSN of the last checkpoint
+  int checkpointInterval; // log bytes between checkpoints, 0 for none
   string fileName_;
-  int recordSize;
+  int recordSize;    // the longest record if varLength
+  bool varLength;    // slotted pages of variable-length records
   int bitmapSize;
-  int recordPerPage;
+  int recordPerPage; // the most slots of a page
+  int pageSpace;     // free slots (free bytes if varLength) of a new page
   int totalPage;
   int totalEmptyPage;
-  bool headerUpdate;
-  vector<PageNum> totalPageList; // this is the actual page number
-  list<PageNum> emptyPageList; // this is the virtual page number
+  // the page directory is loaded on demand, see rm_internal.h.  Chunk 0
+  // holds the entries on the header page, chunk c those on directory
+  // page c - 1.
+  mutable vector<PageNum> dirPages;            // -1 if not known yet
+  mutable vector<vector<PageNum> > pageChunks; // the actual page numbers
+  mutable vector<bool> chunkLoaded;
+  // free-space map: the virtual pages with room for inserts, by tier
+  vector<set<int> > freeTiers;
+  int freeHint;    // as on the header page
+  int freeCursor;  // pages before it with room are in freeTiers
+  int fillFactor;  // as on the header page
+  int reserve;     // free slots (bytes) inserts leave on a page
+  int freeOverflow;  // as on the header page
+  int inlinePrefix;  // as on the header page
+  vector<RM_ZoneMap> zoneMaps;
+  vector<int> columns;  // offsets of the PAX columns, empty for rows
+  vector<RM_AttrInfo> schema;  // as on its page, empty if none
+  vector<int> attrBounds;      // where attributes start and end, in order
+  // the last page decoded from a cold page, see rec_page
+  mutable vector<char> coldBuf;
+  mutable int coldVPage;  // -1 if none
   RC check_record_exist(const RID &, PageNum &, SlotNum &, 
                         PageNum &, char*&) const;
+  // image lengths of -1 stand for recordSize
+  RC log_rec(int type, int vPage, PageNum pageNum, SlotNum slotNum,
+             const char *image1, const char *image2, LSN &lsn,
+             int len1 = -1, int flags1 = 0, int len2 = -1, int flags2 = 0);
+  RC insert_rec(const char *pData, int length, int flags, RID &rid);
+  RC add_page(PF_PageHandle &pageHdl, PageNum &pageNum, int &vPage);
+  // batches of deletes and updates
+  RC batch_order(const RID *rids, int numRecs,
+                 vector<pair<long, int> > &order) const;
+  RC batch_page(const vector<pair<long, int> > &order, size_t first,
+                size_t last, const RM_Record *recs);
+  RC batch_change(const RID *rids, int numRecs, const RM_Record *recs);
+  // compaction
+  RC compact_done(int vPage, PageNum pageNum, RM_FileRecPage *data,
+                  int oldFree, LSN lsn);
+  RC drop_pages();
+  RC load_schema(PageNum schemaPage);
+  // cold pages, see rm_internal.h and rm_cold.cc
+  RM_FileRecPage *rec_page(int vPage, char *pageData) const;
+  RC thaw(int vPage, PageNum &pageNum, RM_FileRecPage *&data);
+  RC set_page(int vPage, PageNum pageNum, LSN lsn);
+  RC cold_write(vector<char> &cold, vector<PageNum> &newPages,
+                PageNum &chain);
+  int page_free(const char *pageData) const;
+  RC page_changed(int vPage, int oldFree, int newFree, LSN lsn);
+  // variable-length records, see rm_internal.h
+  RC var_target(const char *stub, PageNum &pageNum, SlotNum &slotNum,
+                char *&pageData) const;
+  RC var_update(const RM_Record &rec, PageNum pageNum, SlotNum slotNum,
+                PageNum actualPageNum, char *pageData);
+  RC var_put(const char *pData, int length, int flags, PageNum pageNum,
+             SlotNum slotNum, PageNum actualPageNum, char *pageData);
+  RC var_delete(PageNum pageNum, SlotNum slotNum, PageNum actualPageNum,
+                char *pageData);
+  // overflow pages of long records, see rm_internal.h
+  RC var_long(char *pageData, SlotNum slotNum, int &prefix,
+              RM_VarLong &desc) const;
+  RC write_long(const char *pData, int length, char *inlineData,
+                int &inlineLength);
+  RC free_long(const RM_VarLong &desc);
+  RC set_free_overflow(PageNum head, LSN lsn);
+  RC auto_checkpoint();
+  RC cut_log(LSN redoLSN);
+  // page directory, see rm_internal.h
+  RC init_directory(const void *hdr);
+  RC dir_page(int chunk, PageNum &dirPage) const;
+  RC load_chunk(int chunk) const;
+  RC page_of(int vPage, PageNum &pageNum) const;
+  RC dir_entry(int vPage, PageNum &dirPage, char *&pageData) const;
+  RC set_free_slots(int vPage, int freeSlots, LSN lsn);
+  RC set_free_hint(int vPage, LSN lsn);
+  RC scan_free(int minTier);
+  int free_tier(int freeSlots) const;
+  int fit_tier(int need) const;
+  bool fsm_find(int minTier, int &vPage) const;
+  void fsm_update(int vPage, int oldFree, int newFree);
+  void fsm_clear();
+  RC append_page(PageNum pageNum, LSN lsn);
+  RC append_dir_page(PageNum dirPage, LSN lsn);
+  bool need_dir_page() const;
+  // zone maps, see rm_zonemap.cc
+  RC zone_open(bool crashed);
+  void zone_close();
+  RC zone_build(RM_ZoneMap &zone) const;
+  void zone_fill(RM_ZoneMap &zone, int vPage, const RM_FileRecPage *data)
+    const;
+  void zone_page(int vPage, const RM_FileRecPage *data);
+  void zone_widen(int vPage, const char *recData);
+  // records of fixed-length pages, see rm_internal.h and rm_pax.cc
+  inline const char *rec_at(const RM_FileRecPage *data, int slotNum,
+                            char *buf) const;
+  inline void rec_get(const RM_FileRecPage *data, int slotNum,
+                      char *out) const;
+  inline void rec_put(RM_FileRecPage *data, int slotNum,
+                      const char *recData) const;
+  const char *rec_view(const RM_FileRecPage *data, int slotNum,
+                       RM_RecView &view) const;
+  bool bind(RM_Predicate &pred) const;
+  void page_eval(const RM_Predicate &pred, bool bound,
+                 const RM_FileRecPage *data, const uint64_t *cand,
+                 uint64_t *match, vector<char> &rows) const;
+};
+
+//
+// A filter compares the attribute of count records, the first at attr
+// and the others every stride bytes, with value, and sets bit b of word
+// w of mask for record 64*w + b if it passes.  See rm_scanfilter.cc.
+//
+typedef void (*RM_ScanFilter)(const char *attr, int stride, int count,
+                              const char *value, int attrLength,
+                              uint64_t *mask);
+
+//
+// RM_Predicate: a scan condition.  A comparison of an attribute with a
+// value, as OpenScan takes it, or AND / OR of conditions.  IN-lists and
+// BETWEEN are built from comparisons.  The scan orders the conditions
+// under an AND or OR by their estimated selectivity and stops evaluating
+// them as soon as the outcome is settled.
+//
+class RM_Predicate {
+  friend class RM_FileScan;
+  friend class RM_ParallelScan;
+  friend class RM_FileHandle;
+public:
+    RM_Predicate ();                              // every record passes
+    RM_Predicate (AttrType   attrType,
+                  int        attrLength,
+                  int        attrOffset,
+                  CompOp     compOp,
+                  const void *value);
+
+    // attribute equal to one of numValues values, attrLength bytes each
+    static RM_Predicate In     (AttrType attrType, int attrLength,
+                                int attrOffset, const void *values,
+                                int numValues);
+    // low <= attribute <= high
+    static RM_Predicate Between(AttrType attrType, int attrLength,
+                                int attrOffset, const void *low,
+                                const void *high);
+    static RM_Predicate And    (const RM_Predicate &a, const RM_Predicate &b);
+    static RM_Predicate Or     (const RM_Predicate &a, const RM_Predicate &b);
+private:
+  enum Kind { CMP, AND, OR };
+  Kind kind;
+  // a comparison
+  AttrType attrType;
+  int attrLength;
+  int attrOffset;
+  CompOp compOp;
+  bool hasValue;
+  string value;
+  RM_ScanFilter filter;
+  // on a PAX page, where the minipage holding the attribute has it for
+  // slot 0, and the length of its column, see RM_FileHandle::bind
+  int colBase;
+  int colStride;
+  // AND / OR
+  vector<RM_Predicate> children;
+  static RM_Predicate join(Kind kind, const RM_Predicate &a,
+                           const RM_Predicate &b);
+  double selectivity() const;
+  void order();
+  bool valid() const;
+  int end() const;
+  bool may_match(const vector<RM_ZoneMap> &zones, int vPage) const;
+  // with columns, rec is a PAX page the comparisons were bound to
+  void eval(const char *rec, int stride, int count, const uint64_t *cand,
+            uint64_t *match, bool columns = false) const;
 };
 
 //
-// RM_FileScan: condition-based scan of records in the file
+// An attribute a scan keeps, see RM_FileScan::SetProjection
+//
+struct RM_ProjAttr {
+  int attrOffset;
+  int attrLength;
+};
+
+//
+// RM_FileScan: condition-based scan of records in the file.  Pages the
+// zone maps of the file rule out are not read.
 //
 class RM_FileScan {
 public:
@@ -102,24 +472,200 @@ public:
                   CompOp     compOp,
                   void       *value,
                   ClientHint pinHint = NO_HINT); // Initialize a file scan
+    // ... on an attribute of the schema of the file
+    RC OpenScan  (const RM_FileHandle &fileHandle,
+                  const char *attrName,
+                  CompOp     compOp,
+                  void       *value,
+                  ClientHint pinHint = NO_HINT);
+    // ... with a condition tree
+    RC OpenScan  (const RM_FileHandle &fileHandle,
+                  const RM_Predicate &pred,
+                  ClientHint pinHint = NO_HINT);
     RC GetNextRec(RM_Record &rec);               // Get next matching record
+    // ... or a view of it, released at RM_EOF
+    RC GetNextRec(RM_RecView &view);
+    // Copy up to maxRecs matching records into pData, one row of the
+    // record size of the file (or of the projection) each, and their
+    // RIDs into rids unless it is NULL.  numRecs is set to the number of
+    // rows filled; RM_EOF once no record is left.  A page is pinned once
+    // for all the records a batch takes from it.  In a variable-length
+    // file lengths, unless NULL, gets the length of each record, and long
+    // records are copied whole.
+    RC GetNextBatch(char *pData, RID *rids, int maxRecs, int &numRecs,
+                    int *lengths = NULL);
+    // Only keep numAttrs attributes of the records, packed one after the
+    // other in the order given.  Records got as RM_Record and batch rows
+    // are then that long; views are not changed.  Such records cannot be
+    // updated (RM_SCAN_PROJECTED) until SetData gives them whole data.
+    // Bytes past the end of a variable-length record read as zeros.  No
+    // attributes keeps the whole records again.
+    RC SetProjection(const RM_ProjAttr *attrs, int numAttrs);
     RC CloseScan ();                             // Close the scan
 private:
   bool scanOpen_;
   const RM_FileHandle *rmFileHandle;
-  AttrType attrType_;
-  int attrLength_;
-  int attrOffset_;
-  CompOp compOp_;
-  char buf[MAXSTRINGLEN + 1];
+  RM_Predicate pred_;
+  int condEnd_;      // the condition looks at the bytes before, 0 if none
+  bool bound_;       // the condition is bound to the PAX columns
+  vector<char> rows_;  // records of a PAX page put together
+  vector<char> rec_;   // a record of a PAX page, to project
   RID curScanId_;
-  int intVal_;
-  float floatVal_;
-  string stringVal_;
-  bool check_scan_cond(char *recData);
-  SlotNum nextRecSlot(const unsigned char *bitmap, int bitmapSize, SlotNum start);
-  template<typename DataType>
-  bool check_scan_data_cond(const DataType attr, const DataType value);
+  // records of virtual page matchPage_ that pass the condition, as of the
+  // change matchLSN_ of the page
+  uint64_t match_[2];
+  int matchPage_;
+  LSN matchLSN_;
+  char *padded_;     // a short record padded to the end of the condition
+  RM_RecView view_;  // for GetNextRec(RM_Record &)
+  vector<RM_ProjAttr> proj_; // the projection, empty if none
+  int projLength_;   // bytes it keeps of a record
+  char *projBuf_;    // a projected record for GetNextRec(RM_Record &)
+  RC project(const RM_RecView &view, char *out) const;
+  bool check_scan_cond(const char *recData);
+  int next_page(int vPage) const;
+  void page_matches(int vPage, const RM_FileRecPage *data,
+                    unsigned char *cand);
+  RC next_var_rec(RM_RecView &view);
+  RC next_var_batch(char *pData, RID *rids, int maxRecs, int &numRecs,
+                    int *lengths);
+};
+
+//
+// RM_ParallelScan: a scan of a fixed-length file over several threads.
+// The virtual pages are split into morsels of consecutive pages, dealt
+// out to the threads, and taken over by threads that run out of their
+// own.  Each thread filters and copies its records into its own queue,
+// and GetNextBatch takes them from there, so records come back in no
+// particular order.  The threads read pages straight from the file,
+// bypassing the buffer pool: the file's dirty pages are written when the
+// scan is opened, and changes made while it is open may not be seen.
+// Pages the zone maps of the file rule out are left out when it is
+// opened.
+//
+class RM_ParallelScan {
+public:
+    RM_ParallelScan  ();
+    ~RM_ParallelScan ();
+
+    // numThreads 0 uses a thread per processor.  proj is as for
+    // RM_FileScan::SetProjection.
+    RC OpenScan    (const RM_FileHandle &fileHandle,
+                    const RM_Predicate &pred,
+                    int numThreads = 0,
+                    const RM_ProjAttr *proj = NULL,
+                    int numProj = 0);
+    // as RM_FileScan::GetNextBatch
+    RC GetNextBatch(char *pData, RID *rids, int maxRecs, int &numRecs);
+    RC CloseScan   ();                           // stops the threads
+private:
+  struct Chunk;                // the records of a morsel
+  struct Worker;
+  bool scanOpen_;
+  const RM_FileHandle *rmFileHandle;
+  RM_Predicate pred_;
+  bool bound_;                 // pred_ is bound to the PAX columns
+  vector<RM_ProjAttr> proj_;   // empty if whole records
+  int rowLength_;
+  vector<PageNum> pages_;      // of the virtual pages
+  vector<Worker *> workers_;   // the last one is the calling thread
+  int running_;                // threads still working
+  bool closing_;
+  RC rc_;                      // first error of a thread
+  pthread_mutex_t lock_;       // guards everything the threads share
+  pthread_cond_t ready_;       // a chunk was queued, or a thread ended
+  pthread_cond_t room_;        // a chunk was taken from a queue
+  Chunk *cur_;                 // being returned by GetNextBatch
+  int curPos_;
+  int next_;                   // queue GetNextBatch looks at first
+  static void *work(void *worker);
+  bool take_morsel(int self, int &first, int &last);
+  RC run_morsel(int self, int first, int last, char *image);
+  void stop();
+};
+
+//
+// A field of the CSV rows RM_Loader loads: the attribute of the record it
+// goes to
+//
+struct RM_LoadAttr {
+  AttrType attrType;
+  int attrLength;
+  int attrOffset;
+};
+
+//
+// RM_Loader: loads the rows of a CSV or binary file into an RM file.  The
+// input is read a large block at a time and parsed by threads, while the
+// calling thread inserts the records of each block in input order,
+// filling pages whole with InsertRecs.
+//
+class RM_Loader {
+public:
+    RM_Loader  ();
+    ~RM_Loader ();
+
+    // Rows are lines of text, each with a field for every attribute,
+    // separated by delim.  A field may be in double quotes, with "" for
+    // a quote in it, but may not span lines.  Empty lines are skipped.
+    // Bytes of a record no attribute covers are zero, as are those after
+    // a shorter string.
+    RC SetCsv   (const RM_LoadAttr *attrs, int numAttrs, char delim = ',');
+    // ... a field for each attribute of the schema of fileHandle, in
+    // the order of the schema
+    RC SetCsv   (const RM_FileHandle &fileHandle, char delim = ',');
+    // Rows are whole records of the record size of the file, one after
+    // the other (the default)
+    RC SetBinary();
+    // Insert the rows of file fileName into fileHandle and commit them.
+    // numThreads 0 uses a thread per processor.  numRecs is set to the
+    // number of records inserted: on RM_LOAD_BAD_ROW, the rows before
+    // the bad one.
+    RC Load     (RM_FileHandle &fileHandle, const char *fileName,
+                 int &numRecs, int numThreads = 0);
+private:
+  struct Block;                // a block of input and its records
+  struct Job;                  // what a load shares with its threads
+  vector<RM_LoadAttr> attrs_;  // empty for binary rows
+  char delim_;
+  RC read_block(int fd, int recordSize, vector<char> &carry,
+                Block *&block) const;
+  void parse(Block &block, int recordSize) const;
+  bool parse_row(const char *p, const char *end, char *rec) const;
+  static void *work(void *job);
+};
+
+//
+// RM_RecCursor: reads a record in pieces, without copying it whole.  The
+// record is read from the RM_Record first, then from its overflow pages.
+//
+class RM_RecCursor {
+  friend class RM_FileScan;
+public:
+    RM_RecCursor ();
+    ~RM_RecCursor();
+
+    // Start at the first byte of rec, a record got from fileHandle
+    RC Open (const RM_FileHandle &fileHandle, const RM_Record &rec);
+    RC Open (const RM_FileHandle &fileHandle, const RM_RecView &view);
+    // Copy up to length bytes from the current position on and move past
+    // them; read is set to the number of bytes copied.  RM_EOF once the
+    // whole record was read.
+    RC Read (char *pData, int length, int &read);
+    RC Seek (int offset);                   // move to a byte of the record
+    RC Close();
+private:
+  const RM_FileHandle *rmFileHandle;
+  char *prefix;      // a copy of the bytes before the overflow pages
+  const char *prefixData; // those bytes, copied or not
+  int prefixLen;
+  int length;        // of the whole record
+  int pos;           // current position
+  PageNum firstPage; // first overflow page
+  PageNum curPage;   // overflow page holding curStart
+  int curStart;      // position of the first byte of curPage
+  void open(const RM_FileHandle *fileHandle, const char *pData, int prefix,
+            int length, PageNum first, bool copy = true);
 };
 
 //
@@ -130,17 +676,41 @@ public:
     RM_Manager    (PF_Manager &pfm);
     ~RM_Manager   ();
 
-    RC CreateFile (const char *fileName, int recordSize);
+    // With varLength, records are up to recordSize bytes long, each
+    // taking only the space it needs.  recordSize may then exceed a page:
+    // records too long for a record page go to overflow pages.
+    RC CreateFile (const char *fileName, int recordSize,
+                   bool varLength = false);
+    // Create a file of fixed-length records kept in PAX pages: a page
+    // holds the values of each column of its records together, in a
+    // minipage of its own.  columnLengths split the record into
+    // numColumns (up to MAXATTRS) columns, in order.  RIDs and every call
+    // work as with whole records; a scan condition on an attribute
+    // within a column reads only that column of each page.
+    RC CreateFile (const char *fileName, int recordSize,
+                   const int *columnLengths, int numColumns);
+    // Create a file of fixed-length records with a schema of numAttrs
+    // (up to MAXATTRS) attributes, each with a name of its own and at
+    // an offset of its own in the record, which is as long as they need.
+    // The schema is kept in the file, so that zone maps, scans and loads
+    // can name an attribute.  With pax the pages are PAX pages, with a
+    // column for each attribute, and cold pages (see Compress) encode
+    // each attribute on its own.
+    RC CreateFile (const char *fileName, const RM_AttrInfo *attrs,
+                   int numAttrs, bool pax = false);
     RC DestroyFile(const char *fileName);
+    // A file is open through one handle at a time: a second OpenFile
+    // returns RM_OPEN_FILE_ALREADY_OPEN until the first handle closes.
     RC OpenFile   (const char *fileName, RM_FileHandle &fileHandle);
 
     RC CloseFile  (RM_FileHandle &fileHandle);
 private:
   PF_Manager &pfm_;
   map<string, int> openFile_;
-  RC install_page_list(const PF_FileHandle &, RM_FileHandle &, void *, bool);
-  RC write_back_total_page(RM_FileHandle &, void*, void *, bool);
-  RC recur_dispose_dir_page(RM_FileHandle &, PageNum);
+  RC create(const char *fileName, int recordSize, bool varLength,
+            const int *columnLengths, int numColumns,
+            const RM_AttrInfo *attrs = NULL, int numAttrs = 0);
+  RC recover(RM_FileHandle &);
 };
 
 //
@@ -158,14 +728,38 @@ void RM_PrintError(RC rc);
 #define RM_CREATE_FILE_HDR_PAGE_WRITE_ERROR 5
 
 #define RM_OPEN_FILE_HDR_PAGE_ERROR 6
-#define RM_RM_ERROR_END 6
+#define RM_CREATE_FILE_BAD_COLUMNS 7
+#define RM_CREATE_FILE_BAD_SCHEMA 8
+#define RM_NO_SUCH_ATTR 9
+#define RM_OPEN_FILE_ALREADY_OPEN 10
+#define RM_RM_ERROR_END 10
 
 #define RM_NOT_OPEN_FILE 11
 #define RM_REC_NO_EXIST 12
 #define RM_REC_LEN_NO_MATCH 13
-#define RM_FH_ERROR_END 13
+#define RM_BAD_FILL_FACTOR 14
+#define RM_BAD_INLINE_PREFIX 15
+#define RM_CURSOR_NOT_OPEN 16
+#define RM_BAD_OFFSET 17
+#define RM_BAD_ZONE_MAP 18
+#define RM_COMPACT_VAR_LENGTH 19
+#define RM_COMPRESS_VAR_LENGTH 20
+#define RM_FH_ERROR_END 20
 
 #define RM_SCAN_NOT_OPEN 22
 #define RM_SCAN_REOPEN 23
 #define RM_SCAN_NEED_VALUE 24
-#define RM_SCAN_ERROR_END 24
+#define RM_SCAN_BAD_BATCH 25
+#define RM_SCAN_BAD_PROJECTION 26
+#define RM_SCAN_VAR_LENGTH 27
+#define RM_SCAN_PROJECTED 28
+#define RM_SCAN_ERROR_END 28
+
+#define RM_LOG_IO_ERROR 31
+#define RM_LOG_CORRUPT 32
+#define RM_LOG_ERROR_END 32
+
+#define RM_LOAD_IO_ERROR 41
+#define RM_LOAD_BAD_ROW 42
+#define RM_LOAD_BAD_ATTR 43
+#define RM_LOAD_ERROR_END 43
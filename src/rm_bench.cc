@@ -0,0 +1,574 @@
+//
+// File:        rm_bench.cc
+// Description: Microbenchmark of the RM component
+//
+// Loads a file with fixed-length records and reports the time per record
+// of inserts (one or a batch per call, or a CSV load), full scans
+// (copying the records or viewing them in place), scans with a condition
+// (a record or a batch per call, or over several threads) or a tree of
+// them, scans keeping one attribute, range scans with and without a zone
+// map, random fetches, deletes (one or a batch per call), and the time
+// per slot of the bitmap kernels underneath them.  A second file is
+// compressed into cold pages, and its scans and fetches timed again
+// next to the pages it takes before and after.
+//
+//   rm_bench [numRecs]
+//
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstddef>
+#include <unistd.h>
+#include <sys/time.h>
+
+#include "redbase.h"
+#include "pf.h"
+#include "rm.h"
+#include "rm_internal.h"
+#include "rm_logmanager.h"
+using namespace std;
+
+//
+// Defines
+//
+#define FILENAME   (char*)("benchrel")        // benchmark file name
+#define LOGNAME    (char*)("benchrel.log")    // its write-ahead log
+#define BULKNAME   (char*)("benchbulk")       // file loaded in batches
+#define BULKLOG    (char*)("benchbulk.log")
+#define CSVNAME    (char*)("benchbulk.csv")   // rows of the CSV load
+#define STRLEN     29                         // length of string in record
+#define DEF_RECS   200000                     // records loaded by default
+#define KERNEL_REPS 200000                    // bitmaps walked per kernel
+#define BATCH      256                        // records per GetNextBatch
+
+//
+// Structure of the records, the same as in rm_test
+//
+struct BenchRec {
+    char  str[STRLEN];
+    int   num;
+    float r;
+};
+
+PF_Manager pfm;
+RM_Manager rmm(pfm);
+volatile int sink;                            // keeps kernel results live
+
+//
+// Now
+//
+// Desc: wall clock in microseconds
+//
+static double Now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1e6 + tv.tv_usec;
+}
+
+//
+// Report
+//
+// Desc: print the time per item of a phase
+//
+static void Report(const char *phase, double start, int items)
+{
+    double usec = Now() - start;
+    printf("%-28s %10d %12.1f ns/item\n", phase, items,
+           items ? usec * 1000 / items : 0.0);
+}
+
+//
+// PrintError
+//
+// Desc: print an error message with the component's print-error function
+//
+static void PrintError(RC rc)
+{
+    if (abs(rc) <= END_PF_WARN)
+        PF_PrintError(rc);
+    else
+        RM_PrintError(rc);
+}
+
+//
+// Scan
+//
+// Desc: scan the file with a condition on num, return the records seen
+//
+static RC Scan(RM_FileHandle &fh, CompOp op, int value, int &count,
+               bool views = false)
+{
+    RC          rc;
+    RM_FileScan fs;
+    RM_Record   rec;
+    RM_RecView  view;
+
+    count = 0;
+    if ((rc = fs.OpenScan(fh, INT, sizeof(int), offsetof(BenchRec, num),
+                          op, op == NO_OP ? NULL : &value)))
+        return (rc);
+    while (!(rc = views ? fs.GetNextRec(view) : fs.GetNextRec(rec)))
+        count++;
+    if (rc != RM_EOF)
+        return (rc);
+    return (fs.CloseScan());
+}
+
+//
+// ScanBatches
+//
+// Desc: Scan, a batch of records per call
+//
+static RC ScanBatches(RM_FileHandle &fh, const RM_Predicate &pred, int &count,
+                      const RM_ProjAttr *proj = NULL, int numProj = 0)
+{
+    RC          rc;
+    RM_FileScan fs;
+    BenchRec    batch[BATCH];
+    RID         rids[BATCH];
+    int         got;
+
+    count = 0;
+    if ((rc = fs.OpenScan(fh, pred)) ||
+        (rc = fs.SetProjection(proj, numProj)))
+        return (rc);
+    while (!(rc = fs.GetNextBatch((char *)batch, rids, BATCH, got)))
+        count += got;
+    if (rc != RM_EOF)
+        return (rc);
+    return (fs.CloseScan());
+}
+
+//
+// ScanParallel
+//
+// Desc: Scan over numThreads threads, 0 for one per CPU
+//
+static RC ScanParallel(RM_FileHandle &fh, const RM_Predicate &pred,
+                       int numThreads, int &count)
+{
+    RC              rc;
+    RM_ParallelScan ps;
+    BenchRec        batch[BATCH];
+    RID             rids[BATCH];
+    int             got;
+
+    count = 0;
+    if ((rc = ps.OpenScan(fh, pred, numThreads)))
+        return (rc);
+    while (!(rc = ps.GetNextBatch((char *)batch, rids, BATCH, got)))
+        count += got;
+    if (rc != RM_EOF)
+        return (rc);
+    return (ps.CloseScan());
+}
+
+//
+// InsertBatches
+//
+// Desc: time loading numRecs records into a file of their own, a batch
+//       per InsertRecs
+//
+static RC InsertBatches(int numRecs)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    BenchRec      batch[BATCH];
+    RID           rids[BATCH];
+    int           i, j, n;
+    double        start;
+
+    unlink(BULKNAME);
+    unlink(BULKLOG);
+    if ((rc = rmm.CreateFile(BULKNAME, sizeof(BenchRec))) ||
+        (rc = rmm.OpenFile(BULKNAME, fh)))
+        return (rc);
+
+    memset(batch, 0, sizeof(batch));
+    start = Now();
+    for (i = 0; i < numRecs; i += n) {
+        n = numRecs - i < BATCH ? numRecs - i : BATCH;
+        for (j = 0; j < n; j++) {
+            sprintf(batch[j].str, "a%d", i + j);
+            batch[j].num = i + j;
+            batch[j].r = (float)(i + j);
+        }
+        if ((rc = fh.InsertRecs((char *)batch, n, rids)))
+            return (rc);
+    }
+    if ((rc = fh.Commit()))
+        return (rc);
+    Report("insert, batches", start, numRecs);
+
+    if ((rc = rmm.CloseFile(fh)) ||
+        (rc = rmm.DestroyFile(BULKNAME)))
+        return (rc);
+    unlink(BULKLOG);
+    return (0);
+}
+
+//
+// LoadCsv
+//
+// Desc: time loading numRecs CSV rows into a file of their own with
+//       RM_Loader, over a thread per CPU
+//
+static RC LoadCsv(int numRecs)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    RM_Loader     loader;
+    RM_LoadAttr   attrs[] = {
+        { STRING, STRLEN, offsetof(BenchRec, str) },
+        { INT, sizeof(int), offsetof(BenchRec, num) },
+        { FLOAT, sizeof(float), offsetof(BenchRec, r) }
+    };
+    FILE          *f;
+    int           i, n;
+    double        start;
+
+    if (!(f = fopen(CSVNAME, "w")))
+        return (RM_LOAD_IO_ERROR);
+    for (i = 0; i < numRecs; i++)
+        fprintf(f, "a%d,%d,%d\n", i, i, i);
+    fclose(f);
+
+    unlink(BULKNAME);
+    unlink(BULKLOG);
+    if ((rc = rmm.CreateFile(BULKNAME, sizeof(BenchRec))) ||
+        (rc = rmm.OpenFile(BULKNAME, fh)) ||
+        (rc = loader.SetCsv(attrs, 3)))
+        return (rc);
+    start = Now();
+    if ((rc = loader.Load(fh, CSVNAME, n)))
+        return (rc);
+    Report("load, CSV", start, n);
+
+    unlink(CSVNAME);
+    if ((rc = rmm.CloseFile(fh)) ||
+        (rc = rmm.DestroyFile(BULKNAME)))
+        return (rc);
+    unlink(BULKLOG);
+    return (0);
+}
+
+//
+// UsedPages
+//
+// Desc: the number of pages PF has in use in a file that is not open
+//
+static int UsedPages(char *fileName)
+{
+    PF_FileHandle pfh;
+    PF_PageHandle page;
+    PageNum       pageNum = -1;
+    int           n = 0;
+    RC            rc;
+
+    if (pfm.OpenFile(fileName, pfh))
+        return (-1);
+    for (rc = pfh.GetFirstPage(page); !rc;
+         rc = pfh.GetNextPage(pageNum, page)) {
+        page.GetPageNum(pageNum);
+        pfh.UnpinPage(pageNum);
+        n++;
+    }
+    pfm.CloseFile(pfh);
+    return (rc == PF_EOF ? n : -1);
+}
+
+//
+// BenchCold
+//
+// Desc: time batch scans, parallel scans and random fetches on a file
+//       of numRecs records before and after Compress
+//
+static RC BenchCold(int numRecs)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    RM_Record     rec;
+    BenchRec      batch[BATCH];
+    RID           rids[BATCH];
+    int           tenth = numRecs / 10;
+    int           i, j, n, count, pages[2];
+    double        start;
+
+    unlink(BULKNAME);
+    unlink(BULKLOG);
+    if ((rc = rmm.CreateFile(BULKNAME, sizeof(BenchRec))) ||
+        (rc = rmm.OpenFile(BULKNAME, fh)))
+        return (rc);
+    memset(batch, 0, sizeof(batch));
+    for (i = 0; i < numRecs; i += n) {
+        n = numRecs - i < BATCH ? numRecs - i : BATCH;
+        for (j = 0; j < n; j++) {
+            sprintf(batch[j].str, "a%d", i + j);
+            batch[j].num = i + j;
+            batch[j].r = (float)(i + j);
+        }
+        if ((rc = fh.InsertRecs((char *)batch, n, rids)))
+            return (rc);
+    }
+    if ((rc = rmm.CloseFile(fh)))
+        return (rc);
+
+    for (int cold = 0; cold < 2; cold++) {
+        pages[cold] = UsedPages(BULKNAME);
+        if ((rc = rmm.OpenFile(BULKNAME, fh)))
+            return (rc);
+        if (cold) {
+            start = Now();
+            if ((rc = fh.Compress()))
+                return (rc);
+            Report("compress", start, numRecs);
+            if ((rc = rmm.CloseFile(fh)))
+                return (rc);
+            pages[cold] = UsedPages(BULKNAME);
+            if ((rc = rmm.OpenFile(BULKNAME, fh)))
+                return (rc);
+        }
+
+        start = Now();
+        if ((rc = ScanBatches(fh, RM_Predicate(), count)))
+            return (rc);
+        Report(cold ? "batch scan, cold" : "batch scan, hot",
+               start, count);
+
+        start = Now();
+        if ((rc = ScanParallel(fh, RM_Predicate(INT, sizeof(int),
+                                                offsetof(BenchRec, num),
+                                                LT_OP, &tenth), 0, count)))
+            return (rc);
+        Report(cold ? "parallel scan, cold" : "parallel scan, hot", start,
+               numRecs);
+
+        srand(1);
+        start = Now();
+        for (i = 0; i < numRecs; i++) {
+            n = rand() % numRecs;
+            if ((rc = fh.GetRec(RID(n / fh.GetRecordPerPage(),
+                                    n % fh.GetRecordPerPage()), rec)))
+                return (rc);
+        }
+        Report(cold ? "random fetch, cold" : "random fetch, hot",
+               start, numRecs);
+        if ((rc = rmm.CloseFile(fh)))
+            return (rc);
+    }
+    printf("%-28s %10d pages, %d before\n", "compressed file", pages[1],
+           pages[0]);
+
+    if ((rc = rmm.DestroyFile(BULKNAME)))
+        return (rc);
+    unlink(BULKLOG);
+    return (0);
+}
+
+//
+// BenchKernels
+//
+// Desc: time the slot bitmap kernels on a page with every other slot
+//       taken
+//
+static void BenchKernels(int recordPerPage)
+{
+    RM_FileRecPage page;
+    int            slotNum, i, sum = 0;
+    double         start;
+
+    memset(&page, 0, sizeof(page));
+    for (i = 0; i < recordPerPage; i += 2)
+        setEmptySlot(&page, i);
+
+    start = Now();
+    for (i = 0; i < KERNEL_REPS; i++)
+        for (slotNum = nextTakenSlot(page.bitmap, -1); slotNum < recordPerPage;
+             slotNum = nextTakenSlot(page.bitmap, slotNum))
+            sum++;
+    Report("next taken slot", start, sum);
+
+    sum = 0;
+    start = Now();
+    for (i = 0; i < KERNEL_REPS; i++) {
+        int s = -1;
+        while (findFirstEmptySlot(&page, s, s + 1) && s < recordPerPage)
+            sum++;
+    }
+    Report("first empty slot", start, sum);
+
+    sum = 0;
+    start = Now();
+    for (i = 0; i < KERNEL_REPS; i++) {
+        page.bitmap[0] ^= (unsigned char)i;
+        sum += countTaken(&page, recordPerPage);
+    }
+    Report("count taken (per page)", start, KERNEL_REPS);
+    sink = sum;
+}
+
+int main(int argc, char *argv[])
+{
+    RC            rc;
+    RM_FileHandle fh;
+    BenchRec      recBuf;
+    RID           rid;
+    RM_Record     rec;
+    int           numRecs = DEF_RECS;
+    int           i, count;
+    double        start;
+    int           tenth, fifth, rangeEnd;
+    float         seven = 7;
+    RM_ProjAttr   numOnly = { offsetof(BenchRec, num), sizeof(int) };
+
+    if (argc > 1 && (numRecs = atoi(argv[1])) <= 0) {
+        fprintf(stderr, "usage: %s [numRecs]\n", argv[0]);
+        return (1);
+    }
+
+    tenth = numRecs / 10;
+    fifth = numRecs / 5;
+    rangeEnd = tenth + numRecs / 100;
+    unlink(FILENAME);
+    unlink(LOGNAME);
+    if ((rc = rmm.CreateFile(FILENAME, sizeof(BenchRec))) ||
+        (rc = rmm.OpenFile(FILENAME, fh)))
+        goto err;
+
+    memset(&recBuf, 0, sizeof(recBuf));
+    start = Now();
+    for (i = 0; i < numRecs; i++) {
+        sprintf(recBuf.str, "a%d", i);
+        recBuf.num = i;
+        recBuf.r = (float)i;
+        if ((rc = fh.InsertRec((char *)&recBuf, rid)))
+            goto err;
+    }
+    if ((rc = fh.Commit()))
+        goto err;
+    Report("insert", start, numRecs);
+
+    if ((rc = InsertBatches(numRecs)) ||
+        (rc = LoadCsv(numRecs)))
+        goto err;
+
+    start = Now();
+    if ((rc = Scan(fh, NO_OP, 0, count)))
+        goto err;
+    Report("scan, no condition", start, count);
+
+    start = Now();
+    if ((rc = Scan(fh, NO_OP, 0, count, true)))
+        goto err;
+    Report("scan, views", start, count);
+
+    start = Now();
+    if ((rc = Scan(fh, LT_OP, numRecs / 10, count)))
+        goto err;
+    Report("scan, 10% selected", start, numRecs);
+
+    start = Now();
+    if ((rc = ScanBatches(fh, RM_Predicate(), count)))
+        goto err;
+    Report("batch scan, no condition", start, count);
+
+    start = Now();
+    if ((rc = ScanBatches(fh, RM_Predicate(INT, sizeof(int),
+                                           offsetof(BenchRec, num), LT_OP,
+                                           &tenth), count)))
+        goto err;
+    Report("batch scan, 10% selected", start, numRecs);
+
+    // 10% again: r <> 7 AND num BETWEEN n/10 AND n/5, the BETWEEN first
+    start = Now();
+    if ((rc = ScanBatches(fh, RM_Predicate::And(
+                 RM_Predicate(FLOAT, sizeof(float), offsetof(BenchRec, r),
+                              NE_OP, &seven),
+                 RM_Predicate::Between(INT, sizeof(int),
+                                       offsetof(BenchRec, num), &tenth,
+                                       &fifth)), count)))
+        goto err;
+    Report("batch scan, AND of 3", start, numRecs);
+
+    start = Now();
+    if ((rc = ScanBatches(fh, RM_Predicate(), count, &numOnly, 1)))
+        goto err;
+    Report("batch scan, num only", start, count);
+
+    start = Now();
+    if ((rc = ScanParallel(fh, RM_Predicate(INT, sizeof(int),
+                                            offsetof(BenchRec, num), LT_OP,
+                                            &tenth), 1, count)))
+        goto err;
+    Report("parallel scan, 1 thread", start, numRecs);
+
+    start = Now();
+    if ((rc = ScanParallel(fh, RM_Predicate(INT, sizeof(int),
+                                            offsetof(BenchRec, num), LT_OP,
+                                            &tenth), 0, count)))
+        goto err;
+    Report("parallel scan, all CPUs", start, numRecs);
+
+    // 1% of the records, which were inserted in the order of num
+    start = Now();
+    if ((rc = ScanBatches(fh, RM_Predicate::Between(INT, sizeof(int),
+                              offsetof(BenchRec, num), &tenth, &rangeEnd),
+                          count)))
+        goto err;
+    Report("batch scan, 1% range", start, numRecs);
+
+    if ((rc = fh.AddZoneMap(INT, sizeof(int), offsetof(BenchRec, num))))
+        goto err;
+    start = Now();
+    if ((rc = ScanBatches(fh, RM_Predicate::Between(INT, sizeof(int),
+                              offsetof(BenchRec, num), &tenth, &rangeEnd),
+                          count)))
+        goto err;
+    Report("batch scan, 1% range, zoned", start, numRecs);
+
+    srand(1);
+    start = Now();
+    for (i = 0; i < numRecs; i++) {
+        int n = rand() % numRecs;
+        if ((rc = fh.GetRec(RID(n / fh.GetRecordPerPage(),
+                                n % fh.GetRecordPerPage()), rec)))
+            goto err;
+    }
+    Report("random fetch", start, numRecs);
+
+    // the odd records one at a time, the even ones a batch of RIDs at a
+    // time
+    start = Now();
+    for (i = 1; i < numRecs; i += 2)
+        if ((rc = fh.DeleteRec(RID(i / fh.GetRecordPerPage(),
+                                   i % fh.GetRecordPerPage()))))
+            goto err;
+    Report("delete", start, numRecs / 2);
+
+    start = Now();
+    for (i = 0; i < numRecs; i += 2 * BATCH) {
+        RID rids[BATCH];
+        for (count = 0; count < BATCH && i + 2 * count < numRecs; count++)
+            rids[count] = RID((i + 2 * count) / fh.GetRecordPerPage(),
+                              (i + 2 * count) % fh.GetRecordPerPage());
+        if ((rc = fh.DeleteRecs(rids, count)))
+            goto err;
+    }
+    Report("delete, batches", start, (numRecs + 1) / 2);
+
+    if ((rc = BenchCold(numRecs)))
+        goto err;
+    BenchKernels(fh.GetRecordPerPage());
+
+    if ((rc = rmm.CloseFile(fh)) ||
+        (rc = rmm.DestroyFile(FILENAME)))
+        goto err;
+    unlink(LOGNAME);
+    return (0);
+
+err:
+    PrintError(rc);
+    return (1);
+}
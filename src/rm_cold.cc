@@ -0,0 +1,455 @@
+//
+// rm_cold.cc
+//
+//   Cold pages of fixed-length records, see RM_FileHandle::Compress
+//
+// The segment of a virtual page on a cold page is its slot bitmap, then
+// its records a field at a time.  The fields are the 4-byte words of each
+// column (the whole record is one column unless the file has PAX pages),
+// the last of a column shorter if the column is, so a field never spans
+// columns and decodes straight into its place on the page.  In a file
+// with a schema the words of each attribute, and of the bytes between
+// attributes, are fields of their own.  The values
+// of a field across the records of the page are stored in the shortest
+// of:
+//
+//   RM_COLD_CONST - the one value they all have
+//   RM_COLD_FOR   - frame of reference: the smallest, and the difference
+//                   of each from it in as few bits as the largest needs
+//   RM_COLD_DICT  - up to RM_COLD_DICT_SIZE distinct values, and the
+//                   index of each in as few bits as their number needs
+//   RM_COLD_RAW   - the values as they are
+//
+// Integers close to each other take a few bits, and the words of strings
+// with few values an index.  Each encoding starts with a byte naming it.
+// Values are the words read little-endian, compared as signed.
+//
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include "rm.h"
+#include "rm_internal.h"
+#include "rm_logmanager.h"
+
+#define RM_COLD_CONST 0
+#define RM_COLD_FOR   1
+#define RM_COLD_DICT  2
+#define RM_COLD_RAW   3
+#define RM_COLD_DICT_SIZE 16 // most values of a dictionary
+
+// bits needed for values up to max
+static inline int coldBits(uint32_t max)
+{
+  return max ? 32 - __builtin_clz(max) : 0;
+}
+
+// append the low bits bits of each of n values to out
+static char *packBits(const uint32_t *v, int n, int bits, char *out)
+{
+  uint64_t acc = 0;
+  int have = 0;
+  for(int i = 0; i < n; ++i) {
+    acc |= uint64_t(v[i]) << have;
+    for(have += bits; have >= 8; have -= 8, acc >>= 8)
+      *out++ = char(acc);
+  }
+  if(have)
+    *out++ = char(acc);
+  return out;
+}
+
+static const char *unpackBits(const char *in, int n, int bits, uint32_t *v)
+{
+  uint64_t acc = 0, mask = (uint64_t(1) << bits) - 1;
+  int have = 0;
+  for(int i = 0; i < n; ++i) {
+    for(; have < bits; have += 8)
+      acc |= uint64_t((unsigned char)*in++) << have;
+    v[i] = uint32_t(acc & mask);
+    acc >>= bits;
+    have -= bits;
+  }
+  return in;
+}
+
+// Encode the n values of a field, width bytes each, at out; NULL if they
+// take more than room bytes
+static char *encodeField(const uint32_t *v, int n, int width, char *out,
+                         int room)
+{
+  int32_t lo = int32_t(v[0]), hi = lo;
+  uint32_t dict[RM_COLD_DICT_SIZE];
+  int k = 0;  // distinct values, RM_COLD_DICT_SIZE + 1 once too many
+  for(int i = 0; i < n; ++i) {
+    if(int32_t(v[i]) < lo)
+      lo = int32_t(v[i]);
+    if(int32_t(v[i]) > hi)
+      hi = int32_t(v[i]);
+    if(k > RM_COLD_DICT_SIZE)
+      continue;
+    int j = 0;
+    while(j < k && dict[j] != v[i])
+      ++j;
+    if(j == k && k++ < RM_COLD_DICT_SIZE)
+      dict[j] = v[i];
+  }
+
+  int forBits = coldBits(uint32_t(hi) - uint32_t(lo));
+  int dictBits = k <= RM_COLD_DICT_SIZE ? coldBits(k - 1) : 32;
+  int forSize = 1 + sizeof(int32_t) + 1 + (n * forBits + 7) / 8;
+  int dictSize = k <= RM_COLD_DICT_SIZE ?
+                 2 + k * width + (n * dictBits + 7) / 8 : room + 1;
+  int rawSize = 1 + n * width;
+  int size = forBits == 0 ? 1 + width : min(rawSize, min(forSize, dictSize));
+  if(size > room)
+    return NULL;
+
+  if(forBits == 0) {
+    *out++ = RM_COLD_CONST;
+    memcpy(out, &v[0], width);
+    return out + width;
+  }
+  if(size == rawSize) {
+    *out++ = RM_COLD_RAW;
+    for(int i = 0; i < n; ++i, out += width)
+      memcpy(out, &v[i], width);
+    return out;
+  }
+  uint32_t codes[RM_BITMAP_WORDS * 64];
+  if(size == forSize) {
+    *out++ = RM_COLD_FOR;
+    memcpy(out, &lo, sizeof(int32_t));
+    out += sizeof(int32_t);
+    *out++ = char(forBits);
+    for(int i = 0; i < n; ++i)
+      codes[i] = v[i] - uint32_t(lo);
+    return packBits(codes, n, forBits, out);
+  }
+  *out++ = RM_COLD_DICT;
+  *out++ = char(k);
+  for(int j = 0; j < k; ++j, out += width)
+    memcpy(out, &dict[j], width);
+  for(int i = 0; i < n; ++i) {
+    int j = 0;
+    while(dict[j] != v[i])
+      ++j;
+    codes[i] = j;
+  }
+  return packBits(codes, n, dictBits, out);
+}
+
+// Decode the n values of a field at in into v; returns the end of the
+// field
+static const char *decodeField(const char *in, int n, int width,
+                               uint32_t *v)
+{
+  uint32_t value = 0, dict[RM_COLD_DICT_SIZE];
+  int32_t lo;
+  int k;
+  switch(*in++) {
+  case RM_COLD_CONST:
+    memcpy(&value, in, width);
+    for(int i = 0; i < n; ++i)
+      v[i] = value;
+    return in + width;
+  case RM_COLD_FOR:
+    memcpy(&lo, in, sizeof(int32_t));
+    in += sizeof(int32_t);
+    in = unpackBits(in + 1, n, (unsigned char)*in, v);
+    for(int i = 0; i < n; ++i)
+      v[i] += uint32_t(lo);
+    return in;
+  case RM_COLD_DICT:
+    k = (unsigned char)*in++;
+    memset(dict, 0, sizeof(dict));
+    for(int j = 0; j < k; ++j, in += width)
+      memcpy(&dict[j], in, width);
+    in = unpackBits(in, n, coldBits(k - 1), v);
+    for(int i = 0; i < n; ++i)
+      v[i] = dict[v[i]];
+    return in;
+  default:
+    for(int i = 0; i < n; ++i, in += width) {
+      v[i] = 0;
+      memcpy(&v[i], in, width);
+    }
+    return in;
+  }
+}
+
+// bytes of the field at offset: up to 4, and not past stop or the next
+// of bounds
+static inline int fieldWidth(const vector<int> &bounds, int offset,
+                             int stop)
+{
+  vector<int>::const_iterator b = upper_bound(bounds.begin(), bounds.end(),
+                                              offset);
+  if(b != bounds.end() && *b < stop)
+    stop = *b;
+  return min(4, stop - offset);
+}
+
+// The slots taken on a page, in order; returns their number
+static int takenSlots(const unsigned char *bitmap, int recordPerPage,
+                      int *slots)
+{
+  int n = 0;
+  for(int s = nextTakenSlot(bitmap, -1); s < recordPerPage;
+      s = nextTakenSlot(bitmap, s))
+    slots[n++] = s;
+  return n;
+}
+
+int coldEncode(const RM_FileRecPage *data, const vector<int> &columns,
+               const vector<int> &bounds, int recordSize, int recordPerPage,
+               char *out, int room)
+{
+  int slots[RM_BITMAP_WORDS * 64];
+  uint32_t v[RM_BITMAP_WORDS * 64];
+  int n = takenSlots(data->bitmap, recordPerPage, slots);
+  if(room < int(sizeof(data->bitmap)))
+    return -1;
+  char *p = out, *end = out + room;
+  memcpy(p, data->bitmap, sizeof(data->bitmap));
+  p += sizeof(data->bitmap);
+  if(n == 0)
+    return int(p - out);
+
+  int numColumns = columns.empty() ? 1 : int(columns.size());
+  for(int c = 0; c < numColumns; ++c) {
+    int start = columns.empty() ? 0 : columns[c];
+    int stop = c + 1 < numColumns ? columns[c + 1] : recordSize;
+    int stride = stop - start;
+    for(int offset = start, width; offset < stop; offset += width) {
+      width = fieldWidth(bounds, offset, stop);
+      const char *field = data->data + recordPerPage * start
+                          + offset - start;
+      for(int i = 0; i < n; ++i) {
+        v[i] = 0;
+        memcpy(&v[i], field + slots[i] * stride, width);
+      }
+      if(!(p = encodeField(v, n, width, p, int(end - p))))
+        return -1;
+    }
+  }
+  return int(p - out);
+}
+
+void coldDecode(const RM_ColdPage *page, int i, const vector<int> &columns,
+                const vector<int> &bounds, int recordSize, int recordPerPage,
+                RM_FileRecPage *out)
+{
+  int slots[RM_BITMAP_WORDS * 64];
+  uint32_t v[RM_BITMAP_WORDS * 64];
+  const char *p = page->data + (i ? page->ends[i - 1] : 0);
+  memset(out, 0, sizeof(RM_FileRecPage));
+  memcpy(out->bitmap, p, sizeof(out->bitmap));
+  p += sizeof(out->bitmap);
+  out->pageLSN = RM_COLD_LSN;
+  int n = takenSlots(out->bitmap, recordPerPage, slots);
+  if(n == 0)
+    return;
+
+  int numColumns = columns.empty() ? 1 : int(columns.size());
+  for(int c = 0; c < numColumns; ++c) {
+    int start = columns.empty() ? 0 : columns[c];
+    int stop = c + 1 < numColumns ? columns[c + 1] : recordSize;
+    int stride = stop - start;
+    for(int offset = start, width; offset < stop; offset += width) {
+      width = fieldWidth(bounds, offset, stop);
+      char *field = out->data + recordPerPage * start + offset - start;
+      p = decodeField(p, n, width, v);
+      if(width == 4)
+        for(int j = 0; j < n; ++j)
+          memcpy(field + slots[j] * stride, &v[j], 4);
+      else
+        for(int j = 0; j < n; ++j)
+          memcpy(field + slots[j] * stride, &v[j], width);
+    }
+  }
+}
+
+// The records of vPage, from the pinned page pageData the directory
+// points to: the page itself, or a copy decoded from a cold page.  The
+// copy is kept until another page is decoded, and is marked with
+// RM_COLD_LSN too.
+RM_FileRecPage *RM_FileHandle::rec_page(int vPage, char *pageData) const
+{
+  RM_FileRecPage *data = (RM_FileRecPage *)pageData;
+  if(data->pageLSN != RM_COLD_LSN)
+    return data;
+  if(coldVPage != vPage) {
+    const RM_ColdPage *cold = (const RM_ColdPage *)pageData;
+    coldBuf.resize(sizeof(RM_FileRecPage));
+    coldDecode(cold, vPage - cold->firstPage, columns, attrBounds,
+               recordSize, recordPerPage, (RM_FileRecPage *)&coldBuf[0]);
+    coldVPage = vPage;
+  }
+  return (RM_FileRecPage *)&coldBuf[0];
+}
+
+// Give vPage a record page again, a copy of data, its records decoded
+// from the cold page pageNum.  The new page is logged whole, so recovery
+// points the directory at it and writes it without reading the cold
+// page.  The cold page is unpinned, and pageNum and data are set to the
+// new page, pinned.
+RC RM_FileHandle::thaw(int vPage, PageNum &pageNum, RM_FileRecPage *&data)
+{
+  PF_PageHandle pageHdl;
+  PageNum newPage;
+  RM_FileRecPage *page;
+  LSN lsn;
+  RC r = pfh_.AllocatePage(pageHdl);
+  pfh_.UnpinPage(pageNum);
+  if(r)
+    return r;
+  pageHdl.GetPageNum(newPage);
+  pageHdl.GetData((char *&)page);
+  memcpy(page, data, PF_PAGE_SIZE);
+  page->pageLSN = 0;
+  coldVPage = -1;
+  if((r = log_rec(RM_LOG_THAW, vPage, newPage, 0, (char *)page, NULL, lsn,
+                  PF_PAGE_SIZE, 0, 0))
+     || (r = set_page(vPage, newPage, lsn))
+     || (r = page_changed(vPage, 0, page_free((char *)page), lsn))) {
+    pfh_.UnpinPage(newPage);
+    return r;
+  }
+  page->pageLSN = lsn;
+  pfh_.MarkDirty(newPage, lsn);
+  pageNum = newPage;
+  data = page;
+  return OK_RC;
+}
+
+// Write the cold page filled in cold to a new PF page, chained after
+// chain, note it in newPages for its virtual pages, and empty cold
+RC RM_FileHandle::cold_write(vector<char> &cold, vector<PageNum> &newPages,
+                             PageNum &chain)
+{
+  RM_ColdPage *page = (RM_ColdPage *)&cold[0];
+  PF_PageHandle pageHdl;
+  PageNum pageNum;
+  char *pageData;
+  RC r;
+  if((r = pfh_.AllocatePage(pageHdl)))
+    return r;
+  pageHdl.GetPageNum(pageNum);
+  pageHdl.GetData(pageData);
+  page->nextCold = chain;
+  page->pageLSN = RM_COLD_LSN;
+  memcpy(pageData, page, PF_PAGE_SIZE);
+  pfh_.MarkDirty(pageNum);
+  pfh_.UnpinPage(pageNum);
+  for(int i = 0; i < page->numPages; ++i)
+    newPages[page->firstPage + i] = pageNum;
+  chain = pageNum;
+  page->numPages = 0;
+  return OK_RC;
+}
+
+// Compress starts from a clean point, as drop_pages does, and writes
+// the cold pages to new PF pages before anything else changes.  The
+// directory is then pointed at them, and only once that is on disk are
+// the pages they replace disposed of, with the cold pages of the last
+// Compress.  A crash on the way leaves every virtual page on a page that
+// holds its records.  Pages already cold are encoded again, so that cold
+// pages left with few virtual pages on them are merged.
+RC RM_FileHandle::Compress()
+{
+  if(!fileOpen_)
+    return RM_NOT_OPEN_FILE;
+  if(varLength)
+    return RM_COMPRESS_VAR_LENGTH;
+
+  PF_PageHandle pageHdl;
+  RM_FileHeaderPage *hdr;
+  RC r;
+  if((r = Commit()) || (r = pfh_.ForcePages()) || (r = pfh_.Sync())
+     || (r = log_->Truncate()))
+    return r;
+
+  vector<PageNum> oldPages;
+  if((r = pfh_.GetThisPage(RM_HEADER_PAGE, pageHdl))
+     || (r = pageHdl.GetData((char *&)hdr)))
+    return r;
+  PageNum chain = hdr->firstCold;
+  pfh_.UnpinPage(RM_HEADER_PAGE);
+  while(chain != END_PAGE_LIST) {
+    RM_ColdPage *page;
+    if((r = pfh_.GetThisPage(chain, pageHdl))
+       || (r = pageHdl.GetData((char *&)page)))
+      return r;
+    oldPages.push_back(chain);
+    PageNum next = page->nextCold;
+    pfh_.UnpinPage(chain);
+    chain = next;
+  }
+
+  // consecutive virtual pages that encode to half a page go on a cold
+  // page until it is full.  A page already cold fits again.
+  vector<char> cold(PF_PAGE_SIZE), seg(RM_COLD_ROOM);
+  RM_ColdPage *page = (RM_ColdPage *)&cold[0];
+  vector<PageNum> newPages(totalPage, -1);
+  for(int vPage = 0; vPage < totalPage && !r; ++vPage) {
+    PageNum pageNum;
+    char *pageData;
+    if((r = page_of(vPage, pageNum))
+       || (r = pfh_.GetThisPage(pageNum, pageHdl)))
+      break;
+    pageHdl.GetData(pageData);
+    bool wasCold = ((RM_FileRecPage *)pageData)->pageLSN == RM_COLD_LSN;
+    int len = coldEncode(rec_page(vPage, pageData), columns, attrBounds,
+                         recordSize, recordPerPage, &seg[0],
+                         wasCold ? RM_COLD_ROOM : RM_COLD_ROOM / 2);
+    assert(len >= 0 || !wasCold);
+    int used = page->numPages ? page->ends[page->numPages - 1] : 0;
+    if(page->numPages > 0
+       && (len < 0 || page->numPages == RM_COLD_MAX_PAGES
+           || used + len > RM_COLD_ROOM)) {
+      r = cold_write(cold, newPages, chain);
+      used = 0;
+    }
+    if(!r && len >= 0) {
+      if(page->numPages == 0)
+        page->firstPage = vPage;
+      memcpy(page->data + used, &seg[0], len);
+      page->ends[page->numPages++] = (unsigned short)(used + len);
+      oldPages.push_back(pageNum);
+    }
+    pfh_.UnpinPage(pageNum);
+  }
+  if(!r && page->numPages > 0)
+    r = cold_write(cold, newPages, chain);
+  if(r || (r = pfh_.ForcePages()) || (r = pfh_.Sync()))
+    return r;
+
+  // cold pages have no room for inserts; the free-space map is found
+  // again from the directory
+  for(int vPage = 0; vPage < totalPage; ++vPage)
+    if(newPages[vPage] >= 0
+       && ((r = set_page(vPage, newPages[vPage], 0))
+           || (r = set_free_slots(vPage, 0, 0))))
+      return r;
+  if((r = pfh_.GetThisPage(RM_HEADER_PAGE, pageHdl))
+     || (r = pageHdl.GetData((char *&)hdr)))
+    return r;
+  hdr->firstCold = chain;
+  pfh_.MarkDirty(RM_HEADER_PAGE);
+  pfh_.UnpinPage(RM_HEADER_PAGE);
+  fsm_clear();
+  freeCursor = freeHint;
+  coldVPage = -1;
+  if((r = pfh_.ForcePages()) || (r = pfh_.Sync()))
+    return r;
+
+  sort(oldPages.begin(), oldPages.end());
+  oldPages.erase(unique(oldPages.begin(), oldPages.end()), oldPages.end());
+  for(size_t i = 0; i < oldPages.size(); ++i)
+    if((r = pfh_.DisposePage(oldPages[i])))
+      return r;
+  if((r = pfh_.ForcePages()) || (r = pfh_.Sync()))
+    return r;
+  return OK_RC;
+}
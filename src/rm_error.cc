@@ -15,20 +15,46 @@ static char *RM_RecordManagerMsg[] = {
   (char *)"open file with a file handler already opened a file",
   (char *)"close file with a file handler already closed",
   (char *)"creating file, but header page has error",
-  (char *)"header page error when opening the file"
+  (char *)"header page error when opening the file",
+  (char *)"column lengths must add up to the record size",
+  (char *)"schema attributes need unique names, valid types and no overlap",
+  (char *)"no attribute of that name in the schema of the file",
+  (char *)"the file is already open through another file handle"
 };
 
 static char *RM_FileHandleMsg[] = {
   (char *)"file handler did not open file",
   (char *)"the record does not exist",
-  (char *)"record length does not match"
+  (char *)"record length does not match",
+  (char *)"fill factor must be between 1 and 100",
+  (char *)"inline prefix must be between 0 and a quarter page",
+  (char *)"record cursor is not open",
+  (char *)"offset is past the end of the record",
+  (char *)"zone maps need an attribute of fixed-length records",
+  (char *)"only files of fixed-length records can be compacted",
+  (char *)"only files of fixed-length records can be compressed"
 };
 
 static char *RM_FileScanMsg[] = {
   (char *)"end of file scan",
   (char *)"file scan is not open",
   (char *)"reopen file scan while it is already opened",
-  (char *)"need to have some values for scan"
+  (char *)"need to have some values for scan",
+  (char *)"batch must hold at least one record",
+  (char *)"projected attribute outside of the record",
+  (char *)"parallel scans need fixed-length records",
+  (char *)"a record got through a projection cannot be updated"
+};
+
+static char *RM_LogMsg[] = {
+  (char *)"write-ahead log read or write failed",
+  (char *)"write-ahead log does not match the file, recovery failed"
+};
+
+static char *RM_LoadMsg[] = {
+  (char *)"cannot read the file to load",
+  (char *)"row to load is malformed or does not fit the record",
+  (char *)"attribute to load is outside of the record"
 };
 
 void RM_PrintError(RC rc)
@@ -39,6 +65,10 @@ void RM_PrintError(RC rc)
     cerr << "RM error: "<<RM_FileHandleMsg[rc - 11] << endl;
   else if ( rc >= 21 && rc <= RM_SCAN_ERROR_END)
     cerr << "RM error: "<<RM_FileScanMsg[rc-21] << endl; 
+  else if ( rc >= 31 && rc <= RM_LOG_ERROR_END)
+    cerr << "RM error: "<<RM_LogMsg[rc-31] << endl;
+  else if ( rc >= 41 && rc <= RM_LOAD_ERROR_END)
+    cerr << "RM error: "<<RM_LoadMsg[rc-41] << endl;
   else if ( rc == 0 )
     cerr << "RM_PrintError called with return code of 0\n";
   else
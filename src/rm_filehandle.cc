@@ -2,20 +2,24 @@
 #include <cstdio>
 #include "rm.h"
 #include "rm_internal.h"
+#include "rm_logmanager.h"
 #include <cstring>
 #include <cassert>
+#include <algorithm>
 #include <iostream>
 using namespace std;
 
 RM_FileHandle::RM_FileHandle  ()
 {
   fileOpen_ = false;
+  log_ = NULL;
+  checkpointLSN = 0;
+  checkpointInterval = RM_CHECKPOINT_INTERVAL;
+  coldVPage = -1;
 }
 
 RM_FileHandle::~RM_FileHandle  ()
 {
-  totalPageList.clear();
-  emptyPageList.clear();
 }
 
 RC RM_FileHandle::check_record_exist(const RID & rid, PageNum &pageNum,
@@ -27,12 +31,18 @@ RC RM_FileHandle::check_record_exist(const RID & rid, PageNum &pageNum,
     || slotNum >= recordPerPage ) {
     return RM_REC_NO_EXIST;
   }
-  actualPageNum = totalPageList[pageNum];
+  RC r = page_of(pageNum, actualPageNum);
+  if(r)
+    return r;
   PF_PageHandle pageHdl;
   pfh_.GetThisPage(actualPageNum, pageHdl);
   pageHdl.GetData((char * &) data);
 
-  if(!slotTaken((struct RM_FileRecPage *)data, slotNum)) {
+  // a moved record is only reached through the RID of its stub
+  if(varLength ? !varSlotUsed((RM_VarRecPage *)data, slotNum)
+                 || (varSlot((RM_VarRecPage *)data, slotNum)->length
+                     & RM_VAR_MOVED)
+               : !slotTaken(rec_page(pageNum, data), slotNum)) {
     pfh_.UnpinPage(actualPageNum);
     return RM_REC_NO_EXIST;
   } else 
@@ -40,7 +50,442 @@ RC RM_FileHandle::check_record_exist(const RID & rid, PageNum &pageNum,
 
 }
 
+//
+// Page directory
+//
+
+// directory chunk of a virtual page, and the first virtual page of a
+// chunk
+static inline int chunk_of(int vPage)
+{
+  if(vPage < int(HEADER_LIST_SIZE))
+    return 0;
+  return 1 + (vPage - HEADER_LIST_SIZE) / PAGE_DIR_LIST_SIZE;
+}
+
+static inline int chunk_base(int chunk)
+{
+  if(chunk == 0)
+    return 0;
+  return HEADER_LIST_SIZE + (chunk - 1) * PAGE_DIR_LIST_SIZE;
+}
+
+static inline int chunk_size(int chunk)
+{
+  return chunk == 0 ? HEADER_LIST_SIZE : PAGE_DIR_LIST_SIZE;
+}
+
+static RM_PageDirEntry *page_dir_entry(char *pageData, int vPage)
+{
+  if(vPage < int(HEADER_LIST_SIZE))
+    return &((RM_FileHeaderPage *)pageData)->pageList[vPage];
+  return &((RM_FilePageDirPage *)pageData)->data[
+    (vPage - HEADER_LIST_SIZE) % PAGE_DIR_LIST_SIZE];
+}
+
+// set up the directory from the header page, nothing else is read
+RC RM_FileHandle::init_directory(const void *hdrPage)
+{
+  const RM_FileHeaderPage *hdr = (const RM_FileHeaderPage *)hdrPage;
+  totalPage = hdr->totalPage;
+  dirPages.assign(hdr->numPageDir, -1);
+  for(int i = 0; i < hdr->numPageDir && i < RM_DIR_INDEX_SIZE; ++i)
+    dirPages[i] = hdr->pageDirIndex[i];
+  pageChunks.assign(hdr->numPageDir + 1, vector<PageNum>());
+  chunkLoaded.assign(hdr->numPageDir + 1, false);
+  fillFactor = hdr->fillFactor;
+  reserve = pageSpace - (pageSpace * fillFactor + 99) / 100;
+  freeOverflow = hdr->freeOverflow;
+  inlinePrefix = hdr->inlinePrefix;
+  fsm_clear();
+  freeHint = freeCursor = hdr->freeHint;
+  coldVPage = -1;
+  return OK_RC;
+}
+
+// find the page holding a chunk.  Directory pages past the index of the
+// header are found by following the chain from the last known one.
+RC RM_FileHandle::dir_page(int chunk, PageNum &dirPage) const
+{
+  if(chunk == 0) {
+    dirPage = RM_HEADER_PAGE;
+    return OK_RC;
+  }
+  int d = chunk - 1;
+  int known = d;
+  while(dirPages[known] < 0)
+    --known;
+  while(known < d) {
+    PF_PageHandle page;
+    RM_FilePageDirPage *dir;
+    RC r;
+    if((r = pfh_.GetThisPage(dirPages[known], page))
+       || (r = page.GetData((char *&)dir)))
+      return r;
+    dirPages[known + 1] = dir->nextPageDir;
+    pfh_.UnpinPage(dirPages[known]);
+    ++known;
+  }
+  dirPage = dirPages[d];
+  return OK_RC;
+}
+
+// read the page numbers of a chunk
+RC RM_FileHandle::load_chunk(int chunk) const
+{
+  PageNum dirPage;
+  char *pageData;
+  PF_PageHandle page;
+  RC r;
+  if((r = dir_page(chunk, dirPage)) || (r = pfh_.GetThisPage(dirPage, page))
+     || (r = page.GetData(pageData)))
+    return r;
+  int base = chunk_base(chunk);
+  int n = totalPage - base;
+  if(n > chunk_size(chunk))
+    n = chunk_size(chunk);
+  vector<PageNum> &pages = pageChunks[chunk];
+  pages.resize(n > 0 ? n : 0);
+  for(int i = 0; i < n; ++i)
+    pages[i] = page_dir_entry(pageData, base + i)->pageNum;
+  chunkLoaded[chunk] = true;
+  return pfh_.UnpinPage(dirPage);
+}
+
+// the actual page number of a virtual page
+RC RM_FileHandle::page_of(int vPage, PageNum &pageNum) const
+{
+  if(vPage < 0 || vPage >= totalPage)
+    return RM_REC_NO_EXIST;
+  int chunk = chunk_of(vPage);
+  RC r;
+  if(!chunkLoaded[chunk] && (r = load_chunk(chunk)))
+    return r;
+  pageNum = pageChunks[chunk][vPage - chunk_base(chunk)];
+  return OK_RC;
+}
+
+// The directory is not logged, recovery rebuilds what the log touched.
+// Its pages are marked dirty with the LSN of the change they reflect so
+// they never reach the disk ahead of the log.
+
+// pin the page holding the directory entry of vPage
+RC RM_FileHandle::dir_entry(int vPage, PageNum &dirPage, char *&pageData)
+  const
+{
+  PF_PageHandle page;
+  RC r;
+  if((r = dir_page(chunk_of(vPage), dirPage))
+     || (r = pfh_.GetThisPage(dirPage, page)) || (r = page.GetData(pageData)))
+    return r;
+  return OK_RC;
+}
+
+RC RM_FileHandle::set_free_slots(int vPage, int freeSlots, LSN lsn)
+{
+  PageNum dirPage;
+  char *pageData;
+  RC r = dir_entry(vPage, dirPage, pageData);
+  if(r)
+    return r;
+  page_dir_entry(pageData, vPage)->freeSlots = freeSlots;
+  pfh_.MarkDirty(dirPage, lsn);
+  return pfh_.UnpinPage(dirPage);
+}
+
+// point the directory entry of vPage at pageNum
+RC RM_FileHandle::set_page(int vPage, PageNum pageNum, LSN lsn)
+{
+  int chunk = chunk_of(vPage);
+  PageNum dirPage;
+  char *pageData;
+  RC r;
+  if((!chunkLoaded[chunk] && (r = load_chunk(chunk)))
+     || (r = dir_entry(vPage, dirPage, pageData)))
+    return r;
+  page_dir_entry(pageData, vPage)->pageNum = pageNum;
+  pfh_.MarkDirty(dirPage, lsn);
+  pfh_.UnpinPage(dirPage);
+  pageChunks[chunk][vPage - chunk_base(chunk)] = pageNum;
+  return OK_RC;
+}
+
+RC RM_FileHandle::set_free_hint(int vPage, LSN lsn)
+{
+  PF_PageHandle page;
+  RM_FileHeaderPage *hdr;
+  RC r;
+  if(vPage == freeHint)
+    return OK_RC;
+  if((r = pfh_.GetThisPage(RM_HEADER_PAGE, page))
+     || (r = page.GetData((char *&)hdr)))
+    return r;
+  hdr->freeHint = freeHint = vPage;
+  pfh_.MarkDirty(RM_HEADER_PAGE, lsn);
+  return pfh_.UnpinPage(RM_HEADER_PAGE);
+}
+
+RC RM_FileHandle::set_free_overflow(PageNum head, LSN lsn)
+{
+  PF_PageHandle page;
+  RM_FileHeaderPage *hdr;
+  RC r;
+  if((r = pfh_.GetThisPage(RM_HEADER_PAGE, page))
+     || (r = page.GetData((char *&)hdr)))
+    return r;
+  hdr->freeOverflow = freeOverflow = head;
+  pfh_.MarkDirty(RM_HEADER_PAGE, lsn);
+  return pfh_.UnpinPage(RM_HEADER_PAGE);
+}
+
+//
+// Free-space map
+//
+
+// tier of a page with freeSlots free slots (bytes), 0 is the fullest
+int RM_FileHandle::free_tier(int freeSlots) const
+{
+  return (freeSlots - 1) * RM_FSM_TIERS / pageSpace;
+}
+
+// lowest tier whose pages all have room for need more slots (bytes) on
+// top of the reserve, RM_FSM_TIERS if there is none
+int RM_FileHandle::fit_tier(int need) const
+{
+  if(need <= 1)
+    return 0;
+  int tier = free_tier(need + reserve) + 1;
+  return tier < RM_FSM_TIERS ? tier : RM_FSM_TIERS;
+}
+
+// the fullest page from tier minTier up
+bool RM_FileHandle::fsm_find(int minTier, int &vPage) const
+{
+  for(int tier = minTier; tier < RM_FSM_TIERS; ++tier)
+    if(!freeTiers[tier].empty()) {
+      vPage = *freeTiers[tier].begin();
+      return true;
+    }
+  return false;
+}
+
+// a page below freeCursor went from oldFree to newFree free slots; it is
+// in the map while it has room for inserts
+void RM_FileHandle::fsm_update(int vPage, int oldFree, int newFree)
+{
+  if(oldFree > reserve)
+    totalEmptyPage -= freeTiers[free_tier(oldFree)].erase(vPage);
+  if(newFree > reserve)
+    totalEmptyPage += freeTiers[free_tier(newFree)].insert(vPage).second;
+}
+
+void RM_FileHandle::fsm_clear()
+{
+  freeTiers.assign(RM_FSM_TIERS, set<int>());
+  totalEmptyPage = 0;
+}
+
+// look for pages with room from freeCursor on, one directory page at a
+// time, until one from tier minTier up is found
+RC RM_FileHandle::scan_free(int minTier)
+{
+  int vPage;
+  while(freeCursor < totalPage && !fsm_find(minTier, vPage)) {
+    int chunk = chunk_of(freeCursor);
+    int end = chunk_base(chunk) + chunk_size(chunk);
+    if(end > totalPage)
+      end = totalPage;
+    PageNum dirPage;
+    char *pageData;
+    RC r = dir_entry(freeCursor, dirPage, pageData);
+    if(r)
+      return r;
+    for(; freeCursor < end; ++freeCursor)
+      fsm_update(freeCursor, 0, page_dir_entry(pageData, freeCursor)->freeSlots);
+    pfh_.UnpinPage(dirPage);
+  }
+  return OK_RC;
+}
+
+// does the entry of the next new page need a new directory page
+bool RM_FileHandle::need_dir_page() const
+{
+  return totalPage >= int(HEADER_LIST_SIZE
+                          + dirPages.size() * PAGE_DIR_LIST_SIZE);
+}
+
+// add pageNum, an empty record page, as virtual page totalPage
+RC RM_FileHandle::append_page(PageNum pageNum, LSN lsn)
+{
+  int vPage = totalPage;
+  int chunk = chunk_of(vPage);
+  PageNum dirPage;
+  char *pageData;
+  PF_PageHandle page;
+  RM_FileHeaderPage *hdr;
+  RC r;
+
+  if((!chunkLoaded[chunk] && (r = load_chunk(chunk)))
+     || (r = dir_entry(vPage, dirPage, pageData)))
+    return r;
+  RM_PageDirEntry *entry = page_dir_entry(pageData, vPage);
+  entry->pageNum = pageNum;
+  entry->freeSlots = pageSpace;
+  if(chunk > 0)
+    ((RM_FilePageDirPage *)pageData)->pageListSize =
+      vPage - chunk_base(chunk) + 1;
+  pfh_.MarkDirty(dirPage, lsn);
+  pfh_.UnpinPage(dirPage);
+
+  if((r = pfh_.GetThisPage(RM_HEADER_PAGE, page))
+     || (r = page.GetData((char *&)hdr)))
+    return r;
+  hdr->totalPage = vPage + 1;
+  pfh_.MarkDirty(RM_HEADER_PAGE, lsn);
+  pfh_.UnpinPage(RM_HEADER_PAGE);
+
+  pageChunks[chunk].push_back(pageNum);
+  ++totalPage;
+  return OK_RC;
+}
+
+// link dirPage, a newly allocated page, at the end of the directory
+RC RM_FileHandle::append_dir_page(PageNum dirPage, LSN lsn)
+{
+  PF_PageHandle page;
+  RM_FileHeaderPage *hdr;
+  RM_FilePageDirPage *dir;
+  RC r;
+
+  if((r = pfh_.GetThisPage(dirPage, page)) || (r = page.GetData((char *&)dir)))
+    return r;
+  dir->pageListSize = 0;
+  dir->nextPageDir = END_PAGE_LIST;
+  pfh_.MarkDirty(dirPage, lsn);
+  pfh_.UnpinPage(dirPage);
+
+  int d = dirPages.size();
+  if(d > 0) {
+    PageNum prev;
+    if((r = dir_page(d, prev)) || (r = pfh_.GetThisPage(prev, page))
+       || (r = page.GetData((char *&)dir)))
+      return r;
+    dir->nextPageDir = dirPage;
+    pfh_.MarkDirty(prev, lsn);
+    pfh_.UnpinPage(prev);
+  }
+
+  if((r = pfh_.GetThisPage(RM_HEADER_PAGE, page))
+     || (r = page.GetData((char *&)hdr)))
+    return r;
+  if(d == 0)
+    hdr->nextPageDir = dirPage;
+  if(d < RM_DIR_INDEX_SIZE)
+    hdr->pageDirIndex[d] = dirPage;
+  hdr->lastPageDir = dirPage;
+  hdr->numPageDir = d + 1;
+  pfh_.MarkDirty(RM_HEADER_PAGE, lsn);
+  pfh_.UnpinPage(RM_HEADER_PAGE);
+
+  dirPages.push_back(dirPage);
+  pageChunks.push_back(vector<PageNum>());
+  chunkLoaded.push_back(true);
+  return OK_RC;
+}
+
+// take a checkpoint once enough log was written since the last one.
+// Only called between operations, when every logged change is already
+// on a page marked dirty with its LSN.
+RC RM_FileHandle::auto_checkpoint()
+{
+  if(checkpointInterval <= 0
+     || log_->GetEndLSN() - checkpointLSN < checkpointInterval)
+    return OK_RC;
+  return Checkpoint();
+}
+
+// append a record to the write-ahead log, lsn is set to its LSN
+RC RM_FileHandle::log_rec(int type, int vPage, PageNum pageNum,
+                          SlotNum slotNum, const char *image1,
+                          const char *image2, LSN &lsn, int len1,
+                          int flags1, int len2, int flags2)
+{
+  RM_LogRec rec;
+  memset(&rec, 0, sizeof(RM_LogRec));
+  rec.type = type;
+  rec.vPage = vPage;
+  rec.pageNum = pageNum;
+  rec.slotNum = slotNum;
+  rec.imageLen = len1 < 0 ? recordSize : len1;
+  rec.image2Len = len2 < 0 ? recordSize : len2;
+  rec.flags1 = flags1;
+  rec.flags2 = flags2;
+  RC r = log_->Append(rec, image1, image2);
+  lsn = rec.lsn;
+  return r;
+}
+
+// free slots of a record page, free bytes if varLength
+int RM_FileHandle::page_free(const char *pageData) const
+{
+  if(varLength)
+    return varFreeBytes((const RM_VarRecPage *)pageData);
+  return recordPerPage - countTaken((RM_FileRecPage *)pageData,
+                                    recordPerPage);
+}
+
+// the free space of vPage went from oldFree to newFree by the change
+// logged at lsn: bring the free-space map, the directory and the free
+// hint up to date
+RC RM_FileHandle::page_changed(int vPage, int oldFree, int newFree, LSN lsn)
+{
+  RC r;
+  // pages from freeCursor on are found by scan_free later
+  if(vPage < freeCursor)
+    fsm_update(vPage, oldFree, newFree);
+  if(newFree != oldFree && (r = set_free_slots(vPage, newFree, lsn)))
+    return r;
+  if(newFree > reserve && vPage < freeHint)
+    return set_free_hint(vPage, lsn);
+  // every page before freeCursor is full now
+  if(!totalEmptyPage)
+    return set_free_hint(freeCursor, lsn);
+  return OK_RC;
+}
+
+// pin the page a stub points to; slotNum and pageData are set to the
+// moved record
+RC RM_FileHandle::var_target(const char *stubData, PageNum &pageNum,
+                             SlotNum &slotNum, char *&pageData) const
+{
+  RM_VarStub stub;
+  PF_PageHandle pageHdl;
+  RC r;
+  memcpy(&stub, stubData, sizeof(RM_VarStub));
+  if((r = page_of(stub.vPage, pageNum))
+     || (r = pfh_.GetThisPage(pageNum, pageHdl))
+     || (r = pageHdl.GetData(pageData)))
+    return r;
+  slotNum = stub.slotNum;
+  RM_VarRecPage *page = (RM_VarRecPage *)pageData;
+  if(!varSlotUsed(page, slotNum)
+     || !(varSlot(page, slotNum)->length & RM_VAR_MOVED)) {
+    pfh_.UnpinPage(pageNum);
+    return RM_LOG_CORRUPT;
+  }
+  return OK_RC;
+}
+
 RC RM_FileHandle::GetRec     (const RID &rid, RM_Record &rec) const
+{
+  RM_RecView view;
+  RC rc = GetRec(rid, view);
+  if(rc)
+    return rc;
+  return view.CopyTo(rec);
+}
+
+RC RM_FileHandle::GetRec     (const RID &rid, RM_RecView &view) const
 {
   if(!fileOpen_)
     return RM_NOT_OPEN_FILE;
@@ -48,74 +493,251 @@ RC RM_FileHandle::GetRec     (const RID &rid, RM_Record &rec) const
   SlotNum slotNum;
 
   struct RM_FileRecPage * data;
-  if(check_record_exist(rid, pageNum, slotNum, actualPageNum, (char * &)data)
-    == RM_REC_NO_EXIST)
-    return RM_REC_NO_EXIST;
+  RC rc = check_record_exist(rid, pageNum, slotNum, actualPageNum,
+                             (char * &)data);
+  if(rc)
+    return rc;
 
-  if(rec.data)
-    free(rec.data);
-  rec.data = (char *)malloc(sizeof(char) * recordSize);
-  memcpy(rec.data, & data->data[recordSize * slotNum], recordSize);
+  const char *recData;
+  int length = recordSize;
+  bool isLong = false;
+  if(!varLength)
+    recData = rec_view(rec_page(pageNum, (char *)data), slotNum, view);
+  else {
+    RM_VarRecPage *page = (RM_VarRecPage *)data;
+    RM_VarSlot *slot = varSlot(page, slotNum);
+    if(slot->length & RM_VAR_FORWARD) {
+      PageNum homePage = actualPageNum;
+      rc = var_target(page->data + slot->offset, actualPageNum, slotNum,
+                      (char *&)page);
+      pfh_.UnpinPage(homePage);
+      if(rc)
+        return rc;
+      slot = varSlot(page, slotNum);
+      data = (RM_FileRecPage *)page;
+    }
+    recData = page->data + slot->offset;
+    length = varRecLength(slot);
+    isLong = slot->length & RM_VAR_LONG;
+  }
 
-  pfh_.UnpinPage(actualPageNum);
+  view.hold(&pfh_, actualPageNum, (char *)data);
+  view.set(recData, length, isLong, rid);
   return OK_RC;
 }
 
 // Insert a new record
 RC RM_FileHandle::InsertRec  (const char *pData, RID &rid)       
+{
+  return InsertRec(pData, recordSize, rid);
+}
+
+RC RM_FileHandle::InsertRec  (const char *pData, int length, RID &rid)
 {
   if(!fileOpen_)
     return RM_NOT_OPEN_FILE;
+  if(varLength ? length < 0 || length > recordSize : length != recordSize)
+    return RM_REC_LEN_NO_MATCH;
+  RC r;
+  if(varLength && length > RM_VAR_MAX_INLINE) {
+    char inlineData[RM_VAR_MAX_INLINE];
+    int inlineLength;
+    if((r = write_long(pData, length, inlineData, inlineLength))
+       || (r = insert_rec(inlineData, inlineLength, RM_VAR_LONG, rid)))
+      return r;
+  } else if((r = insert_rec(pData, length, 0, rid)))
+    return r;
+  return auto_checkpoint();
+}
+
+// Insert numRecs records, recordSize apart at pData.  A page is pinned,
+// logged and put back once for all the records that go on it, a log
+// record covering each run of free slots filled.  Pages with room are
+// filled first; once none is left, pages are appended and filled whole
+// without going through the free-space map.
+RC RM_FileHandle::InsertRecs(const char *pData, int numRecs, RID *rids,
+                             const int *lengths)
+{
+  if(!fileOpen_)
+    return RM_NOT_OPEN_FILE;
+  RC r = OK_RC;
+  if(varLength) {
+    RID rid;
+    for(int i = 0; i < numRecs; ++i) {
+      if((r = InsertRec(pData + long(i) * recordSize,
+                        lengths ? lengths[i] : recordSize, rid)))
+        return r;
+      if(rids)
+        rids[i] = rid;
+    }
+    return OK_RC;
+  }
+
+  bool append = false;  // no page has room, add new ones
+  for(int done = 0; done < numRecs; ) {
+    PF_PageHandle pageHdl;
+    PageNum pageNum;
+    int vPage;
+    if(!append && !fsm_find(0, vPage)
+       && ((r = scan_free(0)) || !fsm_find(0, vPage))) {
+      if(r)
+        return r;
+      append = true;
+    }
+    if(append)
+      r = add_page(pageHdl, pageNum, vPage);
+    else if(!(r = page_of(vPage, pageNum)))
+      r = pfh_.GetThisPage(pageNum, pageHdl);
+    if(r)
+      return r;
+
+    RM_FileRecPage *data;
+    pageHdl.GetData((char *&)data);
+    int oldFree = page_free((char *)data);
+    int room = min(oldFree - reserve, numRecs - done);
+    LSN lsn;
+    for(SlotNum slotNum = -1; room > 0; ) {
+      findFirstEmptySlot(data, slotNum, slotNum + 1);
+      int n = 1;
+      while(n < room && slotNum + n < recordPerPage
+            && !slotTaken(data, slotNum + n))
+        ++n;
+      const char *recs = pData + long(done) * recordSize;
+      if((r = log_rec(RM_LOG_INSERTS, vPage, pageNum, slotNum, recs, NULL,
+                      lsn, n * recordSize))) {
+        pfh_.UnpinPage(pageNum);
+        return r;
+      }
+      if(columns.empty())
+        memcpy(&data->data[recordSize * slotNum], recs, n * recordSize);
+      for(int i = 0; i < n; ++i) {
+        if(!columns.empty())
+          rec_put(data, slotNum + i, recs + i * recordSize);
+        setEmptySlot(data, slotNum + i);
+        zone_widen(vPage, recs + i * recordSize);
+        if(rids)
+          rids[done + i] = RID(vPage, slotNum + i);
+      }
+      data->pageLSN = lsn;
+      // the first record marks it, redo of the page starts there
+      pfh_.MarkDirty(pageNum, lsn);
+      done += n;
+      room -= n;
+      slotNum += n - 1;
+    }
+
+    // a new page is not in the free-space map yet, page_changed adds it
+    // if it has room left
+    r = page_changed(vPage, oldFree, page_free((char *)data), lsn);
+    pfh_.UnpinPage(pageNum);
+    if(r || (r = auto_checkpoint()))
+      return r;
+  }
+  return OK_RC;
+}
+
+// Append a cleared record page to the file and return it pinned
+RC RM_FileHandle::add_page(PF_PageHandle &pageHdl, PageNum &pageNum,
+                           int &vPage)
+{
+  LSN lsn;
+  RC r;
+  // the entry of the new page may need a new directory page first.
+  // Recovery replays the allocations in the order they are logged.
+  if(need_dir_page()) {
+    PF_PageHandle dirHdl;
+    PageNum dirPage;
+    if((r = pfh_.AllocatePage(dirHdl)))
+      return r;
+    dirHdl.GetPageNum(dirPage);
+    pfh_.UnpinPage(dirPage);
+    if((r = log_rec(RM_LOG_NEWDIR, dirPages.size(), dirPage, 0, NULL, NULL,
+                    lsn)) || (r = append_dir_page(dirPage, lsn)))
+      return r;
+  }
+
+  if((r = pfh_.AllocatePage(pageHdl)))
+    return r;
+  pageHdl.GetPageNum(pageNum);
+  vPage = totalPage;
+
+  char * data;
+  pageHdl.GetData(data);
+  memset(data, 0, PF_PAGE_SIZE);
+  if((r = log_rec(RM_LOG_NEWPAGE, vPage, pageNum, 0, NULL, NULL, lsn))
+     || (r = append_page(pageNum, lsn))) {
+    pfh_.UnpinPage(pageNum);
+    return r;
+  }
+  // the page is not on disk yet, redo has to start from here
+  pfh_.MarkDirty(pageNum, lsn);
+  freeCursor = totalPage;
+  return OK_RC;
+}
 
+// insert a record with the given RM_VAR_ flags into the fullest page with
+// room for it
+RC RM_FileHandle::insert_rec(const char *pData, int length, int flags,
+                             RID &rid)
+{
   PF_PageHandle pageHdl;
   PageNum pageNum; //actual page number
   int pageIdx;
+  LSN lsn;
+  RC r;
 
-  if(!totalEmptyPage){
-    pfh_.AllocatePage(pageHdl);
-    pageHdl.GetPageNum(pageNum);
-    pageIdx = totalPage++;
-    emptyPageList.push_back(pageIdx); //empty list is just idx
-    totalEmptyPage = 1;
-    totalPageList.push_back(pageNum);
-    headerUpdate = true;
-
-    char * data;
-    pageHdl.GetData(data);
-    memset(data, 0, sizeof(struct RM_FileRecPage));
+  int need = varLength ? varSpace(length) + sizeof(RM_VarSlot) : 1;
+  int minTier = fit_tier(need);
+  if(!fsm_find(minTier, pageIdx)
+     && ((r = scan_free(minTier)) || !fsm_find(minTier, pageIdx))) {
+    if(r)
+      return r;
+    if((r = add_page(pageHdl, pageNum, pageIdx)))
+      return r;
+    fsm_update(pageIdx, 0, pageSpace);
   } else {
-    pageIdx = emptyPageList.front();
-    pageNum = totalPageList[pageIdx];
+    if((r = page_of(pageIdx, pageNum)))
+      return r;
     pfh_.GetThisPage(pageNum, pageHdl);
 //    cout << "insert on page with empty id "<< pageIdx << endl;
   }
 //  cout << "insert on page no "<< pageNum << endl;
   struct RM_FileRecPage * data;
   pageHdl.GetData((char *&)data);
+  int oldFree = page_free((char *)data);
 
   SlotNum slotNum;
-  assert(findFirstEmptySlot(data, slotNum));
-  setEmptySlot(data, slotNum);
+  if(varLength)
+    slotNum = varFindSlot((RM_VarRecPage *)data);
+  else {
+    bool found = findFirstEmptySlot(data, slotNum);
+    assert(found);
+    (void)found;
+  }
+  if((r = log_rec(RM_LOG_INSERT, pageIdx, pageNum, slotNum, pData, NULL,
+                  lsn, length, flags))) {
+    pfh_.UnpinPage(pageNum);
+    return r;
+  }
+  if(varLength) {
+    bool put = varPut((RM_VarRecPage *)data, slotNum, pData, length, flags);
+    assert(put);
+    (void)put;
+  } else {
+    setEmptySlot(data, slotNum);
+    rec_put(data, slotNum, pData);
+    zone_widen(pageIdx, pData);
+  }
 
 //  cout << "slot number "<< slotNum << ", page number "<< pageNum << endl;
   assert(slotNum < recordPerPage);
-
-  SlotNum nextSlotNum;
-  if(!findFirstEmptySlot(data, nextSlotNum, slotNum) 
-     || nextSlotNum >= recordPerPage){
-    emptyPageList.pop_front();
-    --totalEmptyPage;
-    headerUpdate = true;
-  }
- 
-  memcpy(& data->data[recordSize * slotNum], pData, recordSize);
-  
+  data->pageLSN = lsn;
   rid = RID(pageIdx, slotNum);
 
-  pfh_.MarkDirty(pageNum);
+  pfh_.MarkDirty(pageNum, lsn);
+  r = page_changed(pageIdx, oldFree, page_free((char *)data), lsn);
   pfh_.UnpinPage(pageNum);
-
-  return OK_RC;
+  return r;
 }
 
 // Delete a record
@@ -128,33 +750,94 @@ RC RM_FileHandle::DeleteRec  (const RID &rid)
 
   struct RM_FileRecPage * data;
 
-  if(check_record_exist(rid, pageNum, slotNum, actualPageNum, (char * &)data)
-    == RM_REC_NO_EXIST)
-    return RM_REC_NO_EXIST;
+  RC rc = check_record_exist(rid, pageNum, slotNum, actualPageNum,
+                             (char * &)data);
+  if(rc)
+    return rc;
+  if(varLength) {
+    rc = var_delete(pageNum, slotNum, actualPageNum, (char *)data);
+    pfh_.UnpinPage(actualPageNum);
+    return rc ? rc : auto_checkpoint();
+  }
 
-  //find if this is a full page, if so, this page become empty page
-  int i, j;
-  for(i = 0; i<bitmapSize; ++i) 
-    if(data->bitmap[i] != 0xff)
-      break;  
-  for(j = 0; j<8; ++j)
-    if( ((data->bitmap[i] >> j) & 1) == 0)
-      break;
-  SlotNum emptySlotNum = i * 8 + j;
+  data = rec_page(pageNum, (char *)data);
+  if(data->pageLSN == RM_COLD_LSN
+     && (rc = thaw(pageNum, actualPageNum, data)))
+    return rc;
+  LSN lsn;
+  char buf[DATA_ON_RECORD_PAGE];
+  RC r = log_rec(RM_LOG_DELETE, pageNum, actualPageNum, slotNum,
+                 rec_at(data, slotNum, buf), NULL, lsn);
+  if(r) {
+    pfh_.UnpinPage(actualPageNum);
+    return r;
+  }
 
-  i = slotNum / 8;
-  j = slotNum & 7;
+  int oldFree = page_free((char *)data);
+  int i = slotNum / 8;
+  int j = slotNum & 7;
   data->bitmap[i] ^= 1 << j; //change the jth bit
+  zone_page(pageNum, data);
 
-  if(emptySlotNum >= recordPerPage) {// this is a full page
-    emptyPageList.push_back(pageNum); //virtual page
-    ++totalEmptyPage;
-    headerUpdate = true;
-  }
-  pfh_.MarkDirty(actualPageNum);
+  data->pageLSN = lsn;
+  pfh_.MarkDirty(actualPageNum, lsn);
+  r = page_changed(pageNum, oldFree, page_free((char *)data), lsn);
   pfh_.UnpinPage(actualPageNum);
+  return r ? r : auto_checkpoint();
+}
 
-  return OK_RC;
+// delete the record in slot slotNum of the pinned page pageData, and the
+// record its stub points to
+RC RM_FileHandle::var_delete(PageNum pageNum, SlotNum slotNum,
+                             PageNum actualPageNum, char *pageData)
+{
+  RM_VarRecPage *page = (RM_VarRecPage *)pageData;
+  RM_VarSlot *slot = varSlot(page, slotNum);
+  LSN lsn;
+  int prefix;
+  RM_VarLong desc;
+  RC r;
+
+  if((r = var_long(pageData, slotNum, prefix, desc)))
+    return r;
+  if(slot->length & RM_VAR_FORWARD) {
+    PageNum target;
+    SlotNum targetSlot;
+    RM_VarRecPage *tpage;
+    RM_VarStub stub;
+    memcpy(&stub, page->data + slot->offset, sizeof(RM_VarStub));
+    if((r = var_target(page->data + slot->offset, target, targetSlot,
+                       (char *&)tpage)))
+      return r;
+    RM_VarSlot *tslot = varSlot(tpage, targetSlot);
+    int oldFree = varFreeBytes(tpage);
+    if((r = log_rec(RM_LOG_DELETE, stub.vPage, target, targetSlot,
+                    tpage->data + tslot->offset, NULL, lsn,
+                    varRecLength(tslot), tslot->length & RM_VAR_FLAGS))) {
+      pfh_.UnpinPage(target);
+      return r;
+    }
+    varErase(tpage, targetSlot);
+    tpage->pageLSN = lsn;
+    pfh_.MarkDirty(target, lsn);
+    r = page_changed(stub.vPage, oldFree, varFreeBytes(tpage), lsn);
+    pfh_.UnpinPage(target);
+    if(r)
+      return r;
+  }
+
+  int oldFree = varFreeBytes(page);
+  if((r = log_rec(RM_LOG_DELETE, pageNum, actualPageNum, slotNum,
+                  page->data + slot->offset, NULL, lsn, varRecLength(slot),
+                  slot->length & RM_VAR_FLAGS)))
+    return r;
+  varErase(page, slotNum);
+  page->pageLSN = lsn;
+  pfh_.MarkDirty(actualPageNum, lsn);
+  if((r = page_changed(pageNum, oldFree, varFreeBytes(page), lsn))
+     || prefix < 0)
+    return r;
+  return free_long(desc);
 }
 
 // Update a record
@@ -162,7 +845,12 @@ RC RM_FileHandle::UpdateRec  (const RM_Record &rec)
 {
   if(!fileOpen_)
     return RM_NOT_OPEN_FILE;
-  if(rec.recordSize != recordSize)
+  // it would overwrite the record, and any overflow pages, with the
+  // attributes projected
+  if(rec.projected_)
+    return RM_SCAN_PROJECTED;
+  if(varLength ? rec.length_ < 0 || rec.length_ > recordSize
+               : rec.recordSize != recordSize)
     return RM_REC_LEN_NO_MATCH;
 
   PageNum pageNum, actualPageNum;
@@ -170,18 +858,627 @@ RC RM_FileHandle::UpdateRec  (const RM_Record &rec)
 
   struct RM_FileRecPage * data;
 
-  if(check_record_exist(rec.rid_, pageNum, slotNum, actualPageNum, 
-    (char * &)data) == RM_REC_NO_EXIST)
-    return RM_REC_NO_EXIST;
+  RC rc = check_record_exist(rec.rid_, pageNum, slotNum, actualPageNum,
+                             (char * &)data);
+  if(rc)
+    return rc;
+  if(varLength) {
+    rc = var_update(rec, pageNum, slotNum, actualPageNum, (char *)data);
+    pfh_.UnpinPage(actualPageNum);
+    return rc ? rc : auto_checkpoint();
+  }
+
+  data = rec_page(pageNum, (char *)data);
+  if(data->pageLSN == RM_COLD_LSN
+     && (rc = thaw(pageNum, actualPageNum, data)))
+    return rc;
+  LSN lsn;
+  char buf[DATA_ON_RECORD_PAGE];
+  RC r = log_rec(RM_LOG_UPDATE, pageNum, actualPageNum, slotNum,
+                 rec_at(data, slotNum, buf), rec.data, lsn);
+  if(r) {
+    pfh_.UnpinPage(actualPageNum);
+    return r;
+  }
 
-  memcpy(&data->data[slotNum * recordSize], rec.data, recordSize);
+  rec_put(data, slotNum, rec.data);
+  zone_page(pageNum, data);
+  data->pageLSN = lsn;
 
-  pfh_.MarkDirty(actualPageNum);
+  pfh_.MarkDirty(actualPageNum, lsn);
   pfh_.UnpinPage(actualPageNum);
 
+  return auto_checkpoint();
+}
+
+// The RIDs of a batch as virtual page * recordPerPage + slot, in order,
+// each with its position in the batch
+RC RM_FileHandle::batch_order(const RID *rids, int numRecs,
+                              vector<pair<long, int> > &order) const
+{
+  order.clear();
+  for(int i = 0; i < numRecs; ++i) {
+    PageNum pageNum;
+    SlotNum slotNum;
+    rids[i].GetPageNum(pageNum);
+    rids[i].GetSlotNum(slotNum);
+    if(pageNum < 0 || slotNum < 0 || pageNum >= totalPage
+       || slotNum >= recordPerPage)
+      return RM_REC_NO_EXIST;
+    order.push_back(make_pair(long(pageNum) * recordPerPage + slotNum, i));
+  }
+  sort(order.begin(), order.end());
+  return OK_RC;
+}
+
+// Delete (recs NULL) or update the records of order[first, last), all on
+// one page, with the page pinned once.  In a fixed-length file every
+// record is checked first, and the free space and the zone maps are
+// brought up to date once.
+RC RM_FileHandle::batch_page(const vector<pair<long, int> > &order,
+                             size_t first, size_t last,
+                             const RM_Record *recs)
+{
+  int vPage = int(order[first].first / recordPerPage);
+  PageNum pageNum;
+  PF_PageHandle pageHdl;
+  RM_FileRecPage *data;
+  RC r;
+  if((r = page_of(vPage, pageNum))
+     || (r = pfh_.GetThisPage(pageNum, pageHdl)))
+    return r;
+  pageHdl.GetData((char *&)data);
+
+  if(varLength) {
+    for(size_t i = first; i < last && !r; ++i) {
+      SlotNum slotNum = SlotNum(order[i].first % recordPerPage);
+      RM_VarRecPage *page = (RM_VarRecPage *)data;
+      if(!varSlotUsed(page, slotNum)
+         || (varSlot(page, slotNum)->length & RM_VAR_MOVED))
+        r = RM_REC_NO_EXIST;
+      else if(recs)
+        r = var_update(recs[order[i].second], vPage, slotNum, pageNum,
+                       (char *)data);
+      else
+        r = var_delete(vPage, slotNum, pageNum, (char *)data);
+    }
+    pfh_.UnpinPage(pageNum);
+    return r;
+  }
+
+  // a record deleted twice is not there the second time
+  data = rec_page(vPage, (char *)data);
+  for(size_t i = first; i < last; ++i)
+    if(!slotTaken(data, int(order[i].first % recordPerPage))
+       || (!recs && i > first && order[i].first == order[i - 1].first)) {
+      pfh_.UnpinPage(pageNum);
+      return RM_REC_NO_EXIST;
+    }
+  if(data->pageLSN == RM_COLD_LSN && (r = thaw(vPage, pageNum, data)))
+    return r;
+  int oldFree = page_free((char *)data);
+  LSN lsn;
+  char buf[DATA_ON_RECORD_PAGE];
+  size_t i;
+  for(i = first; i < last; ++i) {
+    SlotNum slotNum = SlotNum(order[i].first % recordPerPage);
+    const char *newData = recs ? recs[order[i].second].data : NULL;
+    if((r = log_rec(recs ? RM_LOG_UPDATE : RM_LOG_DELETE, vPage, pageNum,
+                    slotNum, rec_at(data, slotNum, buf), newData, lsn)))
+      break;
+    if(recs)
+      rec_put(data, slotNum, newData);
+    else
+      data->bitmap[slotNum >> 3] &= ~(1 << (slotNum & 7));
+    data->pageLSN = lsn;
+    // the first record marks it, redo of the page starts there
+    pfh_.MarkDirty(pageNum, lsn);
+  }
+  if(i > first) {
+    zone_page(vPage, data);
+    RC rc = recs ? OK_RC
+                 : page_changed(vPage, oldFree, page_free((char *)data), lsn);
+    if(!r)
+      r = rc;
+  }
+  pfh_.UnpinPage(pageNum);
+  return r;
+}
+
+// Delete or update a batch, a page at a time
+RC RM_FileHandle::batch_change(const RID *rids, int numRecs,
+                               const RM_Record *recs)
+{
+  vector<pair<long, int> > order;
+  RC r = batch_order(rids, numRecs, order);
+  for(size_t first = 0, last; first < order.size() && !r; first = last) {
+    long vPage = order[first].first / recordPerPage;
+    for(last = first + 1; last < order.size()
+        && order[last].first / recordPerPage == vPage; ++last)
+      ;
+    if(!(r = batch_page(order, first, last, recs)))
+      r = auto_checkpoint();
+  }
+  return r;
+}
+
+RC RM_FileHandle::DeleteRecs(const RID *rids, int numRecs)
+{
+  if(!fileOpen_)
+    return RM_NOT_OPEN_FILE;
+  return batch_change(rids, numRecs, NULL);
+}
+
+RC RM_FileHandle::UpdateRecs(const RM_Record *recs, int numRecs)
+{
+  if(!fileOpen_)
+    return RM_NOT_OPEN_FILE;
+  vector<RID> rids;
+  for(int i = 0; i < numRecs; ++i) {
+    if(recs[i].projected_)
+      return RM_SCAN_PROJECTED;
+    if(varLength ? recs[i].length_ < 0 || recs[i].length_ > recordSize
+                 : recs[i].recordSize != recordSize)
+      return RM_REC_LEN_NO_MATCH;
+    rids.push_back(recs[i].rid_);
+  }
+  return batch_change(rids.empty() ? NULL : &rids[0], numRecs, recs);
+}
+
+// bring a page changed by Compact up to date and unpin it
+RC RM_FileHandle::compact_done(int vPage, PageNum pageNum,
+                               RM_FileRecPage *data, int oldFree, LSN lsn)
+{
+  RC r = OK_RC;
+  int newFree = page_free((char *)data);
+  if(newFree != oldFree) {
+    zone_page(vPage, data);
+    pfh_.MarkDirty(pageNum, lsn);
+    r = page_changed(vPage, oldFree, newFree, lsn);
+  }
+  pfh_.UnpinPage(pageNum);
+  return r;
+}
+
+// Records are moved one at a time, each logged as an insert on the page
+// it goes to and a delete on the page it leaves, from the last page down
+// and into the first page up with room.  Both pages stay pinned until
+// they are done with.  The moves are only reported once committed, as
+// recovery would take them back before.
+RC RM_FileHandle::Compact(RM_RemapFn remap, void *ctx)
+{
+  if(!fileOpen_)
+    return RM_NOT_OPEN_FILE;
+  if(varLength)
+    return RM_COMPACT_VAR_LENGTH;
+
+  PF_PageHandle pageHdl;
+  PageNum srcPage, dstPage = -1;
+  RM_FileRecPage *src, *dst = NULL;
+  int to = 0, dstOld = 0, dstFree = 0;
+  LSN lsn = 0, dstLSN = 0;
+  char buf[DATA_ON_RECORD_PAGE];
+  vector<pair<RID, RID> > moves;
+  RC r = OK_RC;
+  for(int from = totalPage - 1; from > to && !r; --from) {
+    if((r = page_of(from, srcPage))
+       || (r = pfh_.GetThisPage(srcPage, pageHdl)))
+      break;
+    pageHdl.GetData((char *&)src);
+    if(src->pageLSN == RM_COLD_LSN) {
+      pfh_.UnpinPage(srcPage);
+      continue;
+    }
+    int srcOld = page_free((char *)src);
+    SlotNum slotNum = nextTakenSlot(src->bitmap, -1);
+    while(slotNum < recordPerPage && to < from) {
+      if(!dst) {
+        if((r = page_of(to, dstPage))
+           || (r = pfh_.GetThisPage(dstPage, pageHdl)))
+          break;
+        pageHdl.GetData((char *&)dst);
+        if(dst->pageLSN == RM_COLD_LSN) {
+          pfh_.UnpinPage(dstPage);
+          dst = NULL;
+          ++to;
+          continue;
+        }
+        dstOld = dstFree = page_free((char *)dst);
+      }
+      if(dstFree <= reserve) {
+        r = compact_done(to, dstPage, dst, dstOld, dstLSN);
+        dst = NULL;
+        if(r)
+          break;
+        ++to;
+        continue;
+      }
+
+      SlotNum dstSlot;
+      findFirstEmptySlot(dst, dstSlot);
+      const char *recData = rec_at(src, slotNum, buf);
+      if((r = log_rec(RM_LOG_INSERT, to, dstPage, dstSlot, recData, NULL,
+                      dstLSN)))
+        break;
+      setEmptySlot(dst, dstSlot);
+      rec_put(dst, dstSlot, recData);
+      dst->pageLSN = dstLSN;
+      pfh_.MarkDirty(dstPage, dstLSN);
+      --dstFree;
+      if((r = log_rec(RM_LOG_DELETE, from, srcPage, slotNum, recData, NULL,
+                      lsn)))
+        break;
+      src->bitmap[slotNum >> 3] &= ~(1 << (slotNum & 7));
+      src->pageLSN = lsn;
+      // the first move marks each page, redo of it starts there
+      pfh_.MarkDirty(srcPage, lsn);
+      if(remap)
+        moves.push_back(make_pair(RID(from, slotNum), RID(to, dstSlot)));
+      slotNum = nextTakenSlot(src->bitmap, slotNum);
+    }
+
+    RC rc = compact_done(from, srcPage, src, srcOld, lsn);
+    if(!r)
+      r = rc;
+    if(!r)
+      r = auto_checkpoint();
+  }
+  if(dst) {
+    RC rc = compact_done(to, dstPage, dst, dstOld, dstLSN);
+    if(!r)
+      r = rc;
+  }
+  if(r || (r = Commit()))
+    return r;
+  for(size_t i = 0; i < moves.size(); ++i)
+    if((r = remap(ctx, moves[i].first, moves[i].second)))
+      return r;
+  return drop_pages();
+}
+
+// Give the empty pages at the end of the file back to PF.  This starts
+// from a clean point, as when the file is closed, so that the log never
+// replays a change to a dropped page; the header page, written with the
+// smaller totalPage, then drops them all at once, before they are
+// disposed of.
+RC RM_FileHandle::drop_pages()
+{
+  PF_PageHandle page;
+  RM_FileRecPage *data;
+  RM_FileHeaderPage *hdr;
+  PageNum pageNum;
+  RC r;
+  int keep;
+  for(keep = totalPage; keep > 0; --keep) {
+    if((r = page_of(keep - 1, pageNum))
+       || (r = pfh_.GetThisPage(pageNum, page)))
+      return r;
+    page.GetData((char *&)data);
+    bool empty = data->pageLSN != RM_COLD_LSN
+                 && page_free((char *)data) == pageSpace;
+    pfh_.UnpinPage(pageNum);
+    if(!empty)
+      break;
+  }
+  if(keep == totalPage)
+    return OK_RC;
+  if((r = pfh_.ForcePages()) || (r = pfh_.Sync()) || (r = log_->Truncate()))
+    return r;
+
+  vector<PageNum> dropped;
+  for(int vPage = keep; vPage < totalPage; ++vPage) {
+    if((r = page_of(vPage, pageNum)))
+      return r;
+    dropped.push_back(pageNum);
+    if(vPage < freeCursor)
+      fsm_update(vPage, pageSpace, 0);
+  }
+  for(int chunk = chunk_of(keep); chunk < int(pageChunks.size()); ++chunk) {
+    int n = keep - chunk_base(chunk);
+    if(n < 0)
+      n = 0;
+    if(chunkLoaded[chunk] && n < int(pageChunks[chunk].size()))
+      pageChunks[chunk].resize(n);
+    if(chunk == 0 || chunk_base(chunk) >= totalPage)
+      continue;
+    PageNum dirPage;
+    char *pageData;
+    if((r = dir_entry(chunk_base(chunk), dirPage, pageData)))
+      return r;
+    ((RM_FilePageDirPage *)pageData)->pageListSize = n;
+    pfh_.MarkDirty(dirPage);
+    pfh_.UnpinPage(dirPage);
+  }
+  if((r = pfh_.GetThisPage(RM_HEADER_PAGE, page))
+     || (r = page.GetData((char *&)hdr)))
+    return r;
+  hdr->totalPage = totalPage = keep;
+  if(freeHint > keep)
+    hdr->freeHint = freeHint = keep;
+  pfh_.MarkDirty(RM_HEADER_PAGE);
+  pfh_.UnpinPage(RM_HEADER_PAGE);
+  if(freeCursor > keep)
+    freeCursor = keep;
+  for(size_t i = 0; i < zoneMaps.size(); ++i) {
+    RM_ZoneMap &zone = zoneMaps[i];
+    if(int(zone.any.size()) > keep) {
+      zone.any.resize(keep);
+      zone.low.resize(long(keep) * zone.attrLength);
+      zone.high.resize(long(keep) * zone.attrLength);
+    }
+  }
+  if((r = pfh_.ForcePages()) || (r = pfh_.Sync()))
+    return r;
+
+  for(size_t i = 0; i < dropped.size(); ++i)
+    if((r = pfh_.DisposePage(dropped[i])))
+      return r;
+  if((r = pfh_.ForcePages()) || (r = pfh_.Sync()))
+    return r;
+  return OK_RC;
+}
+
+// Update the record in slot slotNum of the pinned page pageData to rec.
+// A long record gets a new chain of overflow pages, unless rec only
+// holds its prefix, and its old chain is freed.
+RC RM_FileHandle::var_update(const RM_Record &rec, PageNum pageNum,
+                             SlotNum slotNum, PageNum actualPageNum,
+                             char *pageData)
+{
+  char inlineData[RM_VAR_MAX_INLINE];
+  const char *pData = rec.data;
+  int length = rec.recordSize;
+  int flags = 0;
+  int oldPrefix;
+  RM_VarLong oldLong;
+  RC r;
+
+  if((r = var_long(pageData, slotNum, oldPrefix, oldLong)))
+    return r;
+  bool keepChain = rec.overflow_ >= 0;
+  if(keepChain) {
+    // the record must still be the one rec was read from
+    if(oldPrefix != rec.recordSize || oldLong.first != rec.overflow_)
+      return RM_REC_LEN_NO_MATCH;
+    memcpy(inlineData, rec.data, length);
+    memcpy(inlineData + length, &oldLong, sizeof(RM_VarLong));
+    length += sizeof(RM_VarLong);
+    pData = inlineData;
+    flags = RM_VAR_LONG;
+  } else if(length > RM_VAR_MAX_INLINE) {
+    if((r = write_long(rec.data, length, inlineData, length)))
+      return r;
+    pData = inlineData;
+    flags = RM_VAR_LONG;
+  }
+
+  if((r = var_put(pData, length, flags, pageNum, slotNum, actualPageNum,
+                  pageData)) || oldPrefix < 0 || keepChain)
+    return r;
+  return free_long(oldLong);
+}
+
+// Store length bytes with the given flags in slot slotNum of the pinned
+// page pageData.  A record that outgrows its page moves, and its slot
+// keeps a stub.
+RC RM_FileHandle::var_put(const char *pData, int length, int flags,
+                          PageNum pageNum, SlotNum slotNum,
+                          PageNum actualPageNum, char *pageData)
+{
+  RM_VarRecPage *page = (RM_VarRecPage *)pageData;
+  RM_VarSlot *slot = varSlot(page, slotNum);
+  LSN lsn;
+  RC r;
+
+  // where the record is now: its own slot, or the one its stub points to
+  int vPage = pageNum;
+  PageNum target = actualPageNum;
+  SlotNum targetSlot = slotNum;
+  RM_VarRecPage *tpage = page;
+  RM_VarStub oldStub;
+  bool moved = slot->length & RM_VAR_FORWARD;
+  if(moved) {
+    memcpy(&oldStub, page->data + slot->offset, sizeof(RM_VarStub));
+    if((r = var_target(page->data + slot->offset, target, targetSlot,
+                       (char *&)tpage)))
+      return r;
+    vPage = oldStub.vPage;
+  }
+  RM_VarSlot *tslot = varSlot(tpage, targetSlot);
+
+  if(varFits(tpage, targetSlot, length)) {
+    // in place
+    int oldFree = varFreeBytes(tpage);
+    int newFlags = flags | (moved ? RM_VAR_MOVED : 0);
+    if(!(r = log_rec(RM_LOG_UPDATE, vPage, target, targetSlot,
+                     tpage->data + tslot->offset, pData, lsn,
+                     varRecLength(tslot), tslot->length & RM_VAR_FLAGS,
+                     length, newFlags))) {
+      varPut(tpage, targetSlot, pData, length, newFlags);
+      tpage->pageLSN = lsn;
+      pfh_.MarkDirty(target, lsn);
+      r = page_changed(vPage, oldFree, varFreeBytes(tpage), lsn);
+    }
+    if(moved)
+      pfh_.UnpinPage(target);
+    return r;
+  }
+
+  // move it to another page and point the stub there
+  RID newRid;
+  RM_VarStub stub;
+  if((r = insert_rec(pData, length, flags | RM_VAR_MOVED, newRid))) {
+    if(moved)
+      pfh_.UnpinPage(target);
+    return r;
+  }
+  newRid.GetPageNum(stub.vPage);
+  newRid.GetSlotNum(stub.slotNum);
+
+  int oldFree = varFreeBytes(page);
+  if((r = log_rec(RM_LOG_UPDATE, pageNum, actualPageNum, slotNum,
+                  page->data + slot->offset, (char *)&stub, lsn,
+                  varRecLength(slot), slot->length & RM_VAR_FLAGS,
+                  sizeof(RM_VarStub), RM_VAR_FORWARD))) {
+    if(moved)
+      pfh_.UnpinPage(target);
+    return r;
+  }
+  varPut(page, slotNum, (char *)&stub, sizeof(RM_VarStub), RM_VAR_FORWARD);
+  page->pageLSN = lsn;
+  pfh_.MarkDirty(actualPageNum, lsn);
+  if((r = page_changed(pageNum, oldFree, varFreeBytes(page), lsn))
+     || !moved) {
+    if(moved)
+      pfh_.UnpinPage(target);
+    return r;
+  }
+
+  // the old place of a record that had moved before
+  oldFree = varFreeBytes(tpage);
+  if(!(r = log_rec(RM_LOG_DELETE, vPage, target, targetSlot,
+                   tpage->data + tslot->offset, NULL, lsn,
+                   varRecLength(tslot), tslot->length & RM_VAR_FLAGS))) {
+    varErase(tpage, targetSlot);
+    tpage->pageLSN = lsn;
+    pfh_.MarkDirty(target, lsn);
+    r = page_changed(vPage, oldFree, varFreeBytes(tpage), lsn);
+  }
+  pfh_.UnpinPage(target);
+  return r;
+}
+
+//
+// Overflow pages
+//
+
+// the inline prefix length (-1 if it is not long) and the RM_VarLong of
+// the record in slot slotNum of the pinned page pageData, or of the
+// record its stub points to
+RC RM_FileHandle::var_long(char *pageData, SlotNum slotNum, int &prefix,
+                           RM_VarLong &desc) const
+{
+  RM_VarRecPage *page = (RM_VarRecPage *)pageData;
+  RM_VarSlot *slot = varSlot(page, slotNum);
+  PageNum target = -1;
+  RC r;
+  if(slot->length & RM_VAR_FORWARD) {
+    if((r = var_target(page->data + slot->offset, target, slotNum,
+                       (char *&)page)))
+      return r;
+    slot = varSlot(page, slotNum);
+  }
+  prefix = -1;
+  if(slot->length & RM_VAR_LONG) {
+    prefix = varRecLength(slot) - sizeof(RM_VarLong);
+    desc = varLong(page->data + slot->offset, varRecLength(slot));
+  }
+  if(target >= 0)
+    pfh_.UnpinPage(target);
+  return OK_RC;
+}
+
+// write what follows the inline prefix of a long record of length bytes
+// to a new chain of overflow pages, and make the inline part of the
+// record in inlineData
+RC RM_FileHandle::write_long(const char *pData, int length,
+                             char *inlineData, int &inlineLength)
+{
+  int prefix = inlinePrefix;
+  int rest = length - prefix;
+  int numPages = (rest + DATA_ON_RECORD_PAGE - 1) / DATA_ON_RECORD_PAGE;
+  vector<PageNum> pages(numPages);
+  vector<bool> fresh(numPages);
+  vector<PageNum> heads(numPages + 1);  // of the free list
+  PF_PageHandle pageHdl;
+  RM_OverflowPage *page;
+  LSN lsn = 0;
+  RC r;
+
+  // the pages are taken before any is written, so that each one is
+  // written with the next.  The free list goes first.
+  heads[0] = freeOverflow;
+  for(int i = 0; i < numPages; ++i) {
+    if(freeOverflow != END_PAGE_LIST) {
+      pages[i] = freeOverflow;
+      if((r = pfh_.GetThisPage(pages[i], pageHdl))
+         || (r = pageHdl.GetData((char *&)page)))
+        return r;
+      freeOverflow = page->nextPage;
+    } else {
+      if((r = pfh_.AllocatePage(pageHdl)))
+        return r;
+      pageHdl.GetPageNum(pages[i]);
+      fresh[i] = true;
+    }
+    pfh_.UnpinPage(pages[i]);
+    heads[i + 1] = freeOverflow;
+  }
+
+  char *before = (char *)malloc(RM_OVF_MAX_IMAGE);
+  char *after = (char *)malloc(RM_OVF_MAX_IMAGE);
+  r = OK_RC;
+  for(int i = 0; i < numPages && !r; ++i) {
+    int n = rest - i * DATA_ON_RECORD_PAGE;
+    if(n > int(DATA_ON_RECORD_PAGE))
+      n = DATA_ON_RECORD_PAGE;
+    int link[2] = { i + 1 < numPages ? pages[i + 1] : END_PAGE_LIST, n };
+    memcpy(after, link, RM_OVF_HDR_SIZE);
+    memcpy(after + RM_OVF_HDR_SIZE, pData + prefix + i * DATA_ON_RECORD_PAGE,
+           n);
+    if((r = pfh_.GetThisPage(pages[i], pageHdl))
+       || (r = pageHdl.GetData((char *&)page)))
+      break;
+    int beforeLen = fresh[i] ? 0 : ovfImage(page, before);
+    if(!(r = log_rec(RM_LOG_OVERFLOW, -1, pages[i], 0,
+                     fresh[i] ? NULL : before, after, lsn, beforeLen,
+                     heads[i], RM_OVF_HDR_SIZE + n, heads[i + 1]))) {
+      ovfApply(page, after, RM_OVF_HDR_SIZE + n);
+      page->pageLSN = lsn;
+      pfh_.MarkDirty(pages[i], lsn);
+    }
+    pfh_.UnpinPage(pages[i]);
+  }
+  free(before);
+  free(after);
+  if(r || (r = set_free_overflow(freeOverflow, lsn)))
+    return r;
+
+  RM_VarLong desc;
+  desc.length = length;
+  desc.first = pages[0];
+  desc.last = pages[numPages - 1];
+  memcpy(inlineData, pData, prefix);
+  memcpy(inlineData + prefix, &desc, sizeof(RM_VarLong));
+  inlineLength = prefix + sizeof(RM_VarLong);
   return OK_RC;
 }
 
+// put the overflow pages of a long record on the free list, by linking
+// its last page to the head
+RC RM_FileHandle::free_long(const RM_VarLong &desc)
+{
+  PF_PageHandle pageHdl;
+  RM_OverflowPage *page;
+  LSN lsn;
+  RC r;
+  if((r = pfh_.GetThisPage(desc.last, pageHdl))
+     || (r = pageHdl.GetData((char *&)page)))
+    return r;
+  int link[2] = { freeOverflow, page->length };
+  if((r = log_rec(RM_LOG_OVERFLOW, -1, desc.last, 0, (char *)page,
+                  (char *)link, lsn, RM_OVF_HDR_SIZE, freeOverflow,
+                  RM_OVF_HDR_SIZE, desc.first))) {
+    pfh_.UnpinPage(desc.last);
+    return r;
+  }
+  ovfApply(page, (char *)link, RM_OVF_HDR_SIZE);
+  page->pageLSN = lsn;
+  pfh_.MarkDirty(desc.last, lsn);
+  pfh_.UnpinPage(desc.last);
+  return set_free_overflow(desc.first, lsn);
+}
+
     // Forces a page (along with any contents stored in this class)
     // from the buffer pool to disk.  Default value forces all pages.
 RC RM_FileHandle::ForcePages (PageNum pageNum)
@@ -189,3 +1486,148 @@ RC RM_FileHandle::ForcePages (PageNum pageNum)
   return pfh_.ForcePages(pageNum);
 }
 
+// Make the changes since the last commit durable
+RC RM_FileHandle::Commit ()
+{
+  if(!fileOpen_)
+    return RM_NOT_OPEN_FILE;
+  return log_->Commit();
+}
+
+// Let the given number of commits share one log flush; the ones before
+// the flush are not durable when Commit returns
+RC RM_FileHandle::SetAsyncCommit(int commits)
+{
+  if(!fileOpen_)
+    return RM_NOT_OPEN_FILE;
+  return log_->SetAsyncCommit(commits);
+}
+
+static bool older_page(const PF_DirtyPage &a, const PF_DirtyPage &b)
+{
+  return a.recLSN < b.recLSN;
+}
+
+// Log the dirty page table and have its pages trickled out, oldest first
+RC RM_FileHandle::Checkpoint()
+{
+  if(!fileOpen_)
+    return RM_NOT_OPEN_FILE;
+
+  PF_DirtyPage *dirty;
+  int numDirty;
+  RC r = pfh_.GetDirtyPages(dirty, numDirty);
+  if(r)
+    return r;
+
+  // a page marked dirty without an LSN holds no logged change, so redo
+  // has nothing to do for it (a page just allocated, or a setting in
+  // the header).  The header and directory pages are marked with the
+  // LSN of the change that dirtied them and are kept, so that the redo
+  // point and a cut of the log stay before that change.
+  int n = 0;
+  for(int i = 0; i < numDirty; ++i)
+    if(dirty[i].recLSN > 0)
+      dirty[n++] = dirty[i];
+  sort(dirty, dirty + n, older_page);
+
+  int len = sizeof(RM_LogCheckpoint) + n * sizeof(PF_DirtyPage);
+  char *image = (char *)malloc(len);
+  RM_LogCheckpoint *ckpt = (RM_LogCheckpoint *)image;
+  ckpt->redoLSN = n > 0 ? dirty[0].recLSN : log_->GetEndLSN();
+  LSN redoLSN = ckpt->redoLSN;
+  ckpt->numDirty = n;
+  ckpt->pad = 0;
+  memcpy(image + sizeof(RM_LogCheckpoint), dirty, n * sizeof(PF_DirtyPage));
+
+  RM_LogRec rec;
+  memset(&rec, 0, sizeof(RM_LogRec));
+  rec.type = RM_LOG_CHECKPOINT;
+  rec.imageLen = len;
+  r = log_->Append(rec, image);
+  free(image);
+
+  PageNum *pages = new PageNum[n > 0 ? n : 1];
+  for(int i = 0; i < n; ++i)
+    pages[i] = dirty[i].pageNum;
+  delete [] dirty;
+  if(!r) {
+    checkpointLSN = rec.lsn;
+    r = pfh_.TricklePages(pages, n);
+  }
+  delete [] pages;
+  if(!r)
+    r = cut_log(redoLSN);
+  return r;
+}
+
+// Cut the log at redoLSN of a checkpoint, or at the last commit if that
+// comes first: every change before is on a written page, and committed.
+// The pages are synced first, and the file header with them, which
+// counts the pages whose allocation is cut off.  The records kept are
+// copied, so only cut once that drops at least as much as it keeps.
+RC RM_FileHandle::cut_log(LSN redoLSN)
+{
+  LSN first = log_->GetFirstLSN();
+  LSN end = log_->GetEndLSN();
+  LSN cut = min(redoLSN, log_->GetCommitLSN());
+  if(cut <= first || cut - first < end - cut)
+    return OK_RC;
+  RC r;
+  if((r = pfh_.ForcePages(RM_HEADER_PAGE)) || (r = pfh_.Sync()))
+    return r;
+  return log_->Cut(cut);
+}
+
+RC RM_FileHandle::SetCheckpointInterval(int logBytes)
+{
+  if(!fileOpen_)
+    return RM_NOT_OPEN_FILE;
+  checkpointInterval = logBytes;
+  return OK_RC;
+}
+
+RC RM_FileHandle::SetFillFactor(int percent)
+{
+  if(!fileOpen_)
+    return RM_NOT_OPEN_FILE;
+  if(percent < 1 || percent > 100)
+    return RM_BAD_FILL_FACTOR;
+
+  PF_PageHandle page;
+  RM_FileHeaderPage *hdr;
+  RC r;
+  if((r = pfh_.GetThisPage(RM_HEADER_PAGE, page))
+     || (r = page.GetData((char *&)hdr)))
+    return r;
+  hdr->fillFactor = fillFactor = percent;
+  pfh_.MarkDirty(RM_HEADER_PAGE);
+  pfh_.UnpinPage(RM_HEADER_PAGE);
+
+  // a smaller reserve gives room on pages the free hint skips as full
+  int oldReserve = reserve;
+  reserve = pageSpace - (pageSpace * fillFactor + 99) / 100;
+  if(reserve < oldReserve && (r = set_free_hint(0, 0)))
+    return r;
+  fsm_clear();
+  freeCursor = freeHint;
+  return OK_RC;
+}
+
+RC RM_FileHandle::SetInlinePrefix(int bytes)
+{
+  if(!fileOpen_)
+    return RM_NOT_OPEN_FILE;
+  if(bytes < 0 || bytes > RM_VAR_MAX_PREFIX)
+    return RM_BAD_INLINE_PREFIX;
+
+  PF_PageHandle page;
+  RM_FileHeaderPage *hdr;
+  RC r;
+  if((r = pfh_.GetThisPage(RM_HEADER_PAGE, page))
+     || (r = page.GetData((char *&)hdr)))
+    return r;
+  hdr->inlinePrefix = inlinePrefix = bytes;
+  pfh_.MarkDirty(RM_HEADER_PAGE);
+  return pfh_.UnpinPage(RM_HEADER_PAGE);
+}
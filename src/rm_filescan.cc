@@ -5,12 +5,15 @@
 #include "rm.h"
 #include "rm_internal.h"
 
-RM_FileScan::RM_FileScan  ():scanOpen_(false)
+RM_FileScan::RM_FileScan  ():scanOpen_(false), padded_(NULL),
+  projLength_(0), projBuf_(NULL)
 {
 }
 
 RM_FileScan::~RM_FileScan ()
 {
+  free(padded_);
+  free(projBuf_);
 }
 
 RC RM_FileScan::OpenScan  (const RM_FileHandle &fileHandle,
@@ -20,93 +23,170 @@ RC RM_FileScan::OpenScan  (const RM_FileHandle &fileHandle,
                   CompOp     compOp,
                   void       *value,
                   ClientHint pinHint) // Initialize a file scan
+{
+  return OpenScan(fileHandle,
+                  RM_Predicate(attrType, attrLength, attrOffset, compOp, value),
+                  pinHint);
+}
+
+RC RM_FileScan::OpenScan  (const RM_FileHandle &fileHandle,
+                           const char *attrName,
+                           CompOp     compOp,
+                           void       *value,
+                           ClientHint pinHint)
+{
+  RM_AttrInfo attr;
+  RC r = fileHandle.GetAttr(attrName, attr);
+  if(r)
+    return r;
+  return OpenScan(fileHandle, attr.attrType, attr.attrLength,
+                  attr.attrOffset, compOp, value, pinHint);
+}
+
+RC RM_FileScan::OpenScan  (const RM_FileHandle &fileHandle,
+                           const RM_Predicate &pred,
+                           ClientHint pinHint)
 {
   if(!fileHandle.fileOpen_)
     return RM_NOT_OPEN_FILE;
   if(scanOpen_)
     return RM_SCAN_REOPEN;
-
-  rmFileHandle = &fileHandle;
-  attrType_ = attrType;
-  attrLength_ = attrLength;
-  assert(attrLength <= MAXSTRINGLEN);
-  attrOffset_ = attrOffset;
-  compOp_ = compOp;
-  if(value == NULL && compOp != NO_OP)
+  if(!pred.valid())
     return RM_SCAN_NEED_VALUE;
 
-  if(value != NULL) {
-    memcpy(buf, value, attrLength);
-    switch (attrType) {
-      case INT: intVal_ = *(int *)buf; 
-//                printf("....scan value %d\n", intVal_);
-                break;
-      case FLOAT: floatVal_ = *(float *)buf; break;
-      case STRING: stringVal_ = string(buf, attrLength_); break;
-    }
-  }
+  rmFileHandle = &fileHandle;
+  pred_ = pred;
+  pred_.order();
+  condEnd_ = pred_.end();
+  bound_ = !fileHandle.columns.empty() && fileHandle.bind(pred_);
+  rec_.resize(fileHandle.columns.empty() ? 0 : fileHandle.recordSize);
+  matchPage_ = -1;
+  // records shorter than the condition reaches are padded here
+  if(fileHandle.varLength && condEnd_ > 0)
+    padded_ = (char *)malloc(condEnd_);
   curScanId_ = RID(0, 0);
   scanOpen_ = true;
 
   return OK_RC;
 }
 
-SlotNum RM_FileScan::nextRecSlot(const unsigned char *bitmap, int bitmapSize, 
-                                SlotNum start)
+bool RM_FileScan::check_scan_cond(const char *recData)
 {
-  int i = start >> 3;
-  int j = start & 7;
+  uint64_t one = 1, match;
+  pred_.eval(recData, 0, 1, &one, &match);
+  return match & 1;
+}
 
-  for(j = j + 1; j < 8; ++j)
-    if((bitmap[i] >> j) & 1)
-      return i * 8 + j;
+// Set cand to the slots of virtual page vPage of a fixed-length file
+// holding records that pass the condition.  The page is filtered again
+// only when it changed since the last time; any change, to the slot
+// bitmap too, gives the page a new LSN.  A cold page is never changed,
+// it is thawed first.
+void RM_FileScan::page_matches(int vPage, const RM_FileRecPage *data,
+                               unsigned char *cand)
+{
+  if(vPage != matchPage_ || data->pageLSN != matchLSN_) {
+    uint64_t taken[RM_BITMAP_WORDS];
+    for(int w = 0; w < int(RM_BITMAP_WORDS); ++w)
+      taken[w] = bitmapWord(data->bitmap, w);
+    memset(match_, 0, sizeof(match_));
+    rmFileHandle->page_eval(pred_, bound_, data, taken, match_, rows_);
+    matchPage_ = vPage;
+    matchLSN_ = data->pageLSN;
+  }
+  memcpy(cand, match_, sizeof(match_));
+}
 
-  for(i = i + 1; i <bitmapSize; ++i)
-    if(bitmap[i])
-      break;
-  for(j=0; j<8; ++j)
-    if((bitmap[i] >> j ) & 1)
-      break;
-  return i * 8 + j;
+// the first virtual page from vPage on that the zone maps of the file do
+// not rule out
+int RM_FileScan::next_page(int vPage) const
+{
+  const RM_FileHandle *fh = rmFileHandle;
+  if(!fh->zoneMaps.empty())
+    while(vPage < fh->totalPage && !pred_.may_match(fh->zoneMaps, vPage))
+      ++vPage;
+  return vPage;
 }
 
-template<typename DataType>
-bool RM_FileScan::check_scan_data_cond(const DataType attr,const DataType value)
+// Get next matching record
+RC RM_FileScan::GetNextRec(RM_Record &rec)               
 {
-  switch(compOp_) {
-    case EQ_OP: return (attr == value);
-    case LT_OP: return (attr < value);
-    case GT_OP: return (attr > value);
-    case LE_OP: return (attr <= value);
-    case GE_OP: return (attr >= value);
-    case NE_OP: return (attr != value);
-    case NO_OP: return true;
+  RC r = GetNextRec(view_);
+  if(r)
+    return r;
+  if(proj_.empty())
+    r = view_.CopyTo(rec);
+  else if(!(r = project(view_, projBuf_))) {
+    rec.set(projBuf_, projLength_);
+    rec.rid_ = view_.rid_;
+    rec.projected_ = true;
   }
-  return true;
+  view_.Release();
+  return r;
 }
 
-bool RM_FileScan::check_scan_cond(char *recData)
+RC RM_FileScan::SetProjection(const RM_ProjAttr *attrs, int numAttrs)
 {
-  if(compOp_ == NO_OP)
-    return true;
+  if(!scanOpen_)
+    return RM_SCAN_NOT_OPEN;
+  int length = 0;
+  for(int i = 0; i < numAttrs; ++i) {
+    if(attrs[i].attrOffset < 0 || attrs[i].attrLength <= 0
+       || attrs[i].attrOffset + attrs[i].attrLength
+          > rmFileHandle->recordSize)
+      return RM_SCAN_BAD_PROJECTION;
+    length += attrs[i].attrLength;
+  }
+  // attributes next to each other in the record are copied as one
+  proj_.clear();
+  for(int i = 0; i < numAttrs; ++i)
+    if(!proj_.empty() && proj_.back().attrOffset + proj_.back().attrLength
+                         == attrs[i].attrOffset)
+      proj_.back().attrLength += attrs[i].attrLength;
+    else
+      proj_.push_back(attrs[i]);
+  projLength_ = length;
+  free(projBuf_);
+  projBuf_ = length ? (char *)malloc(length) : NULL;
+  return OK_RC;
+}
 
-  int recInt;
-  float recFloat;
-  string recString;
-  switch(attrType_) {
-    case INT: recInt = *(int *) &recData[attrOffset_];
-//              printf(".... check rec value %d\n", recInt);
-              return check_scan_data_cond(recInt, intVal_);
-    case FLOAT: recFloat = *(float *) &recData[attrOffset_];
-              return check_scan_data_cond(recFloat, floatVal_);
-    case STRING: recString = string(recData + attrOffset_, attrLength_);
-              return check_scan_data_cond(recString, stringVal_);
+// Copy the projected attributes of the record in view to out.  The
+// overflow pages of a long record are only read for attributes past its
+// prefix.
+RC RM_FileScan::project(const RM_RecView &view, char *out) const
+{
+  int here = view.isLong ? view.inlineLength - int(sizeof(RM_VarLong))
+                         : view.inlineLength;
+  RM_RecCursor cursor;
+  for(size_t i = 0; i < proj_.size(); ++i) {
+    int offset = proj_[i].attrOffset, length = proj_[i].attrLength;
+    if(offset + length <= here)
+      memcpy(out, view.data + offset, length);
+    else {
+      int n = offset < here ? here - offset : 0;
+      memcpy(out, view.data + offset, n);
+      if(view.isLong && offset + n < view.length_) {
+        RC r;
+        int read;
+        if(!cursor.rmFileHandle)
+          cursor.open(rmFileHandle, view.data, here, view.length_,
+                      view.overflow_, false);
+        if((r = cursor.Seek(offset + n))
+           || ((r = cursor.Read(out + n, length - n, read)) && r != RM_EOF))
+          return r;
+        n += read;
+      }
+      memset(out + n, 0, length - n);
+    }
+    out += length;
   }
-  return true;
+  return OK_RC;
 }
 
-// Get next matching record
-RC RM_FileScan::GetNextRec(RM_Record &rec)               
+// Get a view of the next matching record.  The page the view holds is
+// scanned without pinning it again.
+RC RM_FileScan::GetNextRec(RM_RecView &view)
 {
   if(!scanOpen_)
     return RM_SCAN_NOT_OPEN;
@@ -116,68 +196,289 @@ RC RM_FileScan::GetNextRec(RM_Record &rec)
     return RM_NOT_OPEN_FILE;
   }
 
+  if(rmFileHandle->varLength)
+    return next_var_rec(view);
+
   PageNum vPage, pageNum;
   SlotNum slotNum;
   curScanId_.GetPageNum(vPage);
   curScanId_.GetSlotNum(slotNum);
   int recordSize = rmFileHandle->recordSize;
+  const PF_FileHandle &pfh = rmFileHandle->pfh_;
   
   while(vPage < rmFileHandle->totalPage) {
-    pageNum = rmFileHandle->totalPageList[vPage];
-    PF_PageHandle pageHandle;
-    rmFileHandle->pfh_.GetThisPage(pageNum, pageHandle);
+    if(slotNum == 0 && (vPage = next_page(vPage)) >= rmFileHandle->totalPage)
+      break;
+    RC r = rmFileHandle->page_of(vPage, pageNum);
+    if(r)
+      return r;
+    bool held = view.holds(&pfh, pageNum);
     struct RM_FileRecPage * data;
-    pageHandle.GetData((char * &)data);
-    
-    if(slotNum >= rmFileHandle->recordPerPage 
-      || slotTaken(data, slotNum) == false) 
-      slotNum = nextRecSlot(data->bitmap, rmFileHandle->bitmapSize, slotNum);
-
-    if(slotNum >= rmFileHandle->recordPerPage){
-      ++vPage;
-//      printf("++++++++ scan to the next page\n");
-      slotNum = 0;
-      rmFileHandle->pfh_.UnpinPage(pageNum);
-      continue;
+    if(held)
+      data = (struct RM_FileRecPage *)view.pageData_;
+    else {
+      PF_PageHandle pageHandle;
+      if((r = pfh.GetThisPage(pageNum, pageHandle)))
+        return r;
+      pageHandle.GetData((char * &)data);
     }
-    while(slotNum < rmFileHandle->recordPerPage
-         && check_scan_cond(&data->data[slotNum * recordSize]) == false )
-      slotNum = nextRecSlot(data->bitmap, rmFileHandle->bitmapSize, slotNum);
+    
+    RM_FileRecPage *recs = rmFileHandle->rec_page(vPage, (char *)data);
+    unsigned char cand[sizeof(data->bitmap)];
+    page_matches(vPage, recs, cand);
+    slotNum = nextTakenSlot(cand, slotNum - 1);
 
     if(slotNum >= rmFileHandle->recordPerPage){
       ++vPage;
 //      printf("++++++++ scan to the next page\n");
       slotNum = 0;
-      rmFileHandle->pfh_.UnpinPage(pageNum);
+      if(!held)
+        pfh.UnpinPage(pageNum);
       continue;
     } 
     
-    rec.recordSize = rmFileHandle->recordSize;
-    if(rec.data)
-      free(rec.data);
 //    printf("scan page number %d, slotNum %d\n", pageNum, slotNum);
-    rec.data = (char *)malloc(sizeof(char)*recordSize);
-    memcpy(rec.data, &(data->data[slotNum * recordSize]), recordSize);
-    rec.rid_ = RID(vPage, slotNum);
+    if(!held)
+      view.hold(&pfh, pageNum, (char *)data);
+    view.set(rmFileHandle->rec_view(recs, slotNum, view), recordSize, false,
+             RID(vPage, slotNum));
 
-    slotNum = nextRecSlot(data->bitmap, rmFileHandle->bitmapSize, slotNum);
+    slotNum = nextTakenSlot(cand, slotNum);
     if(slotNum >= rmFileHandle->recordPerPage)
       curScanId_ = RID(vPage+1, 0);
     else
       curScanId_ = RID(vPage, slotNum);
+    return OK_RC;  
+  }
 
-    rmFileHandle->pfh_.UnpinPage(pageNum);
+  view.Release();
+  return RM_EOF;
+}
+// GetNextRec on a file of variable-length records.  A moved record is
+// returned at its stub, with the RID it was inserted under.  Bytes past
+// the end of a short record compare as zeros.  The overflow pages of a
+// long record are only read when the condition is past its prefix, and
+// the record is returned as its prefix.
+RC RM_FileScan::next_var_rec(RM_RecView &view)
+{
+  PageNum vPage, pageNum;
+  SlotNum slotNum;
+  curScanId_.GetPageNum(vPage);
+  curScanId_.GetSlotNum(slotNum);
+  int condEnd = condEnd_;
+  const PF_FileHandle &pfh = rmFileHandle->pfh_;
 
-    return OK_RC;  
+  for(; vPage < rmFileHandle->totalPage; ++vPage, slotNum = 0) {
+    RM_VarRecPage *page;
+    RC r;
+    if((r = rmFileHandle->page_of(vPage, pageNum)))
+      return r;
+    bool held = view.holds(&pfh, pageNum);
+    if(held)
+      page = (RM_VarRecPage *)view.pageData_;
+    else {
+      PF_PageHandle pageHandle;
+      if((r = pfh.GetThisPage(pageNum, pageHandle)))
+        return r;
+      pageHandle.GetData((char * &)page);
+    }
+
+    for(; slotNum < page->numSlots; ++slotNum) {
+      RM_VarSlot *slot = varSlot(page, slotNum);
+      if(slot->offset == RM_VAR_FREE || (slot->length & RM_VAR_MOVED))
+        continue;
+      // the page holding the record, pinned too if it moved
+      RM_VarRecPage *rpage = page;
+      PageNum target = -1;
+      if(slot->length & RM_VAR_FORWARD) {
+        SlotNum targetSlot;
+        if((r = rmFileHandle->var_target(page->data + slot->offset, target,
+                                         targetSlot, (char *&)rpage))) {
+          if(!held)
+            pfh.UnpinPage(pageNum);
+          return r;
+        }
+        slot = varSlot(rpage, targetSlot);
+      }
+      const char *recData = rpage->data + slot->offset;
+      int length = varRecLength(slot);
+      bool isLong = slot->length & RM_VAR_LONG;
+      int here = isLong ? length - int(sizeof(RM_VarLong)) : length;
+
+      const char *condData = recData;
+      if(here < condEnd) {
+        memset(padded_, 0, condEnd);
+        memcpy(padded_, recData, here);
+        if(isLong) {
+          RM_VarLong desc = varLong(recData, length);
+          RM_RecCursor cursor;
+          int read;
+          cursor.open(rmFileHandle, recData, here, desc.length, desc.first,
+                      false);
+          r = cursor.Read(padded_, condEnd, read);
+          if(r && r != RM_EOF) {
+            if(target >= 0)
+              pfh.UnpinPage(target);
+            if(!held)
+              pfh.UnpinPage(pageNum);
+            return r;
+          }
+        }
+        condData = padded_;
+      }
+      if(!check_scan_cond(condData)) {
+        if(target >= 0)
+          pfh.UnpinPage(target);
+        continue;
+      }
+
+      // the view takes the pin of the page holding the record
+      if(target >= 0) {
+        view.hold(&pfh, target, (char *)rpage);
+        if(!held)
+          pfh.UnpinPage(pageNum);
+      } else if(!held)
+        view.hold(&pfh, pageNum, (char *)page);
+      view.set(recData, length, isLong, RID(vPage, slotNum));
+      curScanId_ = RID(vPage, slotNum + 1);
+      return OK_RC;
+    }
+    if(!held)
+      pfh.UnpinPage(pageNum);
   }
 
+  curScanId_ = RID(vPage, 0);
+  view.Release();
   return RM_EOF;
 }
+
+// Copy the next matching records into a batch.  The page the scan stops
+// on stays pinned by view_ for the next batch.
+RC RM_FileScan::GetNextBatch(char *pData, RID *rids, int maxRecs,
+                             int &numRecs, int *lengths)
+{
+  numRecs = 0;
+  if(!scanOpen_)
+    return RM_SCAN_NOT_OPEN;
+  if(maxRecs <= 0)
+    return RM_SCAN_BAD_BATCH;
+
+  if(!rmFileHandle->fileOpen_) {
+    this->CloseScan();
+    return RM_NOT_OPEN_FILE;
+  }
+
+  if(rmFileHandle->varLength)
+    return next_var_batch(pData, rids, maxRecs, numRecs, lengths);
+
+  PageNum vPage, pageNum;
+  SlotNum slotNum;
+  curScanId_.GetPageNum(vPage);
+  curScanId_.GetSlotNum(slotNum);
+  int recordSize = rmFileHandle->recordSize;
+  int recordPerPage = rmFileHandle->recordPerPage;
+  const PF_FileHandle &pfh = rmFileHandle->pfh_;
+
+  while(numRecs < maxRecs && vPage < rmFileHandle->totalPage) {
+    if(slotNum == 0 && (vPage = next_page(vPage)) >= rmFileHandle->totalPage)
+      break;
+    RC r = rmFileHandle->page_of(vPage, pageNum);
+    if(r)
+      return r;
+    bool held = view_.holds(&pfh, pageNum);
+    struct RM_FileRecPage * data;
+    if(held)
+      data = (struct RM_FileRecPage *)view_.pageData_;
+    else {
+      PF_PageHandle pageHandle;
+      if((r = pfh.GetThisPage(pageNum, pageHandle)))
+        return r;
+      pageHandle.GetData((char * &)data);
+    }
+
+    RM_FileRecPage *recs = rmFileHandle->rec_page(vPage, (char *)data);
+    unsigned char cand[sizeof(data->bitmap)];
+    page_matches(vPage, recs, cand);
+    for(slotNum = nextTakenSlot(cand, slotNum - 1);
+        slotNum < recordPerPage && numRecs < maxRecs;
+        slotNum = nextTakenSlot(cand, slotNum)) {
+      if(proj_.empty())
+        rmFileHandle->rec_get(recs, slotNum, pData + numRecs * recordSize);
+      else {
+        const char *recData = rmFileHandle->rec_at(recs, slotNum,
+                                                   rec_.data());
+        char *row = pData + numRecs * projLength_;
+        for(size_t i = 0; i < proj_.size(); ++i) {
+          memcpy(row, recData + proj_[i].attrOffset, proj_[i].attrLength);
+          row += proj_[i].attrLength;
+        }
+      }
+      if(rids)
+        rids[numRecs] = RID(vPage, slotNum);
+      ++numRecs;
+    }
+
+    if(slotNum >= recordPerPage) {
+      ++vPage;
+      slotNum = 0;
+      if(held)
+        view_.Release();
+      else
+        pfh.UnpinPage(pageNum);
+    } else if(!held)
+      view_.hold(&pfh, pageNum, (char *)data);
+  }
+
+  curScanId_ = RID(vPage, slotNum);
+  return numRecs ? OK_RC : RM_EOF;
+}
+
+// GetNextBatch on a file of variable-length records, a record at a time
+// through view_, which keeps each page pinned while the batch is on it
+RC RM_FileScan::next_var_batch(char *pData, RID *rids, int maxRecs,
+                               int &numRecs, int *lengths)
+{
+  int recordSize = rmFileHandle->recordSize;
+  RC r;
+  int rowLength = proj_.empty() ? recordSize : projLength_;
+  while(numRecs < maxRecs && !(r = next_var_rec(view_))) {
+    char *row = pData + (long)numRecs * rowLength;
+    if(!proj_.empty()) {
+      if((r = project(view_, row)))
+        return r;
+    } else if(view_.isLong) {
+      RM_RecCursor cursor;
+      int read;
+      cursor.open(rmFileHandle, view_.data,
+                  view_.inlineLength - int(sizeof(RM_VarLong)),
+                  view_.length_, view_.overflow_, false);
+      if((r = cursor.Read(row, view_.length_, read)))
+        return r;
+    } else
+      memcpy(row, view_.data, view_.length_);
+    if(rids)
+      rids[numRecs] = view_.rid_;
+    if(lengths)
+      lengths[numRecs] = view_.length_;
+    ++numRecs;
+  }
+  if(numRecs < maxRecs && r != RM_EOF)
+    return r;
+  return numRecs ? OK_RC : RM_EOF;
+}
+
 RC RM_FileScan::CloseScan ()                             // Close the scan
 {
   if(!scanOpen_)
     return RM_SCAN_NOT_OPEN;
   
+  view_.Release();
+  free(padded_);
+  padded_ = NULL;
+  proj_.clear();
+  projLength_ = 0;
+  free(projBuf_);
+  projBuf_ = NULL;
   scanOpen_ = false;
   return OK_RC;
 }
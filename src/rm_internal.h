@@ -1,33 +1,84 @@
 //only used for RM
+#include <cstring>
+#include <stdint.h>
+
 #define END_PAGE_LIST -1
 #define NXT_PAGE_DIR -2 //indicate the next entry is for the next page dir
-#define HEADER_LIST_HALF ((PF_PAGE_SIZE - sizeof(int)*7)/2)/4
-#define PAGE_DIR_LIST_SIZE (PF_PAGE_SIZE - sizeof(int)*2)/4
-#define DATA_ON_RECORD_PAGE (PF_PAGE_SIZE - sizeof(char)*16)
+#define DATA_ON_RECORD_PAGE (PF_PAGE_SIZE - sizeof(char)*16 - sizeof(LSN))
+#define RM_HEADER_PAGE 0 // the first page CreateFile allocates
+
+// The page directory maps every virtual page (the page number of a RID)
+// to its PF page and keeps its number of free slots.  The first entries
+// are on the header page, the rest on a chain of directory pages.  It is
+// kept up to date on disk as pages are added and filled or emptied, so
+// only the directory page holding the entry of a changed page gets
+// dirtied, and closing the file has nothing to rewrite.
+//
+// The header also indexes the first RM_DIR_INDEX_SIZE directory pages,
+// so that the entries of a virtual page can be found by reading a single
+// directory page.  Entries are loaded on demand; opening a file only
+// reads the header.  freeHint bounds the search for a page with free
+// slots: every page before it is full.
+//
+// The free slot counts of the directory are the persistent half of the
+// free-space map.  The in-memory half buckets the pages found to have
+// room into RM_FSM_TIERS tiers by free slots, and inserts go to the
+// fullest page there, so they cluster instead of spreading over every
+// half-empty page.  With a fill factor below 100 inserts leave the last
+// slots of a page free for later growth; a page counts as full once only
+// those are left.
+struct RM_PageDirEntry {
+  int pageNum;    // PF page number
+  int freeSlots;  // empty slots on the page
+};
+
+#define RM_DIR_INDEX_SIZE 256
+#define RM_FSM_TIERS 8
+#define RM_MAX_COLUMNS MAXATTRS
+#define HEADER_LIST_SIZE \
+  ((PF_PAGE_SIZE - sizeof(int)*(13 + RM_MAX_COLUMNS + RM_DIR_INDEX_SIZE)) \
+   /sizeof(RM_PageDirEntry))
+#define PAGE_DIR_LIST_SIZE \
+  ((PF_PAGE_SIZE - sizeof(int)*2)/sizeof(RM_PageDirEntry))
 
 struct RM_FileHeaderPage {
-  int recordSize;
+  int recordSize;  // the longest record of a variable-length file
+  int varLength;   // records are variable-length, on slotted pages
 
   int totalPage; 
-  int pageOnThis;
-  int nextPageDir; // Linklist of the next Empty Page Dir 
+  int numPageDir;  // number of page directory pages
+  int freeHint;    // no page before it has free slots
+  int fillFactor;  // percent of the slots of a page inserts may take
+  int nextPageDir; // first page directory page
+  int lastPageDir; // last page directory page, new entries go there
+  int freeOverflow; // first free overflow page
+  int inlinePrefix; // bytes of a long record kept on its record page
+  int numColumns;   // columns of PAX pages, 0 for whole records
+  int columns[RM_MAX_COLUMNS]; // the offset of each in the record
+  int firstCold;    // the last cold page Compress wrote, see below
+  int schemaPage;   // page of the schema, END_PAGE_LIST if none
 
-  int totalEmptyPage;
-  int emptyPageOnThis; 
-  int nextEmptyPageDir; // Linklist of the next Empty Page Directory
+  int pageDirIndex[RM_DIR_INDEX_SIZE]; // first page directory pages
+  RM_PageDirEntry pageList[HEADER_LIST_SIZE]; // first virtual pages
+};
 
-  int totalPageList[HEADER_LIST_HALF]; //all data can store
-  int emptyPageList[HEADER_LIST_HALF];
+// The schema of a file created with one, on a page of its own that is
+// written with the header and never changed
+struct RM_SchemaPage {
+  int numAttrs;
+  int pad;
+  RM_AttrInfo attrs[RM_MAX_COLUMNS];
 };
 
 struct RM_FilePageDirPage {
   int pageListSize;
   int nextPageDir;
-  int data[PAGE_DIR_LIST_SIZE];
+  RM_PageDirEntry data[PAGE_DIR_LIST_SIZE];
 };
 
 struct RM_FileRecPage {
   unsigned char bitmap[16];
+  LSN pageLSN; // LSN of the last logged change to this page
   char data[DATA_ON_RECORD_PAGE]; 
 };
 
@@ -48,28 +99,296 @@ inline void setEmptySlot(RM_FileRecPage * data, int slotNum)
   setEmptySlot(data, slotNum >> 3, slotNum & 0x7);
 }
 
+// The slot bitmap is handled 64 slots at a time: slot 64*w + b is bit b
+// of word w (the bitmap is read little-endian, as on i386), so finding
+// or counting slots is a ctz or popcount per word.  Slots past
+// recordPerPage are never taken.
+#define RM_BITMAP_WORDS (16 / sizeof(uint64_t))
+
+inline uint64_t bitmapWord(const unsigned char *bitmap, int w)
+{
+  uint64_t word;
+  memcpy(&word, bitmap + w * sizeof(uint64_t), sizeof(uint64_t));
+  return word;
+}
+
+// first free slot from startSlotNum on; false, with slotNum past the
+// bitmap, if there is none
 inline bool findFirstEmptySlot(struct RM_FileRecPage * data, 
                         int &slotNum, int startSlotNum = 0)
 {
-  int i = startSlotNum >> 3;
-  int j = startSlotNum & 0x7;
-  for(; j < 8; ++j)
-    if((((data->bitmap[i]) >> j) & 1) == 0){
-      slotNum = i * 8 + j;
+  int w = startSlotNum >> 6;
+  uint64_t mask = ~(uint64_t)0 << (startSlotNum & 63);
+  for(; w < int(RM_BITMAP_WORDS); ++w, mask = ~(uint64_t)0) {
+    uint64_t empty = ~bitmapWord(data->bitmap, w) & mask;
+    if(empty) {
+      slotNum = w * 64 + __builtin_ctzll(empty);
       return true;
     }
-  for(++i; i < 16; ++i)
-    if( data->bitmap[i] != 0xff)
-      break;
-  if(i == 16) {
-    slotNum = i * 8;
-    return false;
   }
-  for(j = 0; j < 8; ++j)
-    if( (((data->bitmap[i]) >> j) & 1) == 0 ){
-      slotNum = i * 8 + j;
-      return true;
-    }
-  return false;  
+  slotNum = RM_BITMAP_WORDS * 64;
+  return false;
+}
+
+// first taken slot after slotNum, past the bitmap if there is none
+inline int nextTakenSlot(const unsigned char *bitmap, int slotNum)
+{
+  int start = slotNum + 1;
+  int w = start >> 6;
+  if(w >= int(RM_BITMAP_WORDS))
+    return RM_BITMAP_WORDS * 64;
+  uint64_t taken = bitmapWord(bitmap, w) & (~(uint64_t)0 << (start & 63));
+  while(!taken) {
+    if(++w == int(RM_BITMAP_WORDS))
+      return RM_BITMAP_WORDS * 64;
+    taken = bitmapWord(bitmap, w);
+  }
+  return w * 64 + __builtin_ctzll(taken);
+}
+
+// number of taken slots among the first recordPerPage
+inline int countTaken(struct RM_FileRecPage * data, int recordPerPage)
+{
+  int n = 0;
+  int w;
+  for(w = 0; w < (recordPerPage >> 6); ++w)
+    n += __builtin_popcountll(bitmapWord(data->bitmap, w));
+  if(recordPerPage & 63)
+    n += __builtin_popcountll(bitmapWord(data->bitmap, w)
+                              & ((uint64_t(1) << (recordPerPage & 63)) - 1));
+  return n;
 }
 
+//
+// Fixed-length records may be kept in PAX pages instead, see
+// RM_Manager::CreateFile.  The record is split into columns at the
+// offsets kept in the header, and data holds a minipage per column: the
+// values of the column for all recordPerPage slots, one after the other.
+// Columns being in record order, the minipage of the column at offset o
+// starts at recordPerPage * o.  rec_at, rec_get and rec_put hide the
+// layout from everything but scan conditions, see rm_pax.cc.
+//
+void paxGet(const RM_FileRecPage *data, const vector<int> &columns,
+            int recordSize, int recordPerPage, int slotNum, char *out);
+void paxPut(RM_FileRecPage *data, const vector<int> &columns,
+            int recordSize, int recordPerPage, int slotNum,
+            const char *recData);
+
+// the record in slotNum, in place or put together in buf
+inline const char *RM_FileHandle::rec_at(const RM_FileRecPage *data,
+                                         int slotNum, char *buf) const
+{
+  if(columns.empty())
+    return data->data + slotNum * recordSize;
+  paxGet(data, columns, recordSize, recordPerPage, slotNum, buf);
+  return buf;
+}
+
+// copy the record in slotNum to out
+inline void RM_FileHandle::rec_get(const RM_FileRecPage *data, int slotNum,
+                                   char *out) const
+{
+  if(columns.empty())
+    memcpy(out, data->data + slotNum * recordSize, recordSize);
+  else
+    paxGet(data, columns, recordSize, recordPerPage, slotNum, out);
+}
+
+// write recData into slotNum
+inline void RM_FileHandle::rec_put(RM_FileRecPage *data, int slotNum,
+                                   const char *recData) const
+{
+  if(columns.empty())
+    memcpy(data->data + slotNum * recordSize, recData, recordSize);
+  else
+    paxPut(data, columns, recordSize, recordPerPage, slotNum, recData);
+}
+
+//
+// RM_FileHandle::Compress moves the records of a fixed-length file to
+// cold pages, see rm_cold.cc.  A cold page holds the records of up to
+// RM_COLD_MAX_PAGES consecutive virtual pages, each encoded as a segment
+// of data that ends at ends[i], and the directory entry of each of them
+// points to it, with no free slots.  The pageLSN of a cold page is
+// RM_COLD_LSN, which no record page has, so readers tell one from the
+// other by that alone; rec_page decodes the page of a virtual page from
+// either.  Cold pages are never changed: the first change to a record on
+// one gives its virtual page a record page again (see thaw).  The cold
+// pages Compress wrote are chained from firstCold in the header, so
+// that the next Compress frees them even once no virtual page is left
+// on them.
+//
+#define RM_COLD_LSN LSN(-1)
+#define RM_COLD_MAX_PAGES 32
+
+struct RM_ColdPage {
+  int firstPage;   // virtual page of the first segment
+  int numPages;    // segments on the page
+  int nextCold;    // the cold page Compress wrote before this one
+  int pad;
+  LSN pageLSN;     // RM_COLD_LSN
+  unsigned short ends[RM_COLD_MAX_PAGES];
+  char data[DATA_ON_RECORD_PAGE
+            - RM_COLD_MAX_PAGES * sizeof(unsigned short)];
+};
+
+#define RM_COLD_ROOM int(sizeof(((RM_ColdPage *)0)->data))
+
+// rm_cold.cc: the length of the segment of a record page, -1 if longer
+// than room, and the record page of segment i of a cold page
+int  coldEncode(const RM_FileRecPage *data, const vector<int> &columns,
+                const vector<int> &bounds, int recordSize,
+                int recordPerPage, char *out, int room);
+void coldDecode(const RM_ColdPage *page, int i, const vector<int> &columns,
+                const vector<int> &bounds, int recordSize,
+                int recordPerPage, RM_FileRecPage *out);
+
+//
+// Record pages of a variable-length file are slotted.  Records are
+// packed from the front of data and the slot directory grows down from
+// its end, one RM_VarSlot per slot.  A record that no longer fits on its
+// page after an update moves to another page (flagged RM_VAR_MOVED) and
+// leaves its RID there in the old slot (flagged RM_VAR_FORWARD), so RIDs
+// never change.  Space freed by deletes and shrinking updates is
+// reclaimed by compacting the page when an insert needs it.
+//
+// An all-zero page is an empty slotted page, and pageLSN is where it is
+// on a page of fixed-length records.
+//
+struct RM_VarRecPage {
+  unsigned short numSlots;   // entries in the slot directory
+  unsigned short freeStart;  // the records end before it
+  unsigned short usedBytes;  // taken by records, holes excluded
+  unsigned char pad[10];
+  LSN pageLSN;
+  char data[DATA_ON_RECORD_PAGE];
+};
+
+struct RM_VarSlot {
+  unsigned short offset;     // RM_VAR_FREE for a free slot
+  unsigned short length;     // the record length and its RM_VAR_ flags
+};
+
+// where a moved record went
+struct RM_VarStub {
+  int vPage;
+  int slotNum;
+};
+
+#define RM_VAR_FREE      0xffff
+#define RM_VAR_FORWARD   0x8000 // the record moved, the slot holds a stub
+#define RM_VAR_MOVED     0x4000 // a moved record, reached by its stub
+#define RM_VAR_LONG      0x2000 // a long record, see RM_VarLong
+#define RM_VAR_FLAGS     (RM_VAR_FORWARD | RM_VAR_MOVED | RM_VAR_LONG)
+#define RM_VAR_MIN_SPACE int(sizeof(RM_VarStub)) // least room of a record
+#define RM_VAR_MAX_RECORD int(DATA_ON_RECORD_PAGE - sizeof(RM_VarSlot))
+#define RM_VAR_MAX_SLOTS \
+  int(DATA_ON_RECORD_PAGE / (RM_VAR_MIN_SPACE + sizeof(RM_VarSlot)))
+
+inline RM_VarSlot *varSlot(RM_VarRecPage *page, int slotNum)
+{
+  return (RM_VarSlot *)(page->data + DATA_ON_RECORD_PAGE) - (slotNum + 1);
+}
+
+// room taken by a record of length bytes, so that a stub always fits
+inline int varSpace(int length)
+{
+  return length < RM_VAR_MIN_SPACE ? RM_VAR_MIN_SPACE : length;
+}
+
+inline int varRecLength(const RM_VarSlot *slot)
+{
+  return slot->length & ~RM_VAR_FLAGS;
+}
+
+inline bool varSlotUsed(RM_VarRecPage *page, int slotNum)
+{
+  return slotNum < page->numSlots
+         && varSlot(page, slotNum)->offset != RM_VAR_FREE;
+}
+
+// free bytes of a page, holes included
+inline int varFreeBytes(const RM_VarRecPage *page)
+{
+  return DATA_ON_RECORD_PAGE - page->usedBytes
+         - page->numSlots * sizeof(RM_VarSlot);
+}
+
+// rm_varpage.cc
+int  varFindSlot(RM_VarRecPage *page);
+bool varFits    (RM_VarRecPage *page, int slotNum, int length);
+bool varPut     (RM_VarRecPage *page, int slotNum, const char *record,
+                 int length, int flags);
+void varErase   (RM_VarRecPage *page, int slotNum);
+
+//
+// A record longer than RM_VAR_MAX_INLINE is long: its record page only
+// keeps its first bytes (the inline prefix of the file, RM_VAR_DEF_PREFIX
+// unless set), followed by an RM_VarLong, and its slot is flagged
+// RM_VAR_LONG.  The rest of the record is on a chain of overflow pages,
+// full but for the last.  The fixed-width attributes at the front of a
+// record stay in the prefix, so scans on them never read the chain.
+//
+// Freed chains go on a free list of overflow pages whose head is kept in
+// the file header.  Overflow pages are logged as RM_LOG_OVERFLOW records
+// with images of their first bytes (see ovfImage); the images carry the
+// head of the free list before and after the change in flags1 and
+// flags2, and a change to a page just allocated from PF has no before
+// image.
+//
+struct RM_VarLong {
+  int length;      // of the whole record
+  PageNum first;   // first overflow page
+  PageNum last;    // last overflow page
+};
+
+struct RM_OverflowPage {
+  int nextPage;    // next page of the chain or of the free list
+  int length;      // bytes of data used
+  unsigned char pad[8];
+  LSN pageLSN;
+  char data[DATA_ON_RECORD_PAGE];
+};
+
+#define RM_VAR_MAX_INLINE  int(DATA_ON_RECORD_PAGE / 4)
+#define RM_VAR_MAX_PREFIX  int(RM_VAR_MAX_INLINE - sizeof(RM_VarLong))
+#define RM_VAR_DEF_PREFIX  128
+#define RM_OVF_HDR_SIZE    int(2 * sizeof(int)) // nextPage and length
+#define RM_OVF_MAX_IMAGE   int(RM_OVF_HDR_SIZE + DATA_ON_RECORD_PAGE)
+
+// the RM_VarLong at the end of the inline part of a long record
+inline RM_VarLong varLong(const char *recData, int inlineLength)
+{
+  RM_VarLong desc;
+  memcpy(&desc, recData + inlineLength - sizeof(RM_VarLong),
+         sizeof(RM_VarLong));
+  return desc;
+}
+
+// An image of an overflow page is its header followed by length bytes
+// of data.  Applying one of just RM_OVF_HDR_SIZE bytes only relinks the
+// page.
+inline int ovfImage(const RM_OverflowPage *page, char *image)
+{
+  memcpy(image, page, RM_OVF_HDR_SIZE);
+  memcpy(image + RM_OVF_HDR_SIZE, page->data, page->length);
+  return RM_OVF_HDR_SIZE + page->length;
+}
+
+inline void ovfApply(RM_OverflowPage *page, const char *image, int length)
+{
+  memcpy(page, image, RM_OVF_HDR_SIZE);
+  memcpy(page->data, image + RM_OVF_HDR_SIZE, length - RM_OVF_HDR_SIZE);
+}
+
+// rm_zonemap.cc: zone maps are kept in the file name with RM_ZONE_SUFFIX
+// appended.  zoneCompare orders two attributes as the scan filters do,
+// and zoneValue is false for a NaN float, which is in no zone.
+#define RM_ZONE_SUFFIX ".zone"
+int  zoneCompare(AttrType type, const char *a, const char *b, int length);
+bool zoneValue  (AttrType type, const char *value);
+
+// rm_scanfilter.cc: the RM_ScanFilter of a comparison.  A page of a
+// fixed-length file is filtered in one call, a record of a
+// variable-length file in a call with a count of 1.
+RM_ScanFilter scanFilter(AttrType type, CompOp op);
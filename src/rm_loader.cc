@@ -0,0 +1,342 @@
+//
+// rm_loader.cc
+//
+//   Bulk loads, see RM_Loader in rm.h
+//
+// The calling thread reads the input in blocks of whole rows, with large
+// sequential reads, and keeps a few blocks ahead of the one it inserts.
+// Threads take the blocks read in turn and parse their rows into
+// records.  The calling thread inserts the records of each block once it
+// is parsed, in input order, with InsertRecs: a new page is pinned and
+// logged once and left full.  When the next block is still waiting to be
+// parsed, the calling thread parses it itself, so a load gets through
+// even when no thread could be started.
+//
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include "rm.h"
+#include "rm_internal.h"
+
+#define RM_LOAD_BLOCK (1024 * 1024) // bytes of input read at a time
+#define RM_LOAD_AHEAD 2             // blocks read ahead for each thread
+
+struct RM_Loader::Block {
+  enum State { READ, PARSING, PARSED };
+  State state;
+  vector<char> text;   // whole rows of input
+  vector<char> rows;   // the records parsed from them
+  int numRows;
+  RC rc;               // RM_LOAD_BAD_ROW if row numRows is bad
+};
+
+struct RM_Loader::Job {
+  const RM_Loader *loader;
+  int recordSize;
+  deque<Block *> blocks;   // read and not inserted yet, in input order
+  bool closing;
+  pthread_mutex_t lock;    // guards blocks, closing and the block states
+  pthread_cond_t read;     // a block was read, or closing was set
+  pthread_cond_t parsed;   // a block was parsed
+};
+
+RM_Loader::RM_Loader  ():delim_(',')
+{
+}
+
+RM_Loader::~RM_Loader ()
+{
+}
+
+RC RM_Loader::SetCsv(const RM_LoadAttr *attrs, int numAttrs, char delim)
+{
+  if(numAttrs <= 0 || delim == '\n' || delim == '"')
+    return RM_LOAD_BAD_ATTR;
+  attrs_.assign(attrs, attrs + numAttrs);
+  delim_ = delim;
+  return OK_RC;
+}
+
+RC RM_Loader::SetCsv(const RM_FileHandle &fileHandle, char delim)
+{
+  vector<RM_AttrInfo> schema;
+  RC r = fileHandle.GetSchema(schema);
+  if(r)
+    return r;
+  vector<RM_LoadAttr> attrs(schema.size());
+  for(size_t i = 0; i < schema.size(); ++i) {
+    attrs[i].attrType = schema[i].attrType;
+    attrs[i].attrLength = schema[i].attrLength;
+    attrs[i].attrOffset = schema[i].attrOffset;
+  }
+  return SetCsv(attrs.empty() ? NULL : &attrs[0], int(attrs.size()), delim);
+}
+
+RC RM_Loader::SetBinary()
+{
+  attrs_.clear();
+  return OK_RC;
+}
+
+// store field f, len bytes long, in the attribute of rec
+static bool loadField(const RM_LoadAttr &attr, const char *f, int len,
+                      char *rec)
+{
+  char num[64];
+  char *end;
+  if(attr.attrType == STRING) {
+    if(len > attr.attrLength)
+      return false;
+    memcpy(rec + attr.attrOffset, f, len);
+    return true;
+  }
+  if(len == 0 || len >= int(sizeof(num)))
+    return false;
+  memcpy(num, f, len);
+  num[len] = 0;
+  errno = 0;
+  if(attr.attrType == INT) {
+    long v = strtol(num, &end, 10);
+    if(*end || errno || v < INT_MIN || v > INT_MAX)
+      return false;
+    int i = int(v);
+    memcpy(rec + attr.attrOffset, &i, sizeof(int));
+  } else {
+    float v = strtof(num, &end);
+    if(*end || errno)
+      return false;
+    memcpy(rec + attr.attrOffset, &v, sizeof(float));
+  }
+  return true;
+}
+
+// parse the fields of the line from p to end into rec, which is zeroed
+bool RM_Loader::parse_row(const char *p, const char *end, char *rec) const
+{
+  string quoted;
+  for(size_t i = 0; i < attrs_.size(); ++i) {
+    if(i > 0 && (p == end || *p++ != delim_))
+      return false;
+    const char *f = p;
+    int len;
+    if(p < end && *p == '"') {
+      quoted.clear();
+      for(++p; ; ++p) {
+        if(p == end)
+          return false;
+        if(*p == '"' && (p + 1 == end || p[1] != '"'))
+          break;
+        if(*p == '"')
+          ++p;
+        quoted += *p;
+      }
+      ++p;
+      f = quoted.data();
+      len = int(quoted.size());
+    } else {
+      while(p < end && *p != delim_)
+        ++p;
+      len = int(p - f);
+    }
+    if(!loadField(attrs_[i], f, len, rec))
+      return false;
+  }
+  return p == end;
+}
+
+// parse the rows of a block into records, up to the first bad one
+void RM_Loader::parse(Block &block, int recordSize) const
+{
+  block.numRows = 0;
+  block.rc = OK_RC;
+  if(attrs_.empty()) {
+    block.numRows = int(block.text.size() / recordSize);
+    if(block.text.size() % recordSize)
+      block.rc = RM_LOAD_BAD_ROW;
+    block.rows.swap(block.text);
+    return;
+  }
+
+  const char *p = block.text.data(), *end = p + block.text.size();
+  int lines = 1;
+  for(const char *q = p; (q = (const char *)memchr(q, '\n', end - q)); ++q)
+    ++lines;
+  block.rows.assign(long(lines) * recordSize, 0);
+  while(p < end) {
+    const char *eol = (const char *)memchr(p, '\n', end - p);
+    if(!eol)
+      eol = end;
+    const char *lineEnd = eol > p && eol[-1] == '\r' ? eol - 1 : eol;
+    if(lineEnd > p) {
+      if(!parse_row(p, lineEnd,
+                    &block.rows[long(block.numRows) * recordSize])) {
+        block.rc = RM_LOAD_BAD_ROW;
+        break;
+      }
+      ++block.numRows;
+    }
+    p = eol + 1;
+  }
+  block.text.clear();
+}
+
+// Read the next block of whole rows, NULL at the end of the input.  carry
+// holds the input read but not yet in a block.
+RC RM_Loader::read_block(int fd, int recordSize, vector<char> &carry,
+                         Block *&block) const
+{
+  block = NULL;
+  size_t whole = 0;  // bytes of whole rows at the start of carry
+  bool eof = false;
+  while(!whole && !eof) {
+    size_t old = carry.size();
+    carry.resize(old + RM_LOAD_BLOCK);
+    ssize_t n = read(fd, &carry[old], RM_LOAD_BLOCK);
+    if(n < 0)
+      return RM_LOAD_IO_ERROR;
+    carry.resize(old + n);
+    eof = n == 0;
+    if(attrs_.empty())
+      whole = carry.size() / recordSize * recordSize;
+    else
+      for(whole = carry.size(); whole > 0 && carry[whole - 1] != '\n'; )
+        --whole;
+  }
+  // the last line may have no newline; a partial record is parsed as a
+  // bad row
+  if(eof)
+    whole = carry.size();
+  if(!whole)
+    return OK_RC;
+
+  block = new Block;
+  block->state = Block::READ;
+  block->text.swap(carry);
+  carry.assign(block->text.begin() + whole, block->text.end());
+  block->text.resize(whole);
+  return OK_RC;
+}
+
+void *RM_Loader::work(void *arg)
+{
+  Job *job = (Job *)arg;
+  pthread_mutex_lock(&job->lock);
+  while(!job->closing) {
+    Block *block = NULL;
+    for(size_t i = 0; i < job->blocks.size() && !block; ++i)
+      if(job->blocks[i]->state == Block::READ)
+        block = job->blocks[i];
+    if(!block) {
+      pthread_cond_wait(&job->read, &job->lock);
+      continue;
+    }
+    block->state = Block::PARSING;
+    pthread_mutex_unlock(&job->lock);
+    job->loader->parse(*block, job->recordSize);
+    pthread_mutex_lock(&job->lock);
+    block->state = Block::PARSED;
+    pthread_cond_broadcast(&job->parsed);
+  }
+  pthread_mutex_unlock(&job->lock);
+  return NULL;
+}
+
+RC RM_Loader::Load(RM_FileHandle &fileHandle, const char *fileName,
+                   int &numRecs, int numThreads)
+{
+  numRecs = 0;
+  if(!fileHandle.fileOpen_)
+    return RM_NOT_OPEN_FILE;
+  int recordSize = fileHandle.recordSize;
+  for(size_t i = 0; i < attrs_.size(); ++i) {
+    const RM_LoadAttr &a = attrs_[i];
+    if(a.attrOffset < 0 || a.attrLength <= 0
+       || a.attrOffset + a.attrLength > recordSize
+       || (a.attrType != STRING && a.attrLength != 4))
+      return RM_LOAD_BAD_ATTR;
+  }
+  int fd = open(fileName, O_RDONLY);
+  if(fd < 0)
+    return RM_LOAD_IO_ERROR;
+
+  // binary rows need no parsing, nor threads
+  if(numThreads <= 0)
+    numThreads = int(sysconf(_SC_NPROCESSORS_ONLN));
+  if(numThreads <= 0 || attrs_.empty())
+    numThreads = 0;
+  Job job;
+  job.loader = this;
+  job.recordSize = recordSize;
+  job.closing = false;
+  pthread_mutex_init(&job.lock, NULL);
+  pthread_cond_init(&job.read, NULL);
+  pthread_cond_init(&job.parsed, NULL);
+  vector<pthread_t> threads;
+  for(int i = 0; i < numThreads; ++i) {
+    pthread_t t;
+    if(pthread_create(&t, NULL, work, &job) == 0)
+      threads.push_back(t);
+  }
+
+  vector<char> carry;
+  bool eof = false;
+  RC r = OK_RC;
+  while(!r) {
+    Block *block;
+    while(!eof && job.blocks.size() <= RM_LOAD_AHEAD * threads.size()) {
+      if((r = read_block(fd, recordSize, carry, block)))
+        break;
+      eof = block == NULL;
+      if(block) {
+        pthread_mutex_lock(&job.lock);
+        job.blocks.push_back(block);
+        pthread_cond_signal(&job.read);
+        pthread_mutex_unlock(&job.lock);
+      }
+    }
+    if(r || job.blocks.empty())
+      break;
+
+    pthread_mutex_lock(&job.lock);
+    block = job.blocks.front();
+    if(block->state == Block::READ) {
+      block->state = Block::PARSING;
+      pthread_mutex_unlock(&job.lock);
+      parse(*block, recordSize);
+      pthread_mutex_lock(&job.lock);
+      block->state = Block::PARSED;
+    }
+    while(block->state != Block::PARSED)
+      pthread_cond_wait(&job.parsed, &job.lock);
+    job.blocks.pop_front();
+    pthread_mutex_unlock(&job.lock);
+
+    if(block->numRows > 0
+       && !(r = fileHandle.InsertRecs(&block->rows[0], block->numRows,
+                                      NULL)))
+      numRecs += block->numRows;
+    if(!r)
+      r = block->rc;
+    delete block;
+  }
+  close(fd);
+
+  pthread_mutex_lock(&job.lock);
+  job.closing = true;
+  pthread_cond_broadcast(&job.read);
+  pthread_mutex_unlock(&job.lock);
+  for(size_t i = 0; i < threads.size(); ++i)
+    pthread_join(threads[i], NULL);
+  for(size_t i = 0; i < job.blocks.size(); ++i)
+    delete job.blocks[i];
+  pthread_mutex_destroy(&job.lock);
+  pthread_cond_destroy(&job.read);
+  pthread_cond_destroy(&job.parsed);
+  return r ? r : fileHandle.Commit();
+}
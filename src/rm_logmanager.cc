@@ -0,0 +1,263 @@
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "rm.h"
+#include "rm_internal.h"
+#include "rm_logmanager.h"
+
+RM_LogManager::RM_LogManager()
+{
+  fd = -1;
+  buf = NULL;
+  commitsPerFlush = 1;
+  pendingCommits = 0;
+  firstLSN = writtenLSN = flushedLSN = endLSN = RM_LOG_FIRST_LSN;
+  commitLSN = RM_LOG_FIRST_LSN;
+}
+
+RM_LogManager::~RM_LogManager()
+{
+  if(fd >= 0)
+    Close();
+}
+
+// FNV-1a, enough to tell a torn or garbage record from a real one
+unsigned int RM_LogChecksum(const char *data, int length, unsigned int seed)
+{
+  unsigned int h = seed;
+  for(int i = 0; i < length; ++i) {
+    h ^= (unsigned char)data[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+RC RM_LogManager::Open(const char *logFileName)
+{
+  if(fd >= 0)
+    return RM_LOG_IO_ERROR;
+  if((fd = open(logFileName, O_RDWR | O_CREAT, 0600)) < 0)
+    return RM_LOG_IO_ERROR;
+  fileName = logFileName;
+
+  struct stat st;
+  RM_LogFileHdr hdr;
+  if(fstat(fd, &st) < 0)
+    goto err;
+  if(st.st_size < (off_t)sizeof(RM_LogFileHdr)) {
+    // new log
+    memset(&hdr, 0, sizeof(RM_LogFileHdr));
+    hdr.magic = RM_LOG_MAGIC;
+    hdr.firstLSN = RM_LOG_FIRST_LSN;
+    if(ftruncate(fd, 0) < 0 ||
+       write(fd, &hdr, sizeof(RM_LogFileHdr)) != sizeof(RM_LogFileHdr) ||
+       fsync(fd) < 0)
+      goto err;
+    st.st_size = sizeof(RM_LogFileHdr);
+  } else if(read(fd, &hdr, sizeof(RM_LogFileHdr)) != sizeof(RM_LogFileHdr)
+            || hdr.magic != RM_LOG_MAGIC)
+    goto err;
+
+  firstLSN = hdr.firstLSN;
+  endLSN = firstLSN + (st.st_size - sizeof(RM_LogFileHdr));
+  writtenLSN = flushedLSN = endLSN;
+  // the records of a log that is not empty are recovered, and the log
+  // truncated, before anything is committed
+  commitLSN = firstLSN;
+  pendingCommits = 0;
+  buf = (char *)malloc(RM_LOG_BUFFER_SIZE);
+  return OK_RC;
+
+err:
+  close(fd);
+  fd = -1;
+  return RM_LOG_IO_ERROR;
+}
+
+RC RM_LogManager::Close()
+{
+  if(fd < 0)
+    return RM_LOG_IO_ERROR;
+  RC r = Flush(endLSN);
+  close(fd);
+  fd = -1;
+  free(buf);
+  buf = NULL;
+  return r;
+}
+
+// write the buffered records to the end of the file, no fsync
+RC RM_LogManager::WriteBuffer()
+{
+  int len = int(endLSN - writtenLSN);
+  if(len == 0)
+    return OK_RC;
+  off_t offset = sizeof(RM_LogFileHdr) + (writtenLSN - firstLSN);
+  if(lseek(fd, offset, SEEK_SET) < 0 || write(fd, buf, len) != len)
+    return RM_LOG_IO_ERROR;
+  writtenLSN = endLSN;
+  return OK_RC;
+}
+
+RC RM_LogManager::Append(RM_LogRec &rec, const char *image1,
+                         const char *image2)
+{
+  if(!image1)
+    rec.imageLen = 0;
+  if(!image2)
+    rec.image2Len = 0;
+  int len = sizeof(RM_LogRec) + rec.imageLen + rec.image2Len;
+  if(len > RM_LOG_BUFFER_SIZE)
+    return RM_LOG_IO_ERROR;
+
+  RC r;
+  if(endLSN - writtenLSN + len > RM_LOG_BUFFER_SIZE
+     && (r = WriteBuffer()))
+    return r;
+
+  rec.lsn = endLSN;
+  rec.length = len;
+  rec.checksum = 0;
+
+  char *p = buf + (endLSN - writtenLSN);
+  memcpy(p, &rec, sizeof(RM_LogRec));
+  if(image1)
+    memcpy(p + sizeof(RM_LogRec), image1, rec.imageLen);
+  if(image2)
+    memcpy(p + sizeof(RM_LogRec) + rec.imageLen, image2, rec.image2Len);
+  rec.checksum = RM_LogChecksum(p, len);
+  ((RM_LogRec *)p)->checksum = rec.checksum;
+
+  endLSN += len;
+  return OK_RC;
+}
+
+// make every record with an LSN up to lsn durable, along with all the
+// records before it; one write and one fsync cover the whole group
+RC RM_LogManager::Flush(LSN lsn)
+{
+  if(lsn < flushedLSN)
+    return OK_RC;
+  RC r;
+  if((r = WriteBuffer()))
+    return r;
+  if(fsync(fd) < 0)
+    return RM_LOG_IO_ERROR;
+  flushedLSN = endLSN;
+  pendingCommits = 0;
+  return OK_RC;
+}
+
+RC RM_LogManager::Commit()
+{
+  RM_LogRec rec;
+  memset(&rec, 0, sizeof(RM_LogRec));
+  rec.type = RM_LOG_COMMIT;
+  RC r = Append(rec);
+  if(r)
+    return r;
+  commitLSN = endLSN;
+  if(++pendingCommits < commitsPerFlush)
+    return OK_RC;
+  return Flush(rec.lsn);
+}
+
+RC RM_LogManager::SetAsyncCommit(int commits)
+{
+  commitsPerFlush = commits < 1 ? 1 : commits;
+  if(pendingCommits >= commitsPerFlush)
+    return Flush(endLSN);
+  return OK_RC;
+}
+
+RC RM_LogManager::Truncate()
+{
+  RM_LogFileHdr hdr;
+  memset(&hdr, 0, sizeof(RM_LogFileHdr));
+  hdr.magic = RM_LOG_MAGIC;
+  hdr.firstLSN = endLSN;
+
+  // the header is rewritten first, so that a crash in between leaves a
+  // log that starts at endLSN and holds nothing worth redoing
+  if(lseek(fd, 0, SEEK_SET) < 0 ||
+     write(fd, &hdr, sizeof(RM_LogFileHdr)) != sizeof(RM_LogFileHdr) ||
+     ftruncate(fd, sizeof(RM_LogFileHdr)) < 0 ||
+     fsync(fd) < 0)
+    return RM_LOG_IO_ERROR;
+
+  firstLSN = writtenLSN = flushedLSN = commitLSN = endLSN;
+  pendingCommits = 0;
+  return OK_RC;
+}
+
+// the records kept go to <log>.tmp, which is synced and renamed over the
+// log, so that a crash leaves either log whole.  The buffer, empty once
+// written, carries them.
+RC RM_LogManager::Cut(LSN lsn)
+{
+  if(fd < 0 || lsn < firstLSN || lsn > commitLSN)
+    return RM_LOG_IO_ERROR;
+  if(lsn == firstLSN)
+    return OK_RC;
+  RC r;
+  if((r = WriteBuffer()))
+    return r;
+
+  RM_LogFileHdr hdr;
+  memset(&hdr, 0, sizeof(RM_LogFileHdr));
+  hdr.magic = RM_LOG_MAGIC;
+  hdr.firstLSN = lsn;
+  string tmp = fileName + ".tmp";
+  int tmpFd = open(tmp.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+  if(tmpFd < 0)
+    return RM_LOG_IO_ERROR;
+  bool ok = write(tmpFd, &hdr, sizeof(RM_LogFileHdr))
+            == ssize_t(sizeof(RM_LogFileHdr));
+  off_t from = sizeof(RM_LogFileHdr) + (lsn - firstLSN);
+  for(LSN at = lsn; ok && at < endLSN; ) {
+    int len = endLSN - at < RM_LOG_BUFFER_SIZE ? int(endLSN - at)
+                                               : RM_LOG_BUFFER_SIZE;
+    ok = pread(fd, buf, len, from) == len && write(tmpFd, buf, len) == len;
+    from += len;
+    at += len;
+  }
+  if(!ok || fsync(tmpFd) < 0 || rename(tmp.c_str(), fileName.c_str()) < 0) {
+    close(tmpFd);
+    unlink(tmp.c_str());
+    return RM_LOG_IO_ERROR;
+  }
+  close(fd);
+  fd = tmpFd;
+  firstLSN = lsn;
+  flushedLSN = endLSN;
+  pendingCommits = 0;
+  return OK_RC;
+}
+
+RC RM_LogManager::ReadAll(char *&data, long &length)
+{
+  if(fd < 0 || writtenLSN != endLSN)
+    return RM_LOG_IO_ERROR;
+  length = long(writtenLSN - firstLSN);
+  data = (char *)malloc(length > 0 ? length : 1);
+  // read in pieces, a single read may return less than asked for
+  for(long done = 0; done < length; ) {
+    ssize_t n = pread(fd, data + done, length - done,
+                      sizeof(RM_LogFileHdr) + done);
+    if(n <= 0) {
+      free(data);
+      data = NULL;
+      return RM_LOG_IO_ERROR;
+    }
+    done += n;
+  }
+  return OK_RC;
+}
+
+RC RM_LogManager::FlushLog(void *ctx, LSN lsn)
+{
+  return ((RM_LogManager *)ctx)->Flush(lsn);
+}
@@ -0,0 +1,164 @@
+//
+// rm_logmanager.h
+//
+//   Write-ahead log of an RM file
+//
+// Every RM file has a log next to it (the file name with ".log"
+// appended).  RM_FileHandle appends a record for each insert, delete and
+// update before changing the page, and stamps the page with the LSN of
+// that record.  The buffer manager forces the log up to a page's LSN
+// before writing the page, so data pages can be written lazily.
+//
+// Log records are collected in memory and written with one write and one
+// fsync when the log is flushed: when a dirty page needs it, when the
+// buffer is full, or on commit.  With a group size above one, commits
+// are batched and a group of them shares a single flush.
+//
+// A fuzzy checkpoint (RM_FileHandle::Checkpoint) logs the dirty page
+// table of the file without writing any page.  Redo after a crash starts
+// at the oldest change in that table, and the pages in it are trickled
+// out by the buffer manager afterwards, so the next checkpoint finds
+// fewer of them.  The records before both the oldest change still in
+// the buffer and the last commit are then needed by neither redo nor
+// undo, and a checkpoint cuts them off the log (see Cut), so that a file
+// kept open does not grow its log, or the work of recovering it,
+// without bound.
+//
+// LSNs are byte positions in the stream of log records.  The log file
+// starts with an RM_LogFileHdr that holds the LSN of the first record in
+// the file, so LSNs keep growing when the log is truncated.
+//
+
+#ifndef RM_LOGMANAGER_H
+#define RM_LOGMANAGER_H
+
+#include "rm.h"
+
+#define RM_LOG_SUFFIX       ".log"      // appended to the RM file name
+#define RM_LOG_MAGIC        0x524d4c47  // "RMLG"
+#define RM_LOG_FIRST_LSN    1           // LSN of the very first record
+#define RM_LOG_BUFFER_SIZE  (64 * 1024) // size of the in-memory log tail
+#define RM_CHECKPOINT_INTERVAL (1024 * 1024) // default log bytes between
+                                             // checkpoints
+
+//
+// Log record types
+//
+#define RM_LOG_INSERT   1   // record inserted, after image
+#define RM_LOG_DELETE   2   // record deleted, before image
+#define RM_LOG_UPDATE   3   // record updated, before and after image
+#define RM_LOG_NEWPAGE  4   // page pageNum appended as virtual page vPage
+#define RM_LOG_COMMIT   5   // everything before is committed
+#define RM_LOG_CHECKPOINT 6 // RM_LogCheckpoint and the dirty page table
+#define RM_LOG_NEWDIR   7   // page pageNum appended as directory page vPage
+#define RM_LOG_OVERFLOW 8   // overflow page pageNum written, before and after
+                            // image, see rm_internal.h
+#define RM_LOG_INSERTS  9   // records inserted into the slots from slotNum
+                            // on, their after images one after the other
+                            // (fixed-length files only)
+#define RM_LOG_THAW     10  // page pageNum replaces the cold page of vPage,
+                            // its image as it was decoded, see
+                            // rm_internal.h
+
+struct RM_LogFileHdr {
+  int magic;
+  int pad;
+  LSN firstLSN;     // LSN of the first record in the file
+};
+
+//
+// Header of every log record.  The images follow the header: none, one
+// (insert: after image, or the after images of a run of inserts, delete:
+// before image) or two (update: before then after image).  In a variable-length file the images may differ in
+// length, and they carry the RM_VAR_ flags of their slot.
+//
+struct RM_LogRec {
+  LSN lsn;          // LSN of this record
+  int type;         // RM_LOG_*
+  int length;       // length of the whole record, images included
+  int vPage;        // virtual page number (the page number of the RID)
+  int pageNum;      // PF page number
+  int slotNum;
+  int imageLen;     // length of the first image
+  unsigned int checksum; // over the record with checksum set to 0
+  int image2Len;    // length of the second image
+  int flags1;       // slot flags of the first image (RM_LOG_OVERFLOW: the
+                    // free overflow list before)
+  int flags2;       // slot flags of the second image (RM_LOG_OVERFLOW:
+                    // the free overflow list after)
+};
+
+//
+// Image of a checkpoint record: the redo point, followed by numDirty
+// PF_DirtyPage entries, oldest first.  With a single implicit
+// transaction per file there is no transaction table to save; the last
+// commit before the crash is found by the log scan anyway.
+//
+struct RM_LogCheckpoint {
+  LSN redoLSN;      // no change before it is missing from the disk
+  int numDirty;
+  int pad;
+};
+
+class RM_LogManager {
+public:
+  RM_LogManager ();
+  ~RM_LogManager();
+
+  RC Open    (const char *logFileName);      // open or create the log
+  RC Close   ();
+
+  // Append a record.  The type, vPage, pageNum, slotNum, image lengths
+  // and flags of rec must be set; the rest is filled in, lsn included.
+  RC Append  (RM_LogRec &rec, const char *image1 = NULL,
+              const char *image2 = NULL);
+
+  RC Flush   (LSN lsn);                       // durable up to lsn
+  RC Commit  ();                              // log a commit
+  RC SetAsyncCommit(int commits);             // commits per flush
+
+  // Throw away all records.  Only allowed once every page they describe
+  // is durable on disk.
+  RC Truncate();
+
+  // Throw away the records before lsn, which starts a record no later
+  // than the last commit.  Only allowed once every page those records
+  // describe is durable on disk.  The records kept are copied to a new
+  // log file that replaces this one.
+  RC Cut     (LSN lsn);
+
+  // Read every record in the file into a malloc'ed buffer that the
+  // caller frees.  Used by recovery, right after Open.
+  RC ReadAll (char *&data, long &length);
+
+  LSN GetFirstLSN  () const { return firstLSN; }
+  LSN GetEndLSN    () const { return endLSN; }
+  LSN GetFlushedLSN() const { return flushedLSN; }
+  LSN GetCommitLSN () const { return commitLSN; }
+
+  // Adapter for PF_FileHandle::SetLogFlusher, ctx is the RM_LogManager
+  static RC FlushLog(void *ctx, LSN lsn);
+
+private:
+  RC WriteBuffer();
+
+  int fd;
+  string fileName;         // the log, for Cut
+  LSN firstLSN;            // LSN of the first record in the file
+  LSN writtenLSN;          // records below are in the file
+  LSN flushedLSN;          // records below are durable
+  LSN endLSN;              // LSN the next record will get
+  LSN commitLSN;           // records below are committed
+  char *buf;               // records from writtenLSN to endLSN
+  int commitsPerFlush;     // commits per flush
+  int pendingCommits;      // commits since the last flush
+};
+
+#define RM_LOG_CHECKSUM_SEED 2166136261u
+
+// Checksum of length bytes; pass the checksum of what comes before as
+// seed to continue it
+unsigned int RM_LogChecksum(const char *data, int length,
+                            unsigned int seed = RM_LOG_CHECKSUM_SEED);
+
+#endif
@@ -2,8 +2,11 @@
 #include<cstdio>
 #include<cstring>
 #include<cassert>
+#include<algorithm>
+#include<unistd.h>
 #include "rm.h"
 #include "rm_internal.h"
+#include "rm_logmanager.h"
 
 RM_Manager::RM_Manager (PF_Manager &pfm): pfm_(pfm)
 {
@@ -14,13 +17,81 @@ RM_Manager::~RM_Manager()
 {
 }
 
-RC RM_Manager::CreateFile (const char *fileName, int recordSize)
+RC RM_Manager::CreateFile (const char *fileName, int recordSize,
+                           bool varLength)
 {
-  if(recordSize > int(DATA_ON_RECORD_PAGE))
+  return create(fileName, recordSize, varLength, NULL, 0);
+}
+
+RC RM_Manager::CreateFile (const char *fileName, int recordSize,
+                           const int *columnLengths, int numColumns)
+{
+  if(numColumns < 1 || numColumns > RM_MAX_COLUMNS)
+    return RM_CREATE_FILE_BAD_COLUMNS;
+  int length = 0;
+  for(int i = 0; i < numColumns; ++i) {
+    if(columnLengths[i] < 1)
+      return RM_CREATE_FILE_BAD_COLUMNS;
+    length += columnLengths[i];
+  }
+  if(length != recordSize)
+    return RM_CREATE_FILE_BAD_COLUMNS;
+  return create(fileName, recordSize, false, columnLengths, numColumns);
+}
+
+// The attributes need names of their own, and places of their own in the
+// record.  With pax each starts a column, the first of them at 0.
+RC RM_Manager::CreateFile (const char *fileName, const RM_AttrInfo *attrs,
+                           int numAttrs, bool pax)
+{
+  if(numAttrs < 1 || numAttrs > RM_MAX_COLUMNS)
+    return RM_CREATE_FILE_BAD_SCHEMA;
+  vector<pair<int, int> > places;
+  for(int i = 0; i < numAttrs; ++i) {
+    const RM_AttrInfo &a = attrs[i];
+    int nameLen = strnlen(a.attrName, MAXNAME + 1);
+    if(nameLen == 0 || nameLen > MAXNAME || a.attrOffset < 0
+       || (a.attrType == STRING ? a.attrLength < 1
+                                  || a.attrLength > MAXSTRINGLEN
+           : (a.attrType != INT && a.attrType != FLOAT)
+             || a.attrLength != 4))
+      return RM_CREATE_FILE_BAD_SCHEMA;
+    for(int j = 0; j < i; ++j)
+      if(!strcmp(a.attrName, attrs[j].attrName))
+        return RM_CREATE_FILE_BAD_SCHEMA;
+    places.push_back(make_pair(a.attrOffset, a.attrOffset + a.attrLength));
+  }
+  sort(places.begin(), places.end());
+  for(int i = 1; i < numAttrs; ++i)
+    if(places[i].first < places[i - 1].second)
+      return RM_CREATE_FILE_BAD_SCHEMA;
+  int recordSize = 0;
+  for(int i = 0; i < numAttrs; ++i)
+    recordSize = max(recordSize, places[i].second);
+  if(!pax)
+    return create(fileName, recordSize, false, NULL, 0, attrs, numAttrs);
+
+  int columnLengths[RM_MAX_COLUMNS];
+  for(int i = 0; i < numAttrs; ++i)
+    columnLengths[i] = (i + 1 < numAttrs ? places[i + 1].first : recordSize)
+                       - (i ? places[i].first : 0);
+  return create(fileName, recordSize, false, columnLengths, numAttrs, attrs,
+                numAttrs);
+}
+
+RC RM_Manager::create(const char *fileName, int recordSize, bool varLength,
+                      const int *columnLengths, int numColumns,
+                      const RM_AttrInfo *attrs, int numAttrs)
+{
+  // records too long for a page need the overflow pages of a
+  // variable-length file
+  if(varLength ? recordSize < 1 : recordSize > int(DATA_ON_RECORD_PAGE))
     return RM_CREATE_FILE_RECORD_SIZE;
   RC r = pfm_.CreateFile(fileName);
   if(r)
     return r;
+  // zone maps left by a file of that name are not this one's
+  unlink((string(fileName) + RM_ZONE_SUFFIX).c_str());
 
   //write the file header
   PF_FileHandle fileHandle;
@@ -48,13 +119,43 @@ RC RM_Manager::CreateFile (const char *fileName, int recordSize)
 
   struct RM_FileHeaderPage hdr;
   memset(&hdr, 0, sizeof(RM_FileHeaderPage));
-  if(recordSize < MIN_RECORD_SIZE)
+  if(recordSize < MIN_RECORD_SIZE && !varLength)
     recordSize = MIN_RECORD_SIZE;
   hdr.recordSize = recordSize;
+  hdr.varLength = varLength;
   hdr.nextPageDir = END_PAGE_LIST;
-  hdr.nextEmptyPageDir = END_PAGE_LIST;
+  hdr.lastPageDir = END_PAGE_LIST;
+  hdr.fillFactor = 100;
+  hdr.freeOverflow = END_PAGE_LIST;
+  hdr.firstCold = END_PAGE_LIST;
+  hdr.schemaPage = END_PAGE_LIST;
+  hdr.inlinePrefix = RM_VAR_DEF_PREFIX;
+  // the last column takes the bytes a short record is padded with
+  hdr.numColumns = numColumns;
+  for(int i = 0, offset = 0; i < numColumns; offset += columnLengths[i++])
+    hdr.columns[i] = offset;
+
+  // the schema goes on the page after the header
+  if(attrs) {
+    PF_PageHandle schemaPage;
+    RM_SchemaPage *schema;
+    if((r = fileHandle.AllocatePage(schemaPage))
+       || (r = schemaPage.GetData((char *&)schema))
+       || (r = schemaPage.GetPageNum(hdr.schemaPage))) {
+      fileHandle.UnpinPage(pageNum);
+      pfm_.CloseFile(fileHandle);
+      DestroyFile(fileName);
+      return r;
+    }
+    memset(schema, 0, PF_PAGE_SIZE);
+    schema->numAttrs = numAttrs;
+    memcpy(schema->attrs, attrs, numAttrs * sizeof(RM_AttrInfo));
+    fileHandle.MarkDirty(hdr.schemaPage);
+    fileHandle.UnpinPage(hdr.schemaPage);
+  }
 
-  memcpy(page, &hdr, PF_PAGE_SIZE);
+  memset(page, 0, PF_PAGE_SIZE);
+  memcpy(page, &hdr, sizeof(RM_FileHeaderPage));
   
   fileHandle.MarkDirty(pageNum);
   fileHandle.UnpinPage(pageNum);
@@ -68,6 +169,10 @@ RC RM_Manager::DestroyFile(const char *fileName)
     openFile_[string(fileName)] > 0 )
     return RM_DESTROY_FILE_WHILE_OPEN;
   RC r = pfm_.DestroyFile(fileName);
+  if(r == OK_RC) {
+    unlink((string(fileName) + RM_LOG_SUFFIX).c_str());
+    unlink((string(fileName) + RM_ZONE_SUFFIX).c_str());
+  }
   return r;
 }
 
@@ -75,6 +180,12 @@ RC RM_Manager::OpenFile   (const char *fileName, RM_FileHandle &fileHandle)
 {
   if(fileHandle.fileOpen_)
     return RM_OPEN_FILE_W_OPEN_HANDLE;
+  // each handle has a log of its own, which recovers and truncates the
+  // log file when it is opened and closed; a second one would do so
+  // under the first
+  if(openFile_.find(string(fileName)) != openFile_.end() &&
+     openFile_[string(fileName)] > 0)
+    return RM_OPEN_FILE_ALREADY_OPEN;
   PF_FileHandle pfh;
   RC r = pfm_.OpenFile(fileName, pfh);
   if(r)
@@ -92,209 +203,68 @@ RC RM_Manager::OpenFile   (const char *fileName, RM_FileHandle &fileHandle)
   PF_PageHandle pfp;
   struct RM_FileHeaderPage * data;
   int pageNum;
+  PageNum schemaPage;
+  bool crashed;
   if( pfh.GetFirstPage(pfp) || pfp.GetData((char * &) data) 
       || pfp.GetPageNum(pageNum) ) {
     openFile_[string(fileName)] -= 1;
+    fileHandle.fileOpen_ = false;
     pfm_.CloseFile(pfh);
     return RM_OPEN_FILE_HDR_PAGE_ERROR;
   }
   fileHandle.recordSize = data->recordSize;
-  fileHandle.recordPerPage = (PF_PAGE_SIZE - MAX_BITMAP_SIZE)/data->recordSize;
+  fileHandle.varLength = data->varLength;
+  fileHandle.columns.assign(data->columns, data->columns + data->numColumns);
+  fileHandle.recordPerPage = data->varLength ? RM_VAR_MAX_SLOTS
+                             : DATA_ON_RECORD_PAGE/data->recordSize;
+  fileHandle.pageSpace = data->varLength ? DATA_ON_RECORD_PAGE
+                         : fileHandle.recordPerPage;
 //  printf("++ recordPerPage %d\n", fileHandle.recordPerPage);
   fileHandle.bitmapSize = fileHandle.recordPerPage/8;
   if(fileHandle.recordPerPage & 0x7)
     fileHandle.bitmapSize += 1;
-  fileHandle.totalPage = data->totalPage;
-  fileHandle.totalEmptyPage = data->totalEmptyPage;
-
-  // read in the total page list and total empty page list
-  install_page_list(pfh, fileHandle, (void *)data, false); //total page
-  install_page_list(pfh, fileHandle, (void *)data, true); //empty page
-  fileHandle.headerUpdate = false;
+  // only the header is read, the rest of the directory on demand
+  fileHandle.init_directory(data);
+  schemaPage = data->schemaPage;
     
   // Unpin the header Page
   pfh.UnpinPage(pageNum);
-  return OK_RC;
-}
-
-//setting up empty page or total page
-int RM_Manager::install_page_list(const PF_FileHandle &pfh, 
-            RM_FileHandle &fileHandle, void *hdr, bool emptyPage)
-{
-  struct RM_FileHeaderPage * data = (struct RM_FileHeaderPage *)hdr;
-  if(emptyPage)
-    fileHandle.emptyPageList.clear();
-  else
-    fileHandle.totalPageList.clear();
-
-  if(emptyPage)
-    for(int i = 0; i < data->emptyPageOnThis; ++i)
-      fileHandle.emptyPageList.push_back(data->emptyPageList[i]);
-  else
-    for(int i = 0; i < data->pageOnThis; ++i)
-      fileHandle.totalPageList.push_back(data->totalPageList[i]);
-
-//  printf("Look Deeper\n");
-
-  int nextPageDir; 
-  if(emptyPage)
-    nextPageDir = data->nextEmptyPageDir;
-  else
-    nextPageDir = data->nextPageDir;
-//  printf("nextPageDir %d\n", nextPageDir);
-  PF_PageHandle pageDir;
-  while(nextPageDir != -1) {
-    int thisPageDir = nextPageDir;
-    pfh.GetThisPage(thisPageDir, pageDir);
-
-    struct RM_FilePageDirPage * pageDirData;
-    pageDir.GetData((char * &) pageDirData);
-
-    if(emptyPage)
-      for(int i = 0; i < pageDirData->pageListSize; ++i)
-        fileHandle.emptyPageList.push_back(pageDirData->data[i]);
-    else
-      for(int i=0; i < pageDirData->pageListSize; ++i)
-        fileHandle.totalPageList.push_back(pageDirData->data[i]);
-
-    nextPageDir = pageDirData->nextPageDir;
-    pfh.UnpinPage(thisPageDir);
+  if((r = fileHandle.load_schema(schemaPage)))
+    goto err;
+
+  // open the write-ahead log, the buffer manager flushes it before
+  // writing a page changed under it
+  fileHandle.log_ = new RM_LogManager();
+  if((r = fileHandle.log_->Open((fileHandle.fileName_ + RM_LOG_SUFFIX).c_str()))
+     || (r = pfh.SetLogFlusher(RM_LogManager::FlushLog, fileHandle.log_))) {
+    delete fileHandle.log_;
+    fileHandle.log_ = NULL;
+    goto err;
   }
-  return OK_RC;
-}
 
-RC RM_Manager::recur_dispose_dir_page(RM_FileHandle & fileHandle, 
-                                      PageNum dirPageNum)
-{
-  PF_PageHandle dirPage;
-  PageNum nextPageNum;
-  while(dirPageNum != END_PAGE_LIST) {
-//    printf("recursive close\n");
-    fileHandle.pfh_.GetThisPage(dirPageNum, dirPage);
-    struct RM_FilePageDirPage * data;
-    dirPage.GetData((char *&)data);
-    nextPageNum = data->nextPageDir;
-    fileHandle.pfh_.UnpinPage(dirPageNum);
-    fileHandle.pfh_.DisposePage(dirPageNum);
-    dirPageNum = nextPageNum;
-  }
-  return OK_RC;
-}
-
-RC RM_Manager::write_back_total_page(RM_FileHandle & fileHandle, 
-               void *hdrPage, void * fileHdrP, bool emptyPage)
-{
-  struct RM_FileHeaderPage *oldHdr = (struct RM_FileHeaderPage *)hdrPage;
-  struct RM_FileHeaderPage & fileHdr = *((struct RM_FileHeaderPage *)fileHdrP);
-
-  const vector<PageNum> & totalPageList = fileHandle.totalPageList;
-  const list<PageNum> & emptyPageList = fileHandle.emptyPageList;
-  list<PageNum>::const_iterator it;
-
-  PF_PageHandle thisOverFlow, nextOverFlow;
-  PageNum thisOverFlowNum, nextOverFlowNum;
-  bool allocateNewPage = false;
-
-  assert(size_t(fileHandle.totalPage) == totalPageList.size());
-  if(emptyPage) {
-    if(fileHandle.totalEmptyPage <= int(HEADER_LIST_HALF)) {
-      fileHdr.emptyPageOnThis = fileHandle.totalEmptyPage;
-      fileHdr.nextEmptyPageDir = END_PAGE_LIST;
-      //check if hdr page needs to be truncated
-      if(oldHdr->nextEmptyPageDir != END_PAGE_LIST)
-        recur_dispose_dir_page(fileHandle, oldHdr->nextEmptyPageDir);
-    } else {
-      fileHdr.emptyPageOnThis = HEADER_LIST_HALF;
-      // check to use previous dir pages
-      if(oldHdr->nextEmptyPageDir == END_PAGE_LIST) {
-        fileHandle.pfh_.AllocatePage(thisOverFlow);
-        thisOverFlow.GetPageNum(thisOverFlowNum);
-        allocateNewPage = true;
-      } else {
-        fileHandle.pfh_.GetThisPage(oldHdr->nextEmptyPageDir, thisOverFlow);
-        thisOverFlowNum = oldHdr->nextEmptyPageDir;
-      }
-      fileHdr.nextEmptyPageDir =   thisOverFlowNum;
-    }
-  } else {
-    if(fileHandle.totalPage <= int(HEADER_LIST_HALF)) {
-//      printf("++++++ No need to expand\n");
-      fileHdr.pageOnThis = fileHandle.totalPage;
-      fileHdr.nextPageDir = END_PAGE_LIST;
-      //check if hdr page needs truncated
-      if(oldHdr->nextPageDir != END_PAGE_LIST)
-        recur_dispose_dir_page(fileHandle, oldHdr->nextPageDir);
-    } else {
-//      printf("++++++++++ Need to expand\n");
-      fileHdr.pageOnThis = HEADER_LIST_HALF;
-      // check to see if we can use previous dir pages
-      if(oldHdr->nextPageDir == END_PAGE_LIST) {
-        fileHandle.pfh_.AllocatePage(thisOverFlow);
-        thisOverFlow.GetPageNum(thisOverFlowNum);
-        allocateNewPage = true;
-      } else {
-        fileHandle.pfh_.GetThisPage(oldHdr->nextPageDir, thisOverFlow);
-        thisOverFlowNum = oldHdr->nextPageDir;
-      }
-      fileHdr.nextPageDir =   thisOverFlowNum;
-    }
+  // a log that still holds records means the file was not closed, and
+  // the directory may be cut short until recovery repairs it
+  crashed = fileHandle.log_->GetEndLSN() != fileHandle.log_->GetFirstLSN();
+  if(crashed && (r = recover(fileHandle))) {
+    fileHandle.log_->Close();
+    delete fileHandle.log_;
+    fileHandle.log_ = NULL;
+    goto err;
   }
-
-  if(emptyPage){
-    it = emptyPageList.begin();
-    for(int i=0; i<fileHdr.emptyPageOnThis; ++i, ++it)
-      fileHdr.emptyPageList[i] = *it;
-  } else {
-    for(int i=0; i<fileHdr.pageOnThis; ++i)
-      fileHdr.totalPageList[i] = totalPageList[i];
-  }
-
-  int leftOver; 
-  if(emptyPage)
-    leftOver = fileHdr.totalEmptyPage - fileHdr.emptyPageOnThis;
-  else
-    leftOver = fileHdr.totalPage - fileHdr.pageOnThis;
-
-  int beginIdx = fileHdr.pageOnThis;
-  while(leftOver) {
-    struct RM_FilePageDirPage * data;
-    thisOverFlow.GetData((char *&) data);
-    data->pageListSize = leftOver <= int(PAGE_DIR_LIST_SIZE) ? 
-                         leftOver : int(PAGE_DIR_LIST_SIZE);
-    if(emptyPage){
-      for(int i = 0; i < data->pageListSize; ++i, ++it )
-        data->data[i] = *it;
-    } else {
-      for(int i = 0; i < data->pageListSize; ++i )
-        data->data[i] = totalPageList[beginIdx + i];
-    }
-    leftOver -= data->pageListSize;
-    beginIdx += data->pageListSize;
-    if(!leftOver) {
-      //check to see if need to dispose
-      if(!allocateNewPage && data->nextPageDir != END_PAGE_LIST) {
-        printf("recursive close %x\n", emptyPage);
-        recur_dispose_dir_page(fileHandle, data->nextPageDir);
-      }
-      data->nextPageDir = END_PAGE_LIST;
-    } else {
-      // check to see if can reuse
-      if(allocateNewPage || data->nextPageDir == END_PAGE_LIST) {
-        fileHandle.pfh_.AllocatePage(nextOverFlow);
-        nextOverFlow.GetPageNum(nextOverFlowNum);
-        data->nextPageDir = nextOverFlowNum;
-        allocateNewPage = true;
-      } else {
-        fileHandle.pfh_.GetThisPage(data->nextPageDir, nextOverFlow);
-        nextOverFlowNum = data->nextPageDir;
-      }
-    }
-    fileHandle.pfh_.MarkDirty(thisOverFlowNum);
-    fileHandle.pfh_.UnpinPage(thisOverFlowNum);
-    thisOverFlowNum = nextOverFlowNum;
-    thisOverFlow = nextOverFlow; 
+  fileHandle.checkpointLSN = fileHandle.log_->GetEndLSN();
+  if((r = fileHandle.zone_open(crashed))) {
+    fileHandle.log_->Close();
+    delete fileHandle.log_;
+    fileHandle.log_ = NULL;
+    goto err;
   }
   return OK_RC;
+
+err:
+  fileHandle.fileOpen_ = false;
+  openFile_[string(fileName)] -= 1;
+  pfm_.CloseFile(fileHandle.pfh_);
+  return r;
 }
 
 RC RM_Manager::CloseFile (RM_FileHandle &fileHandle)
@@ -310,38 +280,19 @@ RC RM_Manager::CloseFile (RM_FileHandle &fileHandle)
       openFile_[fileHandle.fileName_] -= 1;
   }
 
-
-  if(fileHandle.headerUpdate) {
-    PF_PageHandle hdrPage; 
-    fileHandle.pfh_.GetFirstPage(hdrPage);
-    char * hdrPageData;
-    hdrPage.GetData(hdrPageData);   
-
-    struct RM_FileHeaderPage fileHdr;
-    memset(&fileHdr, 0, sizeof(RM_FileHeaderPage));
-    fileHdr.nextPageDir = END_PAGE_LIST;
-    fileHdr.nextEmptyPageDir = END_PAGE_LIST;
-
-    fileHdr.recordSize = fileHandle.recordSize;
-    fileHdr.totalPage = fileHandle.totalPage;
-    fileHdr.totalEmptyPage = fileHandle.totalEmptyPage;
- 
-    //write total page list
-    write_back_total_page(fileHandle, hdrPageData, &fileHdr, false);
-    //write empty page list
-    write_back_total_page(fileHandle, hdrPageData, &fileHdr, true); 
-
-    memcpy(hdrPageData, &fileHdr, PF_PAGE_SIZE);
-
-    PageNum pageNum;
-    hdrPage.GetPageNum(pageNum);
-    fileHandle.pfh_.MarkDirty(pageNum);
-    fileHandle.pfh_.UnpinPage(pageNum);
-  }
-
+  // the page directory is kept up to date on its pages, so there is
+  // nothing to write back besides the dirty pages
   fileHandle.pfh_.ForcePages();
 
+  // every logged change is on disk once the file is synced, so the log
+  // can start over
+  if(fileHandle.pfh_.Sync() == OK_RC)
+    fileHandle.log_->Truncate();
+  fileHandle.zone_close();
+  fileHandle.log_->Close();
+  delete fileHandle.log_;
+  fileHandle.log_ = NULL;
+
   pfm_.CloseFile(fileHandle.pfh_);
   return OK_RC;
 }
-
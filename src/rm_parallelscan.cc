@@ -0,0 +1,349 @@
+//
+// rm_parallelscan.cc
+//
+//   Scans over several threads, see RM_ParallelScan in rm.h
+//
+// Every thread has a deque of morsels and a queue of chunks.  A thread
+// takes morsels from the front of its own deque, and when that is empty
+// from the back of another's, so that the threads keep reading pages in
+// order for as long as they can.  The records a morsel yields are queued
+// as one chunk; a thread whose queue is full waits for GetNextBatch to
+// empty it, which bounds the memory a scan takes.  The calling thread
+// has a deque and a queue too: it runs morsels itself when GetNextBatch
+// finds nothing queued, so a scan gets through even when no thread could
+// be started.
+//
+
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <algorithm>
+#include <unistd.h>
+#include "rm.h"
+#include "rm_internal.h"
+
+#define RM_MORSEL_PAGES 16  // virtual pages in a morsel
+#define RM_PSCAN_QUEUE  4   // chunks a thread queues before waiting
+
+struct RM_ParallelScan::Chunk {
+  vector<char> rows;
+  vector<RID> rids;
+};
+
+struct RM_ParallelScan::Worker {
+  RM_ParallelScan *scan;
+  int self;
+  pthread_t thread;
+  bool started;
+  deque<pair<int, int> > morsels;  // first and last virtual page
+  deque<Chunk *> out;
+};
+
+RM_ParallelScan::RM_ParallelScan  ():scanOpen_(false)
+{
+}
+
+RM_ParallelScan::~RM_ParallelScan ()
+{
+  if(scanOpen_)
+    CloseScan();
+}
+
+RC RM_ParallelScan::OpenScan(const RM_FileHandle &fileHandle,
+                             const RM_Predicate &pred,
+                             int numThreads,
+                             const RM_ProjAttr *proj,
+                             int numProj)
+{
+  if(!fileHandle.fileOpen_)
+    return RM_NOT_OPEN_FILE;
+  if(scanOpen_)
+    return RM_SCAN_REOPEN;
+  if(!pred.valid())
+    return RM_SCAN_NEED_VALUE;
+  if(fileHandle.varLength)
+    return RM_SCAN_VAR_LENGTH;
+
+  rowLength_ = 0;
+  for(int i = 0; i < numProj; ++i) {
+    if(proj[i].attrOffset < 0 || proj[i].attrLength <= 0
+       || proj[i].attrOffset + proj[i].attrLength > fileHandle.recordSize)
+      return RM_SCAN_BAD_PROJECTION;
+    rowLength_ += proj[i].attrLength;
+  }
+  proj_.assign(proj, proj + (numProj > 0 ? numProj : 0));
+  if(proj_.empty())
+    rowLength_ = fileHandle.recordSize;
+
+  // the threads neither read the page directory nor use the buffer pool.
+  // Pages the zone maps rule out are left out as -1.
+  RC r;
+  pred_ = pred;
+  pred_.order();
+  bound_ = !fileHandle.columns.empty() && fileHandle.bind(pred_);
+  pages_.resize(fileHandle.totalPage);
+  for(int v = 0; v < fileHandle.totalPage; ++v)
+    if(!pred_.may_match(fileHandle.zoneMaps, v))
+      pages_[v] = -1;
+    else if((r = fileHandle.page_of(v, pages_[v])))
+      return r;
+  if((r = fileHandle.pfh_.ForcePages()))
+    return r;
+
+  rmFileHandle = &fileHandle;
+  if(numThreads <= 0)
+    numThreads = int(sysconf(_SC_NPROCESSORS_ONLN));
+  if(numThreads <= 0)
+    numThreads = 1;
+  for(int i = 0; i <= numThreads; ++i) {
+    Worker *w = new Worker;
+    w->scan = this;
+    w->self = i;
+    w->started = false;
+    workers_.push_back(w);
+  }
+  // consecutive morsels for each thread, none for the calling one
+  int numMorsels = (fileHandle.totalPage + RM_MORSEL_PAGES - 1)
+                   / RM_MORSEL_PAGES;
+  for(int m = 0; m < numMorsels; ++m) {
+    int last = min((m + 1) * RM_MORSEL_PAGES, fileHandle.totalPage) - 1;
+    workers_[long(m) * numThreads / numMorsels]->morsels.push_back(
+      make_pair(m * RM_MORSEL_PAGES, last));
+  }
+
+  pthread_mutex_init(&lock_, NULL);
+  pthread_cond_init(&ready_, NULL);
+  pthread_cond_init(&room_, NULL);
+  running_ = 0;
+  closing_ = false;
+  rc_ = OK_RC;
+  cur_ = NULL;
+  curPos_ = 0;
+  next_ = 0;
+  scanOpen_ = true;
+  // the morsels of a thread that cannot be started are taken over
+  pthread_mutex_lock(&lock_);
+  for(int i = 0; i < numThreads; ++i)
+    if(pthread_create(&workers_[i]->thread, NULL, work, workers_[i]) == 0) {
+      workers_[i]->started = true;
+      ++running_;
+    }
+  pthread_mutex_unlock(&lock_);
+  return OK_RC;
+}
+
+// the next morsel for thread self, lock_ held
+bool RM_ParallelScan::take_morsel(int self, int &first, int &last)
+{
+  int n = int(workers_.size());
+  for(int i = 0; i < n; ++i) {
+    Worker *w = workers_[(self + i) % n];
+    if(w->morsels.empty())
+      continue;
+    pair<int, int> m;
+    if(i == 0) {
+      m = w->morsels.front();
+      w->morsels.pop_front();
+    } else {
+      m = w->morsels.back();
+      w->morsels.pop_back();
+    }
+    first = m.first;
+    last = m.second;
+    return true;
+  }
+  return false;
+}
+
+// filter the pages of a morsel into a chunk on the queue of thread self;
+// image is a page buffer of the thread.  A cold page is read once for the
+// virtual pages it holds, and each of them decoded in turn.
+RC RM_ParallelScan::run_morsel(int self, int first, int last, char *image)
+{
+  const RM_FileHandle *fh = rmFileHandle;
+  int recordSize = fh->recordSize;
+  Chunk *chunk = new Chunk;
+  RM_FileRecPage *data;
+  vector<char> rows, rec(recordSize);  // for PAX pages
+  vector<char> decoded;                // for cold pages
+  PageNum read = -1;
+
+  for(int v = first; v <= last; ++v) {
+    if(pages_[v] < 0)
+      continue;
+    RC r;
+    if(pages_[v] != read && (r = fh->pfh_.ReadPageImage(pages_[v], image))) {
+      delete chunk;
+      return r;
+    }
+    read = pages_[v];
+    data = (RM_FileRecPage *)image;
+    if(data->pageLSN == RM_COLD_LSN) {
+      const RM_ColdPage *cold = (const RM_ColdPage *)image;
+      decoded.resize(sizeof(RM_FileRecPage));
+      data = (RM_FileRecPage *)&decoded[0];
+      coldDecode(cold, v - cold->firstPage, fh->columns, fh->attrBounds,
+                 recordSize, fh->recordPerPage, data);
+    }
+    uint64_t taken[RM_BITMAP_WORDS], match[RM_BITMAP_WORDS];
+    for(int w = 0; w < int(RM_BITMAP_WORDS); ++w) {
+      taken[w] = bitmapWord(data->bitmap, w);
+      match[w] = 0;
+    }
+    fh->page_eval(pred_, bound_, data, taken, match, rows);
+    for(int w = 0; w < int(RM_BITMAP_WORDS); ++w)
+      for(uint64_t bits = match[w]; bits; bits &= bits - 1) {
+        int slotNum = w * 64 + __builtin_ctzll(bits);
+        const char *recData = fh->rec_at(data, slotNum, &rec[0]);
+        size_t at = chunk->rows.size();
+        chunk->rows.resize(at + rowLength_);
+        if(proj_.empty())
+          memcpy(&chunk->rows[at], recData, recordSize);
+        else
+          for(size_t i = 0; i < proj_.size(); ++i) {
+            memcpy(&chunk->rows[at], recData + proj_[i].attrOffset,
+                   proj_[i].attrLength);
+            at += proj_[i].attrLength;
+          }
+        chunk->rids.push_back(RID(v, slotNum));
+      }
+  }
+
+  if(chunk->rids.empty()) {
+    delete chunk;
+    return OK_RC;
+  }
+  Worker *me = workers_[self];
+  bool caller = self == int(workers_.size()) - 1;
+  pthread_mutex_lock(&lock_);
+  while(!caller && !closing_ && me->out.size() >= RM_PSCAN_QUEUE)
+    pthread_cond_wait(&room_, &lock_);
+  if(closing_)
+    delete chunk;
+  else
+    me->out.push_back(chunk);
+  pthread_cond_broadcast(&ready_);
+  pthread_mutex_unlock(&lock_);
+  return OK_RC;
+}
+
+void *RM_ParallelScan::work(void *worker)
+{
+  Worker *me = (Worker *)worker;
+  RM_ParallelScan *scan = me->scan;
+  char *image = (char *)malloc(PF_PAGE_SIZE);
+  int first, last;
+
+  pthread_mutex_lock(&scan->lock_);
+  while(!scan->closing_ && !scan->rc_
+        && scan->take_morsel(me->self, first, last)) {
+    pthread_mutex_unlock(&scan->lock_);
+    RC r = scan->run_morsel(me->self, first, last, image);
+    pthread_mutex_lock(&scan->lock_);
+    if(r && !scan->rc_)
+      scan->rc_ = r;
+  }
+  --scan->running_;
+  pthread_cond_broadcast(&scan->ready_);
+  pthread_mutex_unlock(&scan->lock_);
+  free(image);
+  return NULL;
+}
+
+// Copy queued records, or run a morsel here if none are queued.  Waits
+// for the threads only while nothing was copied yet.
+RC RM_ParallelScan::GetNextBatch(char *pData, RID *rids, int maxRecs,
+                                 int &numRecs)
+{
+  numRecs = 0;
+  if(!scanOpen_)
+    return RM_SCAN_NOT_OPEN;
+  if(maxRecs <= 0)
+    return RM_SCAN_BAD_BATCH;
+
+  int self = int(workers_.size()) - 1;
+  char *image = NULL;
+  RC r = OK_RC;
+  while(numRecs < maxRecs) {
+    if(cur_ && curPos_ < int(cur_->rids.size())) {
+      int n = min(maxRecs - numRecs, int(cur_->rids.size()) - curPos_);
+      memcpy(pData + long(numRecs) * rowLength_,
+             &cur_->rows[long(curPos_) * rowLength_], long(n) * rowLength_);
+      if(rids)
+        copy(cur_->rids.begin() + curPos_, cur_->rids.begin() + curPos_ + n,
+             rids + numRecs);
+      curPos_ += n;
+      numRecs += n;
+      continue;
+    }
+    delete cur_;
+    cur_ = NULL;
+
+    int first, last;
+    pthread_mutex_lock(&lock_);
+    while(!cur_ && !(r = rc_)) {
+      int n = int(workers_.size());
+      for(int i = 0; i < n && !cur_; ++i, next_ = (next_ + 1) % n)
+        if(!workers_[next_]->out.empty()) {
+          cur_ = workers_[next_]->out.front();
+          workers_[next_]->out.pop_front();
+          pthread_cond_broadcast(&room_);
+        }
+      if(cur_ || numRecs > 0)
+        break;
+      if(take_morsel(self, first, last)) {
+        pthread_mutex_unlock(&lock_);
+        if(!image)
+          image = (char *)malloc(PF_PAGE_SIZE);
+        RC mr = run_morsel(self, first, last, image);
+        pthread_mutex_lock(&lock_);
+        if(mr && !rc_)
+          rc_ = mr;
+      } else if(running_ == 0)
+        break;
+      else
+        pthread_cond_wait(&ready_, &lock_);
+    }
+    pthread_mutex_unlock(&lock_);
+    curPos_ = 0;
+    if(r || !cur_)
+      break;
+  }
+  free(image);
+  if(r)
+    return r;
+  return numRecs ? OK_RC : RM_EOF;
+}
+
+// end the threads, dropping what they queued
+void RM_ParallelScan::stop()
+{
+  pthread_mutex_lock(&lock_);
+  closing_ = true;
+  pthread_cond_broadcast(&room_);
+  pthread_mutex_unlock(&lock_);
+  for(size_t i = 0; i < workers_.size(); ++i) {
+    Worker *w = workers_[i];
+    if(w->started)
+      pthread_join(w->thread, NULL);
+    for(size_t j = 0; j < w->out.size(); ++j)
+      delete w->out[j];
+    delete w;
+  }
+  workers_.clear();
+  delete cur_;
+  cur_ = NULL;
+}
+
+RC RM_ParallelScan::CloseScan ()
+{
+  if(!scanOpen_)
+    return RM_SCAN_NOT_OPEN;
+  stop();
+  pthread_mutex_destroy(&lock_);
+  pthread_cond_destroy(&ready_);
+  pthread_cond_destroy(&room_);
+  pages_.clear();
+  scanOpen_ = false;
+  return OK_RC;
+}
@@ -0,0 +1,105 @@
+//
+// rm_pax.cc
+//
+//   PAX pages of fixed-length records, see RM_Manager::CreateFile
+//
+// A PAX page keeps the values of each column of its records together,
+// see rm_internal.h.  Records are put together and taken apart a column
+// at a time, a memcpy each.  A scan binds its condition to the columns
+// once: each comparison then walks the minipage of its attribute, with
+// the column length as stride, and no other byte of the page is read.
+// A comparison of an attribute spanning columns cannot be bound; such a
+// condition is evaluated on the records put together whole.
+//
+
+#include <algorithm>
+#include <cstring>
+#include "rm.h"
+#include "rm_internal.h"
+
+void paxGet(const RM_FileRecPage *data, const vector<int> &columns,
+            int recordSize, int recordPerPage, int slotNum, char *out)
+{
+  int n = int(columns.size());
+  for(int c = 0; c < n; ++c) {
+    int offset = columns[c];
+    int length = (c + 1 < n ? columns[c + 1] : recordSize) - offset;
+    memcpy(out + offset,
+           data->data + recordPerPage * offset + slotNum * length, length);
+  }
+}
+
+void paxPut(RM_FileRecPage *data, const vector<int> &columns,
+            int recordSize, int recordPerPage, int slotNum,
+            const char *recData)
+{
+  int n = int(columns.size());
+  for(int c = 0; c < n; ++c) {
+    int offset = columns[c];
+    int length = (c + 1 < n ? columns[c + 1] : recordSize) - offset;
+    memcpy(data->data + recordPerPage * offset + slotNum * length,
+           recData + offset, length);
+  }
+}
+
+// the record in slotNum for view, which keeps it if put together or on
+// a decoded cold page
+const char *RM_FileHandle::rec_view(const RM_FileRecPage *data, int slotNum,
+                                    RM_RecView &view) const
+{
+  if(columns.empty() && data->pageLSN != RM_COLD_LSN)
+    return data->data + slotNum * recordSize;
+  view.own_.resize(recordSize);
+  rec_get(data, slotNum, &view.own_[0]);
+  return &view.own_[0];
+}
+
+// Bind the comparisons of pred to the columns of the file; false if an
+// attribute spans columns
+bool RM_FileHandle::bind(RM_Predicate &pred) const
+{
+  if(pred.kind != RM_Predicate::CMP) {
+    bool bound = true;
+    for(size_t i = 0; i < pred.children.size(); ++i)
+      if(!bind(pred.children[i]))
+        bound = false;
+    return bound;
+  }
+  if(pred.compOp == NO_OP)
+    return true;
+  int c = int(upper_bound(columns.begin(), columns.end(), pred.attrOffset)
+              - columns.begin()) - 1;
+  if(c < 0)
+    return false;
+  int end = c + 1 < int(columns.size()) ? columns[c + 1] : recordSize;
+  if(pred.attrOffset + pred.attrLength > end)
+    return false;
+  pred.colStride = end - columns[c];
+  pred.colBase = recordPerPage * columns[c] + pred.attrOffset - columns[c];
+  return true;
+}
+
+// Evaluate pred on the records of cand on page data.  bound tells if
+// pred was bound to the columns of a PAX page; if not, the records are
+// put together in rows first.
+void RM_FileHandle::page_eval(const RM_Predicate &pred, bool bound,
+                              const RM_FileRecPage *data,
+                              const uint64_t *cand, uint64_t *match,
+                              vector<char> &rows) const
+{
+  if(columns.empty()) {
+    pred.eval(data->data, recordSize, recordPerPage, cand, match);
+    return;
+  }
+  if(bound) {
+    pred.eval(data->data, 0, recordPerPage, cand, match, true);
+    return;
+  }
+  rows.resize(long(recordPerPage) * recordSize);
+  for(int w = 0; w < int(RM_BITMAP_WORDS); ++w)
+    for(uint64_t bits = cand[w]; bits; bits &= bits - 1) {
+      int slotNum = w * 64 + __builtin_ctzll(bits);
+      rec_get(data, slotNum, &rows[long(slotNum) * recordSize]);
+    }
+  pred.eval(&rows[0], recordSize, recordPerPage, cand, match);
+}
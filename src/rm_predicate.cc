@@ -0,0 +1,267 @@
+//
+// rm_predicate.cc
+//
+//   Scan conditions, see RM_Predicate in rm.h
+//
+// A condition is evaluated on many records at once: a page of a
+// fixed-length file, or one variable-length record.  cand has a bit set
+// for each record still in question, as in the slot bitmap, and match
+// gets the bits of those that pass.  Under an AND a record drops out
+// with the first condition it fails, under an OR with the first it
+// passes, and the conditions after are only evaluated while a word of
+// records is left in question.  Hence the most selective conditions go
+// first under an AND, the least selective first under an OR.
+//
+
+#include <cassert>
+#include <algorithm>
+#include "rm.h"
+#include "rm_internal.h"
+
+// System R's guesses, without statistics of the file
+#define RM_SEL_EQ    0.1
+#define RM_SEL_RANGE (1.0 / 3)
+
+RM_Predicate::RM_Predicate ()
+{
+  kind = CMP;
+  attrType = INT;
+  attrLength = 0;
+  attrOffset = 0;
+  compOp = NO_OP;
+  hasValue = false;
+  filter = scanFilter(INT, NO_OP);
+  colBase = colStride = 0;
+}
+
+RM_Predicate::RM_Predicate (AttrType   attrType,
+                            int        attrLength,
+                            int        attrOffset,
+                            CompOp     compOp,
+                            const void *value)
+{
+  assert(attrLength <= MAXSTRINGLEN);
+  kind = CMP;
+  this->attrType = attrType;
+  this->attrLength = attrLength;
+  this->attrOffset = attrOffset;
+  this->compOp = compOp;
+  hasValue = value != NULL;
+  if(hasValue)
+    this->value.assign((const char *)value, attrLength);
+  filter = scanFilter(attrType, compOp);
+  colBase = colStride = 0;
+}
+
+RM_Predicate RM_Predicate::In(AttrType attrType, int attrLength,
+                              int attrOffset, const void *values,
+                              int numValues)
+{
+  RM_Predicate in;
+  in.kind = OR;
+  for(int i = 0; i < numValues; ++i)
+    in.children.push_back(RM_Predicate(attrType, attrLength, attrOffset,
+      EQ_OP, (const char *)values + i * attrLength));
+  return in;
+}
+
+RM_Predicate RM_Predicate::Between(AttrType attrType, int attrLength,
+                                   int attrOffset, const void *low,
+                                   const void *high)
+{
+  return And(RM_Predicate(attrType, attrLength, attrOffset, GE_OP, low),
+             RM_Predicate(attrType, attrLength, attrOffset, LE_OP, high));
+}
+
+RM_Predicate RM_Predicate::And(const RM_Predicate &a, const RM_Predicate &b)
+{
+  return join(AND, a, b);
+}
+
+RM_Predicate RM_Predicate::Or(const RM_Predicate &a, const RM_Predicate &b)
+{
+  return join(OR, a, b);
+}
+
+// nested conditions of the same kind are flattened, so that they are
+// ordered together
+RM_Predicate RM_Predicate::join(Kind kind, const RM_Predicate &a,
+                                const RM_Predicate &b)
+{
+  RM_Predicate p;
+  p.kind = kind;
+  const RM_Predicate *parts[2] = { &a, &b };
+  for(int i = 0; i < 2; ++i) {
+    if(parts[i]->kind == kind)
+      p.children.insert(p.children.end(), parts[i]->children.begin(),
+                        parts[i]->children.end());
+    else
+      p.children.push_back(*parts[i]);
+  }
+  return p;
+}
+
+// estimated fraction of the records that pass
+double RM_Predicate::selectivity() const
+{
+  double s;
+  switch(kind) {
+    case AND:
+      s = 1;
+      for(size_t i = 0; i < children.size(); ++i)
+        s *= children[i].selectivity();
+      return s;
+    case OR:
+      s = 1;
+      for(size_t i = 0; i < children.size(); ++i)
+        s *= 1 - children[i].selectivity();
+      return 1 - s;
+    default:
+      break;
+  }
+  switch(compOp) {
+    case NO_OP: return 1;
+    case EQ_OP: return RM_SEL_EQ;
+    case NE_OP: return 1 - RM_SEL_EQ;
+    default:    return RM_SEL_RANGE;
+  }
+}
+
+// put the conditions under every AND and OR in the order they are best
+// evaluated in
+void RM_Predicate::order()
+{
+  if(kind == CMP)
+    return;
+  vector<pair<double, int> > sel;
+  for(size_t i = 0; i < children.size(); ++i) {
+    children[i].order();
+    double s = children[i].selectivity();
+    sel.push_back(make_pair(kind == AND ? s : -s, int(i)));
+  }
+  stable_sort(sel.begin(), sel.end());
+  vector<RM_Predicate> ordered;
+  for(size_t i = 0; i < sel.size(); ++i)
+    ordered.push_back(children[sel[i].second]);
+  children.swap(ordered);
+}
+
+// every comparison has a value it needs
+bool RM_Predicate::valid() const
+{
+  if(kind == CMP)
+    return hasValue || compOp == NO_OP;
+  for(size_t i = 0; i < children.size(); ++i)
+    if(!children[i].valid())
+      return false;
+  return true;
+}
+
+// end of the last byte of a record the condition looks at
+int RM_Predicate::end() const
+{
+  if(kind == CMP)
+    return compOp == NO_OP ? 0 : attrOffset + attrLength;
+  int e = 0;
+  for(size_t i = 0; i < children.size(); ++i)
+    e = max(e, children[i].end());
+  return e;
+}
+
+// Whether a record of virtual page vPage may pass, going by the zone
+// maps.  A comparison without a zone map of its attribute, or with <>,
+// may always pass.
+bool RM_Predicate::may_match(const vector<RM_ZoneMap> &zones,
+                             int vPage) const
+{
+  switch(kind) {
+    case AND:
+      for(size_t i = 0; i < children.size(); ++i)
+        if(!children[i].may_match(zones, vPage))
+          return false;
+      return true;
+    case OR:
+      for(size_t i = 0; i < children.size(); ++i)
+        if(children[i].may_match(zones, vPage))
+          return true;
+      return false;
+    default:
+      break;
+  }
+  if(compOp == NO_OP || compOp == NE_OP)
+    return true;
+  const RM_ZoneMap *zone = NULL;
+  for(size_t i = 0; i < zones.size() && !zone; ++i)
+    if(zones[i].attrType == attrType && zones[i].attrLength == attrLength
+       && zones[i].attrOffset == attrOffset)
+      zone = &zones[i];
+  if(!zone || vPage >= int(zone->any.size()))
+    return true;
+  if(!zone->any[vPage] || !zoneValue(attrType, value.data()))
+    return false;
+  const char *v = value.data();
+  int low = zoneCompare(attrType, &zone->low[long(vPage) * attrLength], v,
+                        attrLength);
+  int high = zoneCompare(attrType, &zone->high[long(vPage) * attrLength], v,
+                         attrLength);
+  switch(compOp) {
+    case EQ_OP: return low <= 0 && high >= 0;
+    case LT_OP: return low < 0;
+    case LE_OP: return low <= 0;
+    case GT_OP: return high > 0;
+    case GE_OP: return high >= 0;
+    default:    return true;
+  }
+}
+
+void RM_Predicate::eval(const char *rec, int stride, int count,
+                        const uint64_t *cand, uint64_t *match,
+                        bool columns) const
+{
+  int words = (count + 63) / 64;
+  uint64_t left[RM_BITMAP_WORDS], got[RM_BITMAP_WORDS];
+  bool any;
+  switch(kind) {
+    case CMP:
+      if(compOp == NO_OP) {
+        memcpy(match, cand, words * sizeof(uint64_t));
+        return;
+      }
+      if(columns)
+        filter(rec + colBase, colStride, count, value.data(), attrLength,
+               match);
+      else
+        filter(rec + attrOffset, stride, count, value.data(), attrLength,
+               match);
+      for(int w = 0; w < words; ++w)
+        match[w] &= cand[w];
+      return;
+    case AND:
+      // match holds the records that passed every condition so far
+      memcpy(match, cand, words * sizeof(uint64_t));
+      for(size_t i = 0; i < children.size(); ++i) {
+        children[i].eval(rec, stride, count, match, got, columns);
+        any = false;
+        for(int w = 0; w < words; ++w)
+          any |= (match[w] = got[w]) != 0;
+        if(!any)
+          return;
+      }
+      return;
+    case OR:
+      // left holds the records that failed every condition so far
+      memcpy(left, cand, words * sizeof(uint64_t));
+      memset(match, 0, words * sizeof(uint64_t));
+      for(size_t i = 0; i < children.size(); ++i) {
+        children[i].eval(rec, stride, count, left, got, columns);
+        any = false;
+        for(int w = 0; w < words; ++w) {
+          match[w] |= got[w];
+          any |= (left[w] &= ~got[w]) != 0;
+        }
+        if(!any)
+          return;
+      }
+      return;
+  }
+}
@@ -0,0 +1,140 @@
+//
+// rm_reccursor.cc
+//
+//   Reading a record in pieces, see RM_RecCursor in rm.h
+//
+// The cursor keeps its own copy of the bytes the record holds and
+// walks the overflow chain from its first page, one page per step.  It
+// remembers the page it is on, so reading on or seeking forward never
+// goes back to the start of the chain.
+//
+
+#include <cstdlib>
+#include <cstring>
+#include "rm.h"
+#include "rm_internal.h"
+
+RM_RecCursor::RM_RecCursor ()
+{
+  rmFileHandle = NULL;
+  prefix = NULL;
+}
+
+RM_RecCursor::~RM_RecCursor()
+{
+  free(prefix);
+}
+
+RC RM_RecCursor::Open (const RM_FileHandle &fileHandle, const RM_Record &rec)
+{
+  if(!fileHandle.fileOpen_)
+    return RM_NOT_OPEN_FILE;
+  open(&fileHandle, rec.data, rec.recordSize, rec.length_, rec.overflow_);
+  return OK_RC;
+}
+
+RC RM_RecCursor::Open (const RM_FileHandle &fileHandle,
+                       const RM_RecView &view)
+{
+  if(!fileHandle.fileOpen_)
+    return RM_NOT_OPEN_FILE;
+  if(view.pageNum_ < 0)
+    return RM_REC_NO_EXIST;
+  int prefixLen;
+  view.GetDataLength(prefixLen);
+  open(&fileHandle, view.data, prefixLen, view.length_, view.overflow_);
+  return OK_RC;
+}
+
+// start on a record whose first prefixLen bytes are at pData, and the
+// rest on the chain from page first.  Without copy, pData must stay
+// valid while the cursor is used.
+void RM_RecCursor::open(const RM_FileHandle *fileHandle, const char *pData,
+                        int prefixLen, int length, PageNum first, bool copy)
+{
+  free(prefix);
+  prefix = NULL;
+  prefixData = pData;
+  if(copy) {
+    prefix = (char *)malloc(prefixLen > 0 ? prefixLen : 1);
+    memcpy(prefix, pData, prefixLen);
+    prefixData = prefix;
+  }
+  rmFileHandle = fileHandle;
+  this->prefixLen = prefixLen;
+  this->length = length;
+  pos = 0;
+  firstPage = curPage = first;
+  curStart = prefixLen;
+}
+
+RC RM_RecCursor::Read (char *pData, int length, int &read)
+{
+  read = 0;
+  if(!rmFileHandle)
+    return RM_CURSOR_NOT_OPEN;
+  if(pos >= this->length)
+    return RM_EOF;
+
+  const PF_FileHandle &pfh = rmFileHandle->pfh_;
+  while(read < length && pos < this->length) {
+    int n = length - read;
+    if(pos < prefixLen) {
+      if(n > prefixLen - pos)
+        n = prefixLen - pos;
+      memcpy(pData + read, prefixData + pos, n);
+    } else {
+      PF_PageHandle pageHdl;
+      RM_OverflowPage *page;
+      RC r;
+      if(curPage < 0)
+        return RM_LOG_CORRUPT;
+      if((r = pfh.GetThisPage(curPage, pageHdl))
+         || (r = pageHdl.GetData((char *&)page)))
+        return r;
+      if(pos >= curStart + page->length) {
+        // pos is on a later page
+        PageNum next = page->nextPage;
+        int used = page->length;
+        pfh.UnpinPage(curPage);
+        if(used <= 0)
+          return RM_LOG_CORRUPT;
+        curPage = next;
+        curStart += used;
+        continue;
+      }
+      if(n > curStart + page->length - pos)
+        n = curStart + page->length - pos;
+      memcpy(pData + read, page->data + (pos - curStart), n);
+      pfh.UnpinPage(curPage);
+    }
+    read += n;
+    pos += n;
+  }
+  return OK_RC;
+}
+
+RC RM_RecCursor::Seek (int offset)
+{
+  if(!rmFileHandle)
+    return RM_CURSOR_NOT_OPEN;
+  if(offset < 0 || offset > length)
+    return RM_BAD_OFFSET;
+  // the chain only goes forward
+  if(offset < curStart) {
+    curPage = firstPage;
+    curStart = prefixLen;
+  }
+  pos = offset;
+  return OK_RC;
+}
+
+RC RM_RecCursor::Close()
+{
+  if(!rmFileHandle)
+    return RM_CURSOR_NOT_OPEN;
+  rmFileHandle = NULL;
+  free(prefix);
+  prefix = NULL;
+  return OK_RC;
+}
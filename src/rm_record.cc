@@ -1,10 +1,15 @@
 #include "rm.h"
+#include "rm_internal.h"
 #include <cstdlib>
+#include <cstring>
 
 RM_Record::RM_Record ()
 {
   recordSize = 0;
   data = NULL;
+  length_ = 0;
+  overflow_ = -1;
+  projected_ = false;
 }
 
 RM_Record::~RM_Record()
@@ -28,3 +33,42 @@ RC RM_Record::GetRid (RID &rid) const
   return OK_RC;
 }
 
+
+RC RM_Record::GetLength(int &length) const
+{
+  length = length_;
+  return OK_RC;
+}
+
+RC RM_Record::GetDataLength(int &length) const
+{
+  length = recordSize;
+  return OK_RC;
+}
+
+RC RM_Record::SetData(const char *pData, int length)
+{
+  set(pData, length);
+  return OK_RC;
+}
+
+// copy length bytes of a record page; those of a long record are its
+// prefix and RM_VarLong, and only the prefix is kept
+void RM_Record::set(const char *pData, int length, bool isLong)
+{
+  length_ = length;
+  overflow_ = -1;
+  projected_ = false;
+  if(isLong) {
+    RM_VarLong desc = varLong(pData, length);
+    length -= sizeof(RM_VarLong);
+    length_ = desc.length;
+    overflow_ = desc.first;
+  }
+  char *newData = (char *)malloc(length > 0 ? length : 1);
+  memcpy(newData, pData, length);
+  if(data != NULL)
+    free(data);
+  data = newData;
+  recordSize = length;
+}
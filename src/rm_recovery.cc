@@ -0,0 +1,564 @@
+//
+// rm_recovery.cc
+//
+//   Crash recovery of an RM file from its write-ahead log
+//
+// RM_Manager::OpenFile calls recover() when the log of the file still
+// holds records, which only happens when the file was not closed.  The
+// log covers every change since the file was last consistent on disk, so
+// recovery only reads the log and the pages it names:
+//
+//   analysis - read the log, stop at the first torn or garbage record and
+//              find the last commit.  Records after it are losers.
+//   pages    - replay the page allocations (RM_LOG_NEWDIR, RM_LOG_NEWPAGE,
+//              RM_LOG_THAW and the writes of new overflow pages) in
+//              order, to rebuild the page directory and the PF page
+//              count.
+//   redo     - reapply every record from the redo point of the last
+//              checkpoint on whose LSN is above the pageLSN of its
+//              page.  Records are grouped by page and the pages are split
+//              over several threads that read and write page images
+//              directly, since no two threads share a page.
+//   undo     - roll the losers back, newest first, from their before
+//              images.  Rolling back is idempotent, so no compensation
+//              records are needed.
+//
+// The directory entry is then fixed for every page the log touched, the
+// free hint is pulled back to cover them, the free list of overflow pages
+// is set back to what the last change kept says, and once everything is
+// synced the log is truncated.  Overflow pages the losers took from PF
+// go on that free list.
+//
+
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <set>
+#include <vector>
+#include <pthread.h>
+#include "rm.h"
+#include "rm_internal.h"
+#include "rm_logmanager.h"
+using namespace std;
+
+#define RM_REDO_THREADS 4   // most threads used by redo
+
+typedef vector<const RM_LogRec *> RM_LogRecList;
+
+//
+// Where the records are on the pages of a fixed-length file
+//
+struct RM_RecShape {
+  int recordSize;
+  int recordPerPage;
+  const vector<int> *columns;  // of PAX pages, empty for whole records
+};
+
+//
+// Work of one redo thread: a set of pages with their records, in LSN
+// order
+//
+struct RM_RedoWork {
+  const PF_FileHandle *pfh;
+  RM_RecShape shape;
+  bool varLength;
+  vector<PageNum> pages;
+  vector<const RM_LogRecList *> recs;
+  RC rc;
+};
+
+static inline const char *image1(const RM_LogRec *rec)
+{
+  return (const char *)rec + sizeof(RM_LogRec);
+}
+
+static inline const char *image2(const RM_LogRec *rec)
+{
+  return (const char *)rec + sizeof(RM_LogRec) + rec->imageLen;
+}
+
+// does rec change a record page
+static inline bool data_rec(const RM_LogRec *rec)
+{
+  return rec->type == RM_LOG_INSERT || rec->type == RM_LOG_DELETE
+         || rec->type == RM_LOG_UPDATE || rec->type == RM_LOG_INSERTS
+         || rec->type == RM_LOG_THAW;
+}
+
+static inline void clearSlot(RM_FileRecPage *data, int slotNum)
+{
+  data->bitmap[slotNum >> 3] &= ~(1 << (slotNum & 7));
+}
+
+// write the n records of images into the slots from slotNum on
+static void put_recs(RM_FileRecPage *data, const RM_RecShape &shape,
+                     int slotNum, const char *images, int n)
+{
+  int recordSize = shape.recordSize;
+  if(shape.columns->empty()) {
+    memcpy(&data->data[recordSize * slotNum], images, n * recordSize);
+    return;
+  }
+  for(int i = 0; i < n; ++i)
+    paxPut(data, *shape.columns, recordSize, shape.recordPerPage,
+           slotNum + i, images + i * recordSize);
+}
+
+// apply the change of rec to a record page
+static void redo_rec(RM_FileRecPage *data, const RM_LogRec *rec,
+                     const RM_RecShape &shape)
+{
+  switch(rec->type) {
+  case RM_LOG_INSERT:
+    setEmptySlot(data, rec->slotNum);
+    put_recs(data, shape, rec->slotNum, image1(rec), 1);
+    break;
+  case RM_LOG_DELETE:
+    clearSlot(data, rec->slotNum);
+    break;
+  case RM_LOG_UPDATE:
+    put_recs(data, shape, rec->slotNum, image2(rec), 1);
+    break;
+  case RM_LOG_INSERTS:
+    for(int i = 0; i < rec->imageLen / shape.recordSize; ++i)
+      setEmptySlot(data, rec->slotNum + i);
+    put_recs(data, shape, rec->slotNum, image1(rec),
+             rec->imageLen / shape.recordSize);
+    break;
+  case RM_LOG_THAW:
+    memcpy(data, image1(rec), PF_PAGE_SIZE);
+    break;
+  }
+  data->pageLSN = rec->lsn;
+}
+
+// take back the change of rec from a record page.  A thawed page keeps
+// the records of its cold page, so there is nothing to take back.
+static void undo_rec(RM_FileRecPage *data, const RM_LogRec *rec,
+                     const RM_RecShape &shape)
+{
+  switch(rec->type) {
+  case RM_LOG_INSERT:
+    clearSlot(data, rec->slotNum);
+    break;
+  case RM_LOG_DELETE:
+    setEmptySlot(data, rec->slotNum);
+    put_recs(data, shape, rec->slotNum, image1(rec), 1);
+    break;
+  case RM_LOG_UPDATE:
+    put_recs(data, shape, rec->slotNum, image1(rec), 1);
+    break;
+  case RM_LOG_INSERTS:
+    for(int i = 0; i < rec->imageLen / shape.recordSize; ++i)
+      clearSlot(data, rec->slotNum + i);
+    break;
+  }
+}
+
+// the same for a slotted page.  Slots are reused the same way as when
+// the changes were made, so every record goes back to the slot it had.
+static void redo_var_rec(RM_VarRecPage *page, const RM_LogRec *rec)
+{
+  switch(rec->type) {
+  case RM_LOG_INSERT:
+    varPut(page, rec->slotNum, image1(rec), rec->imageLen, rec->flags1);
+    break;
+  case RM_LOG_DELETE:
+    varErase(page, rec->slotNum);
+    break;
+  case RM_LOG_UPDATE:
+    varPut(page, rec->slotNum, image2(rec), rec->image2Len, rec->flags2);
+    break;
+  }
+  page->pageLSN = rec->lsn;
+}
+
+static void redo_ovf_rec(RM_OverflowPage *page, const RM_LogRec *rec)
+{
+  ovfApply(page, image2(rec), rec->image2Len);
+  page->pageLSN = rec->lsn;
+}
+
+static void undo_var_rec(RM_VarRecPage *page, const RM_LogRec *rec)
+{
+  switch(rec->type) {
+  case RM_LOG_INSERT:
+    varErase(page, rec->slotNum);
+    break;
+  case RM_LOG_DELETE:
+  case RM_LOG_UPDATE:
+    varPut(page, rec->slotNum, image1(rec), rec->imageLen, rec->flags1);
+    break;
+  }
+}
+
+// make sure page pageNum, allocated by a logged RM_LOG_NEWPAGE,
+// RM_LOG_NEWDIR or RM_LOG_THAW, exists.  PF may know it already.  If
+// not, it is taken again wherever it is on the free list, since the PF
+// header and the free pages may have been written in any order.  A new
+// page may still have been written after the PF header was; changes
+// before the redo point are only found in that image.
+static RC replay_alloc(PF_FileHandle &pfh, PageNum pageNum)
+{
+  PF_PageHandle pageHdl;
+  char *data;
+  RC r;
+
+  if(pfh.GetThisPage(pageNum, pageHdl) == OK_RC)
+    return pfh.UnpinPage(pageNum);
+  if((r = pfh.AllocateThisPage(pageNum, pageHdl)))
+    return r == PF_INVALIDPAGE ? RM_LOG_CORRUPT : r;
+  pageHdl.GetData(data);
+  if(pfh.ReadPageImage(pageNum, data))
+    memset(data, 0, PF_PAGE_SIZE);
+  pfh.MarkDirty(pageNum);
+  pfh.UnpinPage(pageNum);
+  return OK_RC;
+}
+
+static void *redo_pages(void *arg)
+{
+  RM_RedoWork *work = (RM_RedoWork *)arg;
+  RM_FileRecPage *data = (RM_FileRecPage *)malloc(PF_PAGE_SIZE);
+  work->rc = OK_RC;
+  for(size_t i = 0; i < work->pages.size() && !work->rc; ++i) {
+    if((work->rc = work->pfh->ReadPageImage(work->pages[i], (char *)data)))
+      break;
+    const RM_LogRecList &recs = *work->recs[i];
+    bool changed = false;
+    for(size_t j = 0; j < recs.size(); ++j)
+      if(recs[j]->lsn > data->pageLSN) {
+        if(recs[j]->type == RM_LOG_OVERFLOW)
+          redo_ovf_rec((RM_OverflowPage *)data, recs[j]);
+        else if(work->varLength)
+          redo_var_rec((RM_VarRecPage *)data, recs[j]);
+        else
+          redo_rec(data, recs[j], work->shape);
+        changed = true;
+      }
+    if(changed)
+      work->rc = work->pfh->WritePageImage(work->pages[i], (char *)data);
+  }
+  free(data);
+  return NULL;
+}
+
+// run redo_pages over the pages, split between up to RM_REDO_THREADS
+// threads
+static RC redo(const PF_FileHandle &pfh, const RM_RecShape &shape,
+               bool varLength, const map<PageNum, RM_LogRecList> &pageRecs)
+{
+  int nThreads = pageRecs.size() < RM_REDO_THREADS ?
+                 int(pageRecs.size()) : RM_REDO_THREADS;
+  if(nThreads == 0)
+    return OK_RC;
+
+  vector<RM_RedoWork> work(nThreads);
+  int i = 0;
+  map<PageNum, RM_LogRecList>::const_iterator it;
+  for(it = pageRecs.begin(); it != pageRecs.end(); ++it, ++i) {
+    work[i % nThreads].pages.push_back(it->first);
+    work[i % nThreads].recs.push_back(&it->second);
+  }
+
+  vector<pthread_t> threads(nThreads);
+  vector<bool> started(nThreads, false);
+  for(i = 0; i < nThreads; ++i) {
+    work[i].pfh = &pfh;
+    work[i].shape = shape;
+    work[i].varLength = varLength;
+    work[i].rc = OK_RC;
+    // the last share runs on this thread, and so does any share whose
+    // thread cannot be started
+    if(i < nThreads - 1 &&
+       pthread_create(&threads[i], NULL, redo_pages, &work[i]) == 0)
+      started[i] = true;
+    else
+      redo_pages(&work[i]);
+  }
+
+  RC rc = OK_RC;
+  for(i = 0; i < nThreads; ++i) {
+    if(started[i])
+      pthread_join(threads[i], NULL);
+    if(work[i].rc && !rc)
+      rc = work[i].rc;
+  }
+  return rc;
+}
+
+// is rec a well formed record at position lsn of a log for this file
+static bool valid_rec(const RM_LogRec *rec, LSN lsn, long left,
+                      int recordSize, int recordPerPage, bool varLength)
+{
+  if(left < long(sizeof(RM_LogRec)) || rec->lsn != lsn
+     || rec->length < int(sizeof(RM_LogRec)) || rec->length > left)
+    return false;
+
+  RM_LogRec hdr = *rec;
+  hdr.checksum = 0;
+  unsigned int sum = RM_LogChecksum((const char *)&hdr, sizeof(RM_LogRec));
+  sum = RM_LogChecksum(image1(rec), rec->length - sizeof(RM_LogRec), sum);
+  if(sum != rec->checksum)
+    return false;
+
+  int images;
+  const RM_LogCheckpoint *ckpt;
+  switch(rec->type) {
+  case RM_LOG_COMMIT:
+  case RM_LOG_NEWPAGE:
+  case RM_LOG_NEWDIR:
+    return rec->length == int(sizeof(RM_LogRec));
+  case RM_LOG_CHECKPOINT:
+    ckpt = (const RM_LogCheckpoint *)image1(rec);
+    return rec->imageLen >= int(sizeof(RM_LogCheckpoint))
+           && rec->length == int(sizeof(RM_LogRec)) + rec->imageLen
+           && rec->imageLen == int(sizeof(RM_LogCheckpoint)
+                               + ckpt->numDirty * sizeof(PF_DirtyPage));
+  case RM_LOG_OVERFLOW:
+    // no before image for a page just allocated
+    return rec->pageNum > 0
+           && (rec->imageLen == 0 || (rec->imageLen >= RM_OVF_HDR_SIZE
+                                      && rec->imageLen <= RM_OVF_MAX_IMAGE))
+           && rec->image2Len >= RM_OVF_HDR_SIZE
+           && rec->image2Len <= RM_OVF_MAX_IMAGE
+           && rec->length == int(sizeof(RM_LogRec)) + rec->imageLen
+                             + rec->image2Len;
+  case RM_LOG_THAW:
+    return !varLength && rec->pageNum > 0
+           && rec->imageLen == PF_PAGE_SIZE
+           && rec->length == int(sizeof(RM_LogRec)) + rec->imageLen;
+  case RM_LOG_INSERTS:
+    return !varLength && rec->imageLen > 0
+           && rec->imageLen % recordSize == 0 && rec->slotNum >= 0
+           && rec->slotNum + rec->imageLen / recordSize <= recordPerPage
+           && rec->length == int(sizeof(RM_LogRec)) + rec->imageLen;
+  case RM_LOG_INSERT:
+  case RM_LOG_DELETE:
+    images = 1;
+    break;
+  case RM_LOG_UPDATE:
+    images = 2;
+    break;
+  default:
+    return false;
+  }
+  if(rec->slotNum < 0 || rec->slotNum >= recordPerPage
+     || rec->length != int(sizeof(RM_LogRec)) + rec->imageLen
+                       + (images == 2 ? rec->image2Len : 0))
+    return false;
+  if(!varLength)
+    return rec->imageLen == recordSize
+           && (images == 1 || rec->image2Len == recordSize);
+  // a stub may be longer than the shortest records, and a long record
+  // only keeps its inline part
+  int maxLen = recordSize < RM_VAR_MAX_INLINE ? recordSize : RM_VAR_MAX_INLINE;
+  if(maxLen < RM_VAR_MIN_SPACE)
+    maxLen = RM_VAR_MIN_SPACE;
+  return rec->imageLen >= 0 && rec->imageLen <= maxLen
+         && (images == 1 || (rec->image2Len >= 0 && rec->image2Len <= maxLen));
+}
+
+RC RM_Manager::recover(RM_FileHandle &fileHandle)
+{
+  RM_LogManager &log = *fileHandle.log_;
+  PF_FileHandle &pfh = fileHandle.pfh_;
+  char *logData;
+  long logLength;
+  RC r;
+
+  if((r = log.ReadAll(logData, logLength)))
+    return r;
+
+  //
+  // analysis: collect the valid records up to the first bad one
+  //
+  vector<const RM_LogRec *> recs;
+  size_t winners = 0;   // records up to and including the last commit
+  LSN redoLSN = 0;      // redo point of the last checkpoint
+  LSN lsn = log.GetFirstLSN();
+  long offset = 0;
+  while(offset < logLength) {
+    const RM_LogRec *rec = (const RM_LogRec *)(logData + offset);
+    if(!valid_rec(rec, lsn, logLength - offset, fileHandle.recordSize,
+                  fileHandle.recordPerPage, fileHandle.varLength))
+      break;  // torn tail, nothing after it was acknowledged
+    recs.push_back(rec);
+    if(rec->type == RM_LOG_COMMIT)
+      winners = recs.size();
+    if(rec->type == RM_LOG_CHECKPOINT)
+      redoLSN = ((const RM_LogCheckpoint *)image1(rec))->redoLSN;
+    offset += rec->length;
+    lsn += rec->length;
+  }
+
+  //
+  // pages: the directory as it was when the log started (truncated or
+  // cut at a checkpoint) is intact, cut it back to that and replay the
+  // allocations of directory and record pages in order, and the thawed
+  // pages in place of their cold pages.
+  // Every page of the file is then known to PF and to the directory.
+  //
+  r = OK_RC;
+  int firstPage = -1, firstDir = -1;
+  for(size_t i = 0; i < recs.size(); ++i) {
+    if(recs[i]->type == RM_LOG_NEWPAGE && firstPage < 0)
+      firstPage = recs[i]->vPage;
+    if(recs[i]->type == RM_LOG_NEWDIR && firstDir < 0)
+      firstDir = recs[i]->vPage;
+  }
+  if(firstPage > fileHandle.totalPage
+     || firstDir > int(fileHandle.dirPages.size()))
+    r = RM_LOG_CORRUPT;
+  else {
+    if(firstPage >= 0)
+      fileHandle.totalPage = firstPage;
+    if(firstDir >= 0) {
+      fileHandle.dirPages.resize(firstDir);
+      fileHandle.pageChunks.resize(firstDir + 1);
+    }
+    // nothing is loaded yet, chunks are read again with the cut applied
+    fileHandle.chunkLoaded.assign(fileHandle.pageChunks.size(), false);
+  }
+
+  for(size_t i = 0; i < recs.size() && !r; ++i) {
+    const RM_LogRec *rec = recs[i];
+    if(rec->type == RM_LOG_NEWDIR) {
+      if(rec->vPage != int(fileHandle.dirPages.size()))
+        r = RM_LOG_CORRUPT;
+      else if(!(r = replay_alloc(pfh, rec->pageNum)))
+        r = fileHandle.append_dir_page(rec->pageNum, rec->lsn);
+    } else if(rec->type == RM_LOG_NEWPAGE) {
+      if(rec->vPage != fileHandle.totalPage || fileHandle.need_dir_page())
+        r = RM_LOG_CORRUPT;
+      else if(!(r = replay_alloc(pfh, rec->pageNum)))
+        r = fileHandle.append_page(rec->pageNum, rec->lsn);
+    } else if(rec->type == RM_LOG_THAW) {
+      if(rec->vPage >= fileHandle.totalPage)
+        r = RM_LOG_CORRUPT;
+      else if(!(r = replay_alloc(pfh, rec->pageNum)))
+        r = fileHandle.set_page(rec->vPage, rec->pageNum, rec->lsn);
+    } else if(rec->type == RM_LOG_OVERFLOW && rec->imageLen == 0)
+      r = replay_alloc(pfh, rec->pageNum);
+  }
+
+  // redo bypasses the buffer pool, so nothing of the file may stay in it
+  if(!r)
+    r = pfh.FlushPages();
+
+  //
+  // redo: group the changes from the redo point on by page, in LSN
+  // order within a page
+  //
+  map<PageNum, RM_LogRecList> pageRecs;
+  set<int> touched;     // virtual pages changed by the log
+  for(size_t i = 0; i < recs.size() && !r; ++i) {
+    const RM_LogRec *rec = recs[i];
+    if(rec->type == RM_LOG_OVERFLOW && rec->lsn >= redoLSN)
+      pageRecs[rec->pageNum].push_back(rec);
+    if(!data_rec(rec))
+      continue;
+    PageNum pageNum;
+    if(fileHandle.page_of(rec->vPage, pageNum) || pageNum != rec->pageNum) {
+      r = RM_LOG_CORRUPT;
+      break;
+    }
+    if(rec->lsn >= redoLSN)
+      pageRecs[rec->pageNum].push_back(rec);
+    touched.insert(rec->vPage);
+  }
+  RM_RecShape shape;
+  shape.recordSize = fileHandle.recordSize;
+  shape.recordPerPage = fileHandle.recordPerPage;
+  shape.columns = &fileHandle.columns;
+  if(!r)
+    r = redo(pfh, shape, fileHandle.varLength, pageRecs);
+
+  //
+  // undo: take back what followed the last commit, newest first
+  //
+  vector<PageNum> reclaim;  // overflow pages the losers allocated
+  for(size_t i = recs.size(); i > winners && !r; --i) {
+    const RM_LogRec *rec = recs[i - 1];
+    if(!data_rec(rec) && rec->type != RM_LOG_OVERFLOW)
+      continue;
+    PF_PageHandle pageHdl;
+    RM_FileRecPage *data;
+    if((r = pfh.GetThisPage(rec->pageNum, pageHdl)))
+      break;
+    pageHdl.GetData((char *&)data);
+    if(rec->type == RM_LOG_OVERFLOW) {
+      if(rec->imageLen == 0)
+        reclaim.push_back(rec->pageNum);
+      else
+        ovfApply((RM_OverflowPage *)data, image1(rec), rec->imageLen);
+    } else if(fileHandle.varLength)
+      undo_var_rec((RM_VarRecPage *)data, rec);
+    else
+      undo_rec(data, rec, shape);
+    pfh.MarkDirty(rec->pageNum);
+    pfh.UnpinPage(rec->pageNum);
+  }
+
+  // the free list of overflow pages as the last change kept left it
+  PageNum freeOverflow = fileHandle.freeOverflow;
+  for(size_t i = 0; i < recs.size(); ++i)
+    if(recs[i]->type == RM_LOG_OVERFLOW) {
+      if(i >= winners) {
+        freeOverflow = recs[i]->flags1;
+        break;
+      }
+      freeOverflow = recs[i]->flags2;
+    }
+  free(logData);
+  for(size_t i = 0; i < reclaim.size() && !r; ++i) {
+    PF_PageHandle pageHdl;
+    RM_OverflowPage *page;
+    if((r = pfh.GetThisPage(reclaim[i], pageHdl)))
+      break;
+    pageHdl.GetData((char *&)page);
+    page->nextPage = freeOverflow;
+    page->length = 0;
+    freeOverflow = reclaim[i];
+    pfh.MarkDirty(reclaim[i]);
+    pfh.UnpinPage(reclaim[i]);
+  }
+  if(r || (r = fileHandle.set_free_overflow(freeOverflow, 0)))
+    return r;
+
+  //
+  // the directory entries of the touched pages are brought up to date.
+  // The free hint is pulled back to the first of them with room, and to
+  // the first replayed page.
+  //
+  int hint = fileHandle.freeHint;
+  if(firstPage >= 0 && firstPage < hint)
+    hint = firstPage;
+  set<int>::const_iterator it;
+  for(it = touched.begin(); it != touched.end(); ++it) {
+    PageNum pageNum;
+    PF_PageHandle pageHdl;
+    RM_FileRecPage *data;
+    if((r = fileHandle.page_of(*it, pageNum))
+       || (r = pfh.GetThisPage(pageNum, pageHdl)))
+      return r;
+    pageHdl.GetData((char *&)data);
+    int freeSlots = fileHandle.page_free((char *)data);
+    pfh.UnpinPage(pageNum);
+    if((r = fileHandle.set_free_slots(*it, freeSlots, 0)))
+      return r;
+    if(freeSlots > fileHandle.reserve && *it < hint)
+      hint = *it;
+  }
+  if(hint > fileHandle.totalPage)
+    hint = fileHandle.totalPage;
+  if((r = fileHandle.set_free_hint(hint, 0)))
+    return r;
+  fileHandle.fsm_clear();
+  fileHandle.freeCursor = hint;
+
+  // make the recovered state durable, then the log can start over
+  if((r = pfh.ForcePages()) || (r = pfh.Sync()))
+    return r;
+  return log.Truncate();
+}
@@ -0,0 +1,103 @@
+//
+// rm_recview.cc
+//
+//   Records read in place, see RM_RecView in rm.h
+//
+// A view owns one pin of the page it points into.  GetRec and scans pin
+// the page of a record and hand that pin over to the view with hold(),
+// which drops it again if the view already pins the page.
+//
+
+#include "rm.h"
+#include "rm_internal.h"
+
+RM_RecView::RM_RecView ()
+{
+  pfh_ = NULL;
+  pageNum_ = -1;
+  pageData_ = NULL;
+  data = NULL;
+  inlineLength = length_ = 0;
+  isLong = false;
+  overflow_ = -1;
+}
+
+RM_RecView::~RM_RecView()
+{
+  Release();
+}
+
+RC RM_RecView::GetData(const char *&pData) const
+{
+  pData = data;
+  return OK_RC;
+}
+
+RC RM_RecView::GetRid (RID &rid) const
+{
+  rid = rid_;
+  return OK_RC;
+}
+
+RC RM_RecView::GetLength(int &length) const
+{
+  length = length_;
+  return OK_RC;
+}
+
+RC RM_RecView::GetDataLength(int &length) const
+{
+  length = isLong ? inlineLength - int(sizeof(RM_VarLong)) : inlineLength;
+  return OK_RC;
+}
+
+RC RM_RecView::CopyTo(RM_Record &rec) const
+{
+  if(pageNum_ < 0)
+    return RM_REC_NO_EXIST;
+  rec.set(data, inlineLength, isLong);
+  rec.rid_ = rid_;
+  return OK_RC;
+}
+
+RC RM_RecView::Release()
+{
+  if(pageNum_ < 0)
+    return OK_RC;
+  RC r = pfh_->UnpinPage(pageNum_);
+  pageNum_ = -1;
+  data = NULL;
+  return r;
+}
+
+// take over the caller's pin of pageNum
+void RM_RecView::hold(const PF_FileHandle *pfh, PageNum pageNum,
+                      char *pageData)
+{
+  if(holds(pfh, pageNum)) {
+    pfh->UnpinPage(pageNum);
+    return;
+  }
+  Release();
+  pfh_ = pfh;
+  pageNum_ = pageNum;
+  pageData_ = pageData;
+}
+
+// point at the length bytes of a record on the held page, those of a
+// long record being its prefix and RM_VarLong
+void RM_RecView::set(const char *pData, int length, bool isLong,
+                     const RID &rid)
+{
+  data = pData;
+  inlineLength = length;
+  this->isLong = isLong;
+  length_ = length;
+  overflow_ = -1;
+  if(isLong) {
+    RM_VarLong desc = varLong(pData, length);
+    length_ = desc.length;
+    overflow_ = desc.first;
+  }
+  rid_ = rid;
+}
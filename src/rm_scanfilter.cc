@@ -0,0 +1,98 @@
+//
+// rm_scanfilter.cc
+//
+//   Scan conditions compiled into page filters, see rm_internal.h
+//
+// There is one filter per attribute type and operator, so the type and
+// the operator are settled once, when the scan is opened.  A filter walks
+// the records of a page without a branch per record: each comparison
+// becomes one bit of the mask.
+//
+
+#include <cstring>
+#include "rm.h"
+#include "rm_internal.h"
+
+// what a filter compares: the attribute itself for numbers, and for
+// strings the sign of memcmp against the value, compared to 0
+template<AttrType type> struct RM_FilterKey;
+
+template<> struct RM_FilterKey<INT> {
+  typedef int Key;
+  Key bound;
+  RM_FilterKey(const char *value, int) { memcpy(&bound, value, sizeof(int)); }
+  Key operator()(const char *attr) const
+    { Key k; memcpy(&k, attr, sizeof(int)); return k; }
+};
+
+template<> struct RM_FilterKey<FLOAT> {
+  typedef float Key;
+  Key bound;
+  RM_FilterKey(const char *value, int)
+    { memcpy(&bound, value, sizeof(float)); }
+  Key operator()(const char *attr) const
+    { Key k; memcpy(&k, attr, sizeof(float)); return k; }
+};
+
+template<> struct RM_FilterKey<STRING> {
+  typedef int Key;
+  Key bound;
+  const char *value;
+  int length;
+  RM_FilterKey(const char *value, int length)
+    : bound(0), value(value), length(length) {}
+  Key operator()(const char *attr) const
+    { return memcmp(attr, value, length); }
+};
+
+template<CompOp op, typename Key>
+inline bool filterCompare(Key attr, Key bound)
+{
+  switch(op) {
+    case EQ_OP: return attr == bound;
+    case NE_OP: return attr != bound;
+    case LT_OP: return attr < bound;
+    case GT_OP: return attr > bound;
+    case LE_OP: return attr <= bound;
+    case GE_OP: return attr >= bound;
+    case NO_OP: return true;
+  }
+  return true;
+}
+
+template<AttrType type, CompOp op>
+static void filterRecords(const char *attr, int stride, int count,
+                          const char *value, int attrLength, uint64_t *mask)
+{
+  RM_FilterKey<type> key(value, attrLength);
+  for(int w = 0; w * 64 < count; ++w) {
+    int n = count - w * 64 < 64 ? count - w * 64 : 64;
+    uint64_t bits = 0;
+    for(int b = 0; b < n; ++b, attr += stride)
+      bits |= uint64_t(filterCompare<op>(key(attr), key.bound)) << b;
+    mask[w] = bits;
+  }
+}
+
+static void filterAll(const char *, int, int count, const char *, int,
+                      uint64_t *mask)
+{
+  for(int w = 0; w * 64 < count; ++w)
+    mask[w] = count - w * 64 < 64 ? (uint64_t(1) << (count - w * 64)) - 1
+                                  : ~uint64_t(0);
+}
+
+#define RM_FILTERS(type) { filterAll, \
+  filterRecords<type, EQ_OP>, filterRecords<type, NE_OP>, \
+  filterRecords<type, LT_OP>, filterRecords<type, GT_OP>, \
+  filterRecords<type, LE_OP>, filterRecords<type, GE_OP> }
+
+// indexed by AttrType and CompOp, in the order of redbase.h
+static const RM_ScanFilter scanFilters[3][7] = {
+  RM_FILTERS(INT), RM_FILTERS(FLOAT), RM_FILTERS(STRING)
+};
+
+RM_ScanFilter scanFilter(AttrType type, CompOp op)
+{
+  return scanFilters[type][op];
+}
@@ -0,0 +1,65 @@
+//
+// rm_schema.cc
+//
+//   The schema of a file, see RM_Manager::CreateFile
+//
+// The attributes are read from their page when the file is opened and
+// kept in the file handle, which looks them up by name for the calls
+// that take one.  Where the attributes start and end is kept in order
+// too, so that cold pages encode each attribute on its own.
+//
+
+#include <algorithm>
+#include <cstring>
+#include "rm.h"
+#include "rm_internal.h"
+
+RC RM_FileHandle::load_schema(PageNum schemaPage)
+{
+  schema.clear();
+  attrBounds.clear();
+  if(schemaPage == END_PAGE_LIST)
+    return OK_RC;
+
+  PF_PageHandle pageHdl;
+  RM_SchemaPage *page;
+  RC r;
+  if((r = pfh_.GetThisPage(schemaPage, pageHdl))
+     || (r = pageHdl.GetData((char *&)page)))
+    return r;
+  if(page->numAttrs < 1 || page->numAttrs > RM_MAX_COLUMNS) {
+    pfh_.UnpinPage(schemaPage);
+    return RM_OPEN_FILE_HDR_PAGE_ERROR;
+  }
+  schema.assign(page->attrs, page->attrs + page->numAttrs);
+  pfh_.UnpinPage(schemaPage);
+
+  for(size_t i = 0; i < schema.size(); ++i) {
+    attrBounds.push_back(schema[i].attrOffset);
+    attrBounds.push_back(schema[i].attrOffset + schema[i].attrLength);
+  }
+  sort(attrBounds.begin(), attrBounds.end());
+  attrBounds.erase(unique(attrBounds.begin(), attrBounds.end()),
+                   attrBounds.end());
+  return OK_RC;
+}
+
+RC RM_FileHandle::GetSchema(vector<RM_AttrInfo> &attrs) const
+{
+  if(!fileOpen_)
+    return RM_NOT_OPEN_FILE;
+  attrs = schema;
+  return OK_RC;
+}
+
+RC RM_FileHandle::GetAttr(const char *attrName, RM_AttrInfo &attr) const
+{
+  if(!fileOpen_)
+    return RM_NOT_OPEN_FILE;
+  for(size_t i = 0; i < schema.size(); ++i)
+    if(!strcmp(schema[i].attrName, attrName)) {
+      attr = schema[i];
+      return OK_RC;
+    }
+  return RM_NO_SUCH_ATTR;
+}
@@ -20,23 +20,37 @@
 #include <cstring>
 #include <unistd.h>
 #include <cstdlib>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <set>
+#include <vector>
+#include <limits>
 
 #include "redbase.h"
 #include "pf.h"
 #include "rm.h"
 #include "rm_internal.h"
+#include "rm_logmanager.h"
 using namespace std;
 
 //
 // Defines
 //
 #define FILENAME   (char*)("testrel")         // test file name
+#define LOGNAME    (char*)("testrel.log")     // its write-ahead log
+#define ZONENAME   (char*)("testrel.zone")    // its zone maps
+#define LOADNAME   (char*)("testrel.load")    // rows to load
+#define ROWNAME    (char*)("testrel.rows")    // whole records, to compare
 #define STRLEN      29               // length of string in testrec
 #define PROG_UNIT   50               // how frequently to give progress
                                       //   reports when adding lots of recs
 #define FEW_RECS   200              // number of records added in
 #define MANY_RECS  200000           // stress test with many records
 #define HUGE_RECS  2000000
+#define VAR_MAX    300              // longest variable-length record
+#define BIG_MAX    20000            // longest record with overflow pages
+#define BIG_PREFIX (2*sizeof(int))  // inline prefix of those records
 //
 // Computes the offset of a field in a record (should be in <stddef.h>)
 //
@@ -68,6 +82,27 @@ RC Test2(void);
 RC Test3(void);
 RC Test4(void);
 RC Test5(void);
+RC Test6(void);
+RC Test7(void);
+RC Test8(void);
+RC Test9(void);
+RC Test10(void);
+RC Test11(void);
+RC Test12(void);
+RC Test13(void);
+RC Test14(void);
+RC Test15(void);
+RC Test16(void);
+RC Test17(void);
+RC Test18(void);
+RC Test19(void);
+RC Test20(void);
+RC Test21(void);
+RC Test22(void);
+RC Test23(void);
+RC Test24(void);
+RC Test25(void);
+RC Test26(void);
 
 int dummyInt;
 
@@ -91,14 +126,35 @@ RC GetNextRecScan(RM_FileScan &fs, RM_Record &rec);
 //
 // Array of pointers to the test functions
 //
-#define NUM_TESTS       5               // number of tests
+#define NUM_TESTS       26              // number of tests
 int (*tests[])() =                      // RC doesn't work on some compilers
 {
     Test1,
     Test2,
     Test3,
     Test4,
-    Test5
+    Test5,
+    Test6,
+    Test7,
+    Test8,
+    Test9,
+    Test10,
+    Test11,
+    Test12,
+    Test13,
+    Test14,
+    Test15,
+    Test16,
+    Test17,
+    Test18,
+    Test19,
+    Test20,
+    Test21,
+    Test22,
+    Test23,
+    Test24,
+    Test25,
+    Test26
 };
 
 //
@@ -118,6 +174,8 @@ int main(int argc, char *argv[])
 
     // Delete files from last time
     unlink(FILENAME);
+    unlink(LOGNAME);
+    unlink(ZONENAME);
 
     // If no argument given, do all tests
     if (argc == 1) {
@@ -344,12 +402,16 @@ RC DumpFile(char *fileName, int & totalPages )
   printf("++ record size %d\n", data->recordSize);
   printf("++ next page dir %d\n", data->nextPageDir);
   printf("++ const %d\n", END_PAGE_LIST);
+  printf("++ last page dir %d\n", data->lastPageDir);
   printf("total page %d\n", data->totalPage);
   totalPages = data->totalPage;
-  printf("first data page %d\n", data->totalPageList[0]);
-  printf("total empty page %d\n", data->totalEmptyPage);
-  printf("first empty page idx %d\n", data->emptyPageList[0]);
+  printf("first data page %d\n", data->pageList[0].pageNum);
+  printf("free slots on it %d\n", data->pageList[0].freeSlots);
+  PageNum pageNum;
+  ph.GetPageNum(pageNum);
+  pf.UnpinPage(pageNum);
   pfm.CloseFile(pf);
+  return OK_RC;
 }
 
 //
@@ -810,3 +872,3429 @@ RC Test5(void)
     printf("\ntest5 done ********************\n");
     return (0);
 }
+
+//
+// FileSize
+//
+// Desc: size of a file in bytes, -1 if it does not exist
+//
+long FileSize(char *fileName)
+{
+    struct stat st;
+    if (stat(fileName, &st) < 0)
+        return (-1);
+    return (st.st_size);
+}
+
+//
+// Test6 tests the write-ahead log: changes are logged, commits flush the
+// log (or every few commits, asynchronously), and closing the file
+// truncates it
+//
+RC Test6(void)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    RM_Record     rec;
+    long          size;
+
+    printf("test6 starting ****************\n");
+
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, FEW_RECS)) ||
+        (rc = fh.Commit()))
+        return (rc);
+
+    LsFile(LOGNAME);
+    size = FileSize(LOGNAME);
+    if (size < long(sizeof(RM_LogFileHdr) +
+                    FEW_RECS * (sizeof(RM_LogRec) + sizeof(TestRec)))) {
+        printf("inserts are not in the log, size %ld\n", size);
+        exit(1);
+    }
+
+    printf("**** asynchronous commit, 4 per flush\n");
+    if ((rc = fh.SetAsyncCommit(4)))
+        return (rc);
+    for (int i = 0; i < 4; ++i) {
+        if ((rc = fh.GetRec(RID(0, i), rec)) ||
+            (rc = fh.UpdateRec(rec)) ||
+            (rc = fh.Commit()))
+            return (rc);
+        if ((i < 3) != (FileSize(LOGNAME) == size)) {
+            printf("log flushed after %d commits\n", i + 1);
+            exit(1);
+        }
+    }
+
+    if ((rc = CloseFile(FILENAME, fh)))
+        return (rc);
+    if (FileSize(LOGNAME) != long(sizeof(RM_LogFileHdr))) {
+        printf("log not truncated on close, size %ld\n", FileSize(LOGNAME));
+        exit(1);
+    }
+
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = VerifyFile(fh, FEW_RECS)) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+    if (FileSize(LOGNAME) != -1) {
+        printf("log not removed with the file\n");
+        exit(1);
+    }
+
+    printf("\ntest6 done ********************\n");
+    return (0);
+}
+
+//
+// Crash
+//
+// Desc: in a child process, open the file, add numRecs committed records
+//       numbered from offset, then make changes that are not committed:
+//       add FEW_RECS more, delete the record in RID(0, 0) and update the
+//       one in RID(0, 1).  With force the pages and the log are forced to
+//       disk.  The child then dies without closing the file.  It takes a
+//       checkpoint every checkpointInterval bytes of log.
+//
+RC Crash(int numRecs, int offset, bool force,
+         int checkpointInterval = RM_CHECKPOINT_INTERVAL)
+{
+    int status;
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+        return (RM_LOG_IO_ERROR);
+    if (pid == 0) {
+        RM_FileHandle fh;
+        RM_Record     rec;
+        TestRec       *pRecBuf;
+        RC            rc;
+
+        if ((rc = OpenFile(FILENAME, fh)) ||
+            (rc = fh.SetCheckpointInterval(checkpointInterval)) ||
+            (rc = AddRecs(fh, numRecs, offset)) ||
+            (rc = fh.Commit()) ||
+            (rc = AddRecs(fh, FEW_RECS, offset + numRecs)) ||
+            (rc = fh.DeleteRec(RID(0, 0))) ||
+            (rc = fh.GetRec(RID(0, 1), rec)) ||
+            (rc = rec.GetData((char *&)pRecBuf)))
+            _exit(1);
+        pRecBuf->num = -1;
+        if ((rc = fh.UpdateRec(rec)) ||
+            (force && (rc = fh.ForcePages())))
+            _exit(1);
+        fflush(stdout);
+        _exit(0);
+    }
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+        printf("crashing child failed\n");
+        exit(1);
+    }
+    printf("\nchild crashed, log size %ld\n", FileSize(LOGNAME));
+    return (0);
+}
+
+//
+// Test7 tests crash recovery: the committed changes of a process that
+// died are redone and the rest undone when the file is opened again
+//
+RC Test7(void)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    int           numRecs;
+
+    printf("test7 starting ****************\n");
+
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, FEW_RECS)) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+
+    // more pages than the buffer pool holds, some reach the disk early
+    printf("**** crash after forcing the pages\n");
+    numRecs = FEW_RECS + 25 * FEW_RECS;
+    if ((rc = Crash(25 * FEW_RECS, FEW_RECS, true)) ||
+        (rc = OpenFile(FILENAME, fh)))
+        return (rc);
+    if (FileSize(LOGNAME) != long(sizeof(RM_LogFileHdr))) {
+        printf("log not truncated after recovery\n");
+        exit(1);
+    }
+    if ((rc = VerifyFile(fh, numRecs)) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+
+    // the new pages only exist in the log, which ends in a torn record
+    printf("**** crash with a torn log tail\n");
+    if ((rc = Crash(FEW_RECS, numRecs, false)))
+        return (rc);
+    numRecs += FEW_RECS;
+    char garbage[100];
+    memset(garbage, 0x5a, sizeof(garbage));
+    int fd = open(LOGNAME, O_WRONLY | O_APPEND);
+    if (fd < 0 || write(fd, garbage, sizeof(garbage)) != sizeof(garbage)) {
+        printf("cannot tear the log\n");
+        exit(1);
+    }
+    close(fd);
+
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = VerifyFile(fh, numRecs)) ||
+        (rc = AddRecs(fh, FEW_RECS, numRecs)) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+    numRecs += FEW_RECS;
+
+    // a second handle may not open the file, whose log it would recover
+    // and truncate under the first
+    printf("**** crash after opening the file twice\n");
+    int   status;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+        return (RM_LOG_IO_ERROR);
+    if (pid == 0) {
+        RM_FileHandle other;
+        if ((rc = OpenFile(FILENAME, fh)) ||
+            (rc = AddRecs(fh, FEW_RECS, numRecs)) ||
+            (rc = fh.Commit()) ||
+            rmm.OpenFile(FILENAME, other) != RM_OPEN_FILE_ALREADY_OPEN ||
+            (rc = AddRecs(fh, FEW_RECS, numRecs + FEW_RECS)) ||
+            (rc = fh.Commit()))
+            _exit(1);
+        fflush(stdout);
+        _exit(0);
+    }
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+        printf("crashing child failed\n");
+        exit(1);
+    }
+    numRecs += 2 * FEW_RECS;
+
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = VerifyFile(fh, numRecs)) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("\ntest7 done ********************\n");
+    return (0);
+}
+
+//
+// Frames
+//
+// Desc: number of pages of a file in the buffer pool, only the dirty
+//       ones if dirtyOnly
+//
+int Frames(char *fileName, bool dirtyOnly = false)
+{
+    PF_FrameInfo *frames;
+    int          numFrames;
+    int          count = 0;
+
+    if (pfm.GetBufferInfo(frames, numFrames))
+        return (-1);
+    for (int i = 0; i < numFrames; i++)
+        if (!strcmp(frames[i].fileName, fileName)
+            && (frames[i].bDirty || !dirtyOnly))
+            count++;
+    delete [] frames;
+    return (count);
+}
+
+//
+// DirtyFrames
+//
+// Desc: number of dirty pages of a file in the buffer pool
+//
+int DirtyFrames(char *fileName)
+{
+    return (Frames(fileName, true));
+}
+
+//
+// Test8 tests fuzzy checkpoints: a checkpoint writes no page, its dirty
+// pages are trickled out by later page requests, and recovery from a
+// log with checkpoints in it redoes what is missing
+//
+RC Test8(void)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    RM_Record     rec;
+    int           numRecs = 10 * FEW_RECS;
+
+    printf("test8 starting ****************\n");
+
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = fh.SetCheckpointInterval(0)) ||
+        (rc = AddRecs(fh, numRecs)))
+        return (rc);
+
+    int dirty = DirtyFrames(FILENAME);
+    long size = FileSize(LOGNAME);
+    if ((rc = fh.Checkpoint()))
+        return (rc);
+    if (DirtyFrames(FILENAME) != dirty || FileSize(LOGNAME) != size) {
+        printf("checkpoint wrote pages or the log\n");
+        exit(1);
+    }
+
+    printf("**** %d dirty pages to trickle\n", dirty);
+    for (int i = 0; i < dirty; i++)
+        if ((rc = fh.GetRec(RID(0, 0), rec)))
+            return (rc);
+    if (DirtyFrames(FILENAME) != 0) {
+        printf("%d pages left dirty\n", DirtyFrames(FILENAME));
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)))
+        return (rc);
+
+    printf("**** crash with checkpoints every 64k of log\n");
+    if ((rc = Crash(25 * FEW_RECS, numRecs, true, 64 * 1024)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = VerifyFile(fh, numRecs + 25 * FEW_RECS)) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+    numRecs += 25 * FEW_RECS;
+
+    // checkpoints cut the log of a file that is never closed, which
+    // would otherwise hold every record added.  The last cut leaves
+    // behind new pages that the file header counts but that were never
+    // written.
+    printf("**** crash after committing for long with the file open\n");
+    int   status;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+        return (RM_LOG_IO_ERROR);
+    if (pid == 0) {
+        long maxSize = 0;
+        if ((rc = OpenFile(FILENAME, fh)) ||
+            (rc = fh.SetCheckpointInterval(64 * 1024)))
+            _exit(1);
+        for (int i = 0; i < 100; i++) {
+            if ((rc = AddRecs(fh, FEW_RECS, numRecs + i * FEW_RECS)) ||
+                (rc = fh.Commit()))
+                _exit(1);
+            maxSize = max(maxSize, FileSize(LOGNAME));
+        }
+        if ((rc = fh.SetCheckpointInterval(0)) ||
+            (rc = AddRecs(fh, 2 * FEW_RECS, numRecs + 100 * FEW_RECS)) ||
+            (rc = fh.Commit()) ||
+            (rc = fh.Checkpoint()))
+            _exit(1);
+        for (int i = DirtyFrames(FILENAME); i > 0; i--)
+            if ((rc = fh.GetRec(RID(0, 0), rec)))
+                _exit(1);
+        long size = FileSize(LOGNAME);
+        if ((rc = AddRecs(fh, FEW_RECS, numRecs + 102 * FEW_RECS)) ||
+            (rc = fh.Commit()) ||
+            (rc = fh.Checkpoint()) ||
+            FileSize(LOGNAME) >= size)
+            _exit(1);
+        printf("\nlog grew to %ld bytes\n", maxSize);
+        fflush(stdout);
+        _exit(maxSize > 512 * 1024);
+    }
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+        printf("crashing child failed\n");
+        exit(1);
+    }
+    numRecs += 103 * FEW_RECS;
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = VerifyFile(fh, numRecs)) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("\ntest8 done ********************\n");
+    return (0);
+}
+
+//
+// Test9 tests the page directory, which is kept up to date on disk:
+// recovery rebuilds it when a crash happened while it grew a directory
+// page, opening the file only reads the header, reaching a record only
+// reads the directory page holding its entry, and changing the record
+// only dirties that page
+//
+RC Test9(void)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    int           numRecs = FEW_RECS + 55000;
+    int           totalPages;
+
+    printf("test9 starting ****************\n");
+
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, FEW_RECS)) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+
+    printf("**** crash while the directory grows a page\n");
+    if ((rc = Crash(numRecs - FEW_RECS, FEW_RECS, false)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = VerifyFile(fh, numRecs)) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+    DumpFile(FILENAME, totalPages);
+    if (totalPages <= int(HEADER_LIST_SIZE)) {
+        printf("no directory page with %d pages\n", totalPages);
+        exit(1);
+    }
+
+    printf("**** delete from the last page\n");
+    if ((rc = OpenFile(FILENAME, fh)))
+        return (rc);
+    if (Frames(FILENAME) != 1) {
+        printf("%d pages read to open the file\n", Frames(FILENAME));
+        exit(1);
+    }
+    if ((rc = fh.DeleteRec(RID(totalPages - 1, 0))))
+        return (rc);
+    if (Frames(FILENAME) != 3) {
+        printf("%d pages read for one delete\n", Frames(FILENAME));
+        exit(1);
+    }
+    if (DirtyFrames(FILENAME) != 2) {
+        printf("%d dirty pages after one delete\n", DirtyFrames(FILENAME));
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("\ntest9 done ********************\n");
+    return (0);
+}
+
+//
+// InsertOn
+//
+// Desc: insert a record and check the page it went to
+//
+RC InsertOn(RM_FileHandle &fh, PageNum expected)
+{
+    RC      rc;
+    TestRec recBuf;
+    RID     rid;
+    PageNum pageNum;
+
+    memset((void *)&recBuf, 0, sizeof(recBuf));
+    if ((rc = InsertRec(fh, (char *)&recBuf, rid)) ||
+        (rc = rid.GetPageNum(pageNum)))
+        return (rc);
+    if (pageNum != expected) {
+        printf("insert went to page %d instead of %d\n", pageNum, expected);
+        exit(1);
+    }
+    return (0);
+}
+
+//
+// Test10 tests the free-space map: inserts go to the fullest page with
+// room, also after the file is reopened, and leave the slots the fill
+// factor keeps free
+//
+RC Test10(void)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    int           perPage, limit, i;
+
+    printf("test10 starting ****************\n");
+
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)))
+        return (rc);
+    perPage = fh.GetRecordPerPage();
+    if ((rc = AddRecs(fh, 3 * perPage)))
+        return (rc);
+    for (i = 0; i < perPage / 2; i++)
+        if ((rc = fh.DeleteRec(RID(0, i))))
+            return (rc);
+    if ((rc = fh.DeleteRec(RID(1, 0))) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+
+    printf("**** inserts fill the fullest page first\n");
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = InsertOn(fh, 1)))
+        return (rc);
+    for (i = 0; i < perPage / 2; i++)
+        if ((rc = InsertOn(fh, 0)))
+            return (rc);
+    if ((rc = InsertOn(fh, 3)) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("**** a fill factor of 50 leaves half of every page free\n");
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)))
+        return (rc);
+    if (fh.SetFillFactor(0) != RM_BAD_FILL_FACTOR) {
+        printf("fill factor 0 accepted\n");
+        exit(1);
+    }
+    limit = (perPage + 1) / 2;
+    if ((rc = fh.SetFillFactor(50)))
+        return (rc);
+    for (i = 0; i < 2 * limit; i++)
+        if ((rc = InsertOn(fh, i / limit)))
+            return (rc);
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = InsertOn(fh, 2)) ||
+        (rc = fh.SetFillFactor(100)) ||
+        (rc = InsertOn(fh, 0)) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("\ntest10 done ********************\n");
+    return (0);
+}
+
+//
+// VarRec
+//
+// Desc: make variable-length record num of length bytes in buf: "v<num>|"
+//       and then a letter that depends on num.  Returns the length.
+//
+int VarRec(int num, int length, char *buf)
+{
+    int n = sprintf(buf, "v%d|", num);
+    if (length < n)
+        length = n;
+    memset(buf + n, 'a' + num % 26, length - n);
+    return (length);
+}
+
+//
+// VarLen
+//
+// Desc: the length record num gets when it is added
+//
+int VarLen(int num)
+{
+    return (10 + num * 37 % (VAR_MAX - 10));
+}
+
+//
+// CheckVarRec
+//
+// Desc: check a record made by VarRec and return its number, -1 if it is
+//       not well formed
+//
+int CheckVarRec(const char *data, int length)
+{
+    int num, n;
+
+    if (sscanf(data, "v%d|%n", &num, &n) != 1 || n > length)
+        return (-1);
+    for (int i = n; i < length; i++)
+        if (data[i] != 'a' + num % 26)
+            return (-1);
+    return (num);
+}
+
+//
+// AddVarRecs
+//
+// Desc: add records numbered from offset, of length VarLen
+//
+RC AddVarRecs(RM_FileHandle &fh, int numRecs, int offset = 0)
+{
+    RC   rc;
+    RID  rid;
+    char buf[VAR_MAX];
+
+    printf("\nadding %d variable-length records\n", numRecs);
+    for (int i = offset; i < offset + numRecs; i++)
+        if ((rc = fh.InsertRec(buf, VarRec(i, VarLen(i), buf), rid)))
+            return (rc);
+    return (0);
+}
+
+//
+// ResizeVarRec
+//
+// Desc: give the record at rid a new length, keeping its number
+//
+RC ResizeVarRec(RM_FileHandle &fh, const RID &rid, int length)
+{
+    RC        rc;
+    RM_Record rec;
+    char      *data;
+    int       oldLength;
+    char      buf[VAR_MAX];
+
+    if ((rc = fh.GetRec(rid, rec)) ||
+        (rc = rec.GetData(data)) ||
+        (rc = rec.GetLength(oldLength)))
+        return (rc);
+    int num = CheckVarRec(data, oldLength);
+    if ((rc = rec.SetData(buf, VarRec(num, length, buf))))
+        return (rc);
+    return (fh.UpdateRec(rec));
+}
+
+//
+// VerifyVarFile
+//
+// Desc: scan the file, check that it holds numRecs well formed records
+//       with different numbers
+//
+RC VerifyVarFile(RM_FileHandle &fh, int numRecs)
+{
+    RC          rc;
+    RM_FileScan fs;
+    RM_Record   rec;
+    char        *data;
+    int         length, n = 0;
+    set<int>    seen;
+
+    printf("\nverifying %d variable-length records\n", numRecs);
+    if ((rc = fs.OpenScan(fh, INT, sizeof(int), 0, NO_OP, NULL)))
+        return (rc);
+    while (!(rc = fs.GetNextRec(rec))) {
+        rec.GetData(data);
+        rec.GetLength(length);
+        int num = CheckVarRec(data, length);
+        if (num < 0 || !seen.insert(num).second) {
+            printf("bad or repeated record %d\n", num);
+            exit(1);
+        }
+        n++;
+    }
+    if (rc != RM_EOF || (rc = fs.CloseScan()))
+        return (rc);
+    if (n != numRecs) {
+        printf("%d records instead of %d\n", n, numRecs);
+        exit(1);
+    }
+    return (0);
+}
+
+//
+// Test11 tests variable-length records: they take less room than fixed
+// ones of the longest length, keep their RID when they grow out of their
+// page, and are recovered after a crash
+//
+RC Test11(void)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    RM_Record     rec;
+    int           numRecs = 2000, totalPages, length, i, status;
+    char          *data;
+
+    printf("test11 starting ****************\n");
+
+    if ((rc = rmm.CreateFile(FILENAME, VAR_MAX, true)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddVarRecs(fh, numRecs)) ||
+        (rc = VerifyVarFile(fh, numRecs)) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+    DumpFile(FILENAME, totalPages);
+    int fixedPages = (numRecs + DATA_ON_RECORD_PAGE / VAR_MAX - 1)
+                     / (DATA_ON_RECORD_PAGE / VAR_MAX);
+    if (totalPages * 5 > fixedPages * 3) {
+        printf("%d pages, %d with fixed-length records\n", totalPages,
+               fixedPages);
+        exit(1);
+    }
+
+    printf("**** records grow out of their page\n");
+    if ((rc = OpenFile(FILENAME, fh)))
+        return (rc);
+    for (i = 0; i < 20; i++)
+        if ((rc = ResizeVarRec(fh, RID(0, i), VAR_MAX)))
+            return (rc);
+    if ((rc = fh.GetRec(RID(0, 3), rec)) ||
+        (rc = rec.GetData(data)) ||
+        (rc = rec.GetLength(length)))
+        return (rc);
+    if (length != VAR_MAX || CheckVarRec(data, length) != 3) {
+        printf("moved record has length %d\n", length);
+        exit(1);
+    }
+    if ((rc = ResizeVarRec(fh, RID(0, 4), 20)) ||
+        (rc = ResizeVarRec(fh, RID(0, 5), VAR_MAX - 1)) ||
+        (rc = fh.DeleteRec(RID(0, 6))) ||
+        (rc = fh.DeleteRec(RID(0, 7))) ||
+        (rc = VerifyVarFile(fh, numRecs - 2)) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+
+    printf("**** crash with moved records\n");
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+        return (RM_LOG_IO_ERROR);
+    if (pid == 0) {
+        if ((rc = OpenFile(FILENAME, fh)) ||
+            (rc = AddVarRecs(fh, FEW_RECS, numRecs)) ||
+            (rc = ResizeVarRec(fh, RID(1, 0), VAR_MAX)) ||
+            (rc = fh.Commit()) ||
+            (rc = AddVarRecs(fh, FEW_RECS, numRecs + FEW_RECS)) ||
+            (rc = ResizeVarRec(fh, RID(1, 1), VAR_MAX)) ||
+            (rc = ResizeVarRec(fh, RID(0, 3), 10)) ||
+            (rc = fh.DeleteRec(RID(0, 8))) ||
+            (rc = fh.DeleteRec(RID(0, 9))))
+            _exit(1);
+        fflush(stdout);
+        _exit(0);
+    }
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+        printf("crashing child failed\n");
+        exit(1);
+    }
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = VerifyVarFile(fh, numRecs - 2 + FEW_RECS)))
+        return (rc);
+    int expected[][2] = { {1, 0}, {1, 1}, {0, 3}, {0, 8} };
+    int lengths[] = { VAR_MAX, -1, VAR_MAX, VAR_MAX };
+    for (i = 0; i < 4; i++) {
+        if ((rc = fh.GetRec(RID(expected[i][0], expected[i][1]), rec)) ||
+            (rc = rec.GetLength(length)))
+            return (rc);
+        rec.GetData(data);
+        if (lengths[i] < 0)
+            lengths[i] = VarLen(CheckVarRec(data, length));
+        if (length != lengths[i]) {
+            printf("record (%d, %d) has length %d instead of %d\n",
+                   expected[i][0], expected[i][1], length, lengths[i]);
+            exit(1);
+        }
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("\ntest11 done ********************\n");
+    return (0);
+}
+
+//
+// BigLen
+//
+// Desc: the length of big record num; every fourth one is short
+//
+int BigLen(int num)
+{
+    if (num % 4 == 0)
+        return (2 * sizeof(int) + num % 50);
+    return (500 + num * 7919 % (BIG_MAX - 500));
+}
+
+//
+// BigRec
+//
+// Desc: make big record num of length bytes in buf: num, a spare int and
+//       then bytes that depend on num and their offset
+//
+void BigRec(int num, int length, char *buf)
+{
+    int spare = 0;
+
+    memcpy(buf, &num, sizeof(int));
+    memcpy(buf + sizeof(int), &spare, sizeof(int));
+    for (int i = 2 * sizeof(int); i < length; i++)
+        buf[i] = (char)((num * 31 + i) % 251);
+}
+
+//
+// AddBigRecs
+//
+// Desc: add big records numbered from offset, their RIDs go to rids
+//
+RC AddBigRecs(RM_FileHandle &fh, int numRecs, int offset, RID *rids)
+{
+    RC   rc;
+    char *buf = new char[BIG_MAX];
+
+    printf("\nadding %d big records\n", numRecs);
+    for (int i = offset; i < offset + numRecs; i++) {
+        BigRec(i, BigLen(i), buf);
+        if ((rc = fh.InsertRec(buf, BigLen(i), rids[i]))) {
+            delete [] buf;
+            return (rc);
+        }
+    }
+    delete [] buf;
+    return (0);
+}
+
+//
+// CheckBigRec
+//
+// Desc: read a big record through a cursor, in pieces of an odd size,
+//       and check it against what BigRec makes.  Returns its number.
+//
+int CheckBigRec(RM_FileHandle &fh, RM_Record &rec)
+{
+    RM_RecCursor cursor;
+    char         *data;
+    int          length, dataLength, num, n, got = 0;
+    char         *buf = new char[BIG_MAX];
+    char         *expected = new char[BIG_MAX];
+
+    rec.GetData(data);
+    rec.GetLength(length);
+    rec.GetDataLength(dataLength);
+    memcpy(&num, data, sizeof(int));
+    if (length > BIG_MAX || dataLength !=
+        (length > RM_VAR_MAX_INLINE ? int(BIG_PREFIX) : length)) {
+        printf("record %d has %d of %d bytes inline\n", num, dataLength,
+               length);
+        exit(1);
+    }
+    if (cursor.Open(fh, rec))
+        exit(1);
+    while (!cursor.Read(buf + got, 777, n))
+        got += n;
+    BigRec(num, length, expected);
+    if (got != length || memcmp(buf + BIG_PREFIX, expected + BIG_PREFIX,
+                                length - BIG_PREFIX)) {
+        printf("record %d reads wrong, %d of %d bytes\n", num, got, length);
+        exit(1);
+    }
+
+    // and from the middle on
+    if (cursor.Seek(length / 2) ||
+        cursor.Read(buf, length, n) ||
+        n != length - length / 2 ||
+        memcmp(buf, expected + length / 2, n) ||
+        cursor.Seek(length + 1) != RM_BAD_OFFSET ||
+        cursor.Close()) {
+        printf("record %d reads wrong from the middle\n", num);
+        exit(1);
+    }
+    delete [] buf;
+    delete [] expected;
+    return (num);
+}
+
+//
+// VerifyBigFile
+//
+// Desc: scan the file, check that it holds numRecs big records with
+//       different numbers
+//
+RC VerifyBigFile(RM_FileHandle &fh, int numRecs)
+{
+    RC          rc;
+    RM_FileScan fs;
+    RM_Record   rec;
+    int         n = 0;
+    set<int>    seen;
+
+    printf("\nverifying %d big records\n", numRecs);
+    if ((rc = fs.OpenScan(fh, INT, sizeof(int), 0, NO_OP, NULL)))
+        return (rc);
+    while (!(rc = fs.GetNextRec(rec))) {
+        int num = CheckBigRec(fh, rec);
+        if (!seen.insert(num).second) {
+            printf("repeated record %d\n", num);
+            exit(1);
+        }
+        n++;
+    }
+    if (rc != RM_EOF || (rc = fs.CloseScan()))
+        return (rc);
+    if (n != numRecs) {
+        printf("%d records instead of %d\n", n, numRecs);
+        exit(1);
+    }
+    return (0);
+}
+
+//
+// CountScan
+//
+// Desc: the number of records a scan with an INT condition returns
+//
+RC CountScan(RM_FileHandle &fh, int offset, CompOp op, int value, int &n)
+{
+    RC          rc;
+    RM_FileScan fs;
+    RM_Record   rec;
+
+    n = 0;
+    if ((rc = fs.OpenScan(fh, INT, sizeof(int), offset, op, &value)))
+        return (rc);
+    while (!(rc = fs.GetNextRec(rec)))
+        n++;
+    if (rc != RM_EOF)
+        return (rc);
+    return (fs.CloseScan());
+}
+
+//
+// Test12 tests records longer than a page: they are read through a
+// cursor, scans on their prefix leave the overflow pages alone, freed
+// overflow pages are reused, and a crash loses none of them
+//
+RC Test12(void)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    RM_Record     rec;
+    int           numRecs = 100, totalPages, n, expected, i, status;
+    RID           rids[200];
+    char          *data;
+    char          *buf = new char[BIG_MAX];
+    long          size;
+
+    printf("test12 starting ****************\n");
+
+    if ((rc = rmm.CreateFile(FILENAME, BIG_MAX, true)) ||
+        (rc = OpenFile(FILENAME, fh)))
+        return (rc);
+    if (fh.SetInlinePrefix(RM_VAR_MAX_PREFIX + 1) != RM_BAD_INLINE_PREFIX) {
+        printf("inline prefix past a quarter page taken\n");
+        exit(1);
+    }
+    if ((rc = fh.SetInlinePrefix(BIG_PREFIX)) ||
+        (rc = AddBigRecs(fh, numRecs, 0, rids)) ||
+        (rc = VerifyBigFile(fh, numRecs)) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+    DumpFile(FILENAME, totalPages);
+
+    printf("**** scans on the prefix\n");
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = CountScan(fh, 0, LT_OP, numRecs / 2, n)))
+        return (rc);
+    // the header and the record pages, no overflow page
+    if (n != numRecs / 2 || Frames(FILENAME) > totalPages + 1) {
+        printf("%d records, %d pages read\n", n, Frames(FILENAME));
+        exit(1);
+    }
+    // a condition past the prefix reads the overflow pages
+    for (i = 0, expected = 0; i < numRecs; i++) {
+        int value = 0;
+        BigRec(i, BigLen(i), buf);
+        memcpy(&value, buf + BIG_PREFIX,
+               BigLen(i) >= int(BIG_PREFIX + sizeof(int)) ? sizeof(int)
+               : BigLen(i) - BIG_PREFIX);
+        expected += value > 1000000;
+    }
+    if ((rc = CountScan(fh, BIG_PREFIX, GT_OP, 1000000, n)))
+        return (rc);
+    if (n != expected) {
+        printf("%d records past the prefix instead of %d\n", n, expected);
+        exit(1);
+    }
+
+    printf("**** updates\n");
+    // only the prefix
+    if ((rc = fh.GetRec(rids[1], rec)) ||
+        (rc = rec.GetData(data)))
+        return (rc);
+    ((int *)data)[1] = -1;
+    if ((rc = fh.UpdateRec(rec)) ||
+        (rc = fh.GetRec(rids[1], rec)) ||
+        (rc = rec.GetData(data)))
+        return (rc);
+    if (((int *)data)[1] != -1 || CheckBigRec(fh, rec) != 1) {
+        printf("prefix update lost\n");
+        exit(1);
+    }
+    // long to short, short to long, and longer
+    BigRec(1, 100, buf);
+    if ((rc = rec.SetData(buf, 100)) ||
+        (rc = fh.UpdateRec(rec)) ||
+        (rc = fh.GetRec(rids[4], rec)))
+        return (rc);
+    BigRec(4, BIG_MAX, buf);
+    if ((rc = rec.SetData(buf, BIG_MAX)) ||
+        (rc = fh.UpdateRec(rec)) ||
+        (rc = fh.GetRec(rids[5], rec)))
+        return (rc);
+    BigRec(5, BIG_MAX - 1, buf);
+    if ((rc = rec.SetData(buf, BIG_MAX - 1)) ||
+        (rc = fh.UpdateRec(rec)) ||
+        (rc = fh.DeleteRec(rids[6])) ||
+        (rc = VerifyBigFile(fh, numRecs - 1)))
+        return (rc);
+    int lengths[][2] = { {1, 100}, {4, BIG_MAX}, {5, BIG_MAX - 1} };
+    for (i = 0; i < 3; i++) {
+        if ((rc = fh.GetRec(rids[lengths[i][0]], rec)) ||
+            (rc = rec.GetLength(n)))
+            return (rc);
+        if (n != lengths[i][1] || CheckBigRec(fh, rec) != lengths[i][0]) {
+            printf("record %d has length %d\n", lengths[i][0], n);
+            exit(1);
+        }
+    }
+    if ((rc = CloseFile(FILENAME, fh)))
+        return (rc);
+
+    printf("**** freed overflow pages are reused\n");
+    size = FileSize(FILENAME);
+    if ((rc = OpenFile(FILENAME, fh)))
+        return (rc);
+    for (i = numRecs / 2; i < numRecs; i++)
+        if ((rc = fh.DeleteRec(rids[i])))
+            return (rc);
+    if ((rc = AddBigRecs(fh, numRecs / 2, numRecs / 2, rids)) ||
+        (rc = VerifyBigFile(fh, numRecs - 1)) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+    if (FileSize(FILENAME) != size) {
+        printf("file grew from %ld to %ld bytes\n", size,
+               FileSize(FILENAME));
+        exit(1);
+    }
+
+    printf("**** crash with big records\n");
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+        return (RM_LOG_IO_ERROR);
+    if (pid == 0) {
+        if ((rc = OpenFile(FILENAME, fh)) ||
+            (rc = AddBigRecs(fh, 20, numRecs, rids)) ||
+            (rc = fh.DeleteRec(rids[7])) ||
+            (rc = fh.Commit()) ||
+            (rc = AddBigRecs(fh, 20, numRecs + 20, rids)) ||
+            (rc = fh.DeleteRec(rids[9])) ||
+            (rc = fh.DeleteRec(rids[numRecs])) ||
+            (rc = fh.GetRec(rids[10], rec)))
+            _exit(1);
+        // the lost changes reach the disk, log and all
+        BigRec(10, BIG_MAX, buf);
+        if ((rc = rec.SetData(buf, BIG_MAX)) ||
+            (rc = fh.UpdateRec(rec)) ||
+            (rc = fh.ForcePages()))
+            _exit(1);
+        fflush(stdout);
+        _exit(0);
+    }
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+        printf("crashing child failed\n");
+        exit(1);
+    }
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = VerifyBigFile(fh, numRecs - 2 + 20)) ||
+        (rc = fh.GetRec(rids[10], rec)) ||
+        (rc = rec.GetLength(n)))
+        return (rc);
+    if (n != BigLen(10)) {
+        printf("update of record 10 not undone\n");
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)))
+        return (rc);
+
+    // the pages the lost inserts took are free again
+    size = FileSize(FILENAME);
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddBigRecs(fh, 20, numRecs + 20, rids)) ||
+        (rc = VerifyBigFile(fh, numRecs - 2 + 40)) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+    if (FileSize(FILENAME) != size) {
+        printf("file grew from %ld to %ld bytes after recovery\n", size,
+               FileSize(FILENAME));
+        exit(1);
+    }
+    if ((rc = DestroyFile(FILENAME)))
+        return (rc);
+    delete [] buf;
+
+    printf("\ntest12 done ********************\n");
+    return (0);
+}
+
+//
+// PinnedFrames
+//
+// Desc: number of pinned pages of a file in the buffer pool
+//
+int PinnedFrames(char *fileName)
+{
+    PF_FrameInfo *frames;
+    int          numFrames;
+    int          count = 0;
+
+    if (pfm.GetBufferInfo(frames, numFrames))
+        return (-1);
+    for (int i = 0; i < numFrames; i++)
+        if (!strcmp(frames[i].fileName, fileName) && frames[i].pinCount)
+            count++;
+    delete [] frames;
+    return (count);
+}
+
+//
+// PageRequests
+//
+// Desc: number of requests for the pages of a file in the buffer pool
+//
+long PageRequests(char *fileName)
+{
+    PF_FrameInfo *frames;
+    int          numFrames;
+    long         count = 0;
+
+    if (pfm.GetBufferInfo(frames, numFrames))
+        return (-1);
+    for (int i = 0; i < numFrames; i++)
+        if (!strcmp(frames[i].fileName, fileName))
+            count += frames[i].accessCount;
+    delete [] frames;
+    return (count);
+}
+
+//
+// Test13 tests record views: they read records in place, keep their
+// page pinned until released, and let a scan pin each page only once
+//
+RC Test13(void)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    RM_FileScan   fs;
+    RM_Record     rec;
+    RM_RecView    view;
+    int           numRecs = 2000, totalPages, n, length, value = 100;
+    const char    *data;
+    char          *copy;
+    long          requests;
+
+    printf("test13 starting ****************\n");
+
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, numRecs)) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+    DumpFile(FILENAME, totalPages);
+
+    printf("**** the same record as a copy\n");
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = fh.GetRec(RID(1, 5), view)) ||
+        (rc = fh.GetRec(RID(1, 5), rec)) ||
+        (rc = view.GetData(data)) ||
+        (rc = view.GetLength(length)) ||
+        (rc = rec.GetData(copy)))
+        return (rc);
+    if (length != sizeof(TestRec) || memcmp(data, copy, length) ||
+        PinnedFrames(FILENAME) != 1) {
+        printf("view differs from the copy, or its page is not pinned\n");
+        exit(1);
+    }
+    if ((rc = view.Release()))
+        return (rc);
+    if (PinnedFrames(FILENAME)) {
+        printf("released view keeps its page\n");
+        exit(1);
+    }
+
+    printf("**** scan with a view\n");
+    if ((rc = fs.OpenScan(fh, INT, sizeof(int), offsetof(TestRec, num),
+                          LT_OP, &value)))
+        return (rc);
+    requests = PageRequests(FILENAME);
+    for (n = 0; !(rc = fs.GetNextRec(view)); n++) {
+        if ((rc = view.GetData(data)) ||
+            (rc = view.CopyTo(rec)) ||
+            (rc = rec.GetData(copy)))
+            return (rc);
+        if (((TestRec *)data)->num >= value ||
+            memcmp(data, copy, sizeof(TestRec)) ||
+            PinnedFrames(FILENAME) != 1) {
+            printf("scan view of record %d is wrong\n", n);
+            exit(1);
+        }
+    }
+    if (rc != RM_EOF || (rc = fs.CloseScan()))
+        return (rc);
+    // every page once, and again for the copies
+    requests = PageRequests(FILENAME) - requests;
+    if (n != value || requests > totalPages + value ||
+        PinnedFrames(FILENAME)) {
+        printf("%d records, %ld page requests, %d pages pinned\n", n,
+               requests, PinnedFrames(FILENAME));
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("**** views of moved records\n");
+    if ((rc = rmm.CreateFile(FILENAME, VAR_MAX, true)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddVarRecs(fh, numRecs)))
+        return (rc);
+    for (int i = 0; i < 20; i++)
+        if ((rc = ResizeVarRec(fh, RID(0, i), VAR_MAX)))
+            return (rc);
+    if ((rc = fs.OpenScan(fh, INT, sizeof(int), 0, NO_OP, NULL)))
+        return (rc);
+    set<int> seen;
+    for (n = 0; !(rc = fs.GetNextRec(view)); n++) {
+        view.GetData(data);
+        view.GetLength(length);
+        int num = CheckVarRec(data, length);
+        if (num < 0 || !seen.insert(num).second ||
+            PinnedFrames(FILENAME) != 1) {
+            printf("bad or repeated record %d\n", num);
+            exit(1);
+        }
+    }
+    if (rc != RM_EOF || (rc = fs.CloseScan()))
+        return (rc);
+    if (n != numRecs || PinnedFrames(FILENAME)) {
+        printf("%d records, %d pages pinned\n", n, PinnedFrames(FILENAME));
+        exit(1);
+    }
+    if ((rc = fh.GetRec(RID(0, 3), view)) ||
+        (rc = view.GetData(data)) ||
+        (rc = view.GetLength(length)))
+        return (rc);
+    if (length != VAR_MAX || CheckVarRec(data, length) != 3) {
+        printf("view of moved record has length %d\n", length);
+        exit(1);
+    }
+    if ((rc = view.Release()) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("\ntest13 done ********************\n");
+    return (0);
+}
+
+//
+// SameRid
+//
+// Desc: whether two RIDs name the same slot
+//
+bool SameRid(const RID &a, const RID &b)
+{
+    PageNum aPage, bPage;
+    SlotNum aSlot, bSlot;
+
+    a.GetPageNum(aPage);
+    a.GetSlotNum(aSlot);
+    b.GetPageNum(bPage);
+    b.GetSlotNum(bSlot);
+    return (aPage == bPage && aSlot == bSlot);
+}
+
+//
+// Test14 tests batch scans: they return the records and RIDs of a scan
+// record by record, and pin each page once
+//
+RC Test14(void)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    RM_FileScan   fs, batchFs;
+    RM_Record     rec;
+    TestRec       batch[64];
+    RID           rids[64], rid;
+    int           numRecs = 2000, totalPages, n, got, value = 1500;
+    char          *data;
+    long          requests;
+
+    printf("test14 starting ****************\n");
+
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, numRecs)))
+        return (rc);
+    for (int i = 0; i < numRecs; i += 3)
+        if ((rc = fh.DeleteRec(RID(i / fh.GetRecordPerPage(),
+                                   i % fh.GetRecordPerPage()))))
+            return (rc);
+    if ((rc = CloseFile(FILENAME, fh)))
+        return (rc);
+    DumpFile(FILENAME, totalPages);
+
+    printf("**** batches against single records\n");
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = fs.OpenScan(fh, INT, sizeof(int), offsetof(TestRec, num),
+                          LT_OP, &value)) ||
+        (rc = batchFs.OpenScan(fh, INT, sizeof(int), offsetof(TestRec, num),
+                               LT_OP, &value)))
+        return (rc);
+    if (batchFs.GetNextBatch((char *)batch, rids, 0, got) !=
+        RM_SCAN_BAD_BATCH) {
+        printf("empty batch accepted\n");
+        exit(1);
+    }
+    vector<TestRec> recs;
+    vector<RID>     recRids;
+    while (!(rc = fs.GetNextRec(rec))) {
+        if ((rc = rec.GetData(data)) ||
+            (rc = rec.GetRid(rid)))
+            return (rc);
+        recs.push_back(*(TestRec *)data);
+        recRids.push_back(rid);
+    }
+    if (rc != RM_EOF)
+        return (rc);
+    requests = PageRequests(FILENAME);
+    // odd sized batches, so that they end in the middle of pages
+    for (n = 0; !(rc = batchFs.GetNextBatch((char *)batch, rids, 37, got));
+         n += got) {
+        if (got < 1 || got > 37 || n + got > (int)recs.size() ||
+            PinnedFrames(FILENAME) > 1) {
+            printf("batch of %d records, %d pages pinned\n", got,
+                   PinnedFrames(FILENAME));
+            exit(1);
+        }
+        for (int i = 0; i < got; i++)
+            if (!SameRid(recRids[n + i], rids[i]) ||
+                memcmp(&recs[n + i], &batch[i], sizeof(TestRec))) {
+                printf("record %d of the batch differs\n", n + i);
+                exit(1);
+            }
+    }
+    if (rc != RM_EOF)
+        return (rc);
+    requests = PageRequests(FILENAME) - requests;
+    if (n != (int)recs.size() || n != value - (value + 2) / 3 ||
+        requests > totalPages || PinnedFrames(FILENAME)) {
+        printf("%d records, %ld page requests, %d pages pinned\n", n,
+               requests, PinnedFrames(FILENAME));
+        exit(1);
+    }
+    if ((rc = fs.CloseScan()) ||
+        (rc = batchFs.CloseScan()) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("**** batches of big records\n");
+    int  numBig = 200;
+    RID  *bigRids = new RID[numBig];
+    char *rows = new char[7 * BIG_MAX];
+    int  lengths[7];
+    set<int> seen;
+    if ((rc = rmm.CreateFile(FILENAME, BIG_MAX, true)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = fh.SetInlinePrefix(BIG_PREFIX)) ||
+        (rc = AddBigRecs(fh, numBig, 0, bigRids)) ||
+        (rc = batchFs.OpenScan(fh, INT, sizeof(int), 0, NO_OP, NULL)))
+        return (rc);
+    char *expect = new char[BIG_MAX];
+    while (!(rc = batchFs.GetNextBatch(rows, rids, 7, got, lengths))) {
+        for (int i = 0; i < got; i++) {
+            char *row = rows + i * BIG_MAX;
+            int  num = *(int *)row;
+            if (num < 0 || num >= numBig || !seen.insert(num).second ||
+                !SameRid(rids[i], bigRids[num]) || lengths[i] != BigLen(num)) {
+                printf("bad or repeated big record %d\n", num);
+                exit(1);
+            }
+            BigRec(num, lengths[i], expect);
+            if (memcmp(row, expect, lengths[i])) {
+                printf("big record %d differs\n", num);
+                exit(1);
+            }
+        }
+    }
+    delete [] expect;
+    delete [] rows;
+    delete [] bigRids;
+    if (rc != RM_EOF)
+        return (rc);
+    if ((int)seen.size() != numBig || PinnedFrames(FILENAME)) {
+        printf("%d big records, %d pages pinned\n", (int)seen.size(),
+               PinnedFrames(FILENAME));
+        exit(1);
+    }
+    if ((rc = batchFs.CloseScan()) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("\ntest14 done ********************\n");
+    return (0);
+}
+
+//
+// Passes
+//
+// Desc: whether attribute attr passes a scan condition, worked out
+//       apart from the scan
+//
+bool Passes(const char *attr, AttrType type, int length, CompOp op,
+            const char *value)
+{
+    int   cmp;
+    int   i, j;
+    float f, g;
+
+    switch (type) {
+    case INT:
+        memcpy(&i, attr, sizeof(int));
+        memcpy(&j, value, sizeof(int));
+        cmp = i < j ? -1 : i > j;
+        break;
+    case FLOAT:
+        memcpy(&f, attr, sizeof(float));
+        memcpy(&g, value, sizeof(float));
+        cmp = f < g ? -1 : f > g;
+        break;
+    default:
+        cmp = strncmp(attr, value, length);
+        break;
+    }
+    switch (op) {
+    case EQ_OP: return (cmp == 0);
+    case NE_OP: return (cmp != 0);
+    case LT_OP: return (cmp < 0);
+    case GT_OP: return (cmp > 0);
+    case LE_OP: return (cmp <= 0);
+    case GE_OP: return (cmp >= 0);
+    default:    return (true);
+    }
+}
+
+//
+// CheckFilter
+//
+// Desc: scan with a condition, and check that the records that pass it
+//       are returned, one record at a time and, in a file of TestRecs,
+//       a batch at a time
+//
+RC CheckFilter(RM_FileHandle &fh, AttrType type, int length, int offset,
+               CompOp op, const char *value, bool testRecs = true)
+{
+    RC          rc;
+    RM_FileScan fs;
+    RM_Record   rec;
+    char        *data;
+    int         expected = 0, n = 0, got;
+    TestRec     batch[16];
+    RID         rids[16];
+
+    if ((rc = fs.OpenScan(fh, INT, sizeof(int), 0, NO_OP, NULL)))
+        return (rc);
+    while (!(rc = fs.GetNextRec(rec))) {
+        rec.GetData(data);
+        expected += Passes(data + offset, type, length, op, value);
+    }
+    if (rc != RM_EOF || (rc = fs.CloseScan()))
+        return (rc);
+
+    if ((rc = fs.OpenScan(fh, type, length, offset, op, (void *)value)))
+        return (rc);
+    while (!(rc = fs.GetNextRec(rec))) {
+        rec.GetData(data);
+        if (!Passes(data + offset, type, length, op, value)) {
+            printf("record fails condition %d on type %d\n", op, type);
+            exit(1);
+        }
+        n++;
+    }
+    if (rc != RM_EOF || (rc = fs.CloseScan()))
+        return (rc);
+    if (n != expected) {
+        printf("%d of %d records for condition %d on type %d\n", n,
+               expected, op, type);
+        exit(1);
+    }
+
+    if (testRecs) {
+        if ((rc = fs.OpenScan(fh, type, length, offset, op, (void *)value)))
+            return (rc);
+        for (n = 0; !(rc = fs.GetNextBatch((char *)batch, rids, 16, got));
+             n += got)
+            for (int i = 0; i < got; i++)
+                if (!Passes((char *)&batch[i] + offset, type, length, op,
+                            value)) {
+                    printf("batch record fails condition %d\n", op);
+                    exit(1);
+                }
+        if (rc != RM_EOF || (rc = fs.CloseScan()))
+            return (rc);
+        if (n != expected) {
+            printf("%d of %d batch records for condition %d\n", n,
+                   expected, op);
+            exit(1);
+        }
+    }
+    return (0);
+}
+
+//
+// Test15 tests scan conditions of every type and operator, and a page
+// that changes under a scan
+//
+RC Test15(void)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    RM_FileScan   fs;
+    RM_Record     rec;
+    char          *data;
+    int           intVal = 777, value = 10, n;
+    float         floatVal = 777.0;
+    char          strVal[] = "a77";
+    char          varVal[] = "v15";
+    set<int>      seen;
+
+    printf("test15 starting ****************\n");
+
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, 2000)))
+        return (rc);
+
+    printf("**** every type and operator\n");
+    for (int op = EQ_OP; op <= GE_OP; op++)
+        if ((rc = CheckFilter(fh, INT, sizeof(int), offsetof(TestRec, num),
+                              (CompOp)op, (char *)&intVal)) ||
+            (rc = CheckFilter(fh, FLOAT, sizeof(float), offsetof(TestRec, r),
+                              (CompOp)op, (char *)&floatVal)) ||
+            (rc = CheckFilter(fh, STRING, 3, offsetof(TestRec, str),
+                              (CompOp)op, strVal)))
+            return (rc);
+
+    printf("**** a record changed under the scan\n");
+    if ((rc = fs.OpenScan(fh, INT, sizeof(int), offsetof(TestRec, num),
+                          LT_OP, &value)) ||
+        (rc = fs.GetNextRec(rec)) ||
+        (rc = fh.GetRec(RID(0, 20), rec)) ||
+        (rc = rec.GetData(data)))
+        return (rc);
+    ((TestRec *)data)->num = 3;
+    if ((rc = fh.UpdateRec(rec)))
+        return (rc);
+    for (n = 1; !(rc = fs.GetNextRec(rec)); n++)
+        ;
+    if (rc != RM_EOF || (rc = fs.CloseScan()))
+        return (rc);
+    if (n != value + 1) {
+        printf("%d records after the update\n", n);
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("**** variable-length records\n");
+    if ((rc = rmm.CreateFile(FILENAME, VAR_MAX, true)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddVarRecs(fh, 500)))
+        return (rc);
+    for (int op = EQ_OP; op <= GE_OP; op++)
+        if ((rc = CheckFilter(fh, STRING, 3, 0, (CompOp)op, varVal,
+                              false)))
+            return (rc);
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("\ntest15 done ********************\n");
+    return (0);
+}
+
+//
+// PredicateCase
+//
+// Desc: whether a record passes condition c of Test16, worked out apart
+//       from the scan
+//
+bool PredicateCase(int c, const char *data)
+{
+    TestRec rec;
+
+    memcpy(&rec, data, c < 4 ? sizeof(TestRec) : 0);
+    switch (c) {
+    case 0:  // num BETWEEN 100 AND 300 AND str < "a2"
+        return (rec.num >= 100 && rec.num <= 300 &&
+                strncmp(rec.str, "a2", 2) < 0);
+    case 1:  // num IN (5, 50, 500, 1999, 4000) OR r > 1990
+        return (rec.num == 5 || rec.num == 50 || rec.num == 500 ||
+                rec.num == 1999 || rec.r > 1990);
+    case 2:  // (num < 100 OR num > 1900) AND num <> 50 AND str <> "a1"
+        return ((rec.num < 100 || rec.num > 1900) && rec.num != 50 &&
+                strncmp(rec.str, "a1", 2) != 0);
+    case 3:  // num IN ()
+        return (false);
+    default: // str IN ("v1|", "v2|") OR str BETWEEN "v50" AND "v59"
+        return (!strncmp(data, "v1|", 3) || !strncmp(data, "v2|", 3) ||
+                (strncmp(data, "v50", 3) >= 0 &&
+                 strncmp(data, "v59", 3) <= 0));
+    }
+}
+
+//
+// CheckPredicate
+//
+// Desc: scan with condition c of Test16, and check that the records that
+//       pass it are returned, one record at a time and, in a file of
+//       TestRecs, a batch at a time
+//
+RC CheckPredicate(RM_FileHandle &fh, const RM_Predicate &pred, int c,
+                  bool testRecs = true)
+{
+    RC          rc;
+    RM_FileScan fs;
+    RM_Record   rec;
+    char        *data;
+    int         expected = 0, n = 0, got;
+    TestRec     batch[16];
+    RID         rids[16];
+
+    if ((rc = fs.OpenScan(fh, INT, sizeof(int), 0, NO_OP, NULL)))
+        return (rc);
+    while (!(rc = fs.GetNextRec(rec))) {
+        rec.GetData(data);
+        expected += PredicateCase(c, data);
+    }
+    if (rc != RM_EOF || (rc = fs.CloseScan()))
+        return (rc);
+
+    if ((rc = fs.OpenScan(fh, pred)))
+        return (rc);
+    for (n = 0; !(rc = fs.GetNextRec(rec)); n++) {
+        rec.GetData(data);
+        if (!PredicateCase(c, data)) {
+            printf("record fails condition %d\n", c);
+            exit(1);
+        }
+    }
+    if (rc != RM_EOF || (rc = fs.CloseScan()))
+        return (rc);
+    if (n != expected) {
+        printf("%d of %d records for condition %d\n", n, expected, c);
+        exit(1);
+    }
+
+    if (testRecs) {
+        if ((rc = fs.OpenScan(fh, pred)))
+            return (rc);
+        for (n = 0; !(rc = fs.GetNextBatch((char *)batch, rids, 16, got));
+             n += got)
+            for (int i = 0; i < got; i++)
+                if (!PredicateCase(c, (char *)&batch[i])) {
+                    printf("batch record fails condition %d\n", c);
+                    exit(1);
+                }
+        if (rc != RM_EOF || (rc = fs.CloseScan()))
+            return (rc);
+        if (n != expected) {
+            printf("%d of %d batch records for condition %d\n", n,
+                   expected, c);
+            exit(1);
+        }
+    }
+    printf("condition %d: %d records\n", c, expected);
+    return (0);
+}
+
+//
+// Test16 tests scans with trees of conditions
+//
+RC Test16(void)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    RM_FileScan   fs;
+    int           low = 100, high = 300, n50 = 50, lt = 100, gt = 1900;
+    int           nums[] = { 5, 50, 500, 1999, 4000 };
+    float         r = 1990;
+    char          strs[] = "v1|v2|";
+
+    printf("test16 starting ****************\n");
+
+    int numOff = offsetof(TestRec, num), strOff = offsetof(TestRec, str);
+    RM_Predicate preds[4] = {
+        RM_Predicate::And(
+            RM_Predicate::Between(INT, sizeof(int), numOff, &low, &high),
+            RM_Predicate(STRING, 2, strOff, LT_OP, "a2")),
+        RM_Predicate::Or(
+            RM_Predicate::In(INT, sizeof(int), numOff, nums, 5),
+            RM_Predicate(FLOAT, sizeof(float), offsetof(TestRec, r), GT_OP,
+                         &r)),
+        RM_Predicate::And(
+            RM_Predicate::And(
+                RM_Predicate::Or(
+                    RM_Predicate(INT, sizeof(int), numOff, LT_OP, &lt),
+                    RM_Predicate(INT, sizeof(int), numOff, GT_OP, &gt)),
+                RM_Predicate(INT, sizeof(int), numOff, NE_OP, &n50)),
+            RM_Predicate(STRING, 2, strOff, NE_OP, "a1")),
+        RM_Predicate::In(INT, sizeof(int), numOff, nums, 0)
+    };
+
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, 2000)))
+        return (rc);
+    for (int c = 0; c < 4; c++)
+        if ((rc = CheckPredicate(fh, preds[c], c)))
+            return (rc);
+    if (fs.OpenScan(fh, RM_Predicate::And(preds[0],
+            RM_Predicate(INT, sizeof(int), numOff, EQ_OP, NULL))) !=
+        RM_SCAN_NEED_VALUE) {
+        printf("condition without a value accepted\n");
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("**** variable-length records\n");
+    if ((rc = rmm.CreateFile(FILENAME, VAR_MAX, true)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddVarRecs(fh, 500)) ||
+        (rc = CheckPredicate(fh, RM_Predicate::Or(
+                 RM_Predicate::In(STRING, 3, 0, strs, 2),
+                 RM_Predicate::Between(STRING, 3, 0, "v50", "v59")),
+                 4, false)) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("\ntest16 done ********************\n");
+    return (0);
+}
+
+//
+// Test17 tests scans that only keep some attributes of the records, and
+// that the records they return cannot be updated
+//
+RC Test17(void)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    RM_FileScan   fs;
+    RM_Record     rec;
+    char          *data, rows[16][12];
+    RID           rids[16];
+    int           n, got, length, value = 1000;
+    RM_ProjAttr   proj[3] = {
+        { offsetof(TestRec, r), sizeof(float) },
+        { offsetof(TestRec, num), sizeof(int) },
+        { offsetof(TestRec, str), 4 }
+    };
+    RM_ProjAttr   bad = { offsetof(TestRec, r), sizeof(TestRec) };
+
+    printf("test17 starting ****************\n");
+
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, 2000)))
+        return (rc);
+
+    printf("**** r, num and 4 bytes of str\n");
+    if ((rc = fs.OpenScan(fh, INT, sizeof(int), offsetof(TestRec, num),
+                          LT_OP, &value)))
+        return (rc);
+    if (fs.SetProjection(&bad, 1) != RM_SCAN_BAD_PROJECTION) {
+        printf("projection past the record accepted\n");
+        exit(1);
+    }
+    if ((rc = fs.SetProjection(proj, 3)))
+        return (rc);
+    for (n = 0; !(rc = fs.GetNextRec(rec)); n++) {
+        float r;
+        int   num;
+        char  str[8];
+        rec.GetData(data);
+        rec.GetLength(length);
+        memcpy(&r, data, sizeof(float));
+        memcpy(&num, data + sizeof(float), sizeof(int));
+        sprintf(str, "a%d", num);
+        if (length != 12 || r != num || num >= value ||
+            strncmp(data + 8, str, 4)) {
+            printf("projected record %d is wrong\n", n);
+            exit(1);
+        }
+    }
+    if (rc != RM_EOF || (rc = fs.CloseScan()))
+        return (rc);
+    if (n != value) {
+        printf("%d projected records\n", n);
+        exit(1);
+    }
+    if (fh.UpdateRec(rec) != RM_SCAN_PROJECTED ||
+        fh.UpdateRecs(&rec, 1) != RM_SCAN_PROJECTED) {
+        printf("projected record updated\n");
+        exit(1);
+    }
+
+    if ((rc = fs.OpenScan(fh, INT, sizeof(int), 0, NO_OP, NULL)) ||
+        (rc = fs.SetProjection(proj + 1, 1)))
+        return (rc);
+    for (n = 0; !(rc = fs.GetNextBatch(rows[0], rids, 16, got)); n += got)
+        // rows of 4 bytes
+        for (int i = 0; i < got; i++)
+            if (((int *)rows[0])[i] < 0 || ((int *)rows[0])[i] >= 2000) {
+                printf("batch row %d is wrong\n", n + i);
+                exit(1);
+            }
+    if (rc != RM_EOF || (rc = fs.CloseScan()))
+        return (rc);
+    if (n != 2000) {
+        printf("%d projected batch rows\n", n);
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("**** attributes in overflow pages and past the record\n");
+    int          numBig = 200;
+    RID          *bigRids = new RID[numBig];
+    char         *expect = new char[BIG_MAX];
+    char         bigRows[7][16];
+    int          lengths[7];
+    RM_ProjAttr  bigProj[2] = { { 0, sizeof(int) }, { 600, 12 } };
+    if ((rc = rmm.CreateFile(FILENAME, BIG_MAX, true)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = fh.SetInlinePrefix(BIG_PREFIX)) ||
+        (rc = AddBigRecs(fh, numBig, 0, bigRids)) ||
+        (rc = fs.OpenScan(fh, INT, sizeof(int), 0, NO_OP, NULL)) ||
+        (rc = fs.SetProjection(bigProj, 2)))
+        return (rc);
+    for (n = 0; !(rc = fs.GetNextBatch(bigRows[0], rids, 7, got, lengths));
+         n += got)
+        for (int i = 0; i < got; i++) {
+            int num = *(int *)bigRows[i];
+            char want[12];
+            memset(want, 0, sizeof(want));
+            BigRec(num, lengths[i], expect);
+            if (lengths[i] > 600)
+                memcpy(want, expect + 600, min(12, lengths[i] - 600));
+            if (num < 0 || num >= numBig || lengths[i] != BigLen(num) ||
+                memcmp(bigRows[i] + sizeof(int), want, 12)) {
+                printf("projected big record %d is wrong\n", num);
+                exit(1);
+            }
+        }
+    delete [] expect;
+    delete [] bigRids;
+    if (rc != RM_EOF || (rc = fs.CloseScan()))
+        return (rc);
+    if (n != numBig || PinnedFrames(FILENAME)) {
+        printf("%d projected big records, %d pages pinned\n", n,
+               PinnedFrames(FILENAME));
+        exit(1);
+    }
+
+    // the projection fits the length check of a variable-length file
+    if ((rc = fs.OpenScan(fh, INT, sizeof(int), 0, NO_OP, NULL)) ||
+        (rc = fs.SetProjection(bigProj, 2)) ||
+        (rc = fs.GetNextRec(rec)) ||
+        (rc = fs.CloseScan()))
+        return (rc);
+    if (fh.UpdateRec(rec) != RM_SCAN_PROJECTED ||
+        fh.UpdateRecs(&rec, 1) != RM_SCAN_PROJECTED) {
+        printf("projected big record updated\n");
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("\ntest17 done ********************\n");
+    return (0);
+}
+
+//
+// ParallelCount
+//
+// Desc: run a parallel scan of records with num < value over numThreads
+//       threads, check that each of them comes back once and is the
+//       record at its RID, and return how many there were
+//
+RC ParallelCount(RM_FileHandle &fh, int numThreads, int value, int &n)
+{
+    RC              rc;
+    RM_ParallelScan ps;
+    RM_Record       rec;
+    TestRec         batch[100];
+    RID             rids[100];
+    char            *data;
+    int             got;
+    set<int>        seen;
+
+    n = 0;
+    if ((rc = ps.OpenScan(fh, RM_Predicate(INT, sizeof(int),
+                                           offsetof(TestRec, num), LT_OP,
+                                           &value), numThreads)))
+        return (rc);
+    while (!(rc = ps.GetNextBatch((char *)batch, rids, 100, got))) {
+        for (int i = 0; i < got; i++) {
+            if ((rc = fh.GetRec(rids[i], rec)) ||
+                (rc = rec.GetData(data)))
+                return (rc);
+            if (batch[i].num >= value || memcmp(data, &batch[i],
+                                                sizeof(TestRec)) ||
+                !seen.insert(batch[i].num).second) {
+                printf("parallel scan record %d is wrong\n", batch[i].num);
+                exit(1);
+            }
+        }
+        n += got;
+    }
+    if (rc != RM_EOF)
+        return (rc);
+    return (ps.CloseScan());
+}
+
+//
+// Test18 tests scans over several threads
+//
+RC Test18(void)
+{
+    RC              rc;
+    RM_FileHandle   fh;
+    RM_ParallelScan ps;
+    TestRec         batch[10];
+    RID             rids[64];
+    int             numRecs = 20000, n, got;
+    int             threads[] = { 1, 4, 0 };
+    RM_ProjAttr     proj = { offsetof(TestRec, num), sizeof(int) };
+    int             nums[64];
+
+    printf("test18 starting ****************\n");
+
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, numRecs)))
+        return (rc);
+    // every other record of the first 2000 goes, on dirty pages
+    for (int i = 0; i < 2000; i += 2)
+        if ((rc = fh.DeleteRec(RID(i / fh.GetRecordPerPage(),
+                                   i % fh.GetRecordPerPage()))))
+            return (rc);
+
+    for (int t = 0; t < 3; t++) {
+        printf("**** %d threads\n", threads[t]);
+        if ((rc = ParallelCount(fh, threads[t], numRecs, n)))
+            return (rc);
+        if (n != numRecs - 1000) {
+            printf("%d records in a full parallel scan\n", n);
+            exit(1);
+        }
+        if ((rc = ParallelCount(fh, threads[t], 5000, n)))
+            return (rc);
+        if (n != 4000) {
+            printf("%d records in a parallel scan\n", n);
+            exit(1);
+        }
+    }
+
+    printf("**** projection, and closing early\n");
+    if ((rc = ps.OpenScan(fh, RM_Predicate(), 4, &proj, 1)))
+        return (rc);
+    for (n = 0; n < 30 && !(rc = ps.GetNextBatch((char *)nums, rids, 64,
+                                                 got)); n++)
+        for (int i = 0; i < got; i++)
+            if (nums[i] < 0 || nums[i] >= numRecs ||
+                (nums[i] < 2000 && nums[i] % 2 == 0)) {
+                printf("projected parallel record %d is wrong\n", nums[i]);
+                exit(1);
+            }
+    if (rc || (rc = ps.CloseScan()))
+        return (rc);
+    if (ps.GetNextBatch((char *)batch, rids, 10, got) != RM_SCAN_NOT_OPEN) {
+        printf("closed parallel scan still returns records\n");
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    if ((rc = rmm.CreateFile(FILENAME, VAR_MAX, true)) ||
+        (rc = OpenFile(FILENAME, fh)))
+        return (rc);
+    if (ps.OpenScan(fh, RM_Predicate()) != RM_SCAN_VAR_LENGTH) {
+        printf("parallel scan of variable-length records accepted\n");
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("\ntest18 done ********************\n");
+    return (0);
+}
+
+//
+// ZoneScan
+//
+// Desc: scan for the records passing pred, a batch at a time, and exit
+//       unless there are numRecs of them and the scan asked for pages
+//       pages of the file
+//
+RC ZoneScan(RM_FileHandle &fh, const RM_Predicate &pred, int numRecs,
+            long pages)
+{
+    RC          rc;
+    RM_FileScan fs;
+    TestRec     batch[100];
+    int         n = 0, got;
+    long        before = PageRequests(FILENAME);
+
+    if ((rc = fs.OpenScan(fh, pred)))
+        return (rc);
+    while (!(rc = fs.GetNextBatch((char *)batch, NULL, 100, got)))
+        n += got;
+    if (rc != RM_EOF || (rc = fs.CloseScan()))
+        return (rc);
+    if (n != numRecs || PageRequests(FILENAME) - before != pages) {
+        printf("zone scan found %d records on %ld pages, not %d on %ld\n",
+               n, PageRequests(FILENAME) - before, numRecs, pages);
+        exit(1);
+    }
+    return (0);
+}
+
+//
+// Test19 tests zone maps: scans skip the pages they rule out, and they
+// follow inserts, updates and deletes, closing the file and crashes
+//
+RC Test19(void)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    RM_Record     rec;
+    TestRec       *pRecBuf;
+    int           numRecs = 3000, n, status;
+    int           low = 1000, high = 1099, big = 77777;
+    float         zero = 0;
+    char          str[STRLEN];
+
+    printf("test19 starting ****************\n");
+
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, numRecs / 2)) ||
+        (rc = fh.AddZoneMap(INT, sizeof(int), offsetof(TestRec, num))) ||
+        (rc = fh.AddZoneMap(STRING, STRLEN, offsetof(TestRec, str))) ||
+        (rc = AddRecs(fh, numRecs / 2, numRecs / 2)))
+        return (rc);
+    int perPage = fh.GetRecordPerPage();
+    long allPages = (numRecs + perPage - 1) / perPage;
+    RM_Predicate range = RM_Predicate::Between(INT, sizeof(int),
+        offsetof(TestRec, num), &low, &high);
+    RM_Predicate isBig(INT, sizeof(int), offsetof(TestRec, num), EQ_OP, &big);
+
+    printf("**** built on the records there, widened by inserts\n");
+    // strings order as text, so "a2990" is also in the range of the pages
+    // from "a0", "a202" and "a909" on
+    memset(str, ' ', STRLEN);
+    sprintf(str, "a%d", numRecs - 10);
+    if ((rc = ZoneScan(fh, range, high - low + 1,
+                       high / perPage - low / perPage + 1)) ||
+        (rc = ZoneScan(fh, RM_Predicate(INT, sizeof(int),
+                                        offsetof(TestRec, num), GE_OP, &low),
+                       numRecs - low, allPages - low / perPage)) ||
+        (rc = ZoneScan(fh, RM_Predicate(STRING, STRLEN,
+                                        offsetof(TestRec, str), EQ_OP, str),
+                       1, 4)))
+        return (rc);
+
+    printf("**** updates and deletes\n");
+    // the record numbered low gets big, and r NaN, which is in no zone
+    if ((rc = fh.GetRec(RID(low / perPage, low % perPage), rec)) ||
+        (rc = rec.GetData((char *&)pRecBuf)))
+        return (rc);
+    pRecBuf->num = big;
+    pRecBuf->r = numeric_limits<float>::quiet_NaN();
+    if ((rc = UpdateRec(fh, rec)) ||
+        (rc = ZoneScan(fh, isBig, 1, 1)) ||
+        (rc = ZoneScan(fh, range, high - low, 2)) ||
+        (rc = ZoneScan(fh, RM_Predicate(FLOAT, sizeof(float),
+                                        offsetof(TestRec, r), GE_OP, &zero),
+                       numRecs - 1, allPages)))
+        return (rc);
+    // then its page is emptied
+    for (int i = 0; i < perPage; i++)
+        if ((rc = fh.DeleteRec(RID(low / perPage, i))))
+            return (rc);
+    int left = high - (low / perPage + 1) * perPage + 1;
+    if ((rc = ZoneScan(fh, isBig, 0, 0)) ||
+        (rc = ZoneScan(fh, range, left, 1)))
+        return (rc);
+
+    printf("**** kept when the file is closed\n");
+    if ((rc = CloseFile(FILENAME, fh)))
+        return (rc);
+    if (FileSize(ZONENAME) <= 0) {
+        printf("zone maps not written\n");
+        exit(1);
+    }
+    // the header is read too, for the page directory
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = ZoneScan(fh, range, left, 2)) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+
+    printf("**** built again after a crash\n");
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+        return (RM_LOG_IO_ERROR);
+    if (pid == 0) {
+        if ((rc = OpenFile(FILENAME, fh)) ||
+            (rc = fh.GetRec(RID(0, 0), rec)) ||
+            (rc = rec.GetData((char *&)pRecBuf)))
+            _exit(1);
+        pRecBuf->num = big;
+        if ((rc = fh.UpdateRec(rec)) ||
+            (rc = fh.Commit()))
+            _exit(1);
+        fflush(stdout);
+        _exit(0);
+    }
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+        printf("crashing child failed\n");
+        exit(1);
+    }
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = ZoneScan(fh, isBig, 1, 1)))
+        return (rc);
+
+    printf("**** parallel scans skip pages too\n");
+    if ((rc = ParallelCount(fh, 2, low, n)))
+        return (rc);
+    if (n != (low / perPage) * perPage - 1) {
+        printf("%d records in a parallel scan with zone maps\n", n);
+        exit(1);
+    }
+
+    printf("**** dropped, and bad zone maps\n");
+    if ((rc = fh.DropZoneMap(offsetof(TestRec, num))) ||
+        (rc = ZoneScan(fh, range, left, allPages)))
+        return (rc);
+    if (fh.DropZoneMap(offsetof(TestRec, num)) != RM_BAD_ZONE_MAP ||
+        fh.AddZoneMap(INT, sizeof(int), sizeof(TestRec)) != RM_BAD_ZONE_MAP ||
+        fh.AddZoneMap(FLOAT, 2, offsetof(TestRec, r)) != RM_BAD_ZONE_MAP) {
+        printf("bad zone map accepted\n");
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+    if (FileSize(ZONENAME) >= 0) {
+        printf("zone maps left behind\n");
+        exit(1);
+    }
+
+    if ((rc = rmm.CreateFile(FILENAME, VAR_MAX, true)) ||
+        (rc = OpenFile(FILENAME, fh)))
+        return (rc);
+    if (fh.AddZoneMap(INT, sizeof(int), 0) != RM_BAD_ZONE_MAP) {
+        printf("zone map of variable-length records accepted\n");
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("\ntest19 done ********************\n");
+    return (0);
+}
+
+//
+// BatchRecs
+//
+// Desc: fill recs with records numbered from offset, as AddRecs adds them
+//
+void BatchRecs(TestRec *recs, int numRecs, int offset)
+{
+    memset((void *)recs, 0, numRecs * sizeof(TestRec));
+    for (int i = 0; i < numRecs; i++) {
+        memset(recs[i].str, ' ', STRLEN);
+        sprintf(recs[i].str, "a%d", i + offset);
+        recs[i].num = i + offset;
+        recs[i].r = (float)(i + offset);
+    }
+}
+
+//
+// AddBatches
+//
+// Desc: add the records of recs with InsertRecs, batch of them at a time,
+//       and check that each RID returned leads to its record
+//
+RC AddBatches(RM_FileHandle &fh, const TestRec *recs, int numRecs,
+              int batch, RID *rids)
+{
+    RC        rc;
+    RM_Record rec;
+    TestRec   *pRecBuf;
+
+    printf("\nadding %d records in batches of %d\n", numRecs, batch);
+    for (int i = 0; i < numRecs; i += batch)
+        if ((rc = fh.InsertRecs((const char *)(recs + i),
+                                min(batch, numRecs - i), rids + i)))
+            return (rc);
+    for (int i = 0; i < numRecs; i++) {
+        if ((rc = fh.GetRec(rids[i], rec)) ||
+            (rc = rec.GetData((char *&)pRecBuf)))
+            return (rc);
+        if (pRecBuf->num != recs[i].num) {
+            printf("record %d found as %d\n", recs[i].num, pRecBuf->num);
+            exit(1);
+        }
+    }
+    return (0);
+}
+
+//
+// Test20 tests InsertRecs: batches fill the holes in the file first and
+// then new pages, keep the fill factor and survive crashes
+//
+RC Test20(void)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    PageNum       pageNum;
+    SlotNum       slotNum;
+    int           numRecs, i, status;
+    int           holes[] = { 3, 4, 5, 108 };
+    vector<TestRec> recs(MANY_RECS);
+    vector<RID>   rids(MANY_RECS);
+
+    printf("test20 starting ****************\n");
+
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, FEW_RECS)))
+        return (rc);
+    int perPage = fh.GetRecordPerPage();
+    for (i = 0; i < 4; i++)
+        if ((rc = fh.DeleteRec(RID(holes[i] / perPage,
+                                   holes[i] % perPage))))
+            return (rc);
+
+    printf("**** holes first, then new pages\n");
+    // the 3 holes of page 0, and those of page 1 after its records
+    BatchRecs(&recs[0], MANY_RECS, FEW_RECS - 4);
+    for (i = 0; i < 4; i++)
+        BatchRecs(&recs[i], 1, holes[i]);
+    numRecs = MANY_RECS - FEW_RECS + 4;
+    if ((rc = AddBatches(fh, &recs[0], numRecs, 1000, &rids[0])))
+        return (rc);
+    for (i = 0; i < 2 * perPage - FEW_RECS + 4; i++)
+        if ((rc = rids[i].GetPageNum(pageNum)) || pageNum > 1) {
+            printf("record %d added on page %d, not in a hole\n",
+                   recs[i].num, pageNum);
+            exit(1);
+        }
+    if ((rc = fh.InsertRecs(NULL, 0, NULL)) ||
+        (rc = VerifyFile(fh, MANY_RECS)) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+
+    // the pages of the uncommitted batch reach the disk before the crash
+    printf("**** crash with a committed and an uncommitted batch\n");
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+        return (RM_LOG_IO_ERROR);
+    if (pid == 0) {
+        BatchRecs(&recs[0], 2 * FEW_RECS, MANY_RECS);
+        if ((rc = OpenFile(FILENAME, fh)) ||
+            (rc = fh.InsertRecs((char *)&recs[0], FEW_RECS, NULL)) ||
+            (rc = fh.Commit()) ||
+            (rc = fh.InsertRecs((char *)&recs[FEW_RECS], FEW_RECS, NULL)) ||
+            (rc = fh.ForcePages()))
+            _exit(1);
+        fflush(stdout);
+        _exit(0);
+    }
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+        printf("crashing child failed\n");
+        exit(1);
+    }
+    numRecs = MANY_RECS + FEW_RECS;
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = VerifyFile(fh, numRecs)))
+        return (rc);
+
+    // every page has its records in its first slots
+    printf("**** new pages keep the fill factor\n");
+    if ((rc = fh.SetFillFactor(50)))
+        return (rc);
+    BatchRecs(&recs[0], 10 * FEW_RECS, numRecs);
+    if ((rc = AddBatches(fh, &recs[0], 10 * FEW_RECS, 333, &rids[0])))
+        return (rc);
+    numRecs += 10 * FEW_RECS;
+    for (i = 0; i < 10 * FEW_RECS; i++)
+        if ((rc = rids[i].GetSlotNum(slotNum)) ||
+            slotNum >= (perPage + 1) / 2) {
+            printf("record %d added in slot %d\n", recs[i].num, slotNum);
+            exit(1);
+        }
+    if ((rc = VerifyFile(fh, numRecs)) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("**** variable-length records\n");
+    vector<char> buf(FEW_RECS * VAR_MAX);
+    vector<int>  lengths(FEW_RECS);
+    for (i = 0; i < FEW_RECS; i++)
+        lengths[i] = VarRec(i, VarLen(i), &buf[i * VAR_MAX]);
+    if ((rc = rmm.CreateFile(FILENAME, VAR_MAX, true)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = fh.InsertRecs(&buf[0], FEW_RECS, &rids[0], &lengths[0])) ||
+        (rc = VerifyVarFile(fh, FEW_RECS)) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("\ntest20 done ********************\n");
+    return (0);
+}
+
+//
+// WriteLoadFile
+//
+// Desc: write text to file fileName
+//
+void WriteLoadFile(const char *fileName, const string &text)
+{
+    FILE *f = fopen(fileName, "w");
+    if (!f || fwrite(text.data(), 1, text.size(), f) != text.size()) {
+        printf("cannot write %s\n", fileName);
+        exit(1);
+    }
+    fclose(f);
+}
+
+//
+// Test21 tests RM_Loader: CSV rows over several blocks and threads,
+// binary rows, and bad input
+//
+RC Test21(void)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    RM_Loader     loader;
+    int           numRecs, n, i;
+    char          line[100];
+    string        text;
+    RM_LoadAttr   attrs[] = {
+        { STRING, STRLEN, offsetof(TestRec, str) },
+        { INT, sizeof(int), offsetof(TestRec, num) },
+        { FLOAT, sizeof(float), offsetof(TestRec, r) }
+    };
+
+    printf("test21 starting ****************\n");
+
+    // several blocks of input, with quotes, CRs and empty lines
+    printf("**** CSV rows\n");
+    for (i = 0; i < MANY_RECS; i++) {
+        if (i % 1000 == 7)
+            sprintf(line, "\"a%d\",%d,%d.0\r\n\n", i, i, i);
+        else
+            sprintf(line, "a%d,%d,%d\n", i, i, i);
+        text += line;
+    }
+    WriteLoadFile(LOADNAME, text);
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = loader.SetCsv(attrs, 3)) ||
+        (rc = loader.Load(fh, LOADNAME, n, 3)))
+        return (rc);
+    if (n != MANY_RECS) {
+        printf("%d records loaded, not %d\n", n, MANY_RECS);
+        exit(1);
+    }
+    if ((rc = VerifyFile(fh, MANY_RECS)))
+        return (rc);
+
+    printf("**** binary rows, and the other way around\n");
+    vector<TestRec> recs(FEW_RECS);
+    BatchRecs(&recs[0], FEW_RECS, MANY_RECS);
+    WriteLoadFile(LOADNAME, string((char *)&recs[0],
+                                   FEW_RECS * sizeof(TestRec)));
+    numRecs = MANY_RECS + FEW_RECS;
+    if ((rc = loader.SetBinary()) ||
+        (rc = loader.Load(fh, LOADNAME, n)) ||
+        (rc = VerifyFile(fh, numRecs)))
+        return (rc);
+    attrs[0].attrOffset = offsetof(TestRec, num);
+    attrs[0].attrType = INT;
+    attrs[0].attrLength = sizeof(int);
+    attrs[1].attrOffset = offsetof(TestRec, r);
+    attrs[1].attrType = FLOAT;
+    attrs[2].attrOffset = offsetof(TestRec, str);
+    attrs[2].attrType = STRING;
+    attrs[2].attrLength = STRLEN;
+    sprintf(line, "%d;%d;\"a%d\"\n", numRecs, numRecs, numRecs);
+    WriteLoadFile(LOADNAME, line);
+    if ((rc = loader.SetCsv(attrs, 3, ';')) ||
+        (rc = loader.Load(fh, LOADNAME, n, 1)) ||
+        (rc = VerifyFile(fh, ++numRecs)))
+        return (rc);
+
+    printf("**** bad input\n");
+    text = "1;1;a\n2;2;b\n3;3;c\n4;x;d\n5;5;e\n";
+    WriteLoadFile(LOADNAME, text);
+    if (loader.Load(fh, LOADNAME, n) != RM_LOAD_BAD_ROW || n != 3) {
+        printf("bad row not found after %d rows\n", n);
+        exit(1);
+    }
+    const char *bad[] = { "1;1\n", "1;1;a;\n", "1;1;\"a\n", "1;1;\"a\"b\n",
+                          "x1;1;a\n", "1;1;123456789012345678901234567890\n",
+                          "99999999999;1;a\n" };
+    for (i = 0; i < 7; i++) {
+        WriteLoadFile(LOADNAME, bad[i]);
+        if (loader.Load(fh, LOADNAME, n) != RM_LOAD_BAD_ROW || n != 0) {
+            printf("bad row %s loaded\n", bad[i]);
+            exit(1);
+        }
+    }
+    WriteLoadFile(LOADNAME, string((char *)&recs[0], sizeof(TestRec) - 1));
+    if ((rc = loader.SetBinary()) ||
+        loader.Load(fh, LOADNAME, n) != RM_LOAD_BAD_ROW || n != 0) {
+        printf("partial record loaded\n");
+        exit(1);
+    }
+    attrs[0].attrOffset = sizeof(TestRec) - 2;
+    unlink(LOADNAME);
+    if (loader.Load(fh, LOADNAME, n) != RM_LOAD_IO_ERROR ||
+        (rc = loader.SetCsv(attrs, 3)) ||
+        loader.Load(fh, LOADNAME, n) != RM_LOAD_BAD_ATTR) {
+        printf("missing file or bad attribute not found\n");
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("\ntest21 done ********************\n");
+    return (0);
+}
+
+//
+// Test22 tests DeleteRecs and UpdateRecs: each page a batch touches is
+// pinned once, and the free space of the pages follows the deletes
+//
+RC Test22(void)
+{
+    RC            rc;
+    RM_FileHandle fh;
+    RM_Record     rec;
+    TestRec       *pRecBuf;
+    int           numRecs = 2000, i, n;
+    long          before;
+
+    printf("test22 starting ****************\n");
+
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, numRecs)))
+        return (rc);
+    int perPage = fh.GetRecordPerPage();
+    int pages = (numRecs + perPage - 1) / perPage;
+
+    // the odd records, last first; a page, its directory entry and the
+    // free hint are pinned for each page
+    printf("**** delete the odd records\n");
+    vector<RID> rids;
+    for (i = numRecs - 1; i > 0; i -= 2)
+        rids.push_back(RID(i / perPage, i % perPage));
+    before = PageRequests(FILENAME);
+    if ((rc = fh.DeleteRecs(&rids[0], int(rids.size()))))
+        return (rc);
+    if (PageRequests(FILENAME) - before > 3 * pages) {
+        printf("%ld pages asked for to delete from %d pages\n",
+               PageRequests(FILENAME) - before, pages);
+        exit(1);
+    }
+
+    printf("**** update the even records\n");
+    RM_Record *recs = new RM_Record[numRecs / 2 + 1];
+    for (i = 0; i < numRecs / 2; i++) {
+        int num = (numRecs / 2 - 1 - i) * 2;
+        if ((rc = fh.GetRec(RID(num / perPage, num % perPage), recs[i])) ||
+            (rc = recs[i].GetData((char *&)pRecBuf)))
+            return (rc);
+        pRecBuf->r = -(float)num;
+    }
+    // the same record twice: the later update wins
+    if ((rc = fh.GetRec(RID(0, 0), recs[i])) ||
+        (rc = recs[i].GetData((char *&)pRecBuf)))
+        return (rc);
+    pRecBuf->r = 1;
+    before = PageRequests(FILENAME);
+    if ((rc = fh.UpdateRecs(recs, numRecs / 2 + 1)))
+        return (rc);
+    if (PageRequests(FILENAME) - before > pages) {
+        printf("%ld pages asked for to update %d pages\n",
+               PageRequests(FILENAME) - before, pages);
+        exit(1);
+    }
+    delete [] recs;
+
+    RM_FileScan fs;
+    if ((rc = fs.OpenScan(fh, INT, sizeof(int), offsetof(TestRec, num),
+                          NO_OP, NULL)))
+        return (rc);
+    for (n = 0; !(rc = fs.GetNextRec(rec)); n++) {
+        rec.GetData((char *&)pRecBuf);
+        if (pRecBuf->num % 2 ||
+            pRecBuf->r != (pRecBuf->num ? -(float)pRecBuf->num : 1)) {
+            printf("record [%s, %d, %f] after the batches\n",
+                   pRecBuf->str, pRecBuf->num, pRecBuf->r);
+            exit(1);
+        }
+    }
+    if (rc != RM_EOF || (rc = fs.CloseScan()))
+        return (rc);
+    if (n != numRecs / 2) {
+        printf("%d records left, not %d\n", n, numRecs / 2);
+        exit(1);
+    }
+
+    printf("**** bad batches change nothing on the page\n");
+    RID missing[] = { RID(0, 0), RID(0, 1) };
+    RID twice[] = { RID(0, 2), RID(0, 2) };
+    RID outside[] = { RID(0, 4), RID(pages, 0) };
+    if (fh.DeleteRecs(missing, 2) != RM_REC_NO_EXIST ||
+        fh.DeleteRecs(twice, 2) != RM_REC_NO_EXIST ||
+        fh.DeleteRecs(outside, 2) != RM_REC_NO_EXIST ||
+        (rc = fh.GetRec(RID(0, 0), rec)) ||
+        (rc = fh.GetRec(RID(0, 2), rec)) ||
+        (rc = fh.GetRec(RID(0, 4), rec))) {
+        printf("bad batch of deletes went through\n");
+        exit(1);
+    }
+
+    // the pages have room again: the deleted slots, and those left on
+    // the last page
+    printf("**** inserts fill the pages deleted from\n");
+    if ((rc = AddRecs(fh, pages * perPage - numRecs / 2, numRecs)))
+        return (rc);
+    if (fh.GetRec(RID(pages, 0), rec) != RM_REC_NO_EXIST) {
+        printf("page added before the others were full\n");
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("**** variable-length records\n");
+    if ((rc = rmm.CreateFile(FILENAME, VAR_MAX, true)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddVarRecs(fh, numRecs)))
+        return (rc);
+    rids.clear();
+    for (i = 0; i < 20; i++)
+        rids.push_back(RID(i % 2, i / 2));
+    if ((rc = fh.DeleteRecs(&rids[0], int(rids.size()))) ||
+        (rc = VerifyVarFile(fh, numRecs - 20)) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("\ntest22 done ********************\n");
+    return (0);
+}
+
+//
+// KeepMove
+//
+// Desc: remap callback that keeps each (old RID, new RID) of a move in
+//       the vector ctx points to
+//
+RC KeepMove(void *ctx, const RID &oldRid, const RID &newRid)
+{
+    ((vector<pair<RID, RID> > *)ctx)->push_back(make_pair(oldRid, newRid));
+    return (0);
+}
+
+//
+// CrashMove
+//
+// Desc: remap callback that crashes the process
+//
+RC CrashMove(void *ctx, const RID &oldRid, const RID &newRid)
+{
+    fflush(stdout);
+    _exit(0);
+}
+
+//
+// CheckCompacted
+//
+// Desc: the file holds the live records numbered below 3000 (every
+//       seventh), and numRecs more from 3000 on, on pages starting at 0
+//
+RC CheckCompacted(RM_FileHandle &fh, int live, int numRecs)
+{
+    RC  rc;
+    int low, high, bad;
+
+    if ((rc = CountScan(fh, offsetof(TestRec, num), LT_OP, 3000, low)) ||
+        (rc = CountScan(fh, offsetof(TestRec, num), GE_OP, 3000, high)) ||
+        (rc = CountScan(fh, offsetof(TestRec, num), LT_OP, 0, bad)))
+        return (rc);
+    if (low != live || high != numRecs || bad) {
+        printf("%d, %d and %d records instead of %d, %d and 0\n",
+               low, high, bad, live, numRecs);
+        exit(1);
+    }
+    return (0);
+}
+
+//
+// CrashReusing
+//
+// Desc: add and commit numRecs records numbered from offset on pages
+//       taken back from PF, then crash after writing either the PF
+//       header (forced with the header page) or those pages (written
+//       back while the pages of ROWNAME, more than the buffer holds, are
+//       read)
+//
+RC CrashReusing(int numRecs, int offset, bool headerFirst)
+{
+    int status;
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+        return (RM_LOG_IO_ERROR);
+    if (pid == 0) {
+        RM_FileHandle fh, rowFh;
+        RC            rc;
+        int           n;
+
+        if ((rc = OpenFile(FILENAME, fh)) ||
+            (rc = AddRecs(fh, numRecs, offset)) ||
+            (rc = fh.Commit()))
+            _exit(1);
+        if (headerFirst)
+            rc = fh.ForcePages(0);
+        else if (!(rc = OpenFile(ROWNAME, rowFh)))
+            rc = CountScan(rowFh, offsetof(TestRec, num), GE_OP, 0, n);
+        if (rc)
+            _exit(1);
+        fflush(stdout);
+        _exit(0);
+    }
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+        printf("crashing child failed\n");
+        exit(1);
+    }
+    return (0);
+}
+
+//
+// Test23 tests compaction: the records of the last pages move into the
+// holes of the first ones, each move is reported, scans only read the
+// pages left, and the pages given back are reused by inserts and
+// survive a crash, whichever of the PF header and the pages was written
+//
+RC Test23(void)
+{
+    RC            rc;
+    RM_FileHandle fh, rowFh;
+    RM_Record     rec;
+    TestRec       *pRecBuf;
+    int           numRecs = 3000, live = 0, moved = 0, i, n;
+    long          before, size;
+
+    printf("test23 starting ****************\n");
+
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, numRecs)))
+        return (rc);
+    int perPage = fh.GetRecordPerPage();
+
+    printf("**** delete all but every seventh record\n");
+    vector<RID> rids;
+    for (i = 0; i < numRecs; i++)
+        if (i % 7)
+            rids.push_back(RID(i / perPage, i % perPage));
+        else
+            live++;
+    if ((rc = fh.DeleteRecs(&rids[0], int(rids.size()))) ||
+        (rc = fh.Commit()))
+        return (rc);
+    int pages = (live + perPage - 1) / perPage;
+    for (i = pages * perPage; i < numRecs; i++)
+        if (i % 7 == 0)
+            moved++;
+
+    // the records of the pages past the first few, and only those, move
+    printf("**** compact %d records onto %d pages\n", live, pages);
+    vector<pair<RID, RID> > moves;
+    if ((rc = fh.Compact(KeepMove, &moves)))
+        return (rc);
+    if (int(moves.size()) != moved) {
+        printf("%d records moved, not %d\n", int(moves.size()), moved);
+        exit(1);
+    }
+    for (i = 0; i < int(moves.size()); i++) {
+        PageNum oldPage, newPage;
+        SlotNum oldSlot;
+        moves[i].first.GetPageNum(oldPage);
+        moves[i].first.GetSlotNum(oldSlot);
+        moves[i].second.GetPageNum(newPage);
+        if ((rc = fh.GetRec(moves[i].second, rec)) ||
+            (rc = rec.GetData((char *&)pRecBuf)))
+            return (rc);
+        if (pRecBuf->num != oldPage * perPage + oldSlot ||
+            newPage >= pages ||
+            fh.GetRec(moves[i].first, rec) != RM_REC_NO_EXIST) {
+            printf("record %d moved to the wrong place\n", pRecBuf->num);
+            exit(1);
+        }
+    }
+    if (fh.GetRec(RID(pages, 0), rec) != RM_REC_NO_EXIST ||
+        FileSize(LOGNAME) != long(sizeof(RM_LogFileHdr))) {
+        printf("pages not dropped from a clean point\n");
+        exit(1);
+    }
+    if ((rc = CheckCompacted(fh, live, 0)))
+        return (rc);
+
+    // the header page and the pages left
+    RM_FileScan fs;
+    TestRec     batch[128];           // more than a page holds
+    RID         batchRids[128];
+    before = PageRequests(FILENAME);
+    if ((rc = fs.OpenScan(fh, INT, sizeof(int), offsetof(TestRec, num),
+                          NO_OP, NULL)))
+        return (rc);
+    while (!(rc = fs.GetNextBatch((char *)batch, batchRids, 128, n)))
+        ;
+    if (rc != RM_EOF || (rc = fs.CloseScan()))
+        return (rc);
+    if (PageRequests(FILENAME) - before > pages + 1) {
+        printf("%ld pages asked for to scan %d pages\n",
+               PageRequests(FILENAME) - before, pages);
+        exit(1);
+    }
+
+    printf("**** nothing left to move\n");
+    moves.clear();
+    if ((rc = fh.Compact(KeepMove, &moves)))
+        return (rc);
+    if (!moves.empty()) {
+        printf("compacted file compacted again\n");
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = CheckCompacted(fh, live, 0)))
+        return (rc);
+    if (fh.GetRec(RID(pages, 0), rec) != RM_REC_NO_EXIST) {
+        printf("dropped pages back after reopening\n");
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)))
+        return (rc);
+
+    // the pages given back hold the new records, before and after a
+    // crash; the file does not grow
+    printf("**** the pages given back are reused\n");
+    size = FileSize(FILENAME);
+    if ((rc = Crash(1000, 3000, false)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = CheckCompacted(fh, live, 1000)) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = Crash(1000, 4000, true)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = CheckCompacted(fh, live, 2000)))
+        return (rc);
+    if (FileSize(FILENAME) != size) {
+        printf("file grew from %ld to %ld bytes\n", size,
+               FileSize(FILENAME));
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    // the free list may then start with a page in use; the pages after
+    // it are still reused
+    printf("**** crashes after reusing pages\n");
+    rids.clear();
+    for (i = perPage; i < numRecs; i++)
+        rids.push_back(RID(i / perPage, i % perPage));
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, numRecs)) ||
+        (rc = fh.DeleteRecs(&rids[0], int(rids.size()))) ||
+        (rc = fh.Commit()) ||
+        (rc = fh.Compact()) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = CreateFile(ROWNAME, sizeof(TestRec))) ||
+        (rc = OpenFile(ROWNAME, rowFh)) ||
+        (rc = AddRecs(rowFh, 50 * perPage)) ||
+        (rc = CloseFile(ROWNAME, rowFh)))
+        return (rc);
+    size = FileSize(FILENAME);
+    if ((rc = CrashReusing(3 * perPage, 3000, true)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = CheckCompacted(fh, perPage, 3 * perPage)) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = CrashReusing(3 * perPage, 3000 + 3 * perPage, false)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = CheckCompacted(fh, perPage, 6 * perPage)) ||
+        (rc = AddRecs(fh, 3 * perPage, 3000 + 6 * perPage)) ||
+        (rc = CheckCompacted(fh, perPage, 9 * perPage)) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+    if (FileSize(FILENAME) != size) {
+        printf("file grew from %ld to %ld bytes\n", size,
+               FileSize(FILENAME));
+        exit(1);
+    }
+
+    // the moves are committed before the first is reported
+    printf("**** crash while the moves are reported\n");
+    rids.clear();
+    for (i = 0; i < perPage; i++)
+        rids.push_back(RID(1, i));
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = fh.DeleteRecs(&rids[0], perPage)) ||
+        (rc = fh.Commit()) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+    int   status;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0)
+        return (RM_LOG_IO_ERROR);
+    if (pid == 0) {
+        if (!OpenFile(FILENAME, fh))
+            fh.Compact(CrashMove);
+        _exit(1);
+    }
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+        printf("crashing child failed\n");
+        exit(1);
+    }
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = CheckCompacted(fh, perPage, 8 * perPage)))
+        return (rc);
+    if (fh.GetRec(RID(9, 0), rec) != RM_REC_NO_EXIST) {
+        printf("moves taken back after they were reported\n");
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)) ||
+        (rc = DestroyFile(ROWNAME)))
+        return (rc);
+
+    printf("**** variable-length records\n");
+    if ((rc = rmm.CreateFile(FILENAME, VAR_MAX, true)) ||
+        (rc = OpenFile(FILENAME, fh)))
+        return (rc);
+    if (fh.Compact() != RM_COMPACT_VAR_LENGTH) {
+        printf("variable-length file compacted\n");
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("\ntest23 done ********************\n");
+    return (0);
+}
+
+//
+// ScanSum
+//
+// Desc: the number of records a scan with pred returns, and the sum of
+//       their nums, got in batches of the num attribute alone
+//
+RC ScanSum(RM_FileHandle &fh, const RM_Predicate &pred, int &n, long &sum)
+{
+    RC          rc;
+    RM_FileScan fs;
+    RM_ProjAttr proj = { offsetof(TestRec, num), sizeof(int) };
+    int         nums[64], got;
+
+    n = 0;
+    sum = 0;
+    if ((rc = fs.OpenScan(fh, pred)) ||
+        (rc = fs.SetProjection(&proj, 1)))
+        return (rc);
+    while (!(rc = fs.GetNextBatch((char *)nums, NULL, 64, got)))
+        for (int i = 0; i < got; i++) {
+            n++;
+            sum += nums[i];
+        }
+    if (rc != RM_EOF)
+        return (rc);
+    return (fs.CloseScan());
+}
+
+//
+// ThinOut
+//
+// Desc: delete the records whose num is a multiple of 3, and negate r in
+//       those left whose num is a multiple of 5
+//
+RC ThinOut(RM_FileHandle &fh)
+{
+    RC          rc;
+    RM_FileScan fs;
+    RM_Record   rec;
+    TestRec     *pRecBuf;
+    RID         rid;
+    vector<RID> deletes, updates;
+
+    if ((rc = fs.OpenScan(fh, INT, sizeof(int), offsetof(TestRec, num),
+                          NO_OP, NULL)))
+        return (rc);
+    while (!(rc = fs.GetNextRec(rec))) {
+        rec.GetData((char *&)pRecBuf);
+        rec.GetRid(rid);
+        if (pRecBuf->num % 3 == 0)
+            deletes.push_back(rid);
+        else if (pRecBuf->num % 5 == 0)
+            updates.push_back(rid);
+    }
+    if (rc != RM_EOF || (rc = fs.CloseScan()) ||
+        (rc = fh.DeleteRecs(&deletes[0], int(deletes.size()))))
+        return (rc);
+    for (size_t i = 0; i < updates.size(); i++) {
+        if ((rc = fh.GetRec(updates[i], rec)) ||
+            (rc = rec.GetData((char *&)pRecBuf)))
+            return (rc);
+        pRecBuf->r = -pRecBuf->r;
+        if ((rc = fh.UpdateRec(rec)))
+            return (rc);
+    }
+    return (fh.Commit());
+}
+
+//
+// Test24 tests PAX pages: records split into columns are read, changed,
+// scanned and recovered as whole records, each column is kept together
+// on its page, and scans return what they do on whole records
+//
+RC Test24(void)
+{
+    RC             rc;
+    RM_FileHandle  fh, rowFh;
+    PF_FileHandle  pfh;
+    PF_PageHandle  page;
+    RM_FileRecPage *data;
+    // the string with the padding after it, num and r
+    int            columns[] = { offsetof(TestRec, num), sizeof(int),
+                                 sizeof(float) };
+    int            wrong[] = { 8, 8 };
+    int            numRecs = 2000, perPage, i, n, m;
+    long           sum, rowSum;
+
+    printf("test24 starting ****************\n");
+
+    if (rmm.CreateFile(FILENAME, sizeof(TestRec), columns, 0) !=
+        RM_CREATE_FILE_BAD_COLUMNS ||
+        rmm.CreateFile(FILENAME, sizeof(TestRec), wrong, 2) !=
+        RM_CREATE_FILE_BAD_COLUMNS) {
+        printf("bad columns taken\n");
+        exit(1);
+    }
+
+    // the undo of the crashes puts records back, the redo of the second
+    // writes pages the buffer pool lost
+    printf("**** records in columns, and crashes\n");
+    if ((rc = rmm.CreateFile(FILENAME, sizeof(TestRec), columns, 3)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, numRecs)) ||
+        (rc = VerifyFile(fh, numRecs)) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = Crash(FEW_RECS, numRecs, false)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = VerifyFile(fh, numRecs + FEW_RECS)) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = Crash(FEW_RECS, numRecs + FEW_RECS, true)))
+        return (rc);
+    numRecs += 2 * FEW_RECS;
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = VerifyFile(fh, numRecs)))
+        return (rc);
+    perPage = fh.GetRecordPerPage();
+    if ((rc = CloseFile(FILENAME, fh)))
+        return (rc);
+
+    // the nums of the first page follow each other in its minipage
+    printf("**** the columns of a page are kept apart\n");
+    if ((rc = pfm.OpenFile(FILENAME, pfh)) ||
+        (rc = pfh.GetThisPage(1, page)) ||
+        (rc = page.GetData((char *&)data)))
+        return (rc);
+    for (i = 0; i < perPage; i++) {
+        int num;
+        memcpy(&num, data->data + perPage * offsetof(TestRec, num) +
+               i * sizeof(int), sizeof(int));
+        if (num != i) {
+            printf("slot %d of the num column holds %d\n", i, num);
+            exit(1);
+        }
+    }
+    if ((rc = pfh.UnpinPage(1)) ||
+        (rc = pfm.CloseFile(pfh)))
+        return (rc);
+
+    printf("**** scans return what they do on whole records\n");
+    if ((rc = CreateFile(ROWNAME, sizeof(TestRec))) ||
+        (rc = OpenFile(ROWNAME, rowFh)) ||
+        (rc = AddRecs(rowFh, numRecs)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = ThinOut(fh)) ||
+        (rc = ThinOut(rowFh)))
+        return (rc);
+    int   value = 700, zero = 0;
+    float low = 100;
+    char  str[6] = "a1234";
+    // the last condition spans two columns
+    RM_Predicate preds[] = {
+        RM_Predicate(INT, sizeof(int), offsetof(TestRec, num), LT_OP,
+                     &value),
+        RM_Predicate::And(
+            RM_Predicate(FLOAT, sizeof(float), offsetof(TestRec, r), GE_OP,
+                         &low),
+            RM_Predicate(INT, sizeof(int), offsetof(TestRec, num), GT_OP,
+                         &value)),
+        RM_Predicate(STRING, sizeof(str), offsetof(TestRec, str), EQ_OP,
+                     str),
+        RM_Predicate(INT, sizeof(int), offsetof(TestRec, num) - 2, NE_OP,
+                     &zero)
+    };
+    for (i = 0; i < 4; i++) {
+        if ((rc = ScanSum(fh, preds[i], n, sum)) ||
+            (rc = ScanSum(rowFh, preds[i], m, rowSum)))
+            return (rc);
+        if (n != m || sum != rowSum || !n) {
+            printf("condition %d: %d records (sum %ld), %d (sum %ld) in "
+                   "rows\n", i, n, sum, m, rowSum);
+            exit(1);
+        }
+    }
+    if ((rc = ParallelCount(fh, 2, value, n)) ||
+        (rc = ParallelCount(rowFh, 2, value, m)))
+        return (rc);
+    if (n != m) {
+        printf("parallel scan: %d records, %d in rows\n", n, m);
+        exit(1);
+    }
+    if ((rc = fh.AddZoneMap(INT, sizeof(int), offsetof(TestRec, num))) ||
+        (rc = ScanSum(fh, preds[1], n, sum)) ||
+        (rc = ScanSum(rowFh, preds[1], m, rowSum)))
+        return (rc);
+    if (n != m || sum != rowSum) {
+        printf("zone maps: %d records, %d in rows\n", n, m);
+        exit(1);
+    }
+
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = CloseFile(ROWNAME, rowFh)) ||
+        (rc = DestroyFile(FILENAME)) ||
+        (rc = DestroyFile(ROWNAME)))
+        return (rc);
+
+    printf("\ntest24 done ********************\n");
+    return (0);
+}
+
+//
+// UsedPages
+//
+// Desc: the number of pages PF has in use in a file that is not open
+//
+int UsedPages(char *fileName)
+{
+    PF_FileHandle pfh;
+    PF_PageHandle page;
+    PageNum       pageNum = -1;
+    int           n = 0;
+    RC            rc;
+
+    if (pfm.OpenFile(fileName, pfh))
+        return (-1);
+    for (rc = pfh.GetFirstPage(page); !rc;
+         rc = pfh.GetNextPage(pageNum, page)) {
+        page.GetPageNum(pageNum);
+        pfh.UnpinPage(pageNum);
+        n++;
+    }
+    pfm.CloseFile(pfh);
+    return (rc == PF_EOF ? n : -1);
+}
+
+//
+// Test25 tests cold pages: a compressed file takes a fraction of its
+// pages and reads as before, changes thaw the pages they are on, also
+// through a crash, and a file compressed again stays as small
+//
+RC Test25(void)
+{
+    RC            rc;
+    RM_FileHandle fh, rowFh;
+    RM_Record     rec;
+    TestRec       *pRecBuf;
+    int           columns[] = { offsetof(TestRec, num), sizeof(int),
+                                sizeof(float) };
+    int           numRecs = 5000, before, after, perPage, i, n, m;
+    long          sum, rowSum;
+
+    printf("test25 starting ****************\n");
+
+    printf("**** compress\n");
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, numRecs)) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+    before = UsedPages(FILENAME);
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = fh.Compress()) ||
+        (rc = VerifyFile(fh, numRecs)))
+        return (rc);
+    perPage = fh.GetRecordPerPage();
+    if ((rc = CloseFile(FILENAME, fh)))
+        return (rc);
+    after = UsedPages(FILENAME);
+    printf("%d pages compressed to %d\n", before, after);
+    if (after <= 0 || 2 * after > before) {
+        printf("not compressed\n");
+        exit(1);
+    }
+
+    printf("**** scans return what they do on record pages\n");
+    if ((rc = CreateFile(ROWNAME, sizeof(TestRec))) ||
+        (rc = OpenFile(ROWNAME, rowFh)) ||
+        (rc = AddRecs(rowFh, numRecs)) ||
+        (rc = OpenFile(FILENAME, fh)))
+        return (rc);
+    int   value = 700;
+    float low = 100;
+    char  str[6] = "a1234";
+    RM_Predicate preds[] = {
+        RM_Predicate(INT, sizeof(int), offsetof(TestRec, num), LT_OP,
+                     &value),
+        RM_Predicate::And(
+            RM_Predicate(FLOAT, sizeof(float), offsetof(TestRec, r), GE_OP,
+                         &low),
+            RM_Predicate(INT, sizeof(int), offsetof(TestRec, num), GT_OP,
+                         &value)),
+        RM_Predicate(STRING, sizeof(str), offsetof(TestRec, str), EQ_OP,
+                     str)
+    };
+    for (int round = 0; round < 2; round++) {
+        for (i = 0; i < 3; i++) {
+            if ((rc = ScanSum(fh, preds[i], n, sum)) ||
+                (rc = ScanSum(rowFh, preds[i], m, rowSum)))
+                return (rc);
+            if (n != m || sum != rowSum || !n) {
+                printf("condition %d: %d records (sum %ld), %d (sum %ld) "
+                       "on record pages\n", i, n, sum, m, rowSum);
+                exit(1);
+            }
+        }
+        if ((rc = ParallelCount(fh, 2, value, n)) ||
+            (rc = ParallelCount(rowFh, 2, value, m)))
+            return (rc);
+        if (n != m) {
+            printf("parallel scan: %d records, %d on record pages\n", n, m);
+            exit(1);
+        }
+        if (round)
+            break;
+
+        if ((rc = fh.GetRec(RID(7, 3), rec)) ||
+            (rc = rec.GetData((char *&)pRecBuf)))
+            return (rc);
+        if (pRecBuf->num != 7 * perPage + 3) {
+            printf("RID(7, 3) holds record %d\n", pRecBuf->num);
+            exit(1);
+        }
+
+        // the inserts go to new pages, cold pages have no room
+        printf("**** changes thaw the pages they are on\n");
+        if ((rc = ThinOut(fh)) ||
+            (rc = ThinOut(rowFh)) ||
+            (rc = AddRecs(fh, FEW_RECS, numRecs)) ||
+            (rc = AddRecs(rowFh, FEW_RECS, numRecs)) ||
+            (rc = fh.Commit()))
+            return (rc);
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = CloseFile(ROWNAME, rowFh)) ||
+        (rc = DestroyFile(ROWNAME)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    // the first crash thaws a page and is undone, the second thaws a
+    // page compressed again and is redone from the forced log
+    printf("**** crashes after thawing\n");
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, numRecs)) ||
+        (rc = fh.Compress()) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = Crash(FEW_RECS, numRecs, false)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = VerifyFile(fh, numRecs + FEW_RECS)) ||
+        (rc = fh.Compress()) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = Crash(FEW_RECS, numRecs + FEW_RECS, true)))
+        return (rc);
+    numRecs += 2 * FEW_RECS;
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = VerifyFile(fh, numRecs)) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+
+    // the thawed page is only in the log, so recovery redoes the
+    // RM_LOG_THAW record to bring it back
+    printf("**** crash after a committed thaw\n");
+    fflush(stdout);
+    int   status;
+    pid_t pid = fork();
+    if (pid < 0)
+        return (RM_LOG_IO_ERROR);
+    if (pid == 0) {
+        if ((rc = OpenFile(FILENAME, fh)) ||
+            (rc = fh.Compress()) ||
+            (rc = fh.GetRec(RID(3, 0), rec)) ||
+            (rc = fh.UpdateRec(rec)) ||
+            (rc = fh.Commit()))
+            _exit(1);
+        fflush(stdout);
+        _exit(0);
+    }
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+        printf("crashing child failed\n");
+        exit(1);
+    }
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = VerifyFile(fh, numRecs)) ||
+        (rc = fh.GetRec(RID(3, 0), rec)) ||
+        (rc = rec.GetData((char *&)pRecBuf)))
+        return (rc);
+    if (pRecBuf->num != 3 * perPage) {
+        printf("RID(3, 0) holds record %d after redo\n", pRecBuf->num);
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)))
+        return (rc);
+
+    printf("**** compress again\n");
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = fh.Compress()) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+    before = UsedPages(FILENAME);
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = fh.Compress()) ||
+        (rc = fh.Compact()) ||
+        (rc = VerifyFile(fh, numRecs)) ||
+        (rc = CloseFile(FILENAME, fh)))
+        return (rc);
+    if (UsedPages(FILENAME) != before) {
+        printf("%d pages compressed again to %d\n", before,
+               UsedPages(FILENAME));
+        exit(1);
+    }
+    if ((rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("**** records in columns\n");
+    if ((rc = rmm.CreateFile(FILENAME, sizeof(TestRec), columns, 3)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, numRecs)) ||
+        (rc = fh.Compress()) ||
+        (rc = VerifyFile(fh, numRecs)) ||
+        (rc = fh.AddZoneMap(INT, sizeof(int), offsetof(TestRec, num))) ||
+        (rc = ScanSum(fh, preds[0], n, sum)))
+        return (rc);
+    if (n != value || sum != long(value) * (value - 1) / 2) {
+        printf("%d records (sum %ld) below %d\n", n, sum, value);
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("**** variable-length records\n");
+    if ((rc = rmm.CreateFile(FILENAME, VAR_MAX, true)) ||
+        (rc = OpenFile(FILENAME, fh)))
+        return (rc);
+    if (fh.Compress() != RM_COMPRESS_VAR_LENGTH) {
+        printf("variable-length file compressed\n");
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("\ntest25 done ********************\n");
+    return (0);
+}
+
+//
+// Test26 tests schemas: a schema is checked and kept in the file, and
+// zone maps, scans and loads name its attributes, in rows, in columns
+// and on cold pages
+//
+RC Test26(void)
+{
+    RC                  rc;
+    RM_FileHandle       fh;
+    RM_FileScan         fs;
+    RM_Loader           loader;
+    RM_Record           rec;
+    RM_AttrInfo         attr;
+    vector<RM_AttrInfo> got;
+    RM_AttrInfo         attrs[] = {
+        { "num", INT, sizeof(int), offsetof(TestRec, num), false },
+        { "r", FLOAT, sizeof(float), offsetof(TestRec, r), true },
+        { "str", STRING, STRLEN, offsetof(TestRec, str), false }
+    };
+    int                 numRecs = 2000, value = 700, i, n;
+    char                line[100];
+    string              text;
+
+    printf("test26 starting ****************\n");
+
+    printf("**** bad schemas\n");
+    RM_AttrInfo bad[3];
+    for (i = 0; i < 4; i++) {
+        memcpy(bad, attrs, sizeof(attrs));
+        if (i == 0)
+            strcpy(bad[1].attrName, "num");
+        else if (i == 1)
+            bad[1].attrOffset = offsetof(TestRec, num) + 2;
+        else if (i == 2)
+            bad[0].attrLength = 2;
+        else
+            bad[2].attrName[0] = '\0';
+        if (rmm.CreateFile(FILENAME, bad, 3) != RM_CREATE_FILE_BAD_SCHEMA) {
+            printf("bad schema %d taken\n", i);
+            exit(1);
+        }
+    }
+
+    printf("**** the schema is kept\n");
+    if ((rc = rmm.CreateFile(FILENAME, attrs, 3)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = AddRecs(fh, numRecs)) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = Crash(FEW_RECS, numRecs, false)))
+        return (rc);
+    numRecs += FEW_RECS;
+    if ((rc = OpenFile(FILENAME, fh)) ||
+        (rc = VerifyFile(fh, numRecs)) ||
+        (rc = fh.GetSchema(got)))
+        return (rc);
+    if (got.size() != 3 || memcmp(&got[0], attrs, sizeof(attrs))) {
+        printf("schema of %d attributes read back wrong\n",
+               int(got.size()));
+        exit(1);
+    }
+    if ((rc = fh.GetAttr("r", attr)))
+        return (rc);
+    if (attr.attrOffset != offsetof(TestRec, r) || !attr.nullable ||
+        fh.GetAttr("rr", attr) != RM_NO_SUCH_ATTR) {
+        printf("attributes looked up wrong\n");
+        exit(1);
+    }
+
+    // the same records as a scan that gives the attribute in full
+    printf("**** scans and zone maps name an attribute\n");
+    for (i = 0; i < 2; i++) {
+        if ((rc = fs.OpenScan(fh, "num", LT_OP, &value)))
+            return (rc);
+        for (n = 0; !(rc = fs.GetNextRec(rec)); n++)
+            ;
+        if (rc != RM_EOF || (rc = fs.CloseScan()))
+            return (rc);
+        if (n != value) {
+            printf("%d records with num below %d\n", n, value);
+            exit(1);
+        }
+        if (i == 0 && (rc = fh.AddZoneMap("num")))
+            return (rc);
+    }
+    if (fs.OpenScan(fh, "nun", LT_OP, &value) != RM_NO_SUCH_ATTR ||
+        fh.AddZoneMap("nun") != RM_NO_SUCH_ATTR) {
+        printf("scan on an attribute not in the schema\n");
+        exit(1);
+    }
+
+    printf("**** compress\n");
+    if ((rc = fh.Compress()) ||
+        (rc = VerifyFile(fh, numRecs)) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    // the fields of the CSV rows in the order of the schema
+    printf("**** loaded into columns\n");
+    for (i = 0; i < numRecs; i++) {
+        sprintf(line, "%d,%d,a%d\n", i, i, i);
+        text += line;
+    }
+    WriteLoadFile(LOADNAME, text);
+    if ((rc = rmm.CreateFile(FILENAME, attrs, 3, true)) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = loader.SetCsv(fh)) ||
+        (rc = loader.Load(fh, LOADNAME, n)) ||
+        (rc = VerifyFile(fh, numRecs)) ||
+        (rc = fh.Compress()) ||
+        (rc = VerifyFile(fh, numRecs)) ||
+        (rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+    unlink(LOADNAME);
+
+    printf("**** no schema\n");
+    if ((rc = CreateFile(FILENAME, sizeof(TestRec))) ||
+        (rc = OpenFile(FILENAME, fh)) ||
+        (rc = fh.GetSchema(got)))
+        return (rc);
+    if (!got.empty() || fh.GetAttr("num", attr) != RM_NO_SUCH_ATTR ||
+        loader.SetCsv(fh) != RM_LOAD_BAD_ATTR) {
+        printf("file without a schema has attributes\n");
+        exit(1);
+    }
+    if ((rc = CloseFile(FILENAME, fh)) ||
+        (rc = DestroyFile(FILENAME)))
+        return (rc);
+
+    printf("\ntest26 done ********************\n");
+    return (0);
+}
@@ -0,0 +1,109 @@
+//
+// rm_varpage.cc
+//
+//   Slotted pages of variable-length RM files, see rm_internal.h
+//
+// The functions here only change the page they are given.  The same
+// calls apply a change, redo it and undo it, so a page ends up with the
+// same records in the same slots, if not at the same offsets.
+//
+
+#include <cstring>
+#include "rm.h"
+#include "rm_internal.h"
+
+// first free slot, a new one past the directory if there is none
+int varFindSlot(RM_VarRecPage *page)
+{
+  for(int i = 0; i < page->numSlots; ++i)
+    if(varSlot(page, i)->offset == RM_VAR_FREE)
+      return i;
+  return page->numSlots;
+}
+
+// can slot slotNum hold a record of length bytes, in place of the one it
+// holds
+bool varFits(RM_VarRecPage *page, int slotNum, int length)
+{
+  int need = varSpace(length);
+  if(slotNum >= page->numSlots)
+    need += (slotNum + 1 - page->numSlots) * sizeof(RM_VarSlot);
+  else if(varSlot(page, slotNum)->offset != RM_VAR_FREE)
+    need -= varSpace(varRecLength(varSlot(page, slotNum)));
+  return need <= varFreeBytes(page);
+}
+
+// move the records to the front of the page, closing the holes
+static void varCompact(RM_VarRecPage *page)
+{
+  char buf[DATA_ON_RECORD_PAGE];
+  int end = 0;
+  for(int i = 0; i < page->numSlots; ++i) {
+    RM_VarSlot *slot = varSlot(page, i);
+    if(slot->offset == RM_VAR_FREE)
+      continue;
+    int space = varSpace(varRecLength(slot));
+    memcpy(buf + end, page->data + slot->offset, space);
+    slot->offset = end;
+    end += space;
+  }
+  memcpy(page->data, buf, end);
+  page->freeStart = end;
+}
+
+// store a record in slot slotNum, replacing the one there; false if it
+// does not fit
+bool varPut(RM_VarRecPage *page, int slotNum, const char *record,
+            int length, int flags)
+{
+  if(!varFits(page, slotNum, length))
+    return false;
+
+  int space = varSpace(length);
+  RM_VarSlot *slot = varSlot(page, slotNum);
+  if(slotNum < page->numSlots && slot->offset != RM_VAR_FREE) {
+    int oldSpace = varSpace(varRecLength(slot));
+    if(space <= oldSpace) {
+      // shrinks in place, the rest becomes a hole
+      memmove(page->data + slot->offset, record, length);
+      slot->length = length | flags;
+      page->usedBytes -= oldSpace - space;
+      return true;
+    }
+    page->usedBytes -= oldSpace;
+    slot->offset = RM_VAR_FREE;
+  }
+
+  int newSlots = slotNum < page->numSlots ? 0 : slotNum + 1 - page->numSlots;
+  int gap = DATA_ON_RECORD_PAGE - page->freeStart
+            - (page->numSlots + newSlots) * sizeof(RM_VarSlot);
+  if(gap < space)
+    varCompact(page);
+  for(; newSlots > 0; --newSlots)
+    varSlot(page, page->numSlots++)->offset = RM_VAR_FREE;
+
+  memmove(page->data + page->freeStart, record, length);
+  slot->offset = page->freeStart;
+  slot->length = length | flags;
+  page->freeStart += space;
+  page->usedBytes += space;
+  return true;
+}
+
+// free slot slotNum, and the directory entries past the last used slot
+void varErase(RM_VarRecPage *page, int slotNum)
+{
+  if(!varSlotUsed(page, slotNum))
+    return;
+  RM_VarSlot *slot = varSlot(page, slotNum);
+  int space = varSpace(varRecLength(slot));
+  if(slot->offset + space == page->freeStart)
+    page->freeStart = slot->offset;
+  page->usedBytes -= space;
+  slot->offset = RM_VAR_FREE;
+  while(page->numSlots > 0
+        && varSlot(page, page->numSlots - 1)->offset == RM_VAR_FREE)
+    --page->numSlots;
+  if(page->numSlots == 0)
+    page->freeStart = 0;
+}
@@ -0,0 +1,302 @@
+//
+// rm_zonemap.cc
+//
+//   Zone maps of RM files, see RM_FileHandle::AddZoneMap in rm.h
+//
+// A zone map keeps, for each virtual page, the smallest and largest
+// value of an attribute among the records of the page.  Inserts widen
+// the zone of their page; deletes and updates work it out again from the
+// page, which they have pinned anyway.  A scan skips a page when the
+// zones show that no record of it can pass the condition, see
+// RM_Predicate::may_match.  A NaN float passes no comparison but <>, so
+// it is left out of the zones.
+//
+// The zone maps are written to a file next to the RM file (the file name
+// with ".zone" appended) when it is closed, stamped with the first LSN of
+// the log, which has just been truncated.  Opening the file loads them
+// if the log still starts there and holds nothing; otherwise the file
+// may have changed since, and they are built again from the pages once
+// recovery is done.  A zone file that cannot be read only loses the zone
+// maps, never the records.
+//
+
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "rm.h"
+#include "rm_internal.h"
+#include "rm_logmanager.h"
+
+#define RM_ZONE_MAGIC 0x524d5a4d  // "RMZM"
+
+// The zone file is an RM_ZoneFileHdr and an RM_ZoneFileAttr for each
+// zone map, followed by the any, low and high arrays of each, pages long
+struct RM_ZoneFileHdr {
+  int magic;
+  int numZones;
+  unsigned int checksum;  // of what follows the header
+  int pad;
+  LSN stamp;              // first LSN of the log when written
+};
+
+struct RM_ZoneFileAttr {
+  int attrType;
+  int attrLength;
+  int attrOffset;
+  int pages;              // pages the arrays cover
+};
+
+// <0, 0 or >0 as attribute a is below, equal to or above b
+int zoneCompare(AttrType type, const char *a, const char *b, int length)
+{
+  switch(type) {
+    case INT: {
+      int x, y;
+      memcpy(&x, a, sizeof(int));
+      memcpy(&y, b, sizeof(int));
+      return x < y ? -1 : x > y;
+    }
+    case FLOAT: {
+      float x, y;
+      memcpy(&x, a, sizeof(float));
+      memcpy(&y, b, sizeof(float));
+      return x < y ? -1 : x > y;
+    }
+    default:
+      return memcmp(a, b, length);
+  }
+}
+
+// false for a NaN float
+bool zoneValue(AttrType type, const char *value)
+{
+  if(type != FLOAT)
+    return true;
+  float f;
+  memcpy(&f, value, sizeof(float));
+  return f == f;
+}
+
+// widen the zone of vPage to take value
+static void zoneWiden(RM_ZoneMap &zone, int vPage, const char *value)
+{
+  int length = zone.attrLength;
+  if(int(zone.any.size()) <= vPage) {
+    zone.any.resize(vPage + 1, 0);
+    zone.low.resize(long(vPage + 1) * length);
+    zone.high.resize(long(vPage + 1) * length);
+  }
+  if(!zoneValue(zone.attrType, value))
+    return;
+  char *low = &zone.low[long(vPage) * length];
+  char *high = &zone.high[long(vPage) * length];
+  if(!zone.any[vPage]) {
+    memcpy(low, value, length);
+    memcpy(high, value, length);
+    zone.any[vPage] = 1;
+  } else if(zoneCompare(zone.attrType, value, low, length) < 0)
+    memcpy(low, value, length);
+  else if(zoneCompare(zone.attrType, value, high, length) > 0)
+    memcpy(high, value, length);
+}
+
+RC RM_FileHandle::AddZoneMap(const char *attrName)
+{
+  RM_AttrInfo attr;
+  RC r = GetAttr(attrName, attr);
+  return r ? r : AddZoneMap(attr.attrType, attr.attrLength, attr.attrOffset);
+}
+
+RC RM_FileHandle::AddZoneMap(AttrType attrType, int attrLength,
+                             int attrOffset)
+{
+  if(!fileOpen_)
+    return RM_NOT_OPEN_FILE;
+  if(varLength || attrOffset < 0 || attrLength <= 0
+     || attrOffset + attrLength > recordSize
+     || (attrType == STRING ? attrLength > MAXSTRINGLEN
+         : (attrType != INT && attrType != FLOAT) || attrLength != 4))
+    return RM_BAD_ZONE_MAP;
+  for(size_t i = 0; i < zoneMaps.size(); ++i)
+    if(zoneMaps[i].attrType == attrType
+       && zoneMaps[i].attrLength == attrLength
+       && zoneMaps[i].attrOffset == attrOffset)
+      return OK_RC;
+
+  RM_ZoneMap zone;
+  zone.attrType = attrType;
+  zone.attrLength = attrLength;
+  zone.attrOffset = attrOffset;
+  RC r = zone_build(zone);
+  if(r)
+    return r;
+  zoneMaps.push_back(zone);
+  return OK_RC;
+}
+
+RC RM_FileHandle::DropZoneMap(int attrOffset)
+{
+  if(!fileOpen_)
+    return RM_NOT_OPEN_FILE;
+  size_t before = zoneMaps.size();
+  for(size_t i = before; i-- > 0; )
+    if(zoneMaps[i].attrOffset == attrOffset)
+      zoneMaps.erase(zoneMaps.begin() + i);
+  return zoneMaps.size() < before ? OK_RC : RM_BAD_ZONE_MAP;
+}
+
+// set the zone of vPage from the records on its page
+void RM_FileHandle::zone_fill(RM_ZoneMap &zone, int vPage,
+                              const RM_FileRecPage *data) const
+{
+  char buf[DATA_ON_RECORD_PAGE];
+  zoneWiden(zone, vPage, data->data + zone.attrOffset);
+  zone.any[vPage] = 0;
+  for(int slotNum = nextTakenSlot(data->bitmap, -1); slotNum < recordPerPage;
+      slotNum = nextTakenSlot(data->bitmap, slotNum))
+    zoneWiden(zone, vPage, rec_at(data, slotNum, buf) + zone.attrOffset);
+}
+
+RC RM_FileHandle::zone_build(RM_ZoneMap &zone) const
+{
+  zone.any.clear();
+  zone.low.clear();
+  zone.high.clear();
+  for(int vPage = 0; vPage < totalPage; ++vPage) {
+    PageNum pageNum;
+    PF_PageHandle pageHdl;
+    RM_FileRecPage *data;
+    RC r;
+    if((r = page_of(vPage, pageNum))
+       || (r = pfh_.GetThisPage(pageNum, pageHdl)))
+      return r;
+    pageHdl.GetData((char *&)data);
+    zone_fill(zone, vPage, rec_page(vPage, (char *)data));
+    pfh_.UnpinPage(pageNum);
+  }
+  return OK_RC;
+}
+
+// after a delete or update on the page of vPage
+void RM_FileHandle::zone_page(int vPage, const RM_FileRecPage *data)
+{
+  for(size_t i = 0; i < zoneMaps.size(); ++i)
+    zone_fill(zoneMaps[i], vPage, data);
+}
+
+// after an insert on the page of vPage
+void RM_FileHandle::zone_widen(int vPage, const char *recData)
+{
+  for(size_t i = 0; i < zoneMaps.size(); ++i)
+    zoneWiden(zoneMaps[i], vPage, recData + zoneMaps[i].attrOffset);
+}
+
+// Load the zone maps of the file just opened, or build them again if the
+// file may have changed since they were written
+RC RM_FileHandle::zone_open(bool crashed)
+{
+  zoneMaps.clear();
+  int fd = open((fileName_ + RM_ZONE_SUFFIX).c_str(), O_RDONLY);
+  if(fd < 0)
+    return OK_RC;
+  RM_ZoneFileHdr hdr;
+  vector<char> body;
+  off_t size = lseek(fd, 0, SEEK_END);
+  bool ok = size >= off_t(sizeof(RM_ZoneFileHdr))
+    && pread(fd, &hdr, sizeof(hdr), 0) == ssize_t(sizeof(hdr))
+    && hdr.magic == RM_ZONE_MAGIC && hdr.numZones >= 0;
+  if(ok) {
+    body.resize(size - sizeof(hdr) + 1);
+    ok = pread(fd, &body[0], size - sizeof(hdr), sizeof(hdr))
+         == ssize_t(size - sizeof(hdr))
+      && RM_LogChecksum(&body[0], int(size - sizeof(hdr))) == hdr.checksum;
+  }
+  close(fd);
+
+  const char *p = ok ? &body[0] : NULL;
+  const char *end = p + (ok ? size - sizeof(hdr) : 0);
+  for(int i = 0; ok && i < hdr.numZones; ++i) {
+    RM_ZoneFileAttr attr;
+    ok = end - p >= long(sizeof(attr));
+    if(!ok)
+      break;
+    memcpy(&attr, p, sizeof(attr));
+    p += sizeof(attr);
+    RM_ZoneMap zone;
+    zone.attrType = AttrType(attr.attrType);
+    zone.attrLength = attr.attrLength;
+    zone.attrOffset = attr.attrOffset;
+    zone.any.resize(attr.pages > 0 ? attr.pages : 0);
+    zoneMaps.push_back(zone);
+  }
+  for(size_t i = 0; ok && i < zoneMaps.size(); ++i) {
+    RM_ZoneMap &zone = zoneMaps[i];
+    long pages = zone.any.size(), bytes = pages * zone.attrLength;
+    ok = end - p >= pages + 2 * bytes;
+    if(!ok)
+      break;
+    zone.any.assign(p, p + pages);
+    zone.low.assign(p + pages, p + pages + bytes);
+    zone.high.assign(p + pages + bytes, p + pages + 2 * bytes);
+    p += pages + 2 * bytes;
+  }
+  if(!ok) {
+    zoneMaps.clear();
+    return OK_RC;
+  }
+  if(!crashed && hdr.stamp == log_->GetFirstLSN())
+    return OK_RC;
+  for(size_t i = 0; i < zoneMaps.size(); ++i) {
+    RC r = zone_build(zoneMaps[i]);
+    if(r)
+      return r;
+  }
+  return OK_RC;
+}
+
+// Write the zone maps of the file being closed, after its log was
+// truncated.  The file is written aside and renamed, so a crash leaves
+// either zone file whole.
+void RM_FileHandle::zone_close()
+{
+  string name = fileName_ + RM_ZONE_SUFFIX;
+  if(zoneMaps.empty()) {
+    unlink(name.c_str());
+    return;
+  }
+
+  vector<char> body;
+  for(size_t i = 0; i < zoneMaps.size(); ++i) {
+    RM_ZoneFileAttr attr;
+    attr.attrType = zoneMaps[i].attrType;
+    attr.attrLength = zoneMaps[i].attrLength;
+    attr.attrOffset = zoneMaps[i].attrOffset;
+    attr.pages = int(zoneMaps[i].any.size());
+    body.insert(body.end(), (char *)&attr, (char *)&attr + sizeof(attr));
+  }
+  for(size_t i = 0; i < zoneMaps.size(); ++i) {
+    body.insert(body.end(), zoneMaps[i].any.begin(), zoneMaps[i].any.end());
+    body.insert(body.end(), zoneMaps[i].low.begin(), zoneMaps[i].low.end());
+    body.insert(body.end(), zoneMaps[i].high.begin(),
+                zoneMaps[i].high.end());
+  }
+  RM_ZoneFileHdr hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = RM_ZONE_MAGIC;
+  hdr.numZones = int(zoneMaps.size());
+  hdr.checksum = RM_LogChecksum(&body[0], int(body.size()));
+  hdr.stamp = log_->GetFirstLSN();
+  zoneMaps.clear();
+
+  string tmp = name + ".tmp";
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0)
+    return;
+  bool ok = write(fd, &hdr, sizeof(hdr)) == ssize_t(sizeof(hdr))
+    && write(fd, &body[0], body.size()) == ssize_t(body.size())
+    && fsync(fd) == 0;
+  close(fd);
+  if(!ok || rename(tmp.c_str(), name.c_str()) < 0)
+    unlink(tmp.c_str());
+}